@@ -13,18 +13,68 @@ All Global variable names shall start with "G_"
 ***********************************************************************************************************************/
 /* New variables */
 volatile u32 G_u32SystemTime1ms = 0;     /*!< @brief Global system time incremented every ms, max 2^32 (~49 days) */
+volatile u32 G_u32SystemTime1msHigh = 0; /*!< @brief Upper 32 bits of the 64-bit ms count (G_u32SystemTime1ms rollovers) */
 volatile u32 G_u32SystemTime1s  = 0;     /*!< @brief Global system time incremented every second, max 2^32 (~136 years) */
 volatile u32 G_u32SystemFlags   = 0;     /*!< @brief Global system flags */
+NOINIT volatile u8 G_u8MainActiveTask;  /*!< @brief Main_asTasks index of the task running (kept through a reset for fault records) */
+
+
+#ifdef EIE_TASK_PROFILER
+TaskProfileType G_asMainTaskProfile[U8_MAIN_TASKS];  /*!< @brief Per-task cycle statistics (task table order) */
+LoopProfileType G_sMainLoopProfile;                  /*!< @brief Whole loop cycle statistics */
+#endif /* EIE_TASK_PROFILER */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* External global variables defined in other files (must indicate which file they are defined in) */
 
 
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void MainSchedulerInitialize(void);
+static void MainSchedulerRunTasks(void);
+static void MainSupervisorFeed(void);
+static u32 MainSchedulerNextRun(const MainTaskType* psTask_, u32 u32From_);
+static u32 MainSchedulerSleepTicks(void);
+
+#ifdef EIE_TASK_PROFILER
+static void MainProfilerInitialize(void);
+static void MainProfilerRecordTask(u8 u8Task_, u32 u32Cycles_);
+static void MainProfilerRecordLoop(u32 u32Cycles_);
+#endif /* EIE_TASK_PROFILER */
+
+
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "Main_" and be declared as static.
 ***********************************************************************************************************************/
+/*! @brief Super loop task table: add new tasks here (and update U8_MAIN_TASKS).
+
+Debug drains its whole 11 ms receive ring per run, Lcd only refreshes every
+U32_LCD_REFRESH_MS and Log sends U8_LOG_RECORDS_PER_RUN records per run, so those run
+every 5 or 10 ms on phases that keep them off each other's ticks. */
+static const MainTaskType Main_asTasks[U8_MAIN_TASKS] =
+{
+/*  Name        Initialize          RunActiveState          Idle check     Next deadline       Period Phase Priority Watchdog */
+  {"Debug",    DebugInitialize,    DebugRunActiveState,    DebugIsIdle,   NULL,               5,     3,    4,       100},
+  {"Button",   ButtonInitialize,   ButtonRunActiveState,   ButtonIsIdle,  ButtonNextDeadline, 1,     0,    0,       0},
+  {"Timer",    TimerInitialize,    TimerRunActiveState,    TimerIsIdle,   TimerNextDeadline,  1,     0,    2,       0},
+  {"Led",      LedInitialize,      LedRunActiveState,      LedIsIdle,     LedNextDeadline,    1,     0,    1,       0},
+  {"Twi",      TwiInitialize,      TwiRunActiveState,      TwiIsIdle,     NULL,               1,     0,    2,       0},
+  {"Lcd",      LcdInitialize,      LcdRunActiveState,      LcdIsIdle,     LcdNextDeadline,    5,     1,    4,       0},
+  {"Audio",    AudioInitialize,    AudioRunActiveState,    AudioIsIdle,   NULL,               1,     0,    3,       0},
+  {"UserApp1", UserApp1Initialize, UserApp1RunActiveState, UserApp1IsIdle, NULL,              1,     0,    3,       100},
+  {"Log",      LogInitialize,      LogRunActiveState,      LogIsIdle,     NULL,               10,    7,    5,       0},
+};
+
+static u8 Main_au8RunOrder[U8_MAIN_TASKS];        /*!< @brief Task table indexes sorted by priority */
+static u32 Main_au32NextRunTime[U8_MAIN_TASKS];   /*!< @brief G_u32SystemTime1ms when each task is next due */
+static u32 Main_au32CheckIn[U8_MAIN_TASKS];       /*!< @brief G_u32SystemTime1ms of each task's last MainTaskCheckIn() */
+
+#ifdef EIE_TASK_PROFILER
+static u32 Main_u32LoopStartCycles;      /*!< @brief DWT_CYCCNT when the current loop iteration started */
+#endif /* EIE_TASK_PROFILER */
 
 
 /*!**********************************************************************************************************************
@@ -36,37 +86,53 @@ Variable names shall start with "Main_" and be declared as static.
 
 void main(void)
 {
+  u32 u32SleepTicks;
+
   /* Low level initialization */
   WatchDogSetup(); 
+  FaultInitialize();
+  G_u8MainActiveTask = U8_MAIN_NO_TASK;
   ClockSetup();
   GpioSetup();
   InterruptSetup();
   SysTickSetup();
+#ifdef EIE_DEEP_SLEEP
+  RttSetup();
+#endif /* EIE_DEEP_SLEEP */
+#ifdef EIE_TRACE
+  TraceInitialize();
+#endif /* EIE_TRACE */
   
-  /* Driver initialization */
-  ButtonInitialize();
-  TimerInitialize();  
-  LedInitialize();
-
-  /* Application initialization */
-  UserApp1Initialize();
+  /* Driver and application initialization */
+  MainSchedulerInitialize();
   
+#ifdef EIE_TASK_PROFILER
+  MainProfilerInitialize();
+#endif /* EIE_TASK_PROFILER */
+
   /* Super loop */  
   while(1)
   {
-    WATCHDOG_BONE();
+    MAIN_PROFILE_LOOP_START();
 
-    /* Drivers */
-    ButtonRunActiveState();
-    LedRunActiveState();
-    TimerRunActiveState(); 
-    
-    /* Applications */
-    UserApp1RunActiveState();
+    /* Drivers and applications that are due this tick */
+    MainSchedulerRunTasks();
+
+    /* The hardware watchdog is only fed while every supervised task is checking in */
+    MainSupervisorFeed();
+
+    /* All LED changes made this tick go out together */
+    LedCommit();
         
-    /* System sleep */
+    /* System sleep until the next tick a task needs.  Interrupts stay masked
+    from the deadline check until the sleep is set up so a new event is not missed. */
+    MAIN_PROFILE_LOOP_END();
     HEARTBEAT_OFF();
-    SystemSleep();
+    __disable_irq();
+    u32SleepTicks = MainSchedulerSleepTicks();
+    TRACE_SLEEP_ENTER(u32SleepTicks);
+    SystemSleep(u32SleepTicks);
+    TRACE_SLEEP_EXIT();
     HEARTBEAT_ON();
     
   } /* end while(1) main super loop */
@@ -74,6 +140,425 @@ void main(void)
 } /* end main() */
 
 
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void MainTaskCheckIn(void)
+
+@brief Tells the task supervisor the running task is healthy.
+
+A task with a u16WatchdogMs entry calls this from the states it should keep
+passing through (its idle / waiting state, or once per completed job).  If it has
+not called it for u16WatchdogMs, the system is reset and the fault record names
+the task (see FaultGetLast()).
+
+Requires:
+- Called from the task's RunActiveState function (anywhere else it does nothing)
+
+Promises:
+- The running task's supervision deadline starts again from now
+
+*/
+void MainTaskCheckIn(void)
+{
+  u8 u8Task = G_u8MainActiveTask;
+
+  if(u8Task < U8_MAIN_TASKS)
+  {
+    Main_au32CheckIn[u8Task] = G_u32SystemTime1ms;
+  }
+
+} /* end MainTaskCheckIn() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn const char* MainTaskName(u8 u8Task_)
+
+@brief Returns the name of a task for reports (fault records, the debug console).
+
+Requires:
+@param u8Task_ is a Main_asTasks index or U8_MAIN_NO_TASK
+
+Promises:
+- Returns the task's pcName, or "none" if u8Task_ is not a task
+
+*/
+const char* MainTaskName(u8 u8Task_)
+{
+  if(u8Task_ < U8_MAIN_TASKS)
+  {
+    return(Main_asTasks[u8Task_].pcName);
+  }
+
+  return("none");
+
+} /* end MainTaskName() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainSchedulerInitialize(void)
+
+@brief Initializes every task in Main_asTasks and prepares the run order.
+
+Requires:
+- Low level hardware setup is complete
+- Every Main_asTasks entry has u16PeriodMs >= 1 and u16PhaseMs < u16PeriodMs
+- Every supervised entry has u16WatchdogMs > u16PeriodMs
+
+Promises:
+- Each task's Initialize function has been called in table order (the watchdog is
+  fed after each so a short hardware timeout only has to cover the slowest one)
+- Every task's supervision deadline starts now
+- Main_au8RunOrder holds the table indexes sorted by u8Priority (ties keep table order)
+- Main_au32NextRunTime holds the first due tick of each task
+
+*/
+static void MainSchedulerInitialize(void)
+{
+  u32 u32Now;
+  u8 u8Index;
+  u8 j;
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    G_u8MainActiveTask = i;
+    Main_asTasks[i].pfnInitialize();
+    WATCHDOG_BONE();
+  }
+  G_u8MainActiveTask = U8_MAIN_NO_TASK;
+
+  /* Insertion sort by priority is plenty for a handful of tasks */
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    u8Index = i;
+    for(j = i; (j > 0) && (Main_asTasks[Main_au8RunOrder[j - 1]].u8Priority > Main_asTasks[u8Index].u8Priority); j--)
+    {
+      Main_au8RunOrder[j] = Main_au8RunOrder[j - 1];
+    }
+    Main_au8RunOrder[j] = u8Index;
+  }
+
+  /* First run is the first tick at the task's phase, starting now */
+  u32Now = G_u32SystemTime1ms;
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    Main_au32NextRunTime[i] = MainSchedulerNextRun(&Main_asTasks[i], u32Now);
+    Main_au32CheckIn[i] = u32Now;
+  }
+
+} /* end MainSchedulerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainSchedulerRunTasks(void)
+
+@brief Runs every task that is due at the current tick, highest priority first.
+
+A due task whose idle check reports nothing to do is skipped; it is checked
+again at its next due tick.  Being idle counts as checking in with the supervisor.  A due
+tick that went by while the system slept or the loop fell behind is not made up: the
+task waits for the next tick on its phase, so it never runs off its period.
+
+Requires:
+- MainSchedulerInitialize() has run
+
+Promises:
+- Due, non-idle tasks have run once
+- Main_au32NextRunTime is advanced for every due task and realigned for every late one
+
+*/
+static void MainSchedulerRunTasks(void)
+{
+  u32 u32Now = G_u32SystemTime1ms;
+  const MainTaskType* psTask;
+  u8 u8Task;
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    u8Task = Main_au8RunOrder[i];
+    psTask = &Main_asTasks[u8Task];
+
+    /* Not due yet (the comparison handles G_u32SystemTime1ms rollover) */
+    if( TIME_IS_AFTER(Main_au32NextRunTime[u8Task], u32Now) )
+    {
+      continue;
+    }
+
+    /* Missed its tick: wait for the next one on the task's phase (this one may be it).
+    A task that slept through its tick with nothing to do has still checked in. */
+    if(Main_au32NextRunTime[u8Task] != u32Now)
+    {
+      Main_au32NextRunTime[u8Task] = MainSchedulerNextRun(psTask, u32Now);
+      if(Main_au32NextRunTime[u8Task] != u32Now)
+      {
+        if( (psTask->pfnIsIdle != NULL) && psTask->pfnIsIdle() )
+        {
+          Main_au32CheckIn[u8Task] = u32Now;
+        }
+        continue;
+      }
+    }
+
+    Main_au32NextRunTime[u8Task] = MainSchedulerNextRun(psTask, u32Now + 1);
+
+    if( (psTask->pfnIsIdle != NULL) && psTask->pfnIsIdle() )
+    {
+      Main_au32CheckIn[u8Task] = u32Now;
+      MAIN_PROFILE_SKIP(u8Task);
+    }
+    else
+    {
+      TRACE_TASK_ENTER(u8Task);
+      G_u8MainActiveTask = u8Task;
+      MAIN_PROFILE_TASK(u8Task, psTask->pfnRunActiveState);
+      G_u8MainActiveTask = U8_MAIN_NO_TASK;
+      TRACE_TASK_EXIT(u8Task);
+    }
+  }
+
+} /* end MainSchedulerRunTasks() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainSupervisorFeed(void)
+
+@brief Feeds the hardware watchdog if every supervised task has checked in on time.
+
+Runs after the tasks so a task that was not due while the system slept has had its
+chance to run (and check in) first.  A task that is stuck in a state but still
+returning to the loop is caught here within its own u16WatchdogMs; a loop that stops
+altogether is caught by the hardware watchdog within U32_WATCHDOG_TIMEOUT_MS.
+
+Requires:
+- MainSchedulerRunTasks() has just run
+
+Promises:
+- If a supervised task has not checked in for more than its u16WatchdogMs: does not
+  return (FaultTaskWatchdog() records the task and resets)
+- Otherwise the hardware watchdog is restarted
+
+*/
+static void MainSupervisorFeed(void)
+{
+  u32 u32Now = G_u32SystemTime1ms;
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    if( (Main_asTasks[i].u16WatchdogMs != 0) &&
+        ((u32Now - Main_au32CheckIn[i]) > Main_asTasks[i].u16WatchdogMs) )
+    {
+      FaultTaskWatchdog(i);
+    }
+  }
+
+  WATCHDOG_BONE();
+
+} /* end MainSupervisorFeed() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 MainSchedulerNextRun(const MainTaskType* psTask_, u32 u32From_)
+
+@brief Returns the first tick from u32From_ on that falls on the task's period and phase.
+
+Requires:
+@param psTask_ points to a task table entry
+@param u32From_ is the earliest tick the task may run
+
+Promises:
+- Returns t >= u32From_ with (t % u16PeriodMs) == u16PhaseMs
+
+*/
+static u32 MainSchedulerNextRun(const MainTaskType* psTask_, u32 u32From_)
+{
+  if(psTask_->u16PeriodMs <= 1)
+  {
+    return(u32From_);
+  }
+
+  /* Work from u32From_'s own offset so a tick before the first phase does not wrap */
+  return( u32From_ + ((psTask_->u16PhaseMs + psTask_->u16PeriodMs - (u32From_ % psTask_->u16PeriodMs)) % psTask_->u16PeriodMs) );
+
+} /* end MainSchedulerNextRun() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 MainSchedulerSleepTicks(void)
+
+@brief Returns how many ticks the system can sleep before a task needs to run.
+
+A task with a deadline function needs the later of its deadline and its next due
+tick.  A task without one needs its next due tick unless its idle check reports
+nothing to do.  Tasks with no deadline are left to be woken by interrupts.
+
+Requires:
+- Called with interrupts disabled just before SystemSleep()
+
+Promises:
+- Returns the smallest number of ticks (>= 1) any task needs, or U32_NO_DEADLINE
+  if every task is waiting on an interrupt
+
+*/
+static u32 MainSchedulerSleepTicks(void)
+{
+  u32 u32Now = G_u32SystemTime1ms;
+  u32 u32SleepTicks = U32_NO_DEADLINE;
+  u32 u32TaskTicks;
+  u32 u32Deadline;
+  const MainTaskType* psTask;
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    psTask = &Main_asTasks[i];
+
+    /* Ticks until the task is next due; one that came up during this pass is checked next tick */
+    u32TaskTicks = Main_au32NextRunTime[i] - u32Now;
+    if( (s32)u32TaskTicks < 1 )
+    {
+      u32TaskTicks = 1;
+    }
+
+    if(psTask->pfnNextDeadline != NULL)
+    {
+      u32Deadline = psTask->pfnNextDeadline();
+      if(u32Deadline == U32_NO_DEADLINE)
+      {
+        continue;
+      }
+
+      if(u32Deadline > u32TaskTicks)
+      {
+        u32TaskTicks = u32Deadline;
+      }
+    }
+    else if( (psTask->pfnIsIdle != NULL) && psTask->pfnIsIdle() )
+    {
+      continue;
+    }
+
+    if(u32TaskTicks < u32SleepTicks)
+    {
+      u32SleepTicks = u32TaskTicks;
+    }
+  }
+
+  return(u32SleepTicks);
+
+} /* end MainSchedulerSleepTicks() */
+
+
+#ifdef EIE_TASK_PROFILER
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainProfilerInitialize(void)
+
+@brief Starts the DWT cycle counter and clears the task statistics.
+
+Requires:
+- No debugger is using the DWT cycle counter for something else
+
+Promises:
+- DWT_CYCCNT counts core clock cycles
+- G_asMainTaskProfile and G_sMainLoopProfile are reset
+
+*/
+static void MainProfilerInitialize(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA;
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    memset(&G_asMainTaskProfile[i], 0, sizeof(TaskProfileType));
+    G_asMainTaskProfile[i].pcName = Main_asTasks[i].pcName;
+    G_asMainTaskProfile[i].u32MinCycles = 0xFFFFFFFF;
+  }
+
+  memset(&G_sMainLoopProfile, 0, sizeof(LoopProfileType));
+
+} /* end MainProfilerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainProfilerRecordTask(u8 u8Task_, u32 u32Cycles_)
+
+@brief Adds one call of a task to its statistics.
+
+Requires:
+@param u8Task_ is the index of the task in Main_asTasks
+@param u32Cycles_ is the number of cycles the call took
+
+Promises:
+- Calls, min, max, total and the log2 histogram of the task are updated
+
+*/
+static void MainProfilerRecordTask(u8 u8Task_, u32 u32Cycles_)
+{
+  TaskProfileType* psTask = &G_asMainTaskProfile[u8Task_];
+  u8 u8Bucket = 0;
+
+  psTask->u32Calls++;
+  psTask->u64TotalCycles += u32Cycles_;
+
+  if(u32Cycles_ < psTask->u32MinCycles)
+  {
+    psTask->u32MinCycles = u32Cycles_;
+  }
+
+  if(u32Cycles_ > psTask->u32MaxCycles)
+  {
+    psTask->u32MaxCycles = u32Cycles_;
+  }
+
+  /* Bucket is the position of the highest set bit */
+  if(u32Cycles_ != 0)
+  {
+    u8Bucket = (u8)(31 - __CLZ(u32Cycles_));
+  }
+  psTask->au32Histogram[u8Bucket]++;
+
+} /* end MainProfilerRecordTask() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void MainProfilerRecordLoop(u32 u32Cycles_)
+
+@brief Records one super loop iteration and flags it if it used more than the 1ms budget.
+
+Requires:
+@param u32Cycles_ is the number of cycles from wake up until just before sleeping
+
+Promises:
+- G_sMainLoopProfile is updated; u32Overruns counts iterations that did not
+  finish within one SysTick period
+
+*/
+static void MainProfilerRecordLoop(u32 u32Cycles_)
+{
+  G_sMainLoopProfile.u32Iterations++;
+
+  if(u32Cycles_ > G_sMainLoopProfile.u32MaxCycles)
+  {
+    G_sMainLoopProfile.u32MaxCycles = u32Cycles_;
+  }
+
+  if(u32Cycles_ > U32_MAIN_LOOP_BUDGET_CYCLES)
+  {
+    G_sMainLoopProfile.u32Overruns++;
+    G_sMainLoopProfile.u32LastOverrunTime = G_u32SystemTime1ms;
+  }
+
+} /* end MainProfilerRecordLoop() */
+#endif /* EIE_TASK_PROFILER */
+
+
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
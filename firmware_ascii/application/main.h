@@ -26,17 +26,114 @@ FIRMWARE_SUB_REV1: should be updated when a pull request is made to the MASTER b
 ***********************************************************************************************************************/
 /* G_u32SystemFlags */
 #define _SYSTEM_SLEEPING                (u32)0x80000000   /*!< G_u32SystemFlags set into sleep mode to go back to sleep if woken before 1ms period */
+#define _SYSTEM_FAULT_RESET             (u32)0x00000001   /*!< G_u32SystemFlags set at start up if a fault caused the reset (see FaultGetLast()) */
 /* end G_u32SystemFlags */
 
+/* Super loop task table (see Main_asTasks in main.c) */
+#define U8_MAIN_TASKS                   (u8)9             /*!< @brief Number of entries in the task table */
+#define U8_MAIN_NO_TASK                 (u8)0xFF          /*!< @brief G_u8MainActiveTask outside of the tasks */
+#define U32_NO_DEADLINE                 (u32)0xFFFFFFFF   /*!< @brief Deadline function result: nothing to do until an interrupt */
 
+/* Task profiler: build with EIE_TASK_PROFILER defined (IAR preprocessor defines or
+make EXTRA_DEFINES=-DEIE_TASK_PROFILER in gcc_sim) to measure each super loop task
+with the DWT cycle counter.  Results are in G_asMainTaskProfile and G_sMainLoopProfile. */
+#ifdef EIE_TASK_PROFILER
+#define U8_MAIN_PROFILER_BUCKETS        (u8)32            /*!< @brief log2 histogram buckets (one per bit of the cycle count) */
+#define U32_MAIN_LOOP_BUDGET_CYCLES     (u32)(MCK / 1000) /*!< @brief Cycles available between SysTicks */
+
+/*! @brief Runs fnTask_ and charges the cycles it took to task table entry u8Task_ */
+#define MAIN_PROFILE_TASK(u8Task_, fnTask_)  do { u32 u32TaskStart = DWT->CYCCNT; fnTask_(); \
+                                                  MainProfilerRecordTask(u8Task_, DWT->CYCCNT - u32TaskStart); } while(0)
+#define MAIN_PROFILE_SKIP(u8Task_)      (G_asMainTaskProfile[u8Task_].u32Skips++)
+#define MAIN_PROFILE_LOOP_START()       (Main_u32LoopStartCycles = DWT->CYCCNT)
+#define MAIN_PROFILE_LOOP_END()         MainProfilerRecordLoop(DWT->CYCCNT - Main_u32LoopStartCycles)
+
+#else
+
+#define MAIN_PROFILE_TASK(u8Task_, fnTask_)  fnTask_()
+#define MAIN_PROFILE_SKIP(u8Task_)
+#define MAIN_PROFILE_LOOP_START()
+#define MAIN_PROFILE_LOOP_END()
+
+#endif /* EIE_TASK_PROFILER */
 
 
 /**********************************************************************************************************************
-Function Declarations
+Type Definitions
 **********************************************************************************************************************/
+/*!
+@struct MainTaskType
+@brief One entry of the super loop task table.
+
+Every task is run once per period at ticks where (G_u32SystemTime1ms % u16PeriodMs) == u16PhaseMs,
+in u8Priority order.  If pfnIsIdle is provided and returns TRUE, the call is skipped for that tick.
+A due tick the system slept through is not made up; the task next runs on its phase.
+
+A task with u16WatchdogMs must call MainTaskCheckIn() at least that often (an idle skip
+counts); if it does not, the loop stops feeding the hardware watchdog and resets with
+the task recorded.  u16WatchdogMs must be longer than u16PeriodMs.
+
+Between ticks the system sleeps for as many ms as the tasks allow (tickless idle).  A task
+with pfnNextDeadline is woken no sooner than its deadline; a task without one is woken at
+every due tick unless pfnIsIdle reports it has nothing to do.  A task whose deadline or
+idle check lets ticks go by must work from elapsed G_u32SystemTime1ms, not call counts.
+*/
+typedef struct
+{
+  const char* pcName;                             /*!< @brief Task name for the debugger / profiler */
+  fnCode_type pfnInitialize;                      /*!< @brief Called once at startup, in table order */
+  fnCode_type pfnRunActiveState;                  /*!< @brief Runs one iteration of the task state machine */
+  fnBoolCode_type pfnIsIdle;                      /*!< @brief TRUE if the task has nothing to do (NULL: always run) */
+  fnU32Code_type pfnNextDeadline;                 /*!< @brief ms until the task next has work or U32_NO_DEADLINE (NULL: see pfnIsIdle) */
+  u16 u16PeriodMs;                                /*!< @brief Run every u16PeriodMs ticks (1 = every tick) */
+  u16 u16PhaseMs;                                 /*!< @brief Tick offset within the period (< u16PeriodMs) */
+  u8 u8Priority;                                  /*!< @brief Order within a tick; 0 runs first */
+  u16 u16WatchdogMs;                              /*!< @brief Longest time between MainTaskCheckIn() calls (0 = not supervised) */
+} MainTaskType;
+
 
+#ifdef EIE_TASK_PROFILER
+/*!
+@struct TaskProfileType
+@brief Execution time statistics for one super loop task, in core clock cycles.
+*/
+typedef struct
+{
+  const char* pcName;                             /*!< @brief Task name for the debugger / simulator report */
+  u32 u32Calls;                                   /*!< @brief Number of measured calls */
+  u32 u32Skips;                                   /*!< @brief Due ticks skipped because the task was idle */
+  u32 u32MinCycles;                               /*!< @brief Shortest call */
+  u32 u32MaxCycles;                               /*!< @brief Longest call */
+  u64 u64TotalCycles;                             /*!< @brief Sum of all calls (the reader divides by u32Calls for the mean) */
+  u32 au32Histogram[U8_MAIN_PROFILER_BUCKETS];    /*!< @brief Bucket n counts calls of 2^n to 2^(n+1)-1 cycles (0 in bucket 0) */
+} TaskProfileType;
 
 
+/*!
+@struct LoopProfileType
+@brief Statistics for whole super loop iterations (wake up to sleep).
+*/
+typedef struct
+{
+  u32 u32Iterations;                              /*!< @brief Measured loop iterations */
+  u32 u32MaxCycles;                               /*!< @brief Longest iteration */
+  u32 u32Overruns;                                /*!< @brief Iterations longer than the 1ms SysTick period */
+  u32 u32LastOverrunTime;                         /*!< @brief G_u32SystemTime1ms at the last overrun */
+} LoopProfileType;
+#endif /* EIE_TASK_PROFILER */
+
+
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+void MainTaskCheckIn(void);
+const char* MainTaskName(u8 u8Task_);
+
 
 #endif /* __MAIN_H */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -7,7 +7,10 @@ are one-time configurations for the processor.
 
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
-- NONE
+- const u8 G_au8BspButtonIndex[U8_BUTTON_PORTS][U8_BUTTON_PORT_BITS]
+- const PinConfigurationType G_asBspKeypadRows[U8_KEYPAD_ROWS] (EIE_KEYPAD builds)
+- const PinConfigurationType G_asBspTimerTioaPins[U8_TIMER_CHANNELS]
+- BspDeepSleepStatsType G_sBspDeepSleep (EIE_DEEP_SLEEP builds)
 
 CONSTANTS
 - NONE
@@ -57,18 +60,64 @@ const PinConfigurationType G_asBspButtonConfigurations[U8_TOTAL_BUTTONS] = { {PA
                                                                              {PB_02_BUTTON3, PORTB, ACTIVE_LOW},
                                                                            };
 
+/*! Button on each port bit, indexed [port][bit number] so an interrupt flag maps to its button without a search.
+Must agree with G_asBspButtonConfigurations.  Only bits in GPIOA_BUTTONS / GPIOB_BUTTONS are ever looked up. */
+const u8 G_au8BspButtonIndex[U8_BUTTON_PORTS][U8_BUTTON_PORT_BITS] = { {[17] = BUTTON0},
+                                                                       {[0] = BUTTON1, [1] = BUTTON2, [2] = BUTTON3},
+                                                                     };
+
+#ifdef EIE_KEYPAD
+/*! Keypad row lines in row order (open drain, pulled low to scan the row) */
+const PinConfigurationType G_asBspKeypadRows[U8_KEYPAD_ROWS] = { {PB_03_BLADE_AN0, PORTB, ACTIVE_LOW},
+                                                                 {PB_04_BLADE_AN1, PORTB, ACTIVE_LOW},
+                                                                 {PA_11_BLADE_UPIMO, PORTA, ACTIVE_LOW},
+                                                                 {PA_12_BLADE_UPOMI, PORTA, ACTIVE_LOW},
+                                                               };
+#endif /* EIE_KEYPAD */
+
+/*! TIOA input of each TC channel in channel order, for timer.c capture (peripheral A except 
+TIOA2, which is never used since TC2 runs the LED PWM) */
+const PinConfigurationType G_asBspTimerTioaPins[U8_TIMER_CHANNELS] = { {PA_01_SD_WP, PORTA, ACTIVE_HIGH},
+                                                                       {PB_05_TP56, PORTB, ACTIVE_HIGH},
+                                                                       {PA_30_AN_DEMO, PORTA, ACTIVE_HIGH},
+                                                                     };
+
+#ifdef EIE_DEEP_SLEEP
+/*! Deep sleep counters and wake up latency (see SystemSleep()) */
+BspDeepSleepStatsType G_sBspDeepSleep = {.u32WakeMarginMs = U32_DEEP_SLEEP_MARGIN_MS};
+#endif /* EIE_DEEP_SLEEP */
+
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
 extern volatile u32 G_u32SystemTime1ms;        /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;         /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1msHigh;    /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;          /*!< @brief From main.c */
 
 
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void ClockStart(void);
+static void ClockWait(u32 u32Flag_);
+static void SystemTimeRealign(u32 u32Clocks_, bool bTickPending_);
+#ifdef EIE_DEEP_SLEEP
+static void ClockStop(void);
+static u32 SystemDeepSleep(u32 u32Ticks_);
+static u32 SystemButtonWakeLevels(void);
+#endif /* EIE_DEEP_SLEEP */
+
+
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "Bsp_" and be declared as static.
 ***********************************************************************************************************************/
+#ifdef EIE_DEEP_SLEEP
+/*! Fast startup input (PMC_FSMR / PMC_FSPR bit) of each button, in ButtonNameType order */
+static const u32 Bsp_au32ButtonWakeUpInputs[U8_TOTAL_BUTTONS] = {PMC_FSTT_BUTTON0, PMC_FSTT_BUTTON1, 
+                                                                  PMC_FSTT_BUTTON2, PMC_FSTT_BUTTON3};
+#endif /* EIE_DEEP_SLEEP */
 
 
 /***********************************************************************************************************************
@@ -92,8 +141,9 @@ Function Definitions
 The dog runs at 32kHz from the slow built-in RC clock source which varies 
 over operating conditions from 20kHz to 44kHz.
 
-Since the main loop time / sleep time should be 1 ms most of the time, choosing a value
-of 5 seconds should be plenty to avoid watchdog resets.  
+The main loop feeds the dog every time it runs (as long as every supervised task
+has checked in, see main.c) and SystemSleep() never sleeps for more than half the
+timeout, so U32_WATCHDOG_TIMEOUT_MS only runs out if the loop itself is stuck.
 
 Note: the processor allows the WDMR register to be written just once after a reset.
 
@@ -101,7 +151,7 @@ Requires:
 - SLCK is active at about 32kHz
 
 Promises:
-- Watchdog is set for 5 second timeout
+- Watchdog is set for a U32_WATCHDOG_TIMEOUT_MS timeout
 
 */
 void WatchDogSetup(void)
@@ -136,30 +186,59 @@ void ClockSetup(void)
   AT91C_BASE_PMC->PMC_PCKR[0] = AT91C_PMC_CSS_SYS_CLK | AT91C_PMC_PRES_CLK;
   AT91C_BASE_PMC->PMC_SCER = AT91C_PMC_PCK0;
 
-  /* Turn on the main oscillator and wait for it to start up */
-  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MOSCXTS) );
-
-  /* Assign main clock as crystal */
-  AT91C_BASE_PMC->PMC_MOR |= (AT91C_CKGR_MOSCSEL | MOR_KEY);
-  
-  /* Initialize PLLA and wait for lock */
-  AT91C_BASE_PMC->PMC_PLLAR = PMC_PLAAR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_LOCKA) );
-  
-  /* Assign the PLLA as the main system clock with prescaler active using the sequence suggested in the user guide */
-  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
-  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_PLLA;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_MCKRDY) );
-
-  /* Initialize UTMI for USB usage */
-  AT91C_BASE_CKGR->CKGR_UCKR |= (AT91C_CKGR_UPLLCOUNT & (3 << 20)) | AT91C_CKGR_UPLLEN;
-  while ( !(AT91C_BASE_PMC->PMC_SR & AT91C_PMC_LOCKU) );
+  ClockStart();
   
 } /* end ClockSetup */
 
 
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void RttSetup(void)
+
+@brief Starts the Real-time Timer that keeps time through deep sleep.
+
+Requires:
+- SLCK is active at about 32kHz
+
+Promises:
+- RTT is counting from 0 at SLCK / U32_RTT_PRESCALER with its interrupts off
+
+*/
+void RttSetup(void)
+{
+  AT91C_BASE_RTTC->RTTC_RTMR = RTT_MR_INIT;
+
+} /* end RttSetup() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u32 RttGetValue(void)
+
+@brief Returns the Real-time Timer value.
+
+RTT_VR counts on SLCK, asynchronously to the core, so it is read until two reads
+agree as the user guide requires.
+
+Requires:
+- RttSetup() has run
+
+Promises:
+- Returns the current RTT count
+
+*/
+u32 RttGetValue(void)
+{
+  u32 u32Value;
+
+  do
+  {
+    u32Value = AT91C_BASE_RTTC->RTTC_RTVR;
+  } while(u32Value != AT91C_BASE_RTTC->RTTC_RTVR);
+
+  return(u32Value);
+
+} /* end RttGetValue() */
+
+
 /*!---------------------------------------------------------------------------------------------------------------------
 @fn void GpioSetup(void)
 
@@ -229,6 +308,7 @@ Promises:
 void SysTickSetup(void)
 {
   G_u32SystemTime1ms = 0;      
+  G_u32SystemTime1msHigh = 0;
   G_u32SystemTime1s  = 0;   
   
   /* Load the SysTick Counter Value */
@@ -242,22 +322,47 @@ void SysTickSetup(void)
 
 
 /*!---------------------------------------------------------------------------------------------------------------------
-@fn void SystemSleep(void)
-@brief Puts the system into sleep mode.  
+@fn void SystemSleep(u32 u32Ticks_)
+@brief Puts the system into sleep mode until u32Ticks_ SysTick periods have passed.  
 _SYSTEM_SLEEPING is set here so if the system wakes up because of a non-Systick
 interrupt, it can go back to sleep.
-Deep sleep mode is currently disabled, so maximum processor power savings are 
-not yet realized.  To enable deep sleep, there are certain considerations for 
-waking up that would need to be taken care of.
+
+Tickless idle: when more than one tick can go by, SysTick is stopped and reloaded to
+count straight through to the requested tick, so the core is not woken every 1ms.
+On wake up (at that tick or earlier by any other interrupt) the ticks that went by are
+added to G_u32SystemTime1ms / G_u32SystemTime1s and SysTick is put back on its 1ms
+grid.  A sleep woken early still ends on the next tick boundary so the super loop always
+runs on a tick.  The SysTick clocks lost while the counter is stopped to reprogram it are
+added back with U32_SYSTICK_STOPPED_CLOCKS.
+
+Deep sleep (EIE_DEEP_SLEEP builds): a sleep long enough to be worth restarting the 
+crystal and PLL for, with no buzzer or TC channel interrupt running, is spent in Wait 
+mode instead (see SystemDeepSleep()).  The rest of it, if woken early by a button, finishes as a normal
+sleep.
+
 Requires:
 - SysTick is running with interrupt enabled for wake from Sleep LPM
+- RttSetup() has run if EIE_DEEP_SLEEP is defined
+- Interrupts are disabled (PRIMASK set) so nothing that changes the sleep time can run
+  between the caller working out u32Ticks_ and the sleep starting
+
+@param u32Ticks_ is the number of tick boundaries to sleep through (1 = next tick,
+clipped to U32_SYSTICK_MAX_SLEEP_TICKS)
+
 Promises:
 - Configures processor for sleep while still allowing any required
   interrupt to wake it up.
 - G_u32SystemFlags _SYSTEM_SLEEPING is set
+- Returns with interrupts enabled just after a SysTick, with G_u32SystemTime1ms
+  and G_u32SystemTime1s counting every tick that went by
 */
-void SystemSleep(void)
+void SystemSleep(u32 u32Ticks_)
 {    
+  u32 u32Remaining;
+  u32 u32Reload;
+  u32 u32Elapsed;
+  bool bCountedOut;
+
   /* Set the system control register for Sleep (but not Deep Sleep) */
   AT91C_BASE_PMC->PMC_FSMR &= ~AT91C_PMC_LPM;
   AT91C_BASE_NVIC->NVIC_SCR &= ~AT91C_NVIC_SLEEPDEEP;
@@ -265,6 +370,74 @@ void SystemSleep(void)
   /* Set the sleep flag (cleared only in SysTick ISR */
   G_u32SystemFlags |= _SYSTEM_SLEEPING;
 
+#ifdef EIE_DEEP_SLEEP
+  /* The buzzers and the music sequencer's tick (audio.c) need the PWM clock and every
+  TC channel counts MCK (LED PWM on TC2, the keypad scan, timer.c callbacks and captures
+  on the others have an interrupt enabled while they run; the quadrature decoder counts
+  with none), so no deep sleep while any of them is on.  USART0 and TWI0 stop too, so the debug console must have sent everything
+  and no TWI transaction may be running */
+  if( (u32Ticks_ >= U32_DEEP_SLEEP_MIN_MS + G_sBspDeepSleep.u32WakeMarginMs) &&
+      !(AT91C_BASE_PWMC->PWMC_SR & (BUZZER1 | BUZZER2 | AUDIO_TICK_CHANNEL)) &&
+      !(AT91C_BASE_US0->US_IMR & AT91C_US_ENDTX) && (AT91C_BASE_US0->US_CSR & AT91C_US_TXEMPTY) &&
+      !AT91C_BASE_TWI0->TWI_IMR &&
+      !AT91C_BASE_TC0->TC_IMR && !AT91C_BASE_TC1->TC_IMR && !AT91C_BASE_TC2->TC_IMR &&
+      !(AT91C_BASE_TCB0->TCB_BMR & TIMER_TCB_BMR_QDEN) )
+  {
+    u32Ticks_ = SystemDeepSleep(u32Ticks_);
+  }
+#endif /* EIE_DEEP_SLEEP */
+
+  if(u32Ticks_ > U32_SYSTICK_MAX_SLEEP_TICKS)
+  {
+    u32Ticks_ = U32_SYSTICK_MAX_SLEEP_TICKS;
+  }
+
+  /* Wake up in time to feed the watchdog */
+  if(u32Ticks_ > U32_WATCHDOG_MAX_SLEEP_MS)
+  {
+    u32Ticks_ = U32_WATCHDOG_MAX_SLEEP_MS;
+  }
+
+  if(u32Ticks_ > 1)
+  {
+    /* Stop SysTick and see how much of the current tick is left */
+    AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+    u32Remaining = AT91C_BASE_NVIC->NVIC_STICKCVR;
+
+    if( (AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET) || (u32Remaining == 0) )
+    {
+      /* The tick has just ended so its ISR must run first: carry on as a normal sleep */
+      AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+    }
+    else
+    {
+      /* One long count through the rest of this tick and every tick that is not needed */
+      u32Reload = u32Remaining + ((u32Ticks_ - 1) * U32_SYSTICK_COUNT) - U32_SYSTICK_STOPPED_CLOCKS - 1;
+      AT91C_BASE_NVIC->NVIC_STICKRVR = u32Reload;
+      AT91C_BASE_NVIC->NVIC_STICKCVR = 0;
+      AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+
+      /* Interrupts are masked, so this returns with whatever woke the core still pending */
+      __WFI();
+
+      /* Stop the count; COUNTFLAG says whether it ran out (reading CSR clears it) */
+      bCountedOut = (bool)((AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKCOUNTFLAG) != 0);
+      AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+      u32Elapsed = u32Reload - AT91C_BASE_NVIC->NVIC_STICKCVR;
+      if(bCountedOut)
+      {
+        u32Elapsed += u32Reload + 1;
+      }
+
+      /* Measure from the start of the tick that was running when the sleep started,
+      including the time the counter was stopped on the way in and out */
+      u32Elapsed += U32_SYSTICK_COUNT - u32Remaining + (2 * U32_SYSTICK_STOPPED_CLOCKS);
+      SystemTimeRealign(u32Elapsed, bCountedOut);
+    }
+  }
+
+  __enable_irq();
+
   /* Now enter the selected LPM */
   while(G_u32SystemFlags & _SYSTEM_SLEEPING)
   {
@@ -290,7 +463,7 @@ Promises:
 void PWMSetupAudio(void)
 {
   /*Set all PWM initialization values */
-  AT91C_BASE_PWMC->PWMC_CLK = PWM_CMR0_INIT;
+  AT91C_BASE_PWMC->PWMC_CLK = PWM_CLK_INIT;
   
   AT91C_BASE_PWMC_CH0->PWMC_CMR = PWM_CMR0_INIT;
   AT91C_BASE_PWMC_CH0->PWMC_CPRDR = PWM_CPRD0_INIT; /* Set current freqency */
@@ -440,6 +613,343 @@ void PWMAudioOff(BuzzerChannelType eBuzzerChannel_)
   AT91C_BASE_PWMC->PWMC_DIS = (u32)eBuzzerChannel_;  
 
 } /* end PWMAudioOff() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void ClockStart(void)
+
+@brief Starts the crystal, PLLA and UTMI PLL and runs the core from PLLA.
+
+Used by ClockSetup() and to restore the clocks after Wait mode.
+
+Requires:
+- Flash wait states are set for 48MHz
+- The core is running from the main RC oscillator
+
+Promises:
+- MCK is PLLA / 2 = 48MHz and the UTMI PLL is locked
+- If a clock never becomes ready, the watchdog resets the processor (see ClockWait())
+
+*/
+static void ClockStart(void)
+{
+  /* Turn on the main oscillator and wait for it to start up (about 60ms, longer
+  than a short watchdog timeout, so the watchdog is fed while waiting) */
+  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
+  ClockWait(AT91C_PMC_MOSCXTS);
+
+  /* Assign main clock as crystal */
+  AT91C_BASE_PMC->PMC_MOR |= (AT91C_CKGR_MOSCSEL | MOR_KEY);
+  
+  /* Initialize PLLA and wait for lock */
+  AT91C_BASE_PMC->PMC_PLLAR = PMC_PLAAR_INIT;
+  ClockWait(AT91C_PMC_LOCKA);
+  
+  /* Assign the PLLA as the main system clock with prescaler active using the sequence suggested in the user guide */
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
+  ClockWait(AT91C_PMC_MCKRDY);
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_PLLA;
+  ClockWait(AT91C_PMC_MCKRDY);
+
+  /* Initialize UTMI for USB usage */
+  AT91C_BASE_CKGR->CKGR_UCKR |= (AT91C_CKGR_UPLLCOUNT & (3 << 20)) | AT91C_CKGR_UPLLEN;
+  ClockWait(AT91C_PMC_LOCKU);
+  
+} /* end ClockStart() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void ClockWait(u32 u32Flag_)
+
+@brief Waits for a PMC_SR ready flag, feeding the watchdog only while the wait is 
+still within U32_CLOCK_WAIT_POLLS.
+
+A dead crystal or a PLL that never locks must not keep the board alive: once the 
+polls run out the watchdog is no longer fed and resets the processor, which 
+FaultGetLast() then reports.
+
+Requires:
+@param u32Flag_ is the AT91C_PMC_xxx bit to wait for
+
+Promises:
+- Returns once u32Flag_ is set in PMC_SR within U32_CLOCK_WAIT_POLLS reads
+- Otherwise never returns
+
+*/
+static void ClockWait(u32 u32Flag_)
+{
+  for(u32 i = 0; i < U32_CLOCK_WAIT_POLLS; i++)
+  {
+    if(AT91C_BASE_PMC->PMC_SR & u32Flag_)
+    {
+      return;
+    }
+    WATCHDOG_BONE();
+  }
+
+  /* Stop feeding and wait for the watchdog reset */
+  while(1)
+  {
+    __WFI();
+  }
+
+} /* end ClockWait() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SystemTimeRealign(u32 u32Clocks_, bool bTickPending_)
+
+@brief Restarts SysTick on its 1ms grid after it was stopped and brings the system time up to date.
+
+Requires:
+- SysTick is stopped
+- Interrupts are disabled
+
+@param u32Clocks_ is the number of SysTick clocks from the start of the tick that was
+running when SysTick was stopped (i.e. from the last counted tick) until now
+@param bTickPending_ is TRUE if a SysTick exception is already pending to count one of
+those ticks
+
+Promises:
+- SysTick is running and counts its next tick where the 1ms grid says it should
+- G_u32SystemTime1ms (carrying into G_u32SystemTime1msHigh) and G_u32SystemTime1s
+  include every completed tick that the SysTick ISR will not count
+
+*/
+static void SystemTimeRealign(u32 u32Clocks_, bool bTickPending_)
+{
+  u32 u32Ticks = u32Clocks_ / U32_SYSTICK_COUNT;
+  u32 u32Clocks = u32Clocks_ % U32_SYSTICK_COUNT;
+
+  /* A boundary only a clock away is counted now since RVR cannot be 0 */
+  if(u32Clocks >= U32_SYSTICK_COUNT - 1)
+  {
+    u32Ticks++;
+    u32Clocks = 0;
+  }
+
+  /* Restart SysTick to end on the original 1ms grid */
+  AT91C_BASE_NVIC->NVIC_STICKRVR = U32_SYSTICK_COUNT - u32Clocks - 1;
+  AT91C_BASE_NVIC->NVIC_STICKCVR = 0;
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+
+  /* The pending SysTick ISR counts the tick that ended the sleep */
+  if(bTickPending_)
+  {
+    u32Ticks--;
+  }
+  G_u32SystemTime1s  += ((G_u32SystemTime1ms % 1000) + u32Ticks) / 1000;
+  G_u32SystemTime1ms += u32Ticks;
+  if(G_u32SystemTime1ms < u32Ticks)
+  {
+    G_u32SystemTime1msHigh++;
+  }
+
+  /* The counter has loaded the short reload by now, so later ticks are 1ms again */
+  AT91C_BASE_NVIC->NVIC_STICKRVR = U32_SYSTICK_COUNT - 1;
+
+  /* The cycle counter may have stopped while asleep: give the trace a new time base,
+  or let the pending SysTick do it once it has counted the last ms */
+  if(!bTickPending_)
+  {
+    TRACE_TICK(G_u32SystemTime1ms);
+  }
+
+} /* end SystemTimeRealign() */
+
+
+#ifdef EIE_DEEP_SLEEP
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void ClockStop(void)
+
+@brief Moves the core to the main RC oscillator and stops the crystal and both PLLs.
+
+Requires:
+- Interrupts are disabled
+
+Promises:
+- MCK is the main RC oscillator and the crystal, PLLA and UTMI PLL are off so
+  Wait mode restarts on the RC oscillator alone
+
+*/
+static void ClockStop(void)
+{
+  /* Main clock first (same sequence as ClockStart() in reverse) */
+  AT91C_BASE_PMC->PMC_MCKR = PMC_MCKR_INIT;
+  ClockWait(AT91C_PMC_MCKRDY);
+
+  /* Select the RC oscillator and then turn the crystal off */
+  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT;
+  ClockWait(AT91C_PMC_MOSCSELS);
+  AT91C_BASE_PMC->PMC_MOR = PMC_MOR_INIT & ~AT91C_CKGR_MOSCXTEN;
+
+  /* MULA = 0 turns PLLA off */
+  AT91C_BASE_PMC->PMC_PLLAR = AT91C_CKGR_SRC;
+  AT91C_BASE_CKGR->CKGR_UCKR &= ~AT91C_CKGR_UPLLEN;
+
+} /* end ClockStop() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static u32 SystemDeepSleep(u32 u32Ticks_)
+
+@brief Spends most of a long sleep in Wait mode and reports how much of it is left.
+
+The NVIC SLEEPDEEP bit selects Backup mode on this processor, which wakes up 
+through a reset, so deep sleep is Wait mode: PMC_FSMR LPM set and WFE.  All 
+clocks stop except SLCK; the RTT alarm and the button WKUP inputs restart the 
+core on the main RC oscillator through the PMC fast startup logic.  ClockStart() 
+then restores the crystal and PLLs, which takes a few tens of ms, so the RTT alarm 
+is set G_sBspDeepSleep.u32WakeMarginMs before the deadline.  That margin is the 
+worst wake up latency measured so far.
+
+Time in Wait mode is measured with the RTT and added to the system time.
+
+Requires:
+- Called from SystemSleep() with interrupts disabled and SysTick running
+- u32Ticks_ is more than U32_DEEP_SLEEP_MIN_MS + G_sBspDeepSleep.u32WakeMarginMs
+
+@param u32Ticks_ is the number of tick boundaries until the next deadline
+
+Promises:
+- SysTick is running on its 1ms grid, G_u32SystemTime1ms / G_u32SystemTime1s
+  are up to date and the clocks are as ClockSetup() left them
+- G_sBspDeepSleep records the wake up source and latency
+- Returns the number of tick boundaries still to sleep through (1 if a button or
+  anything other than the RTT woke the core)
+
+*/
+static u32 SystemDeepSleep(u32 u32Ticks_)
+{
+  u32 u32StartTime = G_u32SystemTime1ms;
+  u32 u32Remaining;
+  u32 u32RttStart;
+  u32 u32RttAlarm;
+  u32 u32RttWake;
+  u32 u32RttReady;
+  u32 u32Elapsed;
+  u32 u32ButtonLevels;
+  BspWakeSourceType eWakeSource;
+
+  if(u32Ticks_ > U32_DEEP_SLEEP_MAX_MS)
+  {
+    u32Ticks_ = U32_DEEP_SLEEP_MAX_MS;
+  }
+
+  /* Stop SysTick; a tick that has just ended or any other pending interrupt must run first */
+  AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT & ~AT91C_NVIC_STICKENABLE;
+  u32Remaining = AT91C_BASE_NVIC->NVIC_STICKCVR;
+
+  if( (AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET) || (u32Remaining == 0) ||
+      (AT91C_BASE_NVIC->NVIC_ISPR[0] & AT91C_BASE_NVIC->NVIC_ISER[0]) )
+  {
+    AT91C_BASE_NVIC->NVIC_STICKCSR = SYSTICK_CTRL_INIT;
+    return(u32Ticks_);
+  }
+
+  /* The alarm flags when the RTT reaches ALMV + 1.  Reading RTT_SR clears an old alarm. */
+  u32RttStart = RttGetValue();
+  u32RttAlarm = u32RttStart + ( ((u32Ticks_ - G_sBspDeepSleep.u32WakeMarginMs) * U32_SLCK_VALUE) /
+                                (U32_RTT_PRESCALER * 1000) );
+  AT91C_BASE_RTTC->RTTC_RTAR = u32RttAlarm - 1;
+  (void)AT91C_BASE_RTTC->RTTC_RTSR;
+
+  /* Each button wakes on the opposite of its level now, so a held button wakes on release */
+  u32ButtonLevels = SystemButtonWakeLevels();
+
+  /* Enter Wait mode */
+  ClockStop();
+  AT91C_BASE_PMC->PMC_FSPR = u32ButtonLevels ^ PMC_FSMR_BUTTON_INPUTS;
+  AT91C_BASE_PMC->PMC_FSMR = PMC_FSMR_WAIT_INIT;
+  AT91C_BASE_NVIC->NVIC_SCR &= ~AT91C_NVIC_SLEEPDEEP;
+  G_sBspDeepSleep.u32Sleeps++;
+
+  __WFE();
+
+  /* Running on the RC oscillator: restore the clocks and measure how long that takes.
+  The buttons are sampled first since a short press can be over once the PLL is up. */
+  u32RttWake = RttGetValue();
+  u32ButtonLevels ^= SystemButtonWakeLevels();
+  AT91C_BASE_PMC->PMC_FSMR &= ~AT91C_PMC_LPM;
+  ClockStart();
+  u32RttReady = RttGetValue();
+
+  if(AT91C_BASE_RTTC->RTTC_RTSR & AT91C_RTTC_ALMS)
+  {
+    eWakeSource = BSP_WAKE_RTT;
+    G_sBspDeepSleep.u32LastLatencyUs = RTT_TICKS_TO_US(u32RttReady - u32RttAlarm);
+  }
+  else
+  {
+    eWakeSource = BSP_WAKE_OTHER;
+    if(u32ButtonLevels)
+    {
+      eWakeSource = BSP_WAKE_BUTTON;
+    }
+
+    /* The wake up edge is not timed, so this misses the short RC oscillator start */
+    G_sBspDeepSleep.u32LastLatencyUs = RTT_TICKS_TO_US(u32RttReady - u32RttWake);
+  }
+
+  G_sBspDeepSleep.eLastWakeSource = eWakeSource;
+  LOG2("deep sleep woken by source %u after %u us", eWakeSource, G_sBspDeepSleep.u32LastLatencyUs);
+  G_sBspDeepSleep.au32Wakes[eWakeSource]++;
+  if(G_sBspDeepSleep.u32LastLatencyUs > G_sBspDeepSleep.u32MaxLatencyUs)
+  {
+    G_sBspDeepSleep.u32MaxLatencyUs = G_sBspDeepSleep.u32LastLatencyUs;
+    G_sBspDeepSleep.u32WakeMarginMs = (G_sBspDeepSleep.u32MaxLatencyUs / 1000) + 1;
+  }
+
+  /* RTT counts to SysTick clocks, from the start of the tick that was running */
+  u32Elapsed = (u32)( ((u64)(u32RttReady - u32RttStart) * U32_RTT_PRESCALER * (MCK / SYSTICK_DIVIDER)) /
+                      U32_SLCK_VALUE );
+  SystemTimeRealign(u32Elapsed + U32_SYSTICK_COUNT - u32Remaining, FALSE);
+
+  u32Elapsed = G_u32SystemTime1ms - u32StartTime;
+  if( (eWakeSource != BSP_WAKE_RTT) || (u32Elapsed >= u32Ticks_) )
+  {
+    return(1);
+  }
+
+  return(u32Ticks_ - u32Elapsed);
+
+} /* end SystemDeepSleep() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static u32 SystemButtonWakeLevels(void)
+
+@brief Returns the button levels laid out as PMC_FSPR bits.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the PMC_FSPR bit of each button whose pin is high (released)
+
+*/
+static u32 SystemButtonWakeLevels(void)
+{
+  u32 u32Levels = 0;
+
+  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  {
+    if( *(&(AT91C_BASE_PIOA->PIO_PDSR) + G_asBspButtonConfigurations[i].ePort) & G_asBspButtonConfigurations[i].u32BitPosition )
+    {
+      u32Levels |= Bsp_au32ButtonWakeUpInputs[i];
+    }
+  }
+
+  return(u32Levels);
+
+} /* end SystemButtonWakeLevels() */
+#endif /* EIE_DEEP_SLEEP */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* End of File */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -48,15 +48,55 @@ typedef enum {WHITE = 0, PURPLE, BLUE, CYAN, GREEN, YELLOW, ORANGE, RED, LCD_RED
 
 The order of the buttons in ButtonNameType must match the order of the definition 
 in G_asBspButtonConfigurations Buttons_au32BitPositions from eief1-pcb-01.c 
-*/
-typedef enum {BUTTON0 = 0, BUTTON1, BUTTON2, BUTTON3, NOBUTTON} ButtonNameType;
 
-#define U8_TOTAL_BUTTONS          (u8)4       /*!< Total number of Buttons in the system */
+EIE_KEYPAD builds add the keys of the blade keypad after the discrete buttons,
+numbered row by row (KEY0 is row 0 column 0, KEY4 is row 1 column 0).
+*/
+typedef enum {BUTTON0 = 0, BUTTON1, BUTTON2, BUTTON3, 
+#ifdef EIE_KEYPAD
+              KEY0, KEY1, KEY2, KEY3, KEY4, KEY5, KEY6, KEY7, 
+              KEY8, KEY9, KEY10, KEY11, KEY12, KEY13, KEY14, KEY15,
+#endif /* EIE_KEYPAD */
+              NOBUTTON} ButtonNameType;
+
+#define U8_TOTAL_BUTTONS          (u8)4       /*!< Total number of discrete Buttons in the system */
+#ifdef EIE_KEYPAD
+#define U8_TOTAL_KEYS             (u8)(U8_KEYPAD_ROWS * U8_KEYPAD_COLUMNS) /*!< Keypad keys after the buttons */
+#else
+#define U8_TOTAL_KEYS             (u8)0
+#endif /* EIE_KEYPAD */
+#define U8_BUTTON_INPUTS          (u8)(U8_TOTAL_BUTTONS + U8_TOTAL_KEYS)   /*!< Everything the button API reports */
 
 /*! All buttons on each port must be ORed together here: set to 0 if no buttons on the port */
 #define GPIOA_BUTTONS             (u32)( PA_17_BUTTON0 )
 #define GPIOB_BUTTONS             (u32)( PB_00_BUTTON1 | PB_01_BUTTON2 | PB_02_BUTTON3 )
 
+#define U8_BUTTON_PORTS           (u8)2       /*!< Ports that can have buttons: index 0 = PORTA, 1 = PORTB */
+#define U8_BUTTON_PORT_BITS       (u8)32      /*!< Pins per port in G_au8BspButtonIndex */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+%KEYPAD% Keypad matrix on the blade connector (EIE_KEYPAD builds)
+----------------------------------------------------------------------------------------------------------------------*/
+/* A 4 x 4 key matrix without diodes: each key joins one row to one column.  The rows are
+open drain outputs pulled low one at a time; the columns are inputs with pull-ups, all on 
+PORTA next to each other so one PIO_PDSR read and a shift gives a row's keys.  The blade's
+SPI / UART functions are not available while the keypad is built in. */
+#define U8_KEYPAD_ROWS            (u8)4       /*!< Rows in G_asBspKeypadRows */
+#define U8_KEYPAD_COLUMNS         (u8)4       /*!< Columns starting at U8_KEYPAD_COLUMN_SHIFT */
+#define U8_KEYPAD_COLUMN_SHIFT    (u8)13      /*!< Bit of column 0 on PORTA */
+#define KEYPAD_COLUMN_PINS        (u32)( PA_13_BLADE_MISO | PA_14_BLADE_MOSI | PA_15_BLADE_SCK | PA_16_BLADE_CS )
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+%TIMER% Timer counter inputs (timer.c)
+----------------------------------------------------------------------------------------------------------------------*/
+/* Capture measures the TIOA input of a channel (G_asBspTimerTioaPins).  The quadrature
+decoder takes PHA on TIOA0, PHB on TIOB0 and the index pulse on TIOB1.  TIOA0 is the SD
+socket write protect line, so channel 0 capture and the decoder can't be used with a card. */
+#define TIMER_QUADRATURE_PIOA_PINS (u32)( PA_01_SD_WP | PA_00_TP54 )  /*!< PHA (TIOA0) and PHB (TIOB0), peripheral A */
+#define TIMER_QUADRATURE_INDEX_PIN (u32)( PB_06_TP58 )                /*!< IDX (TIOB1) on PORTB, peripheral A */
+
 /*----------------------------------------------------------------------------------------------------------------------
 %BUZZER% Buzzer Configuration                                                                                                  
 ----------------------------------------------------------------------------------------------------------------------*/
@@ -69,6 +109,35 @@ These definitions correspond to the Channel ID in the PWM periph
 typedef enum {BUZZER1 = AT91C_PWMC_CHID0, BUZZER2 = AT91C_PWMC_CHID1, } BuzzerChannelType;
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+%DEEPSLEEP% Deep sleep (Wait mode) bookkeeping
+----------------------------------------------------------------------------------------------------------------------*/
+/*! 
+@enum BspWakeSourceType
+@brief What ended the last deep sleep.
+*/
+typedef enum {BSP_WAKE_NONE = 0, BSP_WAKE_RTT, BSP_WAKE_BUTTON, BSP_WAKE_OTHER} BspWakeSourceType;
+
+#define U8_BSP_WAKE_SOURCES       (u8)4         /*!< @brief Number of values in BspWakeSourceType */
+
+/*! 
+@struct BspDeepSleepStatsType
+@brief Deep sleep counters and wake up latency kept by SystemSleep() in EIE_DEEP_SLEEP builds.
+
+Latency is from the wake up event (RTT alarm or button edge) until the PLL is 
+running the core at full speed again.
+*/
+typedef struct
+{
+  u32 u32Sleeps;                          /*!< @brief Number of times Wait mode was entered */
+  u32 au32Wakes[U8_BSP_WAKE_SOURCES];     /*!< @brief Wake ups counted per BspWakeSourceType */
+  BspWakeSourceType eLastWakeSource;      /*!< @brief Source of the most recent wake up */
+  u32 u32LastLatencyUs;                   /*!< @brief Wake up latency of the most recent deep sleep */
+  u32 u32MaxLatencyUs;                    /*!< @brief Longest wake up latency seen */
+  u32 u32WakeMarginMs;                    /*!< @brief How early the RTT alarm is set ahead of the deadline */
+} BspDeepSleepStatsType;
+
+
 /***********************************************************************************************************************
 * Constants
 ***********************************************************************************************************************/
@@ -88,6 +157,43 @@ typedef enum {BUZZER1 = AT91C_PWMC_CHID0, BUZZER2 = AT91C_PWMC_CHID1, } BuzzerCh
 Should be 6000 for 48MHz CCLK. */
 #define U32_SYSTICK_COUNT         (u32)(0.001 * (MCK / SYSTICK_DIVIDER) )
 
+/*!@brief SysTick clocks per microsecond (6 at 48MHz), for TimeNowUs() */
+#define U32_SYSTICK_CLOCKS_PER_US (u32)(MCK / SYSTICK_DIVIDER / 1000000)
+
+/*!@brief Longest tickless sleep the 24-bit SysTick reload can count (2796 ms at 6000 counts per ms). */
+#define U32_SYSTICK_MAX_SLEEP_TICKS (u32)(AT91C_NVIC_STICKRELOAD / U32_SYSTICK_COUNT)
+
+/*!@brief SysTick clocks missed each time SystemSleep() stops the counter to reprogram it (about 24 CPU cycles). */
+#define U32_SYSTICK_STOPPED_CLOCKS (u32)3
+
+/* Hardware watchdog timeout (20 ms to 16 s, in steps of 3.9 ms): override with e.g.
+make EXTRA_DEFINES=-DU32_WATCHDOG_TIMEOUT_MS=50.  The WDT keeps counting while the core
+sleeps, so no sleep is longer than half of it; deep sleep needs more than about 160 ms
+of sleep to be worth it, so deep sleep builds keep a long timeout. */
+#ifndef U32_WATCHDOG_TIMEOUT_MS
+#ifdef EIE_DEEP_SLEEP
+#define U32_WATCHDOG_TIMEOUT_MS   (u32)5000                                  /*!< @brief Time without a WATCHDOG_BONE() before the WDT resets the processor */
+#else
+#define U32_WATCHDOG_TIMEOUT_MS   (u32)100                                   /*!< @brief Time without a WATCHDOG_BONE() before the WDT resets the processor */
+#endif /* EIE_DEEP_SLEEP */
+#endif /* U32_WATCHDOG_TIMEOUT_MS */
+#define U32_CLOCK_WAIT_POLLS      (u32)1000000                               /*!< @brief Most PMC_SR reads ClockWait() makes: 4x the 62 ms crystal
+                                                                                  start up at the 8 MHz RC even at 2 cycles a read */
+#define U32_WATCHDOG_MAX_SLEEP_MS (u32)(U32_WATCHDOG_TIMEOUT_MS / 2)         /*!< @brief Longest sleep between watchdog feeds */
+#define U32_WDT_COUNTS            (u32)((U32_WATCHDOG_TIMEOUT_MS * 256) / 1000) /*!< @brief WDV: the WDT counts SLCK / 128 (256 per second) */
+
+/* Deep sleep: build with EIE_DEEP_SLEEP defined (IAR preprocessor defines or 
+make EXTRA_DEFINES=-DEIE_DEEP_SLEEP in gcc_sim) to let SystemSleep() use Wait mode
+for long sleeps.  Time is kept across the sleep by the RTT on the 32kHz slow clock. */
+#define U32_SLCK_VALUE            (u32)32768                                 /*!< @brief Slow clock frequency */
+#define U32_RTT_PRESCALER         (u32)3                                     /*!< @brief RTT counts SLCK / 3 (91.55us), the smallest allowed */
+#define U32_DEEP_SLEEP_MIN_MS     (u32)100                                   /*!< @brief Shortest deep sleep (on top of the wake margin) worth stopping the clocks for */
+#define U32_DEEP_SLEEP_MAX_MS     U32_WATCHDOG_MAX_SLEEP_MS                  /*!< @brief Longest deep sleep: half the watchdog period since the WDT keeps running */
+#define U32_DEEP_SLEEP_MARGIN_MS  (u32)62                                    /*!< @brief First wake margin: crystal (1920 SLCK) + PLLA (63 SLCK) start up */
+
+/*! @brief Converts RTT counts to microseconds */
+#define RTT_TICKS_TO_US(u32Ticks_)  (u32)( ((u64)(u32Ticks_) * U32_RTT_PRESCALER * 1000000) / U32_SLCK_VALUE )
+
 
 /***********************************************************************************************************************
 * Macros
@@ -112,13 +218,17 @@ Should be 6000 for 48MHz CCLK. */
 
 void WatchDogSetup(void);
 void ClockSetup(void);
+void RttSetup(void);
+u32 RttGetValue(void);
 void GpioSetup(void);
 void SysTickSetup(void);
-void SystemSleep(void);
+void SystemSleep(u32 u32Ticks_);
 void PWMSetupAudio(void);
 void PWMAudioSetFrequency(BuzzerChannelType eChannel_, u16 u16Frequency_);
 void PWMAudioOff(BuzzerChannelType eBuzzerChannel_);
 void PWMAudioOn(BuzzerChannelType eBuzzerChannel_);
+
+
 /***********************************************************************************************************************
 !!!!! GPIO pin names
 ***********************************************************************************************************************/
@@ -203,10 +313,11 @@ void PWMAudioOn(BuzzerChannelType eBuzzerChannel_);
 ***********************************************************************************************************************/
 /* Watch Dog Values
 The watchdog oscillator is on the internal 32k RC with a 128 prescaler = 3.9ms / tick.  
-For a minimum 5 second watchdog timeout, the watchdog
-counter must be set at 1280. */
+The counter is set from U32_WATCHDOG_TIMEOUT_MS (1280 for 5 seconds).  The RC can run
+up to 44kHz, so the real timeout can be as short as 3/4 of that: still more than
+U32_WATCHDOG_MAX_SLEEP_MS. */
 
-#define WDT_MR_INIT      (u32)0x1FFF6500
+#define WDT_MR_INIT      (u32)(0x1FFF6000 | U32_WDT_COUNTS)
 /*
     31 [0] Reserved
     30 [0] "
@@ -233,20 +344,7 @@ counter must be set at 1280. */
     13 [1] WDRSTEN Watchdog reset enable on
     12 [0] WDFIEN Watchdog fault interrupt enable off
 
-    11 [0] WDV Watchdog counter value: 0x500 = 1280 x (128 x 1/32768) = 5 seconds
-    10 [1] "
-    09 [0] "
-    08 [1] "
-
-    07 [0] "
-    06 [0] "
-    05 [0] "
-    04 [0] "
-
-    03 [0] "
-    02 [0] "
-    01 [0] "
-    00 [0] "
+    11-00 WDV Watchdog counter value: U32_WDT_COUNTS x (128 x 1/32768) = U32_WATCHDOG_TIMEOUT_MS
 */
 
 
@@ -488,6 +586,84 @@ Since we want PLLACK at 96 MHz:
 */
 
 
+/* Real-time Timer: keeps time through deep sleep (see RttSetup()).  It runs from SLCK
+in every power mode so it needs no peripheral clock. */
+#define RTT_MR_INIT (u32)0x00040003
+/*
+    31:20 Reserved
+
+    19 [0] Reserved
+    18 [1] RTTRST Restart the counter with the new prescaler
+    17 [0] RTTINCIEN Increment interrupt off
+    16 [0] ALMIEN Alarm interrupt off (the alarm wakes the PMC through PMC_FSMR instead)
+
+    15 [0] RTPRES prescaler = 3: one count every 3 SLCK = 91.55us
+    14 [0] "
+    13 [0] "
+    12 [0] "
+
+    11 [0] "
+    10 [0] "
+    09 [0] "
+    08 [0] "
+
+    07 [0] "
+    06 [0] "
+    05 [0] "
+    04 [0] "
+
+    03 [0] "
+    02 [0] "
+    01 [1] "
+    00 [1] "
+*/
+
+
+/* Fast startup inputs: the buttons reach the PMC through their WKUP pins */
+#define PMC_FSTT_BUTTON0        (u32)0x00000040   /* PA_17_BUTTON0 = WKUP6 */
+#define PMC_FSTT_BUTTON1        (u32)0x00000800   /* PB_00_BUTTON1 = WKUP11 */
+#define PMC_FSTT_BUTTON2        (u32)0x00001000   /* PB_01_BUTTON2 = WKUP12 */
+#define PMC_FSTT_BUTTON3        (u32)0x00002000   /* PB_02_BUTTON3 = WKUP13 */
+#define PMC_FSMR_BUTTON_INPUTS  (u32)(PMC_FSTT_BUTTON0 | PMC_FSTT_BUTTON1 | PMC_FSTT_BUTTON2 | PMC_FSTT_BUTTON3)
+
+/* Fast Startup Mode Register loaded just before entering Wait mode.  PMC_FSPR is loaded
+at the same time so each button wakes on a change from its current level. */
+#define PMC_FSMR_WAIT_INIT (u32)0x00113840
+/*
+    31:24 Reserved
+
+    23 [0] Reserved
+    22 [0] "
+    21 [0] "
+    20 [1] LPM WFE enters Wait mode
+
+    19 [0] Reserved
+    18 [0] "
+    17 [0] RTCAL RTC alarm does not wake up
+    16 [1] RTTAL RTT alarm wakes up
+
+    15 [0] FSTT15
+    14 [0] FSTT14
+    13 [1] FSTT13 PB_02_BUTTON3
+    12 [1] FSTT12 PB_01_BUTTON2
+
+    11 [1] FSTT11 PB_00_BUTTON1
+    10 [0] FSTT10
+    09 [0] FSTT9
+    08 [0] FSTT8
+
+    07 [0] FSTT7
+    06 [1] FSTT6 PA_17_BUTTON0
+    05 [0] FSTT5
+    04 [0] FSTT4
+
+    03 [0] FSTT3
+    02 [0] FSTT2
+    01 [0] FSTT1
+    00 [0] FSTT0
+*/
+
+
 /***********************************************************************************************************************
 ##### GPIO setup values
 ***********************************************************************************************************************/
@@ -1860,8 +2036,8 @@ In general, the period is 6000000 / frequency and duty is always period / 2.
 
 #define PWM_CPRD0_INIT  (u32)6000
 #define PWM_CPRD1_INIT  (u32)1500
-#define PWM_CDTY0_INIT  (u32)(PWM_CPRD0_INIT << 1)
-#define PWM_CDTY1_INIT  (u32)(PWM_CPRD1_INIT << 1)
+#define PWM_CDTY0_INIT  (u32)(PWM_CPRD0_INIT >> 1)
+#define PWM_CDTY1_INIT  (u32)(PWM_CPRD1_INIT >> 1)
 
 
 
@@ -33,11 +33,13 @@ PUBLIC FUNCTIONS
 PROTECTED FUNCTIONS
 - void UserApp1Initialize(void)
 - void UserApp1RunActiveState(void)
+- bool UserApp1IsIdle(void)
 
 
 **********************************************************************************************************************/
 
 #include "configuration.h"
+#include "music.h"
 
 /***********************************************************************************************************************
 Global variable definitions with scope across entire project.
@@ -50,6 +52,22 @@ volatile u32 G_u32UserApp1Flags;                          /*!< @brief Global sta
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
 extern volatile u32 G_u32SystemFlags;                     /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1ms;                   /*!< @brief From main.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void UserApp1SongDone(void* pvContext_);
+static void UserApp1ToggleFor(LedNameType eLed_, u8 u8Count_, u8* pu8Toggled_);
+static void UserApp1ClockTick(void* pvContext_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void UserApp1SM_Idle(void);    
+static void UserApp1SM_Error(void);         
 
 
 /***********************************************************************************************************************
@@ -59,6 +77,50 @@ Variable names shall start with "UserApp1_" and be declared as static.
 static fnCode_type UserApp1_StateMachine;                 /*!< @brief The state machine function pointer */
 //static u32 UserApp1_u32Timeout;                         /*!< @brief Timeout counter used across states */
 
+/*! @brief PWM_LCD_Test() keyframes: ramp up, hold, back to off */
+static const LedKeyframeType UserApp1_asLcdFade[] =
+{
+/*  LEDs                 Brightness             Easing           ms */
+  {LED_MASK(LCD_BLUE),   U8_LED_BRIGHTNESS_MAX, LED_EASE_LINEAR, 800},
+  {LED_MASK(LCD_BLUE),   U8_LED_BRIGHTNESS_MAX, LED_EASE_STEP,   40},
+  {LED_MASK(LCD_BLUE),   0,                     LED_EASE_STEP,   0}
+};
+
+/*! @brief PWM_LCD_Test() sequence: a few fades, then the backlight is left off so the
+TC2 LED PWM stops and the idle demo can reach deep sleep */
+static const LedSequenceType UserApp1_sLcdFade = 
+  {UserApp1_asLcdFade, (u8)(sizeof(UserApp1_asLcdFade) / sizeof(LedKeyframeType)), U8_USERAPP1_LCD_FADES, NULL, NULL};
+
+/*! @brief PWM_Buttons_Test() melody on BUZZER1: the first line of Ode to Joy */
+static const u16 UserApp1_au16MelodyNotes[]         = {E4, E4, F4, G4, G4, F4, E4, D4, C4, C4, D4, E4, E4,      D4, D4};
+static const u16 UserApp1_au16MelodyDurations[]     = {QN, QN, QN, QN, QN, QN, QN, QN, QN, QN, QN, QN, QN + EN, EN, HN};
+static const u16 UserApp1_au16MelodyArticulations[] = {RT, RT, RT, RT, RT, RT, RT, RT, RT, RT, RT, RT, HT,      ST, RT};
+static const AudioSongType UserApp1_sMelody =
+  {UserApp1_au16MelodyNotes, UserApp1_au16MelodyDurations, UserApp1_au16MelodyArticulations,
+   (u16)(sizeof(UserApp1_au16MelodyNotes) / sizeof(u16))};
+
+/*! @brief PWM_Buttons_Test() bass on BUZZER2, the same length as the melody */
+static const u16 UserApp1_au16BassNotes[]         = {C3, E3, G3, G3, A3, F3, G3, NO};
+static const u16 UserApp1_au16BassDurations[]     = {HN, HN, HN, HN, HN, HN, HN, HN};
+static const u16 UserApp1_au16BassArticulations[] = {RT, RT, HT, RT, RT, RT, RT, RT};
+static const AudioSongType UserApp1_sBass =
+  {UserApp1_au16BassNotes, UserApp1_au16BassDurations, UserApp1_au16BassArticulations,
+   (u16)(sizeof(UserApp1_au16BassNotes) / sizeof(u16))};
+
+/*! @brief PWM_Buttons_Test() tempos (percent), stepped through by BUTTON2 */
+static const u16 UserApp1_au16Tempos[] = {100, 150, 75};
+static u8 UserApp1_u8Tempo;                               /*!< @brief Index of the current tempo */
+static LedNameType UserApp1_eSongLed = PURPLE;            /*!< @brief Toggled each time the melody ends */
+static u8 UserApp1_u8SongEnds;                            /*!< @brief Melody ends counted by UserApp1SongDone() */
+static u8 UserApp1_u8SongToggles;                         /*!< @brief Melody ends UserApp1SM_Idle has toggled the LED for */
+
+/* The LED driver's staging is not interrupt safe, so the TC1 callback only counts */
+static LedNameType UserApp1_eTimerLed = CYAN;             /*!< @brief Toggled for each TC1 interrupt (TimerTest()) */
+static volatile u8 UserApp1_u8TimerExpiries;              /*!< @brief TC1 interrupts counted by UserApp1TimerCallback() */
+static u8 UserApp1_u8TimerToggles;                        /*!< @brief TC1 interrupts UserApp1SM_Idle has toggled the LED for */
+
+static TimerSoftType UserApp1_sClockTimer;                /*!< @brief Expires on each U32_USERAPP1_CLOCK_MS boundary for BinaryClock() */
+
 
 /**********************************************************************************************************************
 Function Definitions
@@ -68,27 +130,32 @@ Function Definitions
 /*! @publicsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn void UserApp1TimerCallback(void)
+@fn void UserApp1TimerCallback(void* pvContext_)
 
-@brief Toggles LED at Timer1 interrupt.
+@brief Counts a Timer1 interrupt; UserApp1SM_Idle toggles the LED for it.
+
+The LED functions are only safe from tasks, so the interrupt leaves the toggle to the
+task (the interrupt wakes the system, so the task runs on the next tick).
 
 Requires:
 - Automatically called from Timer Interrupt
 
+@param pvContext_ is unused
+
 Headcannon: 
 
 - CYAN is summoned to or from MIDICITY
 
 Promises:
 
-- CYAN LED is toggled.
+- UserApp1_u8TimerExpiries is incremented
 
 */
 
- void UserApp1TimerCallback(void)
+ void UserApp1TimerCallback(void* pvContext_)
 {
-  
-LedToggle(CYAN);
+  (void)pvContext_;
+  UserApp1_u8TimerExpiries++;
 
 } /* end UserApp1TimerCallback */
 
@@ -100,86 +167,69 @@ LedToggle(CYAN);
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn PWM_LCD_Test(void)
 
-@brief Bit-bang LCD fading test
+@brief LCD fading test: starts UserApp1_sLcdFade, which ramps the blue backlight 
+up over 800ms, holds it for 40ms and starts again from off, U8_USERAPP1_LCD_FADES
+times.
+
+The LED driver plays the sequence, so this only needs to be called once.
 
 Requires:
-- PWM driver properly initialized
+- LED driver initialized
 - No other tasks using LCD
 
 Promises:
-- Clean PWM Buzzing
+- LCD_BLUE fades up U8_USERAPP1_LCD_FADES times and is then left off
 
 */
 
-void PWM_LCD_Test(void){
-   
-   static u16 u16LCDCycleCount = 0;
-   static u8 u8CurrentLCDRate = LED_PWM_0;
-   
-
-
- /* Blue LCD LED Backlight cycling logic */
- 
- 
- u16LCDCycleCount++;
- 
-/* Time delay here should always be a multiple of 20 or you'll suffer the most
-horrific, terrible, no go, very bad jitter. */
- if(u16LCDCycleCount == (u16)40)
- {
-   /* Handle Special Case of LED_PWM_100 (int value appears to be 20)*/
-   if(u8CurrentLCDRate == 20)
-   {
-     u8CurrentLCDRate = LED_PWM_0;
-   u16LCDCycleCount = 0;
-   }
-   
-   /* Otherwise, enum type abuse tolerable */
-   else{
-   LedPWM(LCD_BLUE, ++u8CurrentLCDRate);
-   u16LCDCycleCount = 0;
-   }
-   
- }
+void PWM_LCD_Test(void)
+{
+  LedAnimationStart(&UserApp1_sLcdFade);
 
- } /* end PWM_LCD_Test */
+} /* end PWM_LCD_Test */
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn PWM_Buttons(void)
 
-@brief Crude PWM API test
+@brief Music sequencer test: BUTTON1 plays UserApp1_sMelody on BUZZER1 and
+UserApp1_sBass on BUZZER2 in a loop, BUTTON2 steps through UserApp1_au16Tempos and
+BUTTON3 stops both.
+
+The audio driver plays the songs, so this only reads the buttons.
 
 Requires:
 - Same requirements as ButtonTest.
-- PWM driver properly initialized
-- No other tasks using BUTTON1, BUTTON2, BUTTON3, or any Buzzer
+- Audio driver initialized
+- No other tasks using BUTTON1, BUTTON2, BUTTON3, PURPLE or any Buzzer
 
 Promises:
-- Clean PWM Buzzing
+- Two-part music; PURPLE toggles each time the melody starts again
 
 */
 
 void PWM_Buttons_Test(void){
    
- /* BUZZER1 is on if BUTTON1 was pressed */
+  /* Both parts start together so they stay in step */
   if(WasButtonPressed(BUTTON1))
   {
     ButtonAcknowledge(BUTTON1);
-    PWMAudioOn(BUZZER1);
+    AudioPlay(BUZZER1, &UserApp1_sMelody, TRUE, UserApp1SongDone, NULL);
+    AudioPlay(BUZZER2, &UserApp1_sBass, TRUE, NULL, NULL);
   }
  
-  /* BUZZER2 is on if BUTTON2 was pressed */
+  /* Next tempo */
   if(WasButtonPressed(BUTTON2))
   {
     ButtonAcknowledge(BUTTON2);
-    PWMAudioOn(BUZZER2);
+    UserApp1_u8Tempo = (u8)((UserApp1_u8Tempo + 1) % (sizeof(UserApp1_au16Tempos) / sizeof(u16)));
+    AudioSetTempo(UserApp1_au16Tempos[UserApp1_u8Tempo]);
   }
   
   /* Both buzzers off if BUTTON3 was pressed */
   if(WasButtonPressed(BUTTON3))
   {
     ButtonAcknowledge(BUTTON3);
-    PWMAudioOff(BUZZER1);
-    PWMAudioOff(BUZZER2);
+    AudioStop(BUZZER1);
+    AudioStop(BUZZER2);
   }
  } /* end PWM_Buttons_Test */
  
@@ -236,15 +286,8 @@ Requires:
  Button Driver properly initialized.
 
 Promises:
-- Hardfaulting around return from TimerStart, Watchdogbone, somewhere in
-the ButtonDriver, and seemingly random other places (Due to TC-interrupt happening 
-reguardless of what the main loop is doing). Lots of frustration.
-
-Realization: Callback assignment never works as interrupt code isn't able to
-see the function pointer. No implementation of the working interrupt module code
-is avalible in any online respository, even the final project branches I've checked.
- Better to just ignore the problem as a solution is not needed to understand the
- fundamental ideas behind TCs and their uses. 
+- CYAN is toggled every 125ms for the TC1 interrupt (counted by UserApp1TimerCallback())
+  while PURPLE blinks at 4Hz from the LED task
 */
 void TimerTest(void)
 {
@@ -256,13 +299,11 @@ void TimerTest(void)
   LedOff(PURPLE);
   LedBlink(PURPLE,LED_4HZ);
   
-  /* Setup Timer1 to clock out 125ms periods. 125ms / 2,66666us = 46875 */
-  
-  
-  //TimerAssignCallback(TIMER0_CHANNEL1, UserApp1TimerCallback);
+  /* Setup Timer1 to clock out 125ms periods */
+  TimerAssignCallback(TIMER0_CHANNEL1, UserApp1TimerCallback, NULL);
  
-  // TimerStop(TIMER0_CHANNEL1);
-  TimerSet(TIMER0_CHANNEL1, 46875);
+  TimerStop(TIMER0_CHANNEL1);
+  TimerSetPeriodUs(TIMER0_CHANNEL1, 125000, TIMER_PERIODIC);
   TimerStart(TIMER0_CHANNEL1);
   
       
@@ -274,6 +315,10 @@ void TimerTest(void)
 @brief Abstraction of the Binary Clock project found in an archive of
 the online supplementary materials for the EIE program
 
+The count is the number of U32_USERAPP1_CLOCK_MS periods since start up (mod 16),
+taken from G_u32SystemTime1ms, so it is right however late or often this is called.
+UserApp1ClockTick() calls it on each period boundary.
+
 Requires:
 - WHITE,PURPLE, and CYAN leds aren't being used elsewhere;
 - GPIO configured
@@ -281,12 +326,8 @@ Requires:
 */
 void BinaryClock(void)
 {
-
-
-  static u16 u16BlinkCount = 0;
-  static u8 u8BinaryCounter = 0;
-
-  u16BlinkCount++;
+  u8 u8BinaryCounter = (u8)((G_u32SystemTime1ms / U32_USERAPP1_CLOCK_MS) & 0x0F);
+  u32 u32BinaryLeds;
 
 /* All discrete LEDs to off 
   LedOff(WHITE);
@@ -305,61 +346,33 @@ void BinaryClock(void)
   LedOn(LCD_BLUE);
 */
 
-  /* 500ms check and reset */
-  if(u16BlinkCount == 500)
-    {
-      u16BlinkCount = 0;
-      
-      /* Binary counter check and reset at 16 */
-      if ( ++u8BinaryCounter == 16)
-      {
-        
-        u8BinaryCounter = 0;
-      }
-      
-      //LedToggle(PURPLE);
-    }
-  
      /* Parse the current count to set the LEDs.  
       RED is bit 0, ORANGE is bit 1, 
       YELLOW is bit 2, GREEN is bit 3. */
-    
+    u32BinaryLeds = 0;
     if(u8BinaryCounter & 0x01)
     {
-      LedOn(RED);
-    }
-    else
-    {
-      LedOff(RED);
+      u32BinaryLeds |= LED_MASK(RED);
     }
 
     if(u8BinaryCounter & 0x02)
     {
-      LedOn(ORANGE);
-    }
-    else
-    {
-      LedOff(ORANGE);
+      u32BinaryLeds |= LED_MASK(ORANGE);
     }
 
     if(u8BinaryCounter & 0x04)
     {
-      LedOn(YELLOW);
-    }
-    else
-    {
-      LedOff(YELLOW);
+      u32BinaryLeds |= LED_MASK(YELLOW);
     }
 
     if(u8BinaryCounter & 0x08)
     {
-      LedOn(GREEN);
-    }
-    else
-    {
-      LedOff(GREEN);
+      u32BinaryLeds |= LED_MASK(GREEN);
     }
 
+    /* All four change together on the next LedCommit() */
+    LedSetMask(LED_MASK(RED) | LED_MASK(ORANGE) | LED_MASK(YELLOW) | LED_MASK(GREEN), u32BinaryLeds);
+
 } /* end BinaryClock */
 /*!--------------------------------------------------------------------------------------------------------------------
 @fn void UserApp1Initialize(void)
@@ -377,7 +390,7 @@ Requires:
 - NONE
 
 Promises:
-- NONE
+- UserApp1_sClockTimer is running
 
 */
 void UserApp1Initialize(void)
@@ -386,16 +399,17 @@ void UserApp1Initialize(void)
 
   /* If good initialization, set state to Idle */
   
-  /*Set up for PWM_Buttons_Test */
-  PWMAudioSetFrequency(BUZZER1, 1000);
-  PWMAudioSetFrequency(BUZZER2, 200);
-
   /*Bit-smashing, bashing, banging, hacking, spraying, etc initialization */
   
   LedOff(LCD_RED);
   LedOff(LCD_GREEN);
   LedOff(LCD_BLUE);
   LedPWM(LCD_BLUE, LED_PWM_0);
+  PWM_LCD_Test();
+
+  /* The binary clock runs from the timer wheel, so the task itself has nothing to do each tick */
+  TimerSoftCreate(&UserApp1_sClockTimer, U32_USERAPP1_CLOCK_MS, TIMER_ONE_SHOT, UserApp1ClockTick, NULL);
+  UserApp1ClockTick(NULL);
   
   if( 1 )
   {
@@ -432,10 +446,91 @@ void UserApp1RunActiveState(void)
 } /* end UserApp1RunActiveState */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool UserApp1IsIdle(void)
+
+@brief Reports whether the task has any work this tick (used by the main loop scheduler).
+
+The binary clock is stepped by the Timer task, so the task sleeps between state changes.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE while the state machine is in UserApp1SM_Idle with no LED toggle
+  waiting
+
+*/
+bool UserApp1IsIdle(void)
+{
+  return( (bool)( (UserApp1_StateMachine == UserApp1SM_Idle) &&
+                  (UserApp1_u8TimerToggles == UserApp1_u8TimerExpiries) &&
+                  (UserApp1_u8SongToggles == UserApp1_u8SongEnds) ) );
+
+} /* end UserApp1IsIdle() */
+
+
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UserApp1SongDone(void* pvContext_)
+
+@brief Called from the audio task each time PWM_Buttons_Test()'s melody ends; counts
+the end for UserApp1SM_Idle, as UserApp1TimerCallback() does.
+
+@param pvContext_ is unused
+*/
+static void UserApp1SongDone(void* pvContext_)
+{
+  (void)pvContext_;
+  UserApp1_u8SongEnds++;
+
+} /* end UserApp1SongDone() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UserApp1ToggleFor(LedNameType eLed_, u8 u8Count_, u8* pu8Toggled_)
+
+@brief Toggles an LED once for each event counted since the last call.
+
+Requires:
+@param eLed_ is the LED to toggle
+@param u8Count_ is the event count (it may be incremented by an interrupt)
+@param pu8Toggled_ points to the count already toggled for
+
+Promises:
+- eLed_ is toggled if an odd number of events came in; *pu8Toggled_ = u8Count_
+
+*/
+static void UserApp1ToggleFor(LedNameType eLed_, u8 u8Count_, u8* pu8Toggled_)
+{
+  if( (u8)(u8Count_ - *pu8Toggled_) & 0x01 )
+  {
+    LedToggle(eLed_);
+  }
+  *pu8Toggled_ = u8Count_;
+
+} /* end UserApp1ToggleFor() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void UserApp1ClockTick(void* pvContext_)
+
+@brief Shows the binary clock and starts UserApp1_sClockTimer to the next
+U32_USERAPP1_CLOCK_MS boundary (called from the timer task when it expires).
+
+@param pvContext_ is unused
+*/
+static void UserApp1ClockTick(void* pvContext_)
+{
+  (void)pvContext_;
+  BinaryClock();
+  TimerSoftRestart(&UserApp1_sClockTimer, U32_USERAPP1_CLOCK_MS - (G_u32SystemTime1ms % U32_USERAPP1_CLOCK_MS));
+
+} /* end UserApp1ClockTick() */
+
 
 /**********************************************************************************************************************
 State Machine Function Definitions
@@ -444,16 +539,16 @@ State Machine Function Definitions
 /*!-------------------------------------------------------------------------------------------------------------------
 @fn static void UserApp1SM_Idle(void)
 
-@brief What does this function do?
+@brief Checks in and toggles the LEDs for the interrupt and audio callbacks.
 */
 static void UserApp1SM_Idle(void)
 {
+  MainTaskCheckIn();
 
-  BinaryClock();
-  PWM_LCD_Test();
+  /* LED changes for the callbacks, which only count */
+  UserApp1ToggleFor(UserApp1_eTimerLed, UserApp1_u8TimerExpiries, &UserApp1_u8TimerToggles);
+  UserApp1ToggleFor(UserApp1_eSongLed, UserApp1_u8SongEnds, &UserApp1_u8SongToggles);
 
- 
- 
 } /* end UserApp1SM_Idle() */
     
 
@@ -37,29 +37,20 @@ Function Declarations
 /*--------------------------------------------------------------------------------------------------------------------*/
 void UserApp1Initialize(void);
 void UserApp1RunActiveState(void);
+bool UserApp1IsIdle(void);
 void TimerTest(void);
-void UserApp1TimerCallback(void);
+void UserApp1TimerCallback(void* pvContext_);
 void ButtonTest(void);
 void BinaryClock(void);
 void PWM_Buttons_Test(void);
 void PWM_LCD_Test(void);
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-
-
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
-static void UserApp1SM_Idle(void);    
-static void UserApp1SM_Error(void);         
-
-
 
 /**********************************************************************************************************************
 Constants / Definitions
 **********************************************************************************************************************/
+#define U32_USERAPP1_CLOCK_MS       (u32)500      /*!< @brief BinaryClock() count period */
+#define U8_USERAPP1_LCD_FADES       (u8)3         /*!< @brief Times PWM_LCD_Test() fades the backlight up */
 
 
 
@@ -52,6 +52,13 @@ volatile u32 G_u32UserApp2Flags;                          /*!< @brief Global sta
 extern volatile u32 G_u32SystemFlags;                     /*!< @brief From main.c */
 
 
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void UserApp2SM_Idle(void);    
+static void UserApp2SM_Error(void);         
+
+
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "UserApp2_" and be declared as static.
@@ -40,18 +40,6 @@ void UserApp2Initialize(void);
 
 void UserApp2RunActiveState(void);
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-
-
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
-static void UserApp2SM_Idle(void);    
-static void UserApp2SM_Error(void);         
-
-
 
 /**********************************************************************************************************************
 Constants / Definitions
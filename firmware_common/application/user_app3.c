@@ -55,6 +55,13 @@ extern volatile u32 G_u32SystemFlags;                     /*!< @brief From main.
 extern volatile u32 G_u32ApplicationFlags;                /*!< @brief From main.c */
 
 
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void UserApp3SM_Idle(void);    
+static void UserApp3SM_Error(void);         
+
+
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "UserApp3_<type>" and be declared as static.
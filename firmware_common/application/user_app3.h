@@ -39,19 +39,6 @@ void UserApp3Initialize(void);
 void UserApp3RunActiveState(void);
 
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-
-
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
-static void UserApp3SM_Idle(void);    
-static void UserApp3SM_Error(void);         
-
-
-
 /**********************************************************************************************************************
 Constants / Definitions
 **********************************************************************************************************************/
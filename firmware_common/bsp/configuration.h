@@ -35,9 +35,8 @@ Includes
 #include "exceptions.h"
 #include "interrupts.h"
 #include "core_cm3.h"
-#include "main.h"
 #include "typedefs.h"
-#include "utilities.h"
+#include "main.h"
 
 /* EIEF1-PCB-01 specific header files */
 #ifdef EIE1
@@ -53,10 +52,28 @@ Includes
 #endif /* MPGL2_R01 */
 #endif /* MPGL2 */
 
+/* Utilities use the board's clock definitions */
+#include "utilities.h"
+
 /* Common driver header files */
+#include "audio.h"
 #include "buttons.h"
+#include "debug.h"
+#include "fault.h"
+#include "keypad.h"
 #include "leds.h" 
+#include "log.h"
 #include "timer.h"
+#include "trace.h"
+#include "twi.h"
+
+/* Drivers built on the ones above */
+#include "lcd.h"
+
+/* Host simulation build (firmware_ascii/gcc_sim) */
+#ifdef EIE_SIM
+#include "sim.h"
+#endif /* EIE_SIM */
 
 
 /* Common application header files */
@@ -32,21 +32,28 @@ typedef char CHAR;              /* Signed 8-bits */
 typedef unsigned char UCHAR;    /* Unsigned 8-bits */
 typedef short SHORT;            /* Signed 16-bits */
 typedef unsigned short USHORT;  /* Unsigned 16-bits */
+#ifdef __LP64__
+/* Host simulation builds on 64-bit PCs where long is 64 bits */
+typedef int LONG;               /* Signed 32-bits */
+typedef unsigned int ULONG;     /* Unsigned 32-bits */
+#else
 typedef long LONG;              /* Signed 32-bits */
 typedef unsigned long ULONG;    /* Unsigned 32-bits */
+#endif /* __LP64__ */
 typedef unsigned char BOOL;     /* Boolean */
 /*! @endcond */
 
 
 /* Standard Peripheral Library old types (maintained for legacy purpose) */
-typedef long s32;           /*!< @brief EiE standard variable type name for signed 32-bit variables */ 
+typedef LONG s32;           /*!< @brief EiE standard variable type name for signed 32-bit variables */ 
 typedef short s16;          /*!< @brief EiE standard variable type name for signed 16-bit variables */
 typedef signed char  s8;    /*!< @brief EiE standard variable type name for signed  8-bit variables */
 
-typedef const long sc32;    /*!< @brief EiE standard variable type name for read-only signed 32-bit variables */
+typedef const LONG sc32;    /*!< @brief EiE standard variable type name for read-only signed 32-bit variables */
 typedef const short sc16;   /*!< @brief EiE standard variable type name for read-only signed 16-bit variables */
 typedef const char sc8;     /*!< @brief EiE standard variable type name for read-only signed  8-bit variables */
 
+typedef unsigned long long u64; /*!< @brief EiE standard variable type name for unsigned 64-bit variables */
 typedef ULONG  u32;         /*!< @brief EiE standard variable type name for unsigned 32-bit variables */
 typedef USHORT u16;         /*!< @brief EiE standard variable type name for unsigned 16-bit variables */
 typedef UCHAR  u8;          /*!< @brief EiE standard variable type name for unsigned  8-bit variables */
@@ -61,6 +68,9 @@ typedef void(*fnCode_type)(void);      /*!< @brief EiE standard variable type na
 typedef enum {FALSE = 0, TRUE = !FALSE} bool;  /*!< @brief EiE standard variable type name for boolean */
 #endif
 
+typedef bool(*fnBoolCode_type)(void);  /*!< @brief EiE standard variable type name for function pointer with no arguments returning bool */
+typedef u32(*fnU32Code_type)(void);    /*!< @brief EiE standard variable type name for function pointer with no arguments returning u32 */
+
 /*! 
 @enum PortOffsetType
 @brief Processor-specific port address offsets.
@@ -119,6 +119,9 @@
 #define CoreDebug_DEMCR_TRCENA (1 << 24)      /*!< DEMCR TRCENA enable          */
 #define ITM_TCR_ITMENA              1         /*!< ITM enable                   */
 
+/* Data Watchpoint and Trace */
+#define DWT_CTRL_CYCCNTENA     (1 << 0)       /*!< DWT_CTRL cycle counter enable */
+
 
 
 
@@ -256,10 +259,25 @@ typedef struct
 } CoreDebug_Type;
 
 
+/* Data Watchpoint and Trace unit (profiling counters) */
+typedef struct
+{
+  __IO uint32_t CTRL;                         /*!< DWT Control Register                            */
+  __IO uint32_t CYCCNT;                       /*!< DWT Cycle Count Register                        */
+  __IO uint32_t CPICNT;                       /*!< DWT CPI Count Register                          */
+  __IO uint32_t EXCCNT;                       /*!< DWT Exception Overhead Count Register           */
+  __IO uint32_t SLEEPCNT;                     /*!< DWT Sleep Count Register                        */
+  __IO uint32_t LSUCNT;                       /*!< DWT LSU Count Register                          */
+  __IO uint32_t FOLDCNT;                      /*!< DWT Folded-instruction Count Register           */
+  __I  uint32_t PCSR;                         /*!< DWT Program Counter Sample Register             */
+} DWT_Type;
+
+
 /* Memory mapping of Cortex-M3 Hardware */
 #define SCS_BASE            (0xE000E000)                              /*!< System Control Space Base Address    */
 #define ITM_BASE            (0xE0000000)                              /*!< ITM Base Address                     */
 #define CoreDebug_BASE      (0xE000EDF0)                              /*!< Core Debug Base Address              */
+#define DWT_BASE            (0xE0001000)                              /*!< DWT Base Address                     */
 #define SysTick_BASE        (SCS_BASE +  0x0010)                      /*!< SysTick Base Address                 */
 #define NVIC_BASE           (SCS_BASE +  0x0100)                      /*!< NVIC Base Address                    */
 #define SCB_BASE            (SCS_BASE +  0x0D00)                      /*!< System Control Block Base Address    */
@@ -270,6 +288,7 @@ typedef struct
 #define NVIC                ((NVIC_Type *)          NVIC_BASE)        /*!< NVIC configuration struct            */
 #define ITM                 ((ITM_Type *)           ITM_BASE)         /*!< ITM configuration struct             */
 #define CoreDebug           ((CoreDebug_Type *)     CoreDebug_BASE)   /*!< Core Debug configuration struct      */
+#define DWT                 ((DWT_Type *)           DWT_BASE)         /*!< DWT configuration struct             */
 
 #if defined (__MPU_PRESENT) && (__MPU_PRESENT == 1)
   #define MPU_BASE          (SCS_BASE +  0x0D90)                      /*!< Memory Protection Unit               */
@@ -793,6 +812,31 @@ static void __set_FPSCR(uint32_t fpscr)
 
 #endif                 // __VER__ >= 6020000
 
+#elif (defined (EIE_SIM)) /*------------------ Host simulation ------------------*/
+/* Host PC build: core instructions that affect timing or interrupts are
+   provided by the simulator in firmware_common/sim/sim.c */
+
+static __INLINE void __NOP(void)                  { }
+static __INLINE void __enable_fault_irq(void)     { }
+static __INLINE void __disable_fault_irq(void)    { }
+static __INLINE void __SEV(void)                  { }
+static __INLINE void __ISB(void)                  { }
+static __INLINE void __DMB(void)                  { }
+static __INLINE void __CLREX(void)                { }
+static __INLINE uint32_t __CLZ(uint32_t value)    { return value ? (uint32_t)__builtin_clz(value) : 32; }
+
+extern void __enable_irq(void);
+extern void __disable_irq(void);
+extern void __WFI(void);
+extern void __WFE(void);
+extern void __DSB(void);
+extern uint32_t __get_PRIMASK(void);
+extern void __set_PRIMASK(uint32_t priMask);
+
+#define __enable_interrupt    __enable_irq
+#define __disable_interrupt   __disable_irq
+#define __no_operation        __NOP
+
 #elif (defined (__GNUC__)) /*------------------ GNU Compiler ---------------------*/
 /* GNU gcc specific functions */
 
@@ -810,6 +854,7 @@ static __INLINE void __ISB(arg)                   { __ASM volatile ("isb");   }
 static __INLINE void __DSB(arg)                   { __ASM volatile ("dsb");   }
 static __INLINE void __DMB(arg)                   { __ASM volatile ("dmb");   }
 static __INLINE void __CLREX()                    { __ASM volatile ("clrex"); }
+static __INLINE uint32_t __CLZ(uint32_t value)    { uint32_t result; __ASM volatile ("clz %0, %1" : "=r" (result) : "r" (value)); return(result); }
 
 
 /**
@@ -0,0 +1,646 @@
+/*!**********************************************************************************************************************
+@file audio.c
+@brief Music sequencer: plays music.h note tables on BUZZER1 and BUZZER2 from an interrupt.
+
+Each buzzer is a voice that plays an AudioSongType (note, duration and articulation
+arrays, normally const) on its own, once or looping.  The note changes are made in
+PWM_IrqHandler() by a tick on PWM channel 2, so the tempo does not depend on how busy
+the main loop is and playing costs the loop nothing.  The tick's period is set to end
+at the next note event of either voice rather than every ms, so the system still
+sleeps through long notes.
+
+The period of the tick that is running was chosen at the interrupt before it (the
+hardware loads PWMC_CPRDUPDR at the end of a period), so each interrupt reads back the
+period that just started and works out the one after it.  A note started at one
+interrupt can end before that, so after an interrupt with an event due at the end of
+the running period the next period is 1 ms and the real plan is made then.  A song
+started while the tick runs starts at the end of the current period (at most
+U32_AUDIO_MAX_PERIOD_MS).
+
+Note times are the song's ms scaled by 100 / the tempo percent (AudioSetTempo()) when
+the note starts, with the remainder carried to the next note so the tempo does not
+drift.  When a song reaches its end the voice's callback is called from the audio task.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- U8_AUDIO_VOICES, U16_AUDIO_DEFAULT_TEMPO, U16_AUDIO_MIN_FREQUENCY
+
+TYPES
+- AudioCallbackType
+- AudioSongType
+
+PUBLIC FUNCTIONS
+- bool AudioPlay(BuzzerChannelType eBuzzer_, const AudioSongType* psSong_, bool bLoop_,
+                 AudioCallbackType pfnDone_, void* pvContext_)
+- void AudioStop(BuzzerChannelType eBuzzer_)
+- bool AudioIsPlaying(BuzzerChannelType eBuzzer_)
+- bool AudioSetTempo(u16 u16Percent_)
+
+PROTECTED FUNCTIONS
+- void AudioInitialize(void)
+- void AudioRunActiveState(void)
+- bool AudioIsIdle(void)
+- void PWM_IrqHandler(void)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+#include "music.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Audio"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static AudioVoiceType* AudioVoice(BuzzerChannelType eBuzzer_);
+static void AudioNoteStart(AudioVoiceType* psVoice_, u32 u32Start_);
+static void AudioVoiceUpdate(AudioVoiceType* psVoice_, u32 u32Now_);
+static u32 AudioVoiceNextEvent(AudioVoiceType* psVoice_);
+static void AudioTickPlan(void);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void AudioSM_Idle(void);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Audio_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Audio_pfnStateMachine;              /*!< @brief The state machine function pointer */
+
+static AudioVoiceType Audio_asVoices[U8_AUDIO_VOICES]; /*!< @brief BUZZER1 then BUZZER2 */
+static u16 Audio_u16Tempo;                             /*!< @brief Percent of the written speed */
+
+static bool Audio_bTickRunning;                        /*!< @brief The tick channel is enabled */
+static u32 Audio_u32Now;                               /*!< @brief Time line ms when the running tick period started */
+static u32 Audio_u32RunningMs;                         /*!< @brief Length of the running tick period */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool AudioPlay(BuzzerChannelType eBuzzer_, const AudioSongType* psSong_, bool bLoop_,
+                   AudioCallbackType pfnDone_, void* pvContext_)
+
+@brief Starts a song on a buzzer, replacing whatever it was playing.
+
+Example:
+
+static const u16 au16Notes[] = {C4, E4, G4, NO};
+static const u16 au16Durations[] = {QN, QN, QN, QN};
+static const u16 au16Articulations[] = {RT, RT, ST, RT};
+static const AudioSongType sSong = {au16Notes, au16Durations, au16Articulations, 4};
+
+AudioPlay(BUZZER1, &sSong, FALSE, NULL, NULL);
+
+Requires:
+@param eBuzzer_ is BUZZER1 or BUZZER2
+@param psSong_ points to the song, which must stay valid while it plays
+@param bLoop_ is TRUE to start the song again after its last note
+@param pfnDone_ is called from the audio task each time the song ends (also when it
+       loops), or NULL
+@param pvContext_ is passed to pfnDone_
+
+Promises:
+- Returns FALSE and changes nothing if eBuzzer_ is not a buzzer or the song has no
+  notes or no length (a looping song must take time)
+- Otherwise the buzzer is silenced, callbacks still due for its previous song are
+  dropped, and the first note starts within U32_AUDIO_MAX_PERIOD_MS (1 ms if nothing
+  else is playing); returns TRUE
+
+*/
+bool AudioPlay(BuzzerChannelType eBuzzer_, const AudioSongType* psSong_, bool bLoop_,
+               AudioCallbackType pfnDone_, void* pvContext_)
+{
+  AudioVoiceType* psVoice = AudioVoice(eBuzzer_);
+  u32 u32Length = 0;
+  u32 u32PriMask;
+
+  if( (psVoice == NULL) || (psSong_ == NULL) || (psSong_->u16Notes == 0) )
+  {
+    return(FALSE);
+  }
+
+  for(u16 i = 0; i < psSong_->u16Notes; i++)
+  {
+    u32Length += psSong_->pu16Durations[i];
+  }
+  if(u32Length == 0)
+  {
+    return(FALSE);
+  }
+
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+
+  if(psVoice->bSounding)
+  {
+    PWMAudioOff(eBuzzer_);
+  }
+  psVoice->psSong = psSong_;
+  psVoice->u16Index = 0;
+  psVoice->bLoop = bLoop_;
+  psVoice->bSounding = FALSE;
+  psVoice->u32Remainder = 0;
+  psVoice->pfnDone = pfnDone_;
+  psVoice->pvContext = pvContext_;
+  psVoice->u8EndsReported = psVoice->u8Ends;
+
+  if(Audio_bTickRunning)
+  {
+    /* Start at the end of the running period and plan from there */
+    AUDIO_TICK_REGISTERS->PWMC_CPRDUPDR = U32_AUDIO_TICK_COUNTS_PER_MS;
+  }
+  else
+  {
+    /* 1 ms periods: the first note starts at the end of the first */
+    Audio_u32RunningMs = 1;
+    AUDIO_TICK_REGISTERS->PWMC_CPRDR = U32_AUDIO_TICK_COUNTS_PER_MS;
+    AUDIO_TICK_REGISTERS->PWMC_CPRDUPDR = U32_AUDIO_TICK_COUNTS_PER_MS;
+
+    /* Reading ISR1 clears an event left from the last time the tick ran */
+    (void)AT91C_BASE_PWMC->PWMC_ISR1;
+    NVIC_ClearPendingIRQ(IRQn_PWMC);
+    AT91C_BASE_PWMC->PWMC_IER1 = AUDIO_TICK_CHANNEL;
+    AT91C_BASE_PWMC->PWMC_ENA = AUDIO_TICK_CHANNEL;
+    Audio_bTickRunning = TRUE;
+  }
+  psVoice->u32EndTime = Audio_u32Now + Audio_u32RunningMs;
+
+  __set_PRIMASK(u32PriMask);
+
+  return(TRUE);
+
+} /* end AudioPlay() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void AudioStop(BuzzerChannelType eBuzzer_)
+
+@brief Stops a buzzer's song at once.
+
+Requires:
+@param eBuzzer_ is BUZZER1 or BUZZER2
+
+Promises:
+- The buzzer is off and plays nothing more; its callback is not called for the
+  stop (ends already reached are still reported)
+- The tick stops at its next interrupt if no voice is playing
+
+*/
+void AudioStop(BuzzerChannelType eBuzzer_)
+{
+  AudioVoiceType* psVoice = AudioVoice(eBuzzer_);
+  u32 u32PriMask;
+
+  if(psVoice == NULL)
+  {
+    return;
+  }
+
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+  if(psVoice->bSounding)
+  {
+    PWMAudioOff(eBuzzer_);
+  }
+  psVoice->bSounding = FALSE;
+  psVoice->psSong = NULL;
+  __set_PRIMASK(u32PriMask);
+
+} /* end AudioStop() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool AudioIsPlaying(BuzzerChannelType eBuzzer_)
+
+@brief TRUE while a buzzer has a song (including its rests and a loop).
+
+Requires:
+@param eBuzzer_ is BUZZER1 or BUZZER2
+
+Promises:
+- Returns FALSE for anything that is not a buzzer
+
+*/
+bool AudioIsPlaying(BuzzerChannelType eBuzzer_)
+{
+  AudioVoiceType* psVoice = AudioVoice(eBuzzer_);
+
+  return( (bool)((psVoice != NULL) && (psVoice->psSong != NULL)) );
+
+} /* end AudioIsPlaying() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool AudioSetTempo(u16 u16Percent_)
+
+@brief Scales the speed of both voices.
+
+Example:
+
+AudioSetTempo(150);   (QN lasts 333 ms instead of 500)
+
+Requires:
+@param u16Percent_ is the speed in percent of the written note lengths (100 = as written)
+
+Promises:
+- Returns FALSE for 0
+- Otherwise notes that start from now on are scaled by 100 / u16Percent_ (the notes
+  already sounding finish at the old tempo) and returns TRUE
+
+*/
+bool AudioSetTempo(u16 u16Percent_)
+{
+  if(u16Percent_ == 0)
+  {
+    return(FALSE);
+  }
+
+  Audio_u16Tempo = u16Percent_;
+  return(TRUE);
+
+} /* end AudioSetTempo() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void AudioInitialize(void)
+
+@brief Sets up the buzzer channels and the tick with nothing playing.
+
+Requires:
+- The PWM peripheral clock is on (PMC_PCER_INIT) and no one else uses PWM channels 0-2
+
+Promises:
+- BUZZER1 and BUZZER2 are set up and off (PWMSetupAudio()); the tick channel is set
+  up, disabled and its interrupt enabled in the NVIC
+- The tempo is U16_AUDIO_DEFAULT_TEMPO
+- Audio_pfnStateMachine = AudioSM_Idle
+
+*/
+void AudioInitialize(void)
+{
+  PWMSetupAudio();
+
+  AUDIO_TICK_REGISTERS->PWMC_CMR = AUDIO_TICK_CMR_INIT;
+  AUDIO_TICK_REGISTERS->PWMC_CDTYR = 0;
+  AT91C_BASE_PWMC->PWMC_IDR1 = AUDIO_TICK_CHANNEL;
+  AT91C_BASE_PWMC->PWMC_DIS = AUDIO_TICK_CHANNEL;
+  Audio_bTickRunning = FALSE;
+  Audio_u32Now = 0;
+
+  memset(Audio_asVoices, 0, sizeof(Audio_asVoices));
+  Audio_asVoices[0].eBuzzer = BUZZER1;
+  Audio_asVoices[1].eBuzzer = BUZZER2;
+  Audio_u16Tempo = U16_AUDIO_DEFAULT_TEMPO;
+
+  NVIC_ClearPendingIRQ(IRQn_PWMC);
+  NVIC_EnableIRQ(IRQn_PWMC);
+
+  Audio_pfnStateMachine = AudioSM_Idle;
+
+} /* end AudioInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void AudioRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void AudioRunActiveState(void)
+{
+  Audio_pfnStateMachine();
+
+} /* end AudioRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool AudioIsIdle(void)
+
+@brief TRUE unless a song has ended and its callback is due, so the scheduler skips
+the task while songs play.
+
+Requires:
+- NONE
+
+Promises:
+- Returns FALSE if any voice has ends that pfnDone has not been called for
+
+*/
+bool AudioIsIdle(void)
+{
+  for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+  {
+    if(Audio_asVoices[i].u8EndsReported != Audio_asVoices[i].u8Ends)
+    {
+      return(FALSE);
+    }
+  }
+
+  return(TRUE);
+
+} /* end AudioIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void PWM_IrqHandler(void)
+
+@brief Ends and starts the notes that are due at the end of a tick period and plans
+the period after next.
+
+Requires:
+- Only the tick channel's interrupt is enabled in PWMC_IMR1
+
+Promises:
+- Audio_u32Now / Audio_u32RunningMs are the new period and every voice is up to date
+- PWMC_CPRDUPDR holds the following period, or the tick is stopped if no voice plays
+
+*/
+void PWM_IrqHandler(void)
+{
+  TRACE_ISR_ENTER(IRQn_PWMC);
+
+  /* Reading ISR1 clears it */
+  if(AT91C_BASE_PWMC->PWMC_ISR1 & AUDIO_TICK_CHANNEL)
+  {
+    /* The period that just started is the one the hardware loaded */
+    Audio_u32Now += Audio_u32RunningMs;
+    Audio_u32RunningMs = AUDIO_TICK_REGISTERS->PWMC_CPRDR / U32_AUDIO_TICK_COUNTS_PER_MS;
+
+    for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+    {
+      AudioVoiceUpdate(&Audio_asVoices[i], Audio_u32Now);
+    }
+
+    AudioTickPlan();
+  }
+
+  NVIC_ClearPendingIRQ(IRQn_PWMC);
+  TRACE_ISR_EXIT(IRQn_PWMC);
+
+} /* end PWM_IrqHandler() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static AudioVoiceType* AudioVoice(BuzzerChannelType eBuzzer_)
+
+@brief Returns the voice that plays on a buzzer, or NULL.
+*/
+static AudioVoiceType* AudioVoice(BuzzerChannelType eBuzzer_)
+{
+  for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+  {
+    if(Audio_asVoices[i].eBuzzer == eBuzzer_)
+    {
+      return(&Audio_asVoices[i]);
+    }
+  }
+
+  return(NULL);
+
+} /* end AudioVoice() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void AudioNoteStart(AudioVoiceType* psVoice_, u32 u32Start_)
+
+@brief Starts the voice's next note at u32Start_ (the end of the last one).
+
+At the end of the song the end is counted and the voice starts again or stops.  The
+note sounds for its length less the articulation: REGULAR_NOTE_ADJUSTMENT (RT),
+STACCATO_NOTE_TIME at most (ST) or all of it (HT, so it runs into the next note
+without a gap).  A rest, or a note whose sound is cut to nothing, leaves the buzzer off.
+*/
+static void AudioNoteStart(AudioVoiceType* psVoice_, u32 u32Start_)
+{
+  const AudioSongType* psSong = psVoice_->psSong;
+  u16 u16Duration;
+  u16 u16Articulation;
+  u32 u32Sound;
+  u32 u32Length;
+
+  if(psVoice_->u16Index >= psSong->u16Notes)
+  {
+    psVoice_->u8Ends++;
+    if(!psVoice_->bLoop)
+    {
+      AudioStop(psVoice_->eBuzzer);
+      return;
+    }
+    psVoice_->u16Index = 0;
+  }
+
+  u16Duration = psSong->pu16Durations[psVoice_->u16Index];
+  u16Articulation = psSong->pu16Articulations[psVoice_->u16Index];
+  if(u16Articulation == HOLD_NOTE_ADJUSTMENT)
+  {
+    u32Sound = u16Duration;
+  }
+  else if(u16Articulation == STACCATO_NOTE_TIME)
+  {
+    u32Sound = (u16Duration < STACCATO_NOTE_TIME) ? u16Duration : STACCATO_NOTE_TIME;
+  }
+  else
+  {
+    u32Sound = (u16Duration > u16Articulation) ? (u32)(u16Duration - u16Articulation) : 0;
+  }
+
+  /* Scale to the tempo; the part of a ms left over goes into the next note */
+  u32Length = ((u32)u16Duration * 100) + psVoice_->u32Remainder;
+  psVoice_->u32EndTime = u32Start_ + (u32Length / Audio_u16Tempo);
+  psVoice_->u32Remainder = u32Length % Audio_u16Tempo;
+  u32Sound = (u32Sound * 100) / Audio_u16Tempo;
+
+  if( (psSong->pu16Notes[psVoice_->u16Index] < U16_AUDIO_MIN_FREQUENCY) || (u32Sound == 0) )
+  {
+    if(psVoice_->bSounding)
+    {
+      PWMAudioOff(psVoice_->eBuzzer);
+      psVoice_->bSounding = FALSE;
+    }
+  }
+  else
+  {
+    /* A held note is still sounding, so the new frequency goes in at the end of its cycle */
+    PWMAudioSetFrequency(psVoice_->eBuzzer, psSong->pu16Notes[psVoice_->u16Index]);
+    if(!psVoice_->bSounding)
+    {
+      PWMAudioOn(psVoice_->eBuzzer);
+      psVoice_->bSounding = TRUE;
+    }
+    psVoice_->u32OffTime = u32Start_ + u32Sound;
+  }
+
+  psVoice_->u16Index++;
+
+} /* end AudioNoteStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void AudioVoiceUpdate(AudioVoiceType* psVoice_, u32 u32Now_)
+
+@brief Runs every event of the voice that is due by u32Now_.
+*/
+static void AudioVoiceUpdate(AudioVoiceType* psVoice_, u32 u32Now_)
+{
+  while(psVoice_->psSong != NULL)
+  {
+    if( psVoice_->bSounding && ((s32)(psVoice_->u32OffTime - psVoice_->u32EndTime) < 0) )
+    {
+      if( (s32)(u32Now_ - psVoice_->u32OffTime) < 0 )
+      {
+        return;
+      }
+
+      PWMAudioOff(psVoice_->eBuzzer);
+      psVoice_->bSounding = FALSE;
+      continue;
+    }
+
+    if( (s32)(u32Now_ - psVoice_->u32EndTime) < 0 )
+    {
+      return;
+    }
+
+    AudioNoteStart(psVoice_, psVoice_->u32EndTime);
+  }
+
+} /* end AudioVoiceUpdate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 AudioVoiceNextEvent(AudioVoiceType* psVoice_)
+
+@brief Returns when the playing voice next has something to do.
+*/
+static u32 AudioVoiceNextEvent(AudioVoiceType* psVoice_)
+{
+  if( psVoice_->bSounding && ((s32)(psVoice_->u32OffTime - psVoice_->u32EndTime) < 0) )
+  {
+    return(psVoice_->u32OffTime);
+  }
+
+  return(psVoice_->u32EndTime);
+
+} /* end AudioVoiceNextEvent() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void AudioTickPlan(void)
+
+@brief Sets the period after the running one to end at the next event, or stops the
+tick when no voice is playing.
+
+The running period ends at Audio_u32Now + Audio_u32RunningMs, which no event is before.
+If an event is due right then, the next period is 1 ms because that event may start a
+note that is shorter than anything known now.
+*/
+static void AudioTickPlan(void)
+{
+  u32 u32RunningEnd = Audio_u32Now + Audio_u32RunningMs;
+  u32 u32Next = u32RunningEnd + U32_AUDIO_MAX_PERIOD_MS;
+  u32 u32Event;
+  u32 u32Period;
+  bool bPlaying = FALSE;
+
+  for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+  {
+    if(Audio_asVoices[i].psSong != NULL)
+    {
+      bPlaying = TRUE;
+      u32Event = AudioVoiceNextEvent(&Audio_asVoices[i]);
+      if( (s32)(u32Event - u32Next) < 0 )
+      {
+        u32Next = u32Event;
+      }
+    }
+  }
+
+  if(!bPlaying)
+  {
+    AT91C_BASE_PWMC->PWMC_IDR1 = AUDIO_TICK_CHANNEL;
+    AT91C_BASE_PWMC->PWMC_DIS = AUDIO_TICK_CHANNEL;
+    Audio_bTickRunning = FALSE;
+    return;
+  }
+
+  u32Period = u32Next - u32RunningEnd;
+  if( (s32)u32Period < 1 )
+  {
+    u32Period = 1;
+  }
+  AUDIO_TICK_REGISTERS->PWMC_CPRDUPDR = u32Period * U32_AUDIO_TICK_COUNTS_PER_MS;
+
+} /* end AudioTickPlan() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void AudioSM_Idle(void)
+
+@brief Calls back the songs that have ended.
+*/
+static void AudioSM_Idle(void)
+{
+  AudioVoiceType* psVoice;
+
+  for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+  {
+    psVoice = &Audio_asVoices[i];
+
+    /* The callback may start another song, which drops the ends still due */
+    while(psVoice->u8EndsReported != psVoice->u8Ends)
+    {
+      psVoice->u8EndsReported++;
+      if(psVoice->pfnDone != NULL)
+      {
+        psVoice->pfnDone(psVoice->pvContext);
+      }
+    }
+  }
+
+} /* end AudioSM_Idle() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,120 @@
+/*!**********************************************************************************************************************
+@file audio.h
+@brief Header file for audio.c
+**********************************************************************************************************************/
+
+#ifndef __AUDIO_H
+#define __AUDIO_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*! @brief Function called from the audio task when a song has played to its end */
+typedef void(*AudioCallbackType)(void* pvContext_);
+
+/*!
+@struct AudioSongType
+@brief One voice's part: three arrays of u16Notes entries, normally const (in flash).
+
+Notes and durations use the music.h names: frequencies in Hz (NO for a rest, lowest
+U16_AUDIO_MIN_FREQUENCY) and FN / HN / QN / EN / SN lengths in ms at 100% tempo.
+Each articulation is RT (the note stops REGULAR_NOTE_ADJUSTMENT before the next one),
+ST (it sounds for STACCATO_NOTE_TIME) or HT (it is held into the next note); any other
+value is taken as the silence at the end of the note, like RT. */
+typedef struct
+{
+  const u16* pu16Notes;                   /*!< @brief Frequency of each note in Hz, or NO */
+  const u16* pu16Durations;               /*!< @brief Length of each note in ms at 100% tempo */
+  const u16* pu16Articulations;           /*!< @brief RT, ST or HT for each note */
+  u16 u16Notes;                           /*!< @brief Entries in each array */
+} AudioSongType;
+
+/*!
+@struct AudioVoiceType
+@brief A buzzer and the song it is playing.  Times are on the tick's ms time line. */
+typedef struct
+{
+  BuzzerChannelType eBuzzer;              /*!< @brief Buzzer the voice plays on */
+  const AudioSongType* psSong;            /*!< @brief Song being played, NULL when stopped */
+  u16 u16Index;                           /*!< @brief Note being played */
+  bool bLoop;                             /*!< @brief Start again after the last note */
+  bool bSounding;                         /*!< @brief The buzzer is on for this note */
+  u32 u32OffTime;                         /*!< @brief When the note's sound stops (bSounding only) */
+  u32 u32EndTime;                         /*!< @brief When the next note starts */
+  u32 u32Remainder;                       /*!< @brief Tempo scaling left over from the last note (drift-free) */
+  AudioCallbackType pfnDone;              /*!< @brief Called from the task at each end of the song, or NULL */
+  void* pvContext;                        /*!< @brief Passed to pfnDone */
+  volatile u8 u8Ends;                     /*!< @brief Times the tick interrupt reached the end of the song */
+  u8 u8EndsReported;                      /*!< @brief Ends pfnDone has been called for */
+} AudioVoiceType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool AudioPlay(BuzzerChannelType eBuzzer_, const AudioSongType* psSong_, bool bLoop_,
+               AudioCallbackType pfnDone_, void* pvContext_);
+void AudioStop(BuzzerChannelType eBuzzer_);
+bool AudioIsPlaying(BuzzerChannelType eBuzzer_);
+bool AudioSetTempo(u16 u16Percent_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void AudioInitialize(void);
+void AudioRunActiveState(void);
+bool AudioIsIdle(void);
+void PWM_IrqHandler(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U8_AUDIO_VOICES             (u8)2         /*!< @brief BUZZER1 and BUZZER2 */
+#define U16_AUDIO_DEFAULT_TEMPO     (u16)100      /*!< @brief Percent of the written note lengths' speed */
+#define U16_AUDIO_MIN_FREQUENCY     (u16)92       /*!< @brief Lowest note: the buzzer period (CPRE_CLCK / Hz) has 16 bits */
+
+/* The sequencer's tick is PWM channel 2, which has no pin: its period is set to end
+at the next note event, so it interrupts only when a voice has something to do */
+#define AUDIO_TICK_CHANNEL          AT91C_PWMC_CHID2              /*!< @brief PWM_ENA / PWM_IER1 bit of the tick */
+#define AUDIO_TICK_REGISTERS        AT91C_BASE_PWMC_CH2           /*!< @brief The tick channel's registers */
+#define U32_AUDIO_TICK_COUNTS_PER_MS (u32)(MCK / 128 / 1000)      /*!< @brief 375 counts of MCK / 128 */
+#define U32_AUDIO_MAX_PERIOD_MS     (u32)100      /*!< @brief Longest tick period (the counter has 16 bits); also the
+                                                       longest a song started while another plays waits to start */
+
+#define AUDIO_TICK_CMR_INIT         (u32)0x00000007
+/*
+    31-17 [0] Reserved
+
+    16 [0] DTLI dead time low output not inverted
+    15 [0] DTHI dead time high output not inverted
+    14 [0] DTE dead time generator disabled
+    13 [0] Reserved
+    12 [0] Reserved
+
+    11 [0] Reserved
+    10 [0] CES channel event at the end of the period
+    09 [0] CPOL output low at the start of the period
+    08 [0] CALG left aligned
+
+    07 [0] Reserved
+    06 [0] Reserved
+    05 [0] Reserved
+    04 [0] Reserved
+
+    03 [0] CPRE MCK / 128 (375 kHz)
+    02 [1] "
+    01 [1] "
+    00 [1] "
+*/
+
+
+#endif /* __AUDIO_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -6,22 +6,52 @@ The application handles all debouncing and button press / hold detection.
 All buttons use interrupts to trigger the start and end
 of the action.
 
+Besides the polled IsButtonPressed() / WasButtonPressed() interface, the task
+reports button activity as events (press, release, hold, repeat, double click and
+long press) with timestamps.  An app picks the buttons and events it wants with 
+ButtonEventSubscribe() and drains them with ButtonEventGet(), so bursts of presses 
+between two looks are not lost.  The queue has one producer (the button task) and 
+one consumer and needs no locking.  A task that only reacts to buttons can use 
+ButtonEventQueueEmpty() as its pfnIsIdle so the scheduler skips it until an event 
+arrives.
+
+Built with EIE_BUTTON_VERTICAL_DEBOUNCE, the per-button debounce timers are replaced
+by a vertical counter: every tick that any pin is settling, PIO_PDSR is sampled once 
+per port and all of the port's buttons are debounced together with a few bitwise 
+operations.  Once every pin agrees with its debounced level the task stops sampling 
+and a change interrupt on either port starts it again.
+
+Built with EIE_KEYPAD, the keys of the blade keypad (keypad.c) follow the discrete
+buttons as KEY0..KEY15.  The keypad scan debounces them; this task takes each accepted
+change into the same button states and events.
+
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
-- NONE
+- G_u32ButtonEventsDropped
 
 CONSTANTS
-- 
+- U32_BUTTON_HOLD_TIME, U32_BUTTON_REPEAT_TIME, U32_BUTTON_LONG_PRESS_TIME
+- U32_BUTTON_DOUBLE_CLICK_TIME, U8_BUTTON_EVENT_QUEUE_SIZE
 
 TYPES
-- NONE
+- ButtonEventType
+- ButtonEventRecordType
 
 
 PUBLIC FUNCTIONS
-- 
+- bool IsButtonPressed(ButtonNameType eButton_)
+- bool WasButtonPressed(ButtonNameType eButton_)
+- void ButtonAcknowledge(ButtonNameType eButton_)
+- bool IsButtonHeld(ButtonNameType eButton_, u32 u32ButtonHeldTime_)
+- void ButtonEventSubscribe(u32 u32Buttons_, u8 u8Events_)
+- bool ButtonEventGet(ButtonEventRecordType* psEvent_)
+- u8 ButtonEventCount(void)
+- bool ButtonEventQueueEmpty(void)
+- void ButtonSetDebounceSamples(u32 u32Buttons_, u8 u8Samples_) (EIE_BUTTON_VERTICAL_DEBOUNCE builds)
 
 PROTECTED FUNCTIONS
-- 
+- bool ButtonIsIdle(void)
+- u32 ButtonNextDeadline(void)
 
 ***********************************************************************************************************************/
 
@@ -33,6 +63,7 @@ Global variable definitions with scope across entire project.
 All Global variable names shall start with "G_<type>Button"
 ***********************************************************************************************************************/
 /* New variables */
+u32 G_u32ButtonEventsDropped;                               /*!< @brief Events lost because the queue was full */
 
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
@@ -42,6 +73,37 @@ extern volatile u32 G_u32SystemFlags;                       /*!< @brief From mai
 extern volatile u32 G_u32ApplicationFlags;                  /*!< @brief From main.c */
 
 extern const PinConfigurationType G_asBspButtonConfigurations[U8_TOTAL_BUTTONS]; /*!< @brief from board-specific file */
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+extern const u8 G_au8BspButtonIndex[U8_BUTTON_PORTS][U8_BUTTON_PORT_BITS]; /*!< @brief from board-specific file */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void ButtonEventPost(u8 u8Button_, ButtonEventType eEvent_, u32 u32TimeStamp_, u32 u32Duration_);
+static void ButtonPressEvents(u8 u8Button_);
+static void ButtonReleaseEvents(u8 u8Button_);
+static void ButtonHoldEvents(u8 u8Button_);
+static u32 ButtonHoldDeadline(u8 u8Button_);
+static void ButtonStateChange(u8 u8Button_);
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+static u32 ButtonVerticalCount(ButtonVerticalCounterType* psPort_, u32 u32Pressed_);
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+#ifdef EIE_KEYPAD
+static void ButtonKeypadUpdate(void);
+#endif /* EIE_KEYPAD */
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+static void ButtonSM_Sample(void);
+#else
+static void ButtonSM_Idle(void);                
+static void ButtonSM_ButtonActive(void);
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
 
 
 /***********************************************************************************************************************
@@ -50,7 +112,22 @@ Variable names shall start with "Button_<type>" and be declared as static.
 ***********************************************************************************************************************/
 static fnCode_type Button_pfnStateMachine;                  /*!< @brief The Button application state machine function pointer */
 
-static ButtonStatusType Button_asStatus[U8_TOTAL_BUTTONS];  /*!< @brief Individual status parameters for buttons */
+static ButtonStatusType Button_asStatus[U8_BUTTON_INPUTS];  /*!< @brief Individual status parameters for buttons and keys */
+static u32 Button_au32ActiveLow[U8_BUTTON_PORTS];           /*!< @brief ACTIVE_LOW button pins on each port */
+
+static ButtonEventRecordType Button_asEventQueue[U8_BUTTON_EVENT_QUEUE_SIZE]; /*!< @brief Event ring */
+static volatile u8 Button_u8EventHead;                      /*!< @brief Free-running write index: only the button task moves it */
+static volatile u8 Button_u8EventTail;                      /*!< @brief Free-running read index: only the consumer moves it */
+
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+static ButtonVerticalCounterType Button_asVertical[U8_BUTTON_PORTS]; /*!< @brief Debounce counters of each port */
+static volatile bool Button_bSampling;                      /*!< @brief TRUE while pins are settling (set by the PIO ISRs) */
+static const u32 Button_au32PortButtons[U8_BUTTON_PORTS] = {GPIOA_BUTTONS, GPIOB_BUTTONS}; /*!< @brief Button pins of each port */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+#ifdef EIE_KEYPAD
+static u32 Button_u32Keys;                                  /*!< @brief Keypad keys last taken from KeypadGetKeys() */
+#endif /* EIE_KEYPAD */
 
 
 /***********************************************************************************************************************
@@ -186,6 +263,185 @@ bool IsButtonHeld(ButtonNameType eButton_, u32 u32ButtonHeldTime_)
 } /* end IsButtonHeld() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ButtonEventSubscribe(u32 u32Buttons_, u8 u8Events_)
+
+@brief Chooses which events are queued for a set of buttons.
+
+No events are queued until a button is subscribed, so apps that only poll pay nothing.
+Subscribing again replaces the previous choice for those buttons.
+
+Example: report every click of BUTTON0 and BUTTON1 and nothing else
+ButtonEventSubscribe(BUTTON_MASK(BUTTON0) | BUTTON_MASK(BUTTON1), 
+                     BUTTON_EVENT_MASK(BUTTON_EVENT_PRESS) | BUTTON_EVENT_MASK(BUTTON_EVENT_DOUBLE_CLICK));
+
+Requires:
+@param u32Buttons_ is the BUTTON_MASK() bits of the buttons to change
+@param u8Events_ is the BUTTON_EVENT_MASK() bits to queue for them (0 to unsubscribe)
+
+Promises:
+- Button_asStatus[].u8EventMask of each button in u32Buttons_ is u8Events_
+- The state machine re-checks hold timing in case a held button just gained hold events
+
+*/
+void ButtonEventSubscribe(u32 u32Buttons_, u8 u8Events_)
+{
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
+  {
+    if(u32Buttons_ & BUTTON_MASK(i))
+    {
+      Button_asStatus[i].u8EventMask = u8Events_ & BUTTON_EVENTS_ALL;
+    }
+  }
+
+#ifndef EIE_BUTTON_VERTICAL_DEBOUNCE
+  Button_pfnStateMachine = ButtonSM_ButtonActive;
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+} /* end ButtonEventSubscribe() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool ButtonEventGet(ButtonEventRecordType* psEvent_)
+
+@brief Takes the oldest event off the queue.
+
+Only one task may read the queue.  Call in a loop to drain it:
+
+ButtonEventRecordType sEvent;
+while( ButtonEventGet(&sEvent) )
+{
+  // handle sEvent.eButton / sEvent.eEvent
+}
+
+Requires:
+@param psEvent_ points to where the event is copied
+
+Promises:
+- Returns FALSE if the queue is empty (psEvent_ untouched)
+- Otherwise copies the oldest event to psEvent_, frees its slot and returns TRUE
+
+*/
+bool ButtonEventGet(ButtonEventRecordType* psEvent_)
+{
+  u8 u8Tail = Button_u8EventTail;
+
+  if(u8Tail == Button_u8EventHead)
+  {
+    return(FALSE);
+  }
+
+  /* Read the slot only after seeing the head that published it, and free it only after the copy */
+  __DMB();
+  *psEvent_ = Button_asEventQueue[u8Tail & (U8_BUTTON_EVENT_QUEUE_SIZE - 1)];
+  __DMB();
+  Button_u8EventTail = u8Tail + 1;
+
+  return(TRUE);
+
+} /* end ButtonEventGet() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8 ButtonEventCount(void)
+
+@brief Returns the number of events waiting in the queue.
+
+Requires:
+- NONE
+
+Promises:
+- Returns 0 to U8_BUTTON_EVENT_QUEUE_SIZE
+
+*/
+u8 ButtonEventCount(void)
+{
+  return( (u8)(Button_u8EventHead - Button_u8EventTail) );
+
+} /* end ButtonEventCount() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool ButtonEventQueueEmpty(void)
+
+@brief Reports whether there are no button events to read.
+
+Fits the task table's pfnIsIdle so a task that only reacts to buttons waits 
+(costing nothing) until the button task queues something for it.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if ButtonEventGet() would return FALSE
+
+*/
+bool ButtonEventQueueEmpty(void)
+{
+  return( (bool)(Button_u8EventHead == Button_u8EventTail) );
+
+} /* end ButtonEventQueueEmpty() */
+
+
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ButtonSetDebounceSamples(u32 u32Buttons_, u8 u8Samples_)
+
+@brief Sets how many matching 1ms samples in a row a button needs before a new level is accepted.
+
+Lower counts react faster; noisy or worn switches need more.
+
+Requires:
+@param u32Buttons_ is the BUTTON_MASK() bits of the buttons to change
+@param u8Samples_ is the sample count, 1 to U8_BUTTON_MAX_SAMPLES (limited to that range)
+
+Promises:
+- Each button's bit in its port's au32Samples[] planes holds u8Samples_
+- Button_asStatus[].u8DebounceSamples is u8Samples_ (used to date the edge)
+
+*/
+void ButtonSetDebounceSamples(u32 u32Buttons_, u8 u8Samples_)
+{
+  ButtonVerticalCounterType* psPort;
+  u32 u32Bit;
+
+  if(u8Samples_ == 0)
+  {
+    u8Samples_ = 1;
+  }
+
+  if(u8Samples_ > U8_BUTTON_MAX_SAMPLES)
+  {
+    u8Samples_ = U8_BUTTON_MAX_SAMPLES;
+  }
+
+  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  {
+    if(u32Buttons_ & BUTTON_MASK(i))
+    {
+      psPort = &Button_asVertical[G_asBspButtonConfigurations[i].ePort / PORTB];
+      u32Bit = G_asBspButtonConfigurations[i].u32BitPosition;
+
+      for(u8 j = 0; j < U8_BUTTON_COUNTER_BITS; j++)
+      {
+        if(u8Samples_ & (1 << j))
+        {
+          psPort->au32Samples[j] |= u32Bit;
+        }
+        else
+        {
+          psPort->au32Samples[j] &= ~u32Bit;
+        }
+      }
+
+      Button_asStatus[i].u8DebounceSamples = u8Samples_;
+    }
+  }
+
+} /* end ButtonSetDebounceSamples() */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+
 /*------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -204,22 +460,37 @@ Requires:
 Promises:
 - The Button task is configured
 - Button interrupts are active on PIOA and PIOB
-- Button task is set to ButtonSM_Idle
+- Button task is set to ButtonSM_Idle (ButtonSM_Sample with every button at
+  U8_BUTTON_DEFAULT_SAMPLES in EIE_BUTTON_VERTICAL_DEBOUNCE builds)
 
 */
 void ButtonInitialize(void)
 {
   u32 u32Dummy;
   
-  /* Setup default data for all of the buttons in the system */
-  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  /* Setup default data for all of the buttons (and keys) in the system */
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
   {
     Button_asStatus[i].bNewPressFlag = FALSE;
     Button_asStatus[i].eCurrentState = RELEASED;
     Button_asStatus[i].eNewState     = RELEASED;
     Button_asStatus[i].u32TimeStamp  = 0;
+    Button_asStatus[i].u8EventMask   = 0;
+    Button_asStatus[i].bClickArmed   = FALSE;
+  }
+
+  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  {
+    if(G_asBspButtonConfigurations[i].eActiveState == ACTIVE_LOW)
+    {
+      Button_au32ActiveLow[G_asBspButtonConfigurations[i].ePort / PORTB] |= G_asBspButtonConfigurations[i].u32BitPosition;
+    }
   }
 
+  Button_u8EventHead = 0;
+  Button_u8EventTail = 0;
+  G_u32ButtonEventsDropped = 0;
+
   /* Enable PIO interrupts */
   AT91C_BASE_PIOA->PIO_IER = GPIOA_BUTTONS;
   AT91C_BASE_PIOB->PIO_IER = GPIOB_BUTTONS;
@@ -233,9 +504,21 @@ void ButtonInitialize(void)
   NVIC_ClearPendingIRQ(IRQn_PIOB);
   NVIC_EnableIRQ(IRQn_PIOA);
   NVIC_EnableIRQ(IRQn_PIOB);
+
+#ifdef EIE_KEYPAD
+  Button_u32Keys = 0;
+  KeypadInitialize();
+#endif /* EIE_KEYPAD */
     
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+  /* All buttons start released; sample once in case one is already held down */
+  ButtonSetDebounceSamples(BUTTON_MASK(U8_TOTAL_BUTTONS) - 1, U8_BUTTON_DEFAULT_SAMPLES);
+  Button_bSampling = TRUE;
+  Button_pfnStateMachine = ButtonSM_Sample;
+#else
   /* Init complete: set function pointer and application flag */
   Button_pfnStateMachine = ButtonSM_Idle;
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
 
 } /* end ButtonInitialize() */
 
@@ -256,49 +539,171 @@ Promises:
 */
 void ButtonRunActiveState(void)
 {
+#ifdef EIE_KEYPAD
+  ButtonKeypadUpdate();
+#endif /* EIE_KEYPAD */
+
   Button_pfnStateMachine();
 
 } /* end ButtonRunActiveState */
 
 
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn void ButtonStartDebounce(u32 u32BitPosition_, PortOffsetType ePort_)
+@fn bool ButtonIsIdle(void)
 
-@brief Called only from ISR: sets the "debounce active" flag and debounce start time  
+@brief Reports whether the button task has any work this tick (used by the main loop scheduler).
 
 Requires:
-- Only the PIOA or PIOB ISR should call this function
+- NONE
+
+Promises:
+- Returns TRUE if no button is waiting to be debounced and no held button is due
+  a HOLD, REPEAT or LONG_PRESS event
+
+*/
+bool ButtonIsIdle(void)
+{
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+  if(Button_bSampling)
+  {
+    return(FALSE);
+  }
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+#ifdef EIE_KEYPAD
+  if(KeypadGetKeys(NULL) != Button_u32Keys)
+  {
+    return(FALSE);
+  }
+#endif /* EIE_KEYPAD */
+
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
+  {
+    if( Button_asStatus[i].bDebounceActive || (ButtonHoldDeadline(i) == 0) )
+    {
+      return(FALSE);
+    }
+  }
+
+  return(TRUE);
 
-@param u32BitPosition_ is a SINGLE bit and actual button location on which to start debouncing
-@param ePort_ is the port on which the button is located
+} /* end ButtonIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 ButtonNextDeadline(void)
+
+@brief Reports how many ms until the first debounce window closes or held button 
+event is due (used by the main loop scheduler).
+
+Requires:
+- NONE
 
 Promises:
-- If the indicated button is found in G_asBspButtonConfigurations, then the
-corresponding interrupt is disabled and debounce information is set in Button_asStatus
+- Returns the ms until the earliest debouncing button has waited U32_DEBOUNCE_TIME
+  or the earliest held button is due a subscribed hold event (at least 1), or 
+  U32_NO_DEADLINE if there is neither (a button interrupt wakes the system)
 
 */
-void ButtonStartDebounce(u32 u32BitPosition_, PortOffsetType ePort_)
+u32 ButtonNextDeadline(void)
 {
-  ButtonNameType eButton = NOBUTTON;
-  
-  /* Parse through to find the button */
-  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  u32 u32Deadline = U32_NO_DEADLINE;
+  u32 u32Elapsed;
+  u32 u32HoldDeadline;
+
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+  /* Pins that are settling are sampled every tick */
+  if(Button_bSampling)
+  {
+    return(1);
+  }
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+#ifdef EIE_KEYPAD
+  /* The keypad scan has accepted new keys */
+  if(KeypadGetKeys(NULL) != Button_u32Keys)
+  {
+    return(1);
+  }
+#endif /* EIE_KEYPAD */
+
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
   {
-    if( (G_asBspButtonConfigurations[i].u32BitPosition == u32BitPosition_) &&
-        (G_asBspButtonConfigurations[i].ePort == ePort_) )
+    if(Button_asStatus[i].bDebounceActive)
     {
-      eButton = (ButtonNameType)i;
-      break;
+      u32Elapsed = G_u32SystemTime1ms - Button_asStatus[i].u32DebounceTimeStart;
+      if(u32Elapsed >= U32_DEBOUNCE_TIME)
+      {
+        return(1);
+      }
+
+      if(U32_DEBOUNCE_TIME - u32Elapsed < u32Deadline)
+      {
+        u32Deadline = U32_DEBOUNCE_TIME - u32Elapsed;
+      }
+    }
+    else
+    {
+      u32HoldDeadline = ButtonHoldDeadline(i);
+      if(u32HoldDeadline == 0)
+      {
+        return(1);
+      }
+
+      if(u32HoldDeadline < u32Deadline)
+      {
+        u32Deadline = u32HoldDeadline;
+      }
     }
   }
-  
-  /* If the button has been found, disable the interrupt and update debounce status */
-  if(eButton != NOBUTTON)
+
+  return(u32Deadline);
+
+} /* end ButtonNextDeadline() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void ButtonStartDebounce(ButtonNameType eButton_)
+
+@brief Called only from ISR: sets the "debounce active" flag and debounce start time  
+
+Requires:
+- Only the PIOA or PIOB ISR should call this function (it finds eButton_ from the 
+  interrupt flag through G_au8BspButtonIndex)
+
+@param eButton_ is the button on which to start debouncing
+
+Promises:
+- The button's interrupt is disabled on its own port and debounce information 
+  is set in Button_asStatus
+- EIE_BUTTON_VERTICAL_DEBOUNCE builds: all button interrupts are disabled and
+  sampling starts; the counters take it from there
+
+*/
+void ButtonStartDebounce(ButtonNameType eButton_)
+{
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+  /* Which button does not matter: every button pin is sampled each tick until they 
+  all settle, so further edges are not needed */
+  (void)eButton_;
+  AT91C_BASE_PIOA->PIO_IDR = GPIOA_BUTTONS;
+  AT91C_BASE_PIOB->PIO_IDR = GPIOB_BUTTONS;
+  Button_bSampling = TRUE;
+
+#else
+  u32 *pu32InterruptAddress;
+
+  if(eButton_ >= NOBUTTON)
   {
-    AT91C_BASE_PIOA->PIO_IDR |= u32BitPosition_;
-    Button_asStatus[(u8)eButton].bDebounceActive = TRUE;
-    Button_asStatus[(u8)eButton].u32DebounceTimeStart = G_u32SystemTime1ms;
+    return;
   }
+
+  pu32InterruptAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_IDR) + G_asBspButtonConfigurations[eButton_].ePort);
+  *pu32InterruptAddress = G_asBspButtonConfigurations[eButton_].u32BitPosition;
+
+  Button_asStatus[(u8)eButton_].bDebounceActive = TRUE;
+  Button_asStatus[(u8)eButton_].u32DebounceTimeStart = G_u32SystemTime1ms;
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
   
 } /* end ButtonStartDebounce() */
  
@@ -307,6 +712,354 @@ void ButtonStartDebounce(u32 u32BitPosition_, PortOffsetType ePort_)
 /*! @privatesection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonEventPost(u8 u8Button_, ButtonEventType eEvent_, u32 u32TimeStamp_, u32 u32Duration_)
+
+@brief Queues an event if the button is subscribed to it.
+
+Only the button task calls this, so it is the single producer of the queue.
+
+Requires:
+@param u8Button_ is a valid button index
+@param eEvent_ is the event to report
+@param u32TimeStamp_ is the system time of the event
+@param u32Duration_ is the event's duration in ms (saturated to 16 bits)
+
+Promises:
+- If eEvent_ is subscribed for u8Button_ and the queue has room, the event is written
+  and then published by advancing Button_u8EventHead
+- If the queue is full the event is dropped and G_u32ButtonEventsDropped counts it
+
+*/
+static void ButtonEventPost(u8 u8Button_, ButtonEventType eEvent_, u32 u32TimeStamp_, u32 u32Duration_)
+{
+  u8 u8Head = Button_u8EventHead;
+  ButtonEventRecordType* psEvent;
+
+  if( !(Button_asStatus[u8Button_].u8EventMask & BUTTON_EVENT_MASK(eEvent_)) )
+  {
+    return;
+  }
+
+  if( (u8)(u8Head - Button_u8EventTail) >= U8_BUTTON_EVENT_QUEUE_SIZE )
+  {
+    G_u32ButtonEventsDropped++;
+    return;
+  }
+
+  psEvent = &Button_asEventQueue[u8Head & (U8_BUTTON_EVENT_QUEUE_SIZE - 1)];
+  psEvent->eButton      = (ButtonNameType)u8Button_;
+  psEvent->eEvent       = eEvent_;
+  psEvent->u32TimeStamp = u32TimeStamp_;
+  psEvent->u16Duration  = (u32Duration_ > U16_BUTTON_DURATION_MAX) ? U16_BUTTON_DURATION_MAX : (u16)u32Duration_;
+
+  /* The entry must be complete before the consumer can see it */
+  __DMB();
+  Button_u8EventHead = u8Head + 1;
+
+} /* end ButtonEventPost() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonPressEvents(u8 u8Button_)
+
+@brief Reports a debounced press and starts the hold timing for it.
+
+Requires:
+- Button_asStatus[u8Button_].u32TimeStamp is the time of the edge that started the press
+
+@param u8Button_ is a valid button index
+
+Promises:
+- PRESS is posted, then DOUBLE_CLICK if a short press ended less than 
+  U32_BUTTON_DOUBLE_CLICK_TIME before this one started
+- The hold and long press timing restarts
+
+*/
+static void ButtonPressEvents(u8 u8Button_)
+{
+  ButtonStatusType* psStatus = &Button_asStatus[u8Button_];
+  u32 u32Gap = psStatus->u32TimeStamp - psStatus->u32ReleaseTime;
+
+  psStatus->u32NextHoldTime = U32_BUTTON_HOLD_TIME;
+  psStatus->bLongPressSent  = FALSE;
+  psStatus->bDoubleClick    = FALSE;
+
+  ButtonEventPost(u8Button_, BUTTON_EVENT_PRESS, psStatus->u32TimeStamp, 0);
+  LOG1("button %u pressed", u8Button_);
+
+  if( psStatus->bClickArmed && (u32Gap <= U32_BUTTON_DOUBLE_CLICK_TIME) )
+  {
+    psStatus->bDoubleClick = TRUE;
+    ButtonEventPost(u8Button_, BUTTON_EVENT_DOUBLE_CLICK, psStatus->u32TimeStamp, u32Gap);
+  }
+
+  psStatus->bClickArmed = FALSE;
+
+} /* end ButtonPressEvents() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonReleaseEvents(u8 u8Button_)
+
+@brief Reports a debounced release.
+
+Requires:
+- Button_asStatus[u8Button_].u32DebounceTimeStart is the time of the edge that ended the press
+
+@param u8Button_ is a valid button index
+
+Promises:
+- RELEASE is posted with the time the button was held
+- A press shorter than U32_BUTTON_HOLD_TIME that was not itself the second click of
+  a double click arms double click detection for the next press
+
+*/
+static void ButtonReleaseEvents(u8 u8Button_)
+{
+  ButtonStatusType* psStatus = &Button_asStatus[u8Button_];
+  u32 u32Held = psStatus->u32DebounceTimeStart - psStatus->u32TimeStamp;
+
+  psStatus->u32ReleaseTime = psStatus->u32DebounceTimeStart;
+  psStatus->bClickArmed = (bool)( !psStatus->bDoubleClick && (u32Held < U32_BUTTON_HOLD_TIME) );
+
+  ButtonEventPost(u8Button_, BUTTON_EVENT_RELEASE, psStatus->u32ReleaseTime, u32Held);
+  LOG2("button %u released after %u ms", u8Button_, u32Held);
+
+} /* end ButtonReleaseEvents() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonHoldEvents(u8 u8Button_)
+
+@brief Reports the hold, repeat and long press thresholds a pressed button has reached.
+
+Events are stamped with the time the threshold was reached, not when the task got
+to it.  If the task fell behind by more than one repeat, only one REPEAT is posted
+and the rest are skipped rather than sent as a burst.
+
+Requires:
+- Button_asStatus[u8Button_].eCurrentState is PRESSED
+
+@param u8Button_ is a valid button index
+
+Promises:
+- LONG_PRESS is posted once per press after U32_BUTTON_LONG_PRESS_TIME
+- HOLD is posted at U32_BUTTON_HOLD_TIME and REPEAT every U32_BUTTON_REPEAT_TIME after
+- u32NextHoldTime is moved past the current held time
+
+*/
+static void ButtonHoldEvents(u8 u8Button_)
+{
+  ButtonStatusType* psStatus = &Button_asStatus[u8Button_];
+  u32 u32Held = G_u32SystemTime1ms - psStatus->u32TimeStamp;
+
+  if( !psStatus->bLongPressSent && (u32Held >= U32_BUTTON_LONG_PRESS_TIME) )
+  {
+    psStatus->bLongPressSent = TRUE;
+    ButtonEventPost(u8Button_, BUTTON_EVENT_LONG_PRESS, 
+                    psStatus->u32TimeStamp + U32_BUTTON_LONG_PRESS_TIME, U32_BUTTON_LONG_PRESS_TIME);
+  }
+
+  if(u32Held >= psStatus->u32NextHoldTime)
+  {
+    ButtonEventPost(u8Button_, 
+                    (psStatus->u32NextHoldTime == U32_BUTTON_HOLD_TIME) ? BUTTON_EVENT_HOLD : BUTTON_EVENT_REPEAT,
+                    psStatus->u32TimeStamp + psStatus->u32NextHoldTime, psStatus->u32NextHoldTime);
+
+    do
+    {
+      psStatus->u32NextHoldTime += U32_BUTTON_REPEAT_TIME;
+    } while(psStatus->u32NextHoldTime <= u32Held);
+  }
+
+} /* end ButtonHoldEvents() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 ButtonHoldDeadline(u8 u8Button_)
+
+@brief Returns how long until a held button is due its next subscribed hold event.
+
+Requires:
+@param u8Button_ is a valid button index
+
+Promises:
+- Returns U32_NO_DEADLINE if the button is not pressed or none of HOLD, REPEAT or 
+  LONG_PRESS is still to come for it
+- Otherwise returns the ms until the earliest of them (0 if already due)
+
+*/
+static u32 ButtonHoldDeadline(u8 u8Button_)
+{
+  ButtonStatusType* psStatus = &Button_asStatus[u8Button_];
+  u32 u32Next = U32_NO_DEADLINE;
+  u32 u32Held;
+
+  if(psStatus->eCurrentState != PRESSED)
+  {
+    return(U32_NO_DEADLINE);
+  }
+
+  /* The HOLD threshold is also where the REPEATs start counting from */
+  if( (psStatus->u8EventMask & BUTTON_EVENT_MASK(BUTTON_EVENT_REPEAT)) ||
+      ( (psStatus->u8EventMask & BUTTON_EVENT_MASK(BUTTON_EVENT_HOLD)) && 
+        (psStatus->u32NextHoldTime == U32_BUTTON_HOLD_TIME) ) )
+  {
+    u32Next = psStatus->u32NextHoldTime;
+  }
+
+  if( (psStatus->u8EventMask & BUTTON_EVENT_MASK(BUTTON_EVENT_LONG_PRESS)) && 
+      !psStatus->bLongPressSent && (U32_BUTTON_LONG_PRESS_TIME < u32Next) )
+  {
+    u32Next = U32_BUTTON_LONG_PRESS_TIME;
+  }
+
+  if(u32Next == U32_NO_DEADLINE)
+  {
+    return(U32_NO_DEADLINE);
+  }
+
+  u32Held = G_u32SystemTime1ms - psStatus->u32TimeStamp;
+  if(u32Held >= u32Next)
+  {
+    return(0);
+  }
+
+  return(u32Next - u32Held);
+
+} /* end ButtonHoldDeadline() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonStateChange(u8 u8Button_)
+
+@brief Accepts a debounced change of a button to its eNewState.
+
+Requires:
+- Button_asStatus[u8Button_].eNewState differs from eCurrentState
+- Button_asStatus[u8Button_].u32DebounceTimeStart is the time of the edge
+
+@param u8Button_ is a valid button index
+
+Promises:
+- eCurrentState is updated
+- A press sets bNewPressFlag and u32TimeStamp and posts the press events; a 
+  release posts the release event
+
+*/
+static void ButtonStateChange(u8 u8Button_)
+{
+  Button_asStatus[u8Button_].eCurrentState = Button_asStatus[u8Button_].eNewState;
+  
+  /* If the new state is PRESSED, update the new press flag */
+  if(Button_asStatus[u8Button_].eCurrentState == PRESSED)
+  {
+    Button_asStatus[u8Button_].bNewPressFlag = TRUE;
+    Button_asStatus[u8Button_].u32TimeStamp  = Button_asStatus[u8Button_].u32DebounceTimeStart;
+    ButtonPressEvents(u8Button_);
+  }
+  else
+  {
+    ButtonReleaseEvents(u8Button_);
+  }
+
+} /* end ButtonStateChange() */
+
+
+#ifdef EIE_KEYPAD
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonKeypadUpdate(void)
+
+@brief Takes the keys accepted by the keypad scan into the button states.
+
+Requires:
+- Button_u32Keys holds the keys already reported
+
+Promises:
+- Every key that changed in KeypadGetKeys() goes through ButtonStateChange() dated by
+  the scan that first saw it, and Button_u32Keys is updated
+- The state machine checks the hold timers of a newly pressed key
+
+*/
+static void ButtonKeypadUpdate(void)
+{
+  u32 u32Keys;
+  u32 u32ChangeTime;
+  u32 u32Changed;
+  u8 u8Key;
+  u8 u8Button;
+
+  u32Keys = KeypadGetKeys(&u32ChangeTime);
+  u32Changed = u32Keys ^ Button_u32Keys;
+  Button_u32Keys = u32Keys;
+
+  while(u32Changed)
+  {
+    u8Key = (u8)(31 - __CLZ(u32Changed));
+    u32Changed &= ~((u32)1 << u8Key);
+
+    u8Button = U8_TOTAL_BUTTONS + u8Key;
+    Button_asStatus[u8Button].eNewState = (u32Keys & ((u32)1 << u8Key)) ? PRESSED : RELEASED;
+    Button_asStatus[u8Button].u32DebounceTimeStart = u32ChangeTime;
+    ButtonStateChange(u8Button);
+
+#ifndef EIE_BUTTON_VERTICAL_DEBOUNCE
+    Button_pfnStateMachine = ButtonSM_ButtonActive;
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+  }
+
+} /* end ButtonKeypadUpdate() */
+#endif /* EIE_KEYPAD */
+
+
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 ButtonVerticalCount(ButtonVerticalCounterType* psPort_, u32 u32Pressed_)
+
+@brief Runs one sample through the vertical counters of a port.
+
+Every pin that disagrees with its debounced level counts up (a ripple carry through 
+the bit planes); every pin that agrees is reset to 0.  Pins whose count reaches their
+sample setting take the new level.
+
+Requires:
+@param psPort_ points to the port's counters
+@param u32Pressed_ is the port's button pins sampled now (1 = pressed)
+
+Promises:
+- Returns the pins whose debounced level changed (already applied to u32Debounced,
+  their counters reset)
+
+*/
+static u32 ButtonVerticalCount(ButtonVerticalCounterType* psPort_, u32 u32Pressed_)
+{
+  u32 u32Differ = u32Pressed_ ^ psPort_->u32Debounced;
+  u32 u32Carry  = u32Differ;
+  u32 u32Done   = u32Differ;
+  u32 u32Plane;
+
+  for(u8 i = 0; i < U8_BUTTON_COUNTER_BITS; i++)
+  {
+    u32Plane = psPort_->au32Count[i];
+    psPort_->au32Count[i] = (u32Plane ^ u32Carry) & u32Differ;
+    u32Carry &= u32Plane;
+
+    /* Still done only where every bit so far matches the sample setting */
+    u32Done &= ~(psPort_->au32Count[i] ^ psPort_->au32Samples[i]);
+  }
+
+  psPort_->u32Debounced ^= u32Done;
+  for(u8 i = 0; i < U8_BUTTON_COUNTER_BITS; i++)
+  {
+    psPort_->au32Count[i] &= ~u32Done;
+  }
+
+  return(u32Done);
+
+} /* end ButtonVerticalCount() */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
 
 /***********************************************************************************************************************
 State Machine Function Definitions
@@ -315,6 +1068,72 @@ The button state machine monitors button activity and manages debouncing and
 maintaining the global button states.
 ***********************************************************************************************************************/
 
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void ButtonSM_Sample(void)
+
+@brief Debounce every button from one PIO_PDSR sample per port and manage the hold timers.
+
+The only state in EIE_BUTTON_VERTICAL_DEBOUNCE builds.  The scheduler skips it while
+nothing is settling and no hold event is due.
+*/
+static void ButtonSM_Sample(void)
+{
+  ButtonVerticalCounterType* psPort;
+  u32 u32Changed;
+  u32 u32Counting = 0;
+  u8 u8Bit;
+  u8 u8Button;
+
+  if(Button_bSampling)
+  {
+    for(u8 i = 0; i < U8_BUTTON_PORTS; i++)
+    {
+      psPort = &Button_asVertical[i];
+      u32Changed = ButtonVerticalCount(psPort, 
+                                       (*(&(AT91C_BASE_PIOA->PIO_PDSR) + (i * PORTB)) ^ Button_au32ActiveLow[i]) &
+                                       Button_au32PortButtons[i]);
+
+      /* Date each change back to the first of the matching samples */
+      while(u32Changed)
+      {
+        u8Bit = (u8)(31 - __CLZ(u32Changed));
+        u32Changed &= ~((u32)1 << u8Bit);
+
+        u8Button = G_au8BspButtonIndex[i][u8Bit];
+        Button_asStatus[u8Button].eNewState = (psPort->u32Debounced & ((u32)1 << u8Bit)) ? PRESSED : RELEASED;
+        Button_asStatus[u8Button].u32DebounceTimeStart = G_u32SystemTime1ms - (Button_asStatus[u8Button].u8DebounceSamples - 1);
+        ButtonStateChange(u8Button);
+      }
+
+      for(u8 j = 0; j < U8_BUTTON_COUNTER_BITS; j++)
+      {
+        u32Counting |= psPort->au32Count[j];
+      }
+    }
+
+    /* Every pin agrees with its debounced level: wait for the next change interrupt */
+    if(u32Counting == 0)
+    {
+      Button_bSampling = FALSE;
+      AT91C_BASE_PIOA->PIO_IER = GPIOA_BUTTONS;
+      AT91C_BASE_PIOB->PIO_IER = GPIOB_BUTTONS;
+    }
+  }
+
+  /* A button held down reports its hold thresholds */
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
+  {
+    if(ButtonHoldDeadline(i) == 0)
+    {
+      ButtonHoldEvents(i);
+    }
+  }
+
+} /* end ButtonSM_Sample() */
+
+#else
+
 /*!-------------------------------------------------------------------------------------------------------------------
 @fn static void ButtonSM_Idle(void)
 
@@ -322,7 +1141,7 @@ maintaining the global button states.
 */
 static void ButtonSM_Idle(void)                
 {
-  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
   {
     if(Button_asStatus[i].bDebounceActive)
     {
@@ -340,23 +1159,22 @@ static void ButtonSM_Idle(void)
 @brief Process each button that is debouncing.
 
 Time out the debounce period and set the "pressed" state if button action is confirmed.
-Manage the hold timers.
+Manage the hold timers and queue the subscribed events.  The state stays active while
+any button is debouncing or a held button still has hold events to come.
 */
 static void ButtonSM_ButtonActive(void)         
 {
-  u32 *pu32PortAddress;
+  u32 au32Pressed[U8_BUTTON_PORTS];
+  u8 u8PortsRead = 0;
+  u8 u8Port;
   u32 *pu32InterruptAddress;
 
   /* Start by resetting back to Idle in case no buttons are active */
   Button_pfnStateMachine = ButtonSM_Idle;
 
-  /* Check for buttons that are debouncing */
-  for(u8 i = 0; i < U8_TOTAL_BUTTONS; i++)
+  /* Check for buttons that are debouncing (keys never are: the keypad scan debounces them) */
+  for(u8 i = 0; i < U8_BUTTON_INPUTS; i++)
   {
-    /* Load address offsets for the current button */
-    pu32PortAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_PDSR) + G_asBspButtonConfigurations[i].ePort);
-    pu32InterruptAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_IER) + G_asBspButtonConfigurations[i].ePort);
-    
     /* Check if the current button is debouncing */
     if( Button_asStatus[i].bDebounceActive )
     {
@@ -366,55 +1184,56 @@ static void ButtonSM_ButtonActive(void)
       /* Check if debounce period is over */
       if( IsTimeUp(&Button_asStatus[i].u32DebounceTimeStart, U32_DEBOUNCE_TIME) )
       {
-        /* Active low */
-        if(G_asBspButtonConfigurations[i].eActiveState == ACTIVE_LOW)
+        /* Read PIO_PDSR once per port for all of its buttons this tick; flipping the 
+        active low pins leaves a 1 for every pressed button */
+        u8Port = (u8)(G_asBspButtonConfigurations[i].ePort / PORTB);
+        if( !(u8PortsRead & (1 << u8Port)) )
         {
-          /* Read PIO_PDSR to get the actual input signal (new button state) */
-          if( ~(*pu32PortAddress) & G_asBspButtonConfigurations[i].u32BitPosition )
-          {          
-            Button_asStatus[i].eNewState = PRESSED;
-          }
-          else
-          {
-            Button_asStatus[i].eNewState = RELEASED;
-          }
+          au32Pressed[u8Port] = *(&(AT91C_BASE_PIOA->PIO_PDSR) + G_asBspButtonConfigurations[i].ePort) ^
+                                Button_au32ActiveLow[u8Port];
+          u8PortsRead |= (u8)(1 << u8Port);
+        }
+
+        if( au32Pressed[u8Port] & G_asBspButtonConfigurations[i].u32BitPosition )
+        {          
+          Button_asStatus[i].eNewState = PRESSED;
         }
-        /* Active high */
         else
         {
-          /* Read PIO_PDSR to get the actual input signal (new button state) */
-          if( *pu32PortAddress & G_asBspButtonConfigurations[i].u32BitPosition )
-          {          
-            Button_asStatus[i].eNewState = PRESSED;
-          }
-          else
-          {
-            Button_asStatus[i].eNewState = RELEASED;
-          }
+          Button_asStatus[i].eNewState = RELEASED;
         }
         
         /* Update if the button state has changed */
         if( Button_asStatus[i].eNewState != Button_asStatus[i].eCurrentState )
         {
-          Button_asStatus[i].eCurrentState = Button_asStatus[i].eNewState;
-          
-          /* If the new state is PRESSED, update the new press flag */
-          if(Button_asStatus[i].eCurrentState == PRESSED)
-          {
-            Button_asStatus[i].bNewPressFlag = TRUE;
-            Button_asStatus[i].u32TimeStamp  = G_u32SystemTime1ms;
-          }
+          ButtonStateChange(i);
         }
 
         /* Regardless of a good press or not, clear the debounce active flag and re-enable the interrupts */
         Button_asStatus[i].bDebounceActive = FALSE;
+        pu32InterruptAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_IER) + G_asBspButtonConfigurations[i].ePort);
         *pu32InterruptAddress = G_asBspButtonConfigurations[i].u32BitPosition;
         
       } /* end if( IsTimeUp...) */
     } /* end if(Button_asStatus[i].bDebounceActive) */
-  } /* end for (u8 i = 0; i < U8_TOTAL_BUTTONS; i++) */
+
+    /* A button held down reports its hold thresholds */
+    if( !Button_asStatus[i].bDebounceActive )
+    {
+      if(ButtonHoldDeadline(i) == 0)
+      {
+        ButtonHoldEvents(i);
+      }
+
+      if(ButtonHoldDeadline(i) != U32_NO_DEADLINE)
+      {
+        Button_pfnStateMachine = ButtonSM_ButtonActive;
+      }
+    }
+  } /* end for (u8 i = 0; i < U8_BUTTON_INPUTS; i++) */
   
 } /* end ButtonSM_ButtonActive() */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
 
 
 #if 0
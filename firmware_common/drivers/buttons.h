@@ -9,6 +9,10 @@
 /***********************************************************************************************************************
 Type Definitions
 ***********************************************************************************************************************/
+#define BUTTON_MASK(eButton_)       ((u32)1 << (u8)(eButton_))  /*!< @brief ButtonEventSubscribe() bit for a button */
+#define BUTTON_EVENT_MASK(eEvent_)  ((u8)(1 << (u8)(eEvent_)))  /*!< @brief ButtonEventSubscribe() bit for an event */
+#define BUTTON_EVENTS_ALL           (u8)0x3F                    /*!< @brief Every ButtonEventType */
+#define U8_BUTTON_COUNTER_BITS      (u8)4                       /*!< @brief Vertical counter depth: up to 15 samples */
 
 /*! 
 @enum ButtonStateType
@@ -16,6 +20,20 @@ Type Definitions
 typedef enum {RELEASED, PRESSED} ButtonStateType; 
 
 
+/*! 
+@enum ButtonEventType
+@brief Things a button can report through the event queue.
+
+PRESS and RELEASE follow the debounced state.  While a button stays down, HOLD is 
+reported once after U32_BUTTON_HOLD_TIME, then REPEAT every U32_BUTTON_REPEAT_TIME, 
+and LONG_PRESS once after U32_BUTTON_LONG_PRESS_TIME.  A short press that starts 
+within U32_BUTTON_DOUBLE_CLICK_TIME of the previous short press ending is reported 
+as PRESS followed by DOUBLE_CLICK.
+*/
+typedef enum {BUTTON_EVENT_PRESS = 0, BUTTON_EVENT_RELEASE, BUTTON_EVENT_HOLD, BUTTON_EVENT_REPEAT, 
+              BUTTON_EVENT_DOUBLE_CLICK, BUTTON_EVENT_LONG_PRESS} ButtonEventType;
+
+
 /*! 
 @struct ButtonStatusType
 @brief Required parameters for the task to track what each button is doing. 
@@ -27,10 +45,50 @@ typedef struct
   ButtonStateType eCurrentState;          /*!< @brief Current state of the button */
   ButtonStateType eNewState;              /*!< @brief New state of the button */
   u32 u32DebounceTimeStart;               /*!< @brief System time loaded by ISR when button interrupt occurs */
-  u32 u32TimeStamp;                       /*!< @brief System time when the button was pressed */
+  u32 u32TimeStamp;                       /*!< @brief System time of the edge that started the current press */
+  u32 u32ReleaseTime;                     /*!< @brief System time of the edge that ended the last press */
+  u32 u32NextHoldTime;                    /*!< @brief Held time in ms of the next HOLD / REPEAT */
+  u8 u8EventMask;                         /*!< @brief BUTTON_EVENT_MASK() bits queued for this button */
+  bool bLongPressSent;                    /*!< @brief LONG_PRESS has been reported for the current press */
+  bool bDoubleClick;                      /*!< @brief The current press completed a double click */
+  bool bClickArmed;                       /*!< @brief The last press was short: a quick next press is a double click */
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+  u8 u8DebounceSamples;                   /*!< @brief Matching samples needed to accept a new level */
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
 }ButtonStatusType;
 
 
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+/*! 
+@struct ButtonVerticalCounterType
+@brief Debounce state of all the buttons on one port, one bit per pin.
+
+The per-pin counters are stored "vertically": bit n of au32Count[] holds bit n of
+every pin's count, so one pass of bitwise operations updates all pins at once.
+*/
+typedef struct 
+{
+  u32 u32Debounced;                               /*!< @brief Accepted level of each pin: 1 = pressed */
+  u32 au32Count[U8_BUTTON_COUNTER_BITS];          /*!< @brief Consecutive samples that disagree with u32Debounced */
+  u32 au32Samples[U8_BUTTON_COUNTER_BITS];        /*!< @brief Count at which each pin takes the new level */
+}ButtonVerticalCounterType;
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
+
+
+/*! 
+@struct ButtonEventRecordType
+@brief One entry of the button event queue.
+*/
+typedef struct 
+{
+  ButtonNameType eButton;                 /*!< @brief Button the event is for */
+  ButtonEventType eEvent;                 /*!< @brief What happened */
+  u32 u32TimeStamp;                       /*!< @brief G_u32SystemTime1ms when it happened */
+  u16 u16Duration;                        /*!< @brief ms held (RELEASE, HOLD, REPEAT, LONG_PRESS) or released 
+                                                      between the clicks (DOUBLE_CLICK); 0 for PRESS; saturates at 0xFFFF */
+}ButtonEventRecordType;
+
+
 #if 0
 /*! 
 @struct ButtonDebounceType
@@ -54,6 +112,13 @@ bool IsButtonPressed(ButtonNameType eButton_);
 bool WasButtonPressed(ButtonNameType eButton_);
 void ButtonAcknowledge(ButtonNameType eButton_);
 bool IsButtonHeld(ButtonNameType eButton_, u32 u32ButtonHeldTime_);
+void ButtonEventSubscribe(u32 u32Buttons_, u8 u8Events_);
+bool ButtonEventGet(ButtonEventRecordType* psEvent_);
+u8 ButtonEventCount(void);
+bool ButtonEventQueueEmpty(void);
+#ifdef EIE_BUTTON_VERTICAL_DEBOUNCE
+void ButtonSetDebounceSamples(u32 u32Buttons_, u8 u8Samples_);
+#endif /* EIE_BUTTON_VERTICAL_DEBOUNCE */
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
@@ -61,27 +126,30 @@ bool IsButtonHeld(ButtonNameType eButton_, u32 u32ButtonHeldTime_);
 /*--------------------------------------------------------------------------------------------------------------------*/
 void ButtonInitialize(void);                        
 void ButtonRunActiveState(void);
-void ButtonStartDebounce(u32 u32BitPosition_, PortOffsetType ePort_);
-
-
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
+bool ButtonIsIdle(void);
+u32 ButtonNextDeadline(void);
+void ButtonStartDebounce(ButtonNameType eButton_);
 
 
 /***********************************************************************************************************************
-State Machine Declarations
+Constants / Definitions
 ***********************************************************************************************************************/
-static void ButtonSM_Idle(void);                
-static void ButtonSM_ButtonActive(void);
-static void ButtonSM_Error(void);        
+#define U32_DEBOUNCE_TIME       (u32)10       /*! @brief Time in ms for button debouncing */
 
+#define U32_BUTTON_HOLD_TIME          (u32)500      /*!< @brief Held time in ms for BUTTON_EVENT_HOLD */
+#define U32_BUTTON_REPEAT_TIME        (u32)100      /*!< @brief ms between BUTTON_EVENT_REPEATs after the HOLD */
+#define U32_BUTTON_LONG_PRESS_TIME    (u32)2000     /*!< @brief Held time in ms for BUTTON_EVENT_LONG_PRESS */
+#define U32_BUTTON_DOUBLE_CLICK_TIME  (u32)300      /*!< @brief Longest gap in ms between the clicks of a double click */
 
+#define U8_BUTTON_EVENT_QUEUE_SIZE    (u8)16        /*!< @brief Event queue entries (power of 2, at most 128) */
+#define U16_BUTTON_DURATION_MAX       (u16)0xFFFF   /*!< @brief ButtonEventRecordType.u16Duration saturation */
 
-/***********************************************************************************************************************
-Constants / Definitions
-***********************************************************************************************************************/
-#define U32_DEBOUNCE_TIME       (u32)10       /*! @brief Time in ms for button debouncing */
+/* Vertical counter debounce: build with EIE_BUTTON_VERTICAL_DEBOUNCE defined (IAR preprocessor defines or
+make EXTRA_DEFINES=-DEIE_BUTTON_VERTICAL_DEBOUNCE in gcc_sim) to debounce every button from one PIO_PDSR 
+sample per port per tick instead of a timer per button.  A pin takes its new level after the set number of 
+matching samples in a row. */
+#define U8_BUTTON_MAX_SAMPLES         (u8)((1 << U8_BUTTON_COUNTER_BITS) - 1)  /*!< @brief Most samples a counter can reach */
+#define U8_BUTTON_DEFAULT_SAMPLES     (u8)U32_DEBOUNCE_TIME                     /*!< @brief Samples (ms) after ButtonInitialize() */
 
 
 
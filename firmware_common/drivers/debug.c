@@ -0,0 +1,1107 @@
+/*!**********************************************************************************************************************
+@file debug.c
+@brief Debug console on USART0 (PA18 / PA19 to the board's USB serial port).
+
+Output: DebugPrintf() formats straight into one of U8_DEBUG_TX_BUFFERS buffers and
+queues it; the USART's PDC channel sends the queue one buffer after the other and
+the ENDTX interrupt frees each buffer and starts the next.  Nothing waits for the
+line and the buffers and transmit counters are only changed with interrupts masked, so
+tasks and interrupt handlers may both print: if every buffer is still in use the
+message is dropped and counted instead.  The vsnprintf() formatting runs in the
+caller's time, so from an interrupt handler keep messages short and without floating
+point conversions (which need a reentrant C library).  Messages end lines with "\r\n".
+
+Input: the receive PDC channel fills a U16_DEBUG_RX_BUFFER_SIZE ring in two halves
+(the ENDRX interrupt hands each full half back as the next buffer) with no interrupt
+per character.  The receiver time-out interrupt fires when the line goes quiet after
+some input, which wakes the loop from sleep so the debug task can read the ring.
+
+The task echoes what is typed, with backspace / delete to edit and Ctrl-C to drop the
+line, and runs the line against Debug_asCommands[] on Enter.  Type help for the list.
+
+At start up the console prints the firmware version and, if the last reset was not
+asked for, what caused it (see FaultGetLast()).
+
+USART0 has no clock in Wait mode, so in EIE_DEEP_SLEEP builds the system only deep
+sleeps once all output has gone and characters typed during a deep sleep are lost.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_sDebugStats
+
+CONSTANTS
+- U32_DEBUG_BAUD, U8_DEBUG_TX_BUFFERS, U16_DEBUG_TX_BUFFER_SIZE, U16_DEBUG_RX_BUFFER_SIZE
+
+TYPES
+- DebugCommandType, DebugStatsType
+
+PUBLIC FUNCTIONS
+- bool DebugPrintf(const char* pcFormat_, ...)
+- bool DebugWrite(const u8* pu8Data_, u16 u16Length_)
+- u8 DebugTxFreeBuffers(void)
+
+PROTECTED FUNCTIONS
+- void DebugInitialize(void)
+- void DebugRunActiveState(void)
+- bool DebugIsIdle(void)
+- void USART0_IrqHandler(void)
+
+***********************************************************************************************************************/
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Debug"
+***********************************************************************************************************************/
+/* New variables */
+DebugStatsType G_sDebugStats;                          /*!< @brief Console counters */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+
+#ifdef EIE_TASK_PROFILER
+extern TaskProfileType G_asMainTaskProfile[U8_MAIN_TASKS]; /*!< @brief From main.c */
+extern LoopProfileType G_sMainLoopProfile;             /*!< @brief From main.c */
+#endif /* EIE_TASK_PROFILER */
+
+#ifdef EIE_TRACE
+extern TraceBufferType G_sTrace;                       /*!< @brief From trace.c */
+#endif /* EIE_TRACE */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u8 DebugTxClaim(void);
+static void DebugTxCommit(u8 u8Buffer_, u16 u16Length_);
+static void DebugStatsCount(u32* pu32Counter_);
+static void DebugTxStart(void);
+static u16 DebugRxWriteIndex(void);
+static void DebugRxRearm(void);
+static void DebugLineInput(u8 u8Char_);
+static void DebugLineExecute(void);
+static void DebugEcho(const char* pcText_);
+static void DebugEchoFlush(void);
+static u32 DebugReadableBytes(u32 u32Address_);
+static void DebugPrintFault(void);
+
+static void DebugCommandHelp(const char* pcArgs_);
+static void DebugCommandVersion(const char* pcArgs_);
+static void DebugCommandTime(const char* pcArgs_);
+static void DebugCommandFault(const char* pcArgs_);
+static void DebugCommandStats(const char* pcArgs_);
+static void DebugCommandRead(const char* pcArgs_);
+static void DebugCommandTasks(const char* pcArgs_);
+static void DebugCommandTrace(const char* pcArgs_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void DebugSM_Idle(void);
+#ifdef EIE_TRACE
+static void DebugSM_TraceDump(void);
+#endif /* EIE_TRACE */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Debug_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Debug_pfnStateMachine;              /*!< @brief The state machine function pointer */
+
+static u8 Debug_aau8TxBuffers[U8_DEBUG_TX_BUFFERS][U16_DEBUG_TX_BUFFER_SIZE]; /*!< @brief The transmit buffer pool */
+static u16 Debug_au16TxLength[U8_DEBUG_TX_BUFFERS];    /*!< @brief Bytes to send from each queued buffer */
+static volatile u32 Debug_u32TxFreeMask;               /*!< @brief Bit n set while buffer n is free */
+static u8 Debug_au8TxQueue[U8_DEBUG_TX_BUFFERS];       /*!< @brief Buffers waiting for the PDC, oldest at Debug_u8TxQueueHead */
+static u8 Debug_u8TxQueueHead;                         /*!< @brief Oldest entry of Debug_au8TxQueue */
+static u8 Debug_u8TxQueued;                            /*!< @brief Entries in Debug_au8TxQueue */
+static volatile u8 Debug_u8TxActive;                   /*!< @brief Buffer the PDC is sending or U8_DEBUG_TX_NONE */
+
+static u8 Debug_au8RxBuffer[U16_DEBUG_RX_BUFFER_SIZE]; /*!< @brief Receive ring the PDC writes */
+static u16 Debug_u16RxRead;                            /*!< @brief Next Debug_au8RxBuffer index the parser reads */
+
+static char Debug_acLine[U8_DEBUG_LINE_SIZE + 1];      /*!< @brief Command line being typed */
+static u8 Debug_u8LineLength;                          /*!< @brief Characters in Debug_acLine */
+static u8 Debug_u8LastChar;                            /*!< @brief Previous character, to treat CR LF as one Enter */
+static char Debug_acEcho[U8_DEBUG_LINE_SIZE];          /*!< @brief Echo gathered while reading input, sent as one message */
+static u8 Debug_u8EchoLength;                          /*!< @brief Characters in Debug_acEcho */
+
+/*! @brief What the rd command may read: anything else would bus fault (or, in the
+simulation, read host memory that is not there) */
+static const DebugMemoryRegionType Debug_asReadRegions[] =
+{
+  {AT91C_IFLASH0,         AT91C_IFLASH0_SIZE},
+  {AT91C_IFLASH1,         AT91C_IFLASH1_SIZE},
+  {AT91C_IRAM,            AT91C_IRAM_SIZE},
+  {U32_DEBUG_SRAM1_BASE,  U32_DEBUG_SRAM1_SIZE},
+  {U32_DEBUG_PERIPH_BASE, U32_DEBUG_PERIPH_SIZE},
+  {U32_DEBUG_PPB_BASE,    U32_DEBUG_PPB_SIZE},
+};
+
+#ifdef EIE_TRACE
+static u32 Debug_u32DumpOffset;                        /*!< @brief Next G_sTrace byte the trace dump prints */
+static u32 Debug_u32DumpTraceEnabled;                  /*!< @brief G_sTrace.u32Enabled before the dump stopped it */
+#endif /* EIE_TRACE */
+
+/*! @brief Console commands: add new ones here (and the prototype to debug.h) */
+static const DebugCommandType Debug_asCommands[] =
+{
+  {"help",    DebugCommandHelp,    "list the commands"},
+  {"version", DebugCommandVersion, "firmware version"},
+  {"time",    DebugCommandTime,    "time since start up"},
+  {"fault",   DebugCommandFault,   "what caused the last reset"},
+  {"stats",   DebugCommandStats,   "console counters"},
+  {"rd",      DebugCommandRead,    "rd <address> [words]: read flash, SRAM or peripheral registers"},
+  {"tasks",   DebugCommandTasks,   "task profile (EIE_TASK_PROFILER builds)"},
+  {"trace",   DebugCommandTrace,   "trace [start|stop|clear]: no argument dumps G_sTrace as hex for xxd -r -p"},
+};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DebugPrintf(const char* pcFormat_, ...)
+
+@brief Formats a message into a transmit buffer and queues it for the console.
+
+Never waits: the formatting is the only work done in the caller's time.  Interrupt
+handlers may call it too (see the file header for what to avoid there).
+
+Requires:
+- DebugInitialize() has run
+@param pcFormat_ is a printf format (end lines with "\r\n"); the result is cut to
+U16_DEBUG_TX_BUFFER_SIZE - 1 characters
+
+Promises:
+- Returns TRUE if the message was queued
+- Returns FALSE (and counts it in G_sDebugStats.u32TxDropped) if every transmit
+  buffer is in use
+
+*/
+bool DebugPrintf(const char* pcFormat_, ...)
+{
+  va_list vaArgs;
+  int iLength;
+  u8 u8Buffer;
+
+  u8Buffer = DebugTxClaim();
+  if(u8Buffer == U8_DEBUG_TX_NONE)
+  {
+    DebugStatsCount(&G_sDebugStats.u32TxDropped);
+    return(FALSE);
+  }
+
+  va_start(vaArgs, pcFormat_);
+  iLength = vsnprintf((char*)Debug_aau8TxBuffers[u8Buffer], U16_DEBUG_TX_BUFFER_SIZE, pcFormat_, vaArgs);
+  va_end(vaArgs);
+
+  if(iLength < 0)
+  {
+    iLength = 0;
+  }
+  else if(iLength >= U16_DEBUG_TX_BUFFER_SIZE)
+  {
+    iLength = U16_DEBUG_TX_BUFFER_SIZE - 1;
+    DebugStatsCount(&G_sDebugStats.u32TxTruncated);
+  }
+
+  DebugTxCommit(u8Buffer, (u16)iLength);
+  return(TRUE);
+
+} /* end DebugPrintf() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DebugWrite(const u8* pu8Data_, u16 u16Length_)
+
+@brief Queues raw bytes for the console, using as many transmit buffers as they need.
+
+Requires:
+- DebugInitialize() has run
+@param pu8Data_ points to the bytes (copied, so it may be reused straight away)
+@param u16Length_ is the number of bytes
+
+Promises:
+- Returns TRUE if every byte was queued
+- Returns FALSE if the buffers ran out; the bytes up to the last full buffer are
+  queued and the drop is counted in G_sDebugStats.u32TxDropped
+
+*/
+bool DebugWrite(const u8* pu8Data_, u16 u16Length_)
+{
+  u16 u16Chunk;
+  u8 u8Buffer;
+
+  while(u16Length_ != 0)
+  {
+    u8Buffer = DebugTxClaim();
+    if(u8Buffer == U8_DEBUG_TX_NONE)
+    {
+      DebugStatsCount(&G_sDebugStats.u32TxDropped);
+      return(FALSE);
+    }
+
+    u16Chunk = (u16Length_ > U16_DEBUG_TX_BUFFER_SIZE) ? U16_DEBUG_TX_BUFFER_SIZE : u16Length_;
+    memcpy(Debug_aau8TxBuffers[u8Buffer], pu8Data_, u16Chunk);
+    DebugTxCommit(u8Buffer, u16Chunk);
+
+    pu8Data_ += u16Chunk;
+    u16Length_ -= u16Chunk;
+  }
+
+  return(TRUE);
+
+} /* end DebugWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8 DebugTxFreeBuffers(void)
+
+@brief Returns how many transmit buffers are free.
+
+Lets bulk output (the log drain) leave room for the console's own messages.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the number of buffers DebugPrintf() / DebugWrite() could claim now
+
+*/
+u8 DebugTxFreeBuffers(void)
+{
+  u32 u32Free = Debug_u32TxFreeMask;
+  u8 u8Count = 0;
+
+  while(u32Free != 0)
+  {
+    u32Free &= u32Free - 1;
+    u8Count++;
+  }
+
+  return(u8Count);
+
+} /* end DebugTxFreeBuffers() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DebugInitialize(void)
+
+@brief Sets up USART0 and both PDC channels and prints the start up banner.
+
+Requires:
+- PA18 / PA19 are assigned to USART0 and its peripheral clock is on (GpioSetup(),
+  PMC_PCER_INIT)
+
+Promises:
+- USART0 runs at U32_DEBUG_BAUD 8N1 with the receive ring armed and the ENDRX and
+  TIMEOUT interrupts enabled
+- The version and any fault record from the last reset are queued for output, plus a
+  reminder if the trace ring was kept frozen through the reset (EIE_TRACE)
+- Debug_pfnStateMachine = DebugSM_Idle
+
+*/
+void DebugInitialize(void)
+{
+  u8 au8Version[] = FIRMWARE_VERSION;
+
+  AT91C_BASE_US0->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+  AT91C_BASE_US0->US_IDR = 0xFFFFFFFF;
+  AT91C_BASE_US0->US_CR = DEBUG_US_CR_RESET;
+  AT91C_BASE_US0->US_MR = DEBUG_US_MR_INIT;
+  AT91C_BASE_US0->US_BRGR = DEBUG_US_BRGR_INIT;
+  AT91C_BASE_US0->US_RTOR = DEBUG_US_RTOR_INIT;
+
+  /* Every transmit buffer is free; the receive ring starts with both halves armed */
+  Debug_u32TxFreeMask = (u32)(((u64)1 << U8_DEBUG_TX_BUFFERS) - 1);
+  Debug_u8TxQueueHead = 0;
+  Debug_u8TxQueued = 0;
+  Debug_u8TxActive = U8_DEBUG_TX_NONE;
+  Debug_u16RxRead = 0;
+  AT91C_BASE_US0->US_TCR = 0;
+  AT91C_BASE_US0->US_TNCR = 0;
+  AT91C_BASE_US0->US_RPR = (u32)&Debug_au8RxBuffer[0];
+  AT91C_BASE_US0->US_RCR = U16_DEBUG_RX_HALF;
+  AT91C_BASE_US0->US_RNPR = (u32)&Debug_au8RxBuffer[U16_DEBUG_RX_HALF];
+  AT91C_BASE_US0->US_RNCR = U16_DEBUG_RX_HALF;
+
+  AT91C_BASE_US0->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
+  AT91C_BASE_US0->US_CR = DEBUG_US_CR_ENABLE;
+  AT91C_BASE_US0->US_IER = DEBUG_US_IER_INIT;
+
+  NVIC_ClearPendingIRQ(IRQn_US0);
+  NVIC_EnableIRQ(IRQn_US0);
+
+  /* Start up banner */
+  DebugPrintf("\r\n%s", (char*)au8Version);
+  if( FaultGetLast(NULL) )
+  {
+    DebugPrintFault();
+  }
+#ifdef EIE_TRACE
+  if(!G_sTrace.u32Enabled)
+  {
+    DebugPrintf("trace: ring kept from before the reset, stopped until trace start\r\n");
+  }
+#endif /* EIE_TRACE */
+  DebugPrintf(DEBUG_PROMPT);
+
+  Debug_pfnStateMachine = DebugSM_Idle;
+
+} /* end DebugInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void DebugRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void DebugRunActiveState(void)
+{
+  Debug_pfnStateMachine();
+
+} /* end DebugRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool DebugIsIdle(void)
+
+@brief Reports whether the debug task has any work this tick (used by the main loop scheduler).
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if no dump is running and the PDC has not received anything the
+  parser has not read
+
+*/
+bool DebugIsIdle(void)
+{
+  return( (bool)((Debug_pfnStateMachine == DebugSM_Idle) && (DebugRxWriteIndex() == Debug_u16RxRead)) );
+
+} /* end DebugIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void USART0_IrqHandler(void)
+
+@brief Moves the transmit queue along and keeps the receive ring armed.
+
+Requires:
+- DebugInitialize() has run
+
+Promises:
+- ENDTX: the buffer just sent is free again and the next queued one is started
+- ENDRX: the half of the receive ring just filled is the PDC's next buffer
+- TIMEOUT: cleared; the time-out waits for the next character
+
+*/
+void USART0_IrqHandler(void)
+{
+  u32 u32Status;
+
+  TRACE_ISR_ENTER(IRQn_US0);
+
+  u32Status = AT91C_BASE_US0->US_CSR & AT91C_BASE_US0->US_IMR;
+
+  if(u32Status & AT91C_US_ENDTX)
+  {
+    Debug_u32TxFreeMask |= (u32)1 << Debug_u8TxActive;
+    Debug_u8TxActive = U8_DEBUG_TX_NONE;
+    AT91C_BASE_US0->US_IDR = AT91C_US_ENDTX;
+    DebugTxStart();
+  }
+
+  if(u32Status & AT91C_US_ENDRX)
+  {
+    DebugRxRearm();
+  }
+
+  /* Nothing to do but wake the loop: the task reads the ring */
+  if(u32Status & AT91C_US_TIMEOUT)
+  {
+    AT91C_BASE_US0->US_CR = AT91C_US_STTTO;
+  }
+
+  NVIC_ClearPendingIRQ(IRQn_US0);
+  TRACE_ISR_EXIT(IRQn_US0);
+
+} /* end USART0_IrqHandler() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 DebugTxClaim(void)
+
+@brief Takes a free transmit buffer, or returns U8_DEBUG_TX_NONE if there is none.
+*/
+static u8 DebugTxClaim(void)
+{
+  u32 u32PriMask = __get_PRIMASK();
+  u8 u8Buffer = U8_DEBUG_TX_NONE;
+
+  __disable_irq();
+  if(Debug_u32TxFreeMask != 0)
+  {
+    u8Buffer = (u8)(31 - __CLZ(Debug_u32TxFreeMask));
+    Debug_u32TxFreeMask &= ~((u32)1 << u8Buffer);
+  }
+  __set_PRIMASK(u32PriMask);
+
+  return(u8Buffer);
+
+} /* end DebugTxClaim() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugTxCommit(u8 u8Buffer_, u16 u16Length_)
+
+@brief Queues a claimed buffer holding u16Length_ bytes (an empty one is just freed).
+*/
+static void DebugTxCommit(u8 u8Buffer_, u16 u16Length_)
+{
+  u32 u32PriMask = __get_PRIMASK();
+
+  __disable_irq();
+  if(u16Length_ == 0)
+  {
+    Debug_u32TxFreeMask |= (u32)1 << u8Buffer_;
+  }
+  else
+  {
+    Debug_au16TxLength[u8Buffer_] = u16Length_;
+    Debug_au8TxQueue[(Debug_u8TxQueueHead + Debug_u8TxQueued) % U8_DEBUG_TX_BUFFERS] = u8Buffer_;
+    Debug_u8TxQueued++;
+    G_sDebugStats.u32TxBytes += u16Length_;
+    DebugTxStart();
+  }
+  __set_PRIMASK(u32PriMask);
+
+} /* end DebugTxCommit() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugStatsCount(u32* pu32Counter_)
+
+@brief Adds one to a G_sDebugStats counter; masked, since tasks and interrupts both print.
+*/
+static void DebugStatsCount(u32* pu32Counter_)
+{
+  u32 u32PriMask = __get_PRIMASK();
+
+  __disable_irq();
+  (*pu32Counter_)++;
+  __set_PRIMASK(u32PriMask);
+
+} /* end DebugStatsCount() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugTxStart(void)
+
+@brief Hands the oldest queued buffer to the PDC if it is not already sending one.
+
+Called with interrupts masked or from USART0_IrqHandler().
+*/
+static void DebugTxStart(void)
+{
+  u8 u8Buffer;
+
+  if( (Debug_u8TxActive != U8_DEBUG_TX_NONE) || (Debug_u8TxQueued == 0) )
+  {
+    return;
+  }
+
+  u8Buffer = Debug_au8TxQueue[Debug_u8TxQueueHead];
+  Debug_u8TxQueueHead = (Debug_u8TxQueueHead + 1) % U8_DEBUG_TX_BUFFERS;
+  Debug_u8TxQueued--;
+  Debug_u8TxActive = u8Buffer;
+
+  /* Writing TCR clears ENDTX */
+  AT91C_BASE_US0->US_TPR = (u32)Debug_aau8TxBuffers[u8Buffer];
+  AT91C_BASE_US0->US_TCR = Debug_au16TxLength[u8Buffer];
+  AT91C_BASE_US0->US_IER = AT91C_US_ENDTX;
+
+} /* end DebugTxStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u16 DebugRxWriteIndex(void)
+
+@brief Returns the Debug_au8RxBuffer index the PDC writes next.
+*/
+static u16 DebugRxWriteIndex(void)
+{
+  return( (u16)((AT91C_BASE_US0->US_RPR - (u32)&Debug_au8RxBuffer[0]) % U16_DEBUG_RX_BUFFER_SIZE) );
+
+} /* end DebugRxWriteIndex() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugRxRearm(void)
+
+@brief Gives the half of the receive ring the PDC is not filling back to it as the next buffer.
+
+The parser has U16_DEBUG_RX_HALF character times to read a half before it is
+written again (5.5ms at 115200).
+*/
+static void DebugRxRearm(void)
+{
+  u32 u32Base = (u32)&Debug_au8RxBuffer[0];
+
+  if(AT91C_BASE_US0->US_RPR >= u32Base + U16_DEBUG_RX_HALF)
+  {
+    AT91C_BASE_US0->US_RNPR = u32Base;
+  }
+  else
+  {
+    AT91C_BASE_US0->US_RNPR = u32Base + U16_DEBUG_RX_HALF;
+  }
+
+  /* Writing RNCR clears ENDRX */
+  AT91C_BASE_US0->US_RNCR = U16_DEBUG_RX_HALF;
+
+} /* end DebugRxRearm() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugLineInput(u8 u8Char_)
+
+@brief Line editor: adds one received character to the command line and echoes it.
+*/
+static void DebugLineInput(u8 u8Char_)
+{
+  char acChar[2] = {(char)u8Char_, '\0'};
+  u8 u8LastChar = Debug_u8LastChar;
+
+  Debug_u8LastChar = u8Char_;
+
+  switch(u8Char_)
+  {
+    case U8_DEBUG_CHAR_LF:
+    {
+      /* CR LF is one Enter */
+      if(u8LastChar == U8_DEBUG_CHAR_CR)
+      {
+        break;
+      }
+    }
+    /* fall through */
+    case U8_DEBUG_CHAR_CR:
+    {
+      DebugEcho("\r\n");
+      DebugEchoFlush();
+      DebugLineExecute();
+      break;
+    }
+
+    case U8_DEBUG_CHAR_BACKSPACE:
+    case U8_DEBUG_CHAR_DELETE:
+    {
+      if(Debug_u8LineLength != 0)
+      {
+        Debug_u8LineLength--;
+        DebugEcho("\b \b");
+      }
+      break;
+    }
+
+    case U8_DEBUG_CHAR_CTRL_C:
+    {
+      Debug_u8LineLength = 0;
+      DebugEcho("^C\r\n" DEBUG_PROMPT);
+      break;
+    }
+
+    default:
+    {
+      /* Printable characters that fit; anything else is ignored */
+      if( (u8Char_ >= ' ') && (u8Char_ < U8_DEBUG_CHAR_DELETE) && (Debug_u8LineLength < U8_DEBUG_LINE_SIZE) )
+      {
+        Debug_acLine[Debug_u8LineLength++] = (char)u8Char_;
+        DebugEcho(acChar);
+      }
+      break;
+    }
+  }
+
+} /* end DebugLineInput() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugLineExecute(void)
+
+@brief Runs the command on the line and starts a new line.
+
+The first word is looked up in Debug_asCommands[]; the rest of the line, without
+leading spaces, is passed to the command.
+*/
+static void DebugLineExecute(void)
+{
+  char* pcName = Debug_acLine;
+  char* pcArgs;
+  u8 i;
+
+  Debug_acLine[Debug_u8LineLength] = '\0';
+  Debug_u8LineLength = 0;
+
+  while(*pcName == ' ')
+  {
+    pcName++;
+  }
+
+  if(*pcName != '\0')
+  {
+    /* Split the name from the arguments */
+    for(pcArgs = pcName; (*pcArgs != ' ') && (*pcArgs != '\0'); pcArgs++);
+    if(*pcArgs != '\0')
+    {
+      *pcArgs++ = '\0';
+      while(*pcArgs == ' ')
+      {
+        pcArgs++;
+      }
+    }
+
+    for(i = 0; i < sizeof(Debug_asCommands) / sizeof(DebugCommandType); i++)
+    {
+      if(strcmp(pcName, Debug_asCommands[i].pcName) == 0)
+      {
+        Debug_asCommands[i].pfnCommand(pcArgs);
+        break;
+      }
+    }
+
+    if(i == sizeof(Debug_asCommands) / sizeof(DebugCommandType))
+    {
+      DebugPrintf("%s: unknown command (try help)\r\n", pcName);
+    }
+  }
+
+  /* A command that keeps printing shows the prompt when it is done */
+  if(Debug_pfnStateMachine == DebugSM_Idle)
+  {
+    DebugPrintf(DEBUG_PROMPT);
+  }
+
+} /* end DebugLineExecute() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugEcho(const char* pcText_)
+
+@brief Adds text to the echo so a burst of typing goes out as one message.
+*/
+static void DebugEcho(const char* pcText_)
+{
+  while(*pcText_ != '\0')
+  {
+    if(Debug_u8EchoLength == sizeof(Debug_acEcho))
+    {
+      DebugEchoFlush();
+    }
+    Debug_acEcho[Debug_u8EchoLength++] = *pcText_++;
+  }
+
+} /* end DebugEcho() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugEchoFlush(void)
+
+@brief Queues the echo gathered so far.
+*/
+static void DebugEchoFlush(void)
+{
+  if(Debug_u8EchoLength != 0)
+  {
+    DebugWrite((u8*)Debug_acEcho, Debug_u8EchoLength);
+    Debug_u8EchoLength = 0;
+  }
+
+} /* end DebugEchoFlush() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 DebugReadableBytes(u32 u32Address_)
+
+@brief Returns how many bytes from u32Address_ to the end of its Debug_asReadRegions[]
+entry may be read, or 0 if it is in none of them.
+*/
+static u32 DebugReadableBytes(u32 u32Address_)
+{
+  for(u8 i = 0; i < (u8)(sizeof(Debug_asReadRegions) / sizeof(DebugMemoryRegionType)); i++)
+  {
+    if( (u32Address_ - Debug_asReadRegions[i].u32Base) < Debug_asReadRegions[i].u32Size )
+    {
+      return(Debug_asReadRegions[i].u32Size - (u32Address_ - Debug_asReadRegions[i].u32Base));
+    }
+  }
+
+  return(0);
+
+} /* end DebugReadableBytes() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugPrintFault(void)
+
+@brief Prints G_sFaultLast: what caused the last reset, the task and the stacked registers.
+*/
+static void DebugPrintFault(void)
+{
+  static const char* const apcCauses[] = {"none", "fault", "task watchdog", "watchdog"};
+  FaultRecordType sFault;
+  const char* pcCause = "?";
+
+  if( !FaultGetLast(&sFault) )
+  {
+    DebugPrintf("No fault since power on\r\n");
+    return;
+  }
+
+  if(sFault.u8Cause < sizeof(apcCauses) / sizeof(apcCauses[0]))
+  {
+    pcCause = apcCauses[sFault.u8Cause];
+  }
+
+  DebugPrintf("Last reset: %s, exception %u, task %s at %u ms\r\n", pcCause, (unsigned)sFault.u32Exception,
+              MainTaskName(sFault.u8Task), (unsigned)sFault.u32SystemTime1ms);
+
+  if(sFault.u32StackPointer != U32_FAULT_NO_FRAME)
+  {
+    DebugPrintf("PC 0x%08X LR 0x%08X xPSR 0x%08X SP 0x%08X\r\n", (unsigned)sFault.sFrame.u32Pc,
+                (unsigned)sFault.sFrame.u32Lr, (unsigned)sFault.sFrame.u32Xpsr, (unsigned)sFault.u32StackPointer);
+  }
+
+  if(sFault.u8Cause == FAULT_CAUSE_EXCEPTION)
+  {
+    DebugPrintf("CFSR 0x%08X HFSR 0x%08X MMFAR 0x%08X BFAR 0x%08X\r\n", (unsigned)sFault.u32Cfsr,
+                (unsigned)sFault.u32Hfsr, (unsigned)sFault.u32Mmfar, (unsigned)sFault.u32Bfar);
+  }
+
+} /* end DebugPrintFault() */
+
+
+/**********************************************************************************************************************
+Console commands
+**********************************************************************************************************************/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandHelp(const char* pcArgs_)
+
+@brief Lists the commands.
+*/
+static void DebugCommandHelp(const char* pcArgs_)
+{
+  for(u8 i = 0; i < sizeof(Debug_asCommands) / sizeof(DebugCommandType); i++)
+  {
+    DebugPrintf("%-8s %s\r\n", Debug_asCommands[i].pcName, Debug_asCommands[i].pcHelp);
+  }
+
+} /* end DebugCommandHelp() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandVersion(const char* pcArgs_)
+
+@brief Prints FIRMWARE_VERSION.
+*/
+static void DebugCommandVersion(const char* pcArgs_)
+{
+  u8 au8Version[] = FIRMWARE_VERSION;
+
+  DebugPrintf("%s", (char*)au8Version);
+
+} /* end DebugCommandVersion() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandTime(const char* pcArgs_)
+
+@brief Prints the system time.
+*/
+static void DebugCommandTime(const char* pcArgs_)
+{
+  DebugPrintf("%u ms (%u s)\r\n", (unsigned)G_u32SystemTime1ms, (unsigned)G_u32SystemTime1s);
+
+} /* end DebugCommandTime() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandFault(const char* pcArgs_)
+
+@brief Prints the fault record of the last reset.
+*/
+static void DebugCommandFault(const char* pcArgs_)
+{
+  DebugPrintFault();
+
+} /* end DebugCommandFault() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandStats(const char* pcArgs_)
+
+@brief Prints G_sDebugStats.
+*/
+static void DebugCommandStats(const char* pcArgs_)
+{
+  DebugPrintf("tx %u bytes, %u dropped, %u truncated; rx %u bytes\r\n", (unsigned)G_sDebugStats.u32TxBytes,
+              (unsigned)G_sDebugStats.u32TxDropped, (unsigned)G_sDebugStats.u32TxTruncated,
+              (unsigned)G_sDebugStats.u32RxBytes);
+
+} /* end DebugCommandStats() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandRead(const char* pcArgs_)
+
+@brief rd <address> [words]: prints words of memory or registers, four to a line.
+
+Only addresses in Debug_asReadRegions[] are read, and the count is cut at the end of
+the region.  Reading a register may still have a side effect (e.g. a status register
+cleared by the read).
+*/
+static void DebugCommandRead(const char* pcArgs_)
+{
+  char* pcNext;
+  u32 u32Address;
+  u32 u32Words = 1;
+  u32 u32Readable;
+  u32* pu32Word;
+
+  u32Address = strtoul(pcArgs_, &pcNext, 0);
+  if(pcNext == pcArgs_)
+  {
+    DebugPrintf("usage: rd <address> [words]\r\n");
+    return;
+  }
+
+  if(*pcNext != '\0')
+  {
+    u32Words = strtoul(pcNext, NULL, 0);
+  }
+  if( (u32Words == 0) || (u32Words > U8_DEBUG_READ_MAX_WORDS) )
+  {
+    u32Words = U8_DEBUG_READ_MAX_WORDS;
+  }
+
+  u32Address &= ~(u32)0x3;
+  u32Readable = DebugReadableBytes(u32Address) / sizeof(u32);
+  if(u32Readable == 0)
+  {
+    DebugPrintf("rd: %08X is not in flash, SRAM or the peripherals\r\n", (unsigned)u32Address);
+    return;
+  }
+  if(u32Words > u32Readable)
+  {
+    u32Words = u32Readable;
+  }
+
+  pu32Word = (u32*)u32Address;
+  for(u32 i = 0; i < u32Words; i += 4)
+  {
+    switch(u32Words - i)
+    {
+      case 1:
+        DebugPrintf("%08X: %08X\r\n", (unsigned)(u32)&pu32Word[i], (unsigned)pu32Word[i]);
+        break;
+      case 2:
+        DebugPrintf("%08X: %08X %08X\r\n", (unsigned)(u32)&pu32Word[i], (unsigned)pu32Word[i],
+                    (unsigned)pu32Word[i + 1]);
+        break;
+      case 3:
+        DebugPrintf("%08X: %08X %08X %08X\r\n", (unsigned)(u32)&pu32Word[i], (unsigned)pu32Word[i],
+                    (unsigned)pu32Word[i + 1], (unsigned)pu32Word[i + 2]);
+        break;
+      default:
+        DebugPrintf("%08X: %08X %08X %08X %08X\r\n", (unsigned)(u32)&pu32Word[i], (unsigned)pu32Word[i],
+                    (unsigned)pu32Word[i + 1], (unsigned)pu32Word[i + 2], (unsigned)pu32Word[i + 3]);
+        break;
+    }
+  }
+
+} /* end DebugCommandRead() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandTasks(const char* pcArgs_)
+
+@brief Prints the task profiler results (cycles).
+*/
+static void DebugCommandTasks(const char* pcArgs_)
+{
+#ifdef EIE_TASK_PROFILER
+  DebugPrintf("%-10s %10s %10s %8s %8s %8s\r\n", "task", "calls", "idle", "min", "mean", "max");
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    TaskProfileType* psTask = &G_asMainTaskProfile[i];
+
+    DebugPrintf("%-10s %10u %10u %8u %8u %8u\r\n", MainTaskName(i), (unsigned)psTask->u32Calls,
+                (unsigned)psTask->u32Skips, psTask->u32Calls ? (unsigned)psTask->u32MinCycles : 0,
+                psTask->u32Calls ? (unsigned)(psTask->u64TotalCycles / psTask->u32Calls) : 0,
+                (unsigned)psTask->u32MaxCycles);
+  }
+  DebugPrintf("loop %u iterations, max %u cycles, %u overruns (last at %u ms)\r\n",
+              (unsigned)G_sMainLoopProfile.u32Iterations, (unsigned)G_sMainLoopProfile.u32MaxCycles,
+              (unsigned)G_sMainLoopProfile.u32Overruns, (unsigned)G_sMainLoopProfile.u32LastOverrunTime);
+#else
+  DebugPrintf("built without EIE_TASK_PROFILER\r\n");
+#endif /* EIE_TASK_PROFILER */
+
+} /* end DebugCommandTasks() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void DebugCommandTrace(const char* pcArgs_)
+
+@brief trace start | stop | clear controls the trace ring; trace on its own dumps it.
+
+The dump is G_sTrace as hex, U8_DEBUG_DUMP_LINE_BYTES to a line: save the lines and
+run xxd -r -p on them to get the file trace_decode reads.  Recording stops for the
+dump so the ring holds still.
+*/
+static void DebugCommandTrace(const char* pcArgs_)
+{
+#ifdef EIE_TRACE
+  if(strcmp(pcArgs_, "start") == 0)
+  {
+    TraceStart();
+  }
+  else if(strcmp(pcArgs_, "stop") == 0)
+  {
+    TraceStop();
+  }
+  else if(strcmp(pcArgs_, "clear") == 0)
+  {
+    TraceClear();
+  }
+  else
+  {
+    Debug_u32DumpTraceEnabled = G_sTrace.u32Enabled;
+    TraceStop();
+    Debug_u32DumpOffset = 0;
+    DebugPrintf("G_sTrace: %u bytes\r\n", (unsigned)sizeof(G_sTrace));
+    Debug_pfnStateMachine = DebugSM_TraceDump;
+  }
+#else
+  DebugPrintf("built without EIE_TRACE\r\n");
+#endif /* EIE_TRACE */
+
+} /* end DebugCommandTrace() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void DebugSM_Idle(void)
+
+@brief Reads everything the PDC has received through the line editor.
+*/
+static void DebugSM_Idle(void)
+{
+  u16 u16Write = DebugRxWriteIndex();
+
+  MainTaskCheckIn();
+
+  /* Stop at a command that keeps printing; the rest of the input waits for it */
+  while( (Debug_u16RxRead != u16Write) && (Debug_pfnStateMachine == DebugSM_Idle) )
+  {
+    DebugLineInput(Debug_au8RxBuffer[Debug_u16RxRead]);
+    Debug_u16RxRead = (Debug_u16RxRead + 1) % U16_DEBUG_RX_BUFFER_SIZE;
+    G_sDebugStats.u32RxBytes++;
+  }
+
+  DebugEchoFlush();
+
+} /* end DebugSM_Idle() */
+
+
+#ifdef EIE_TRACE
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void DebugSM_TraceDump(void)
+
+@brief Prints the trace ring a line at a time while there are free transmit buffers.
+*/
+static void DebugSM_TraceDump(void)
+{
+  static const char acHex[] = "0123456789ABCDEF";
+  const u8* pu8Trace = (const u8*)&G_sTrace;
+  u8* pu8Line;
+  u16 u16Length;
+  u8 u8Buffer;
+
+  MainTaskCheckIn();
+
+  while(Debug_u32DumpOffset < sizeof(G_sTrace))
+  {
+    u8Buffer = DebugTxClaim();
+    if(u8Buffer == U8_DEBUG_TX_NONE)
+    {
+      return;
+    }
+
+    pu8Line = Debug_aau8TxBuffers[u8Buffer];
+    u16Length = 0;
+    for(u8 i = 0; (i < U8_DEBUG_DUMP_LINE_BYTES) && (Debug_u32DumpOffset < sizeof(G_sTrace)); i++)
+    {
+      pu8Line[u16Length++] = acHex[pu8Trace[Debug_u32DumpOffset] >> 4];
+      pu8Line[u16Length++] = acHex[pu8Trace[Debug_u32DumpOffset] & 0x0F];
+      Debug_u32DumpOffset++;
+    }
+    pu8Line[u16Length++] = '\r';
+    pu8Line[u16Length++] = '\n';
+    DebugTxCommit(u8Buffer, u16Length);
+  }
+
+  if(Debug_u32DumpTraceEnabled)
+  {
+    Debug_u32DumpTraceEnabled = 0;
+    TraceStart();
+  }
+
+  if( DebugPrintf(DEBUG_PROMPT) )
+  {
+    Debug_pfnStateMachine = DebugSM_Idle;
+  }
+
+} /* end DebugSM_TraceDump() */
+#endif /* EIE_TRACE */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,219 @@
+/*!**********************************************************************************************************************
+@file debug.h
+@brief Header file for debug.c
+**********************************************************************************************************************/
+
+#ifndef __DEBUG_H
+#define __DEBUG_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*! @brief A console command; pcArgs_ is the rest of the line after the command name */
+typedef void(*DebugCommandFunctionType)(const char* pcArgs_);
+
+/*!
+@struct DebugCommandType
+@brief One entry of the console command table.
+*/
+typedef struct
+{
+  const char* pcName;                     /*!< @brief What is typed to run the command */
+  DebugCommandFunctionType pfnCommand;    /*!< @brief Called from the debug task with the arguments */
+  const char* pcHelp;                     /*!< @brief One line for the help command */
+} DebugCommandType;
+
+
+/*!
+@struct DebugMemoryRegionType
+@brief An address range the rd command may read.
+*/
+typedef struct
+{
+  u32 u32Base;                            /*!< @brief First address */
+  u32 u32Size;                            /*!< @brief Bytes from u32Base */
+} DebugMemoryRegionType;
+
+
+/*!
+@struct DebugStatsType
+@brief Console counters (the stats command prints them).
+*/
+typedef struct
+{
+  u32 u32TxBytes;                         /*!< @brief Bytes queued for transmit */
+  u32 u32TxDropped;                       /*!< @brief Messages dropped because every transmit buffer was in use */
+  u32 u32TxTruncated;                     /*!< @brief Messages cut to fit a transmit buffer */
+  u32 u32RxBytes;                         /*!< @brief Bytes read by the command parser */
+} DebugStatsType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool DebugPrintf(const char* pcFormat_, ...);
+bool DebugWrite(const u8* pu8Data_, u16 u16Length_);
+u8 DebugTxFreeBuffers(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void DebugInitialize(void);
+void DebugRunActiveState(void);
+bool DebugIsIdle(void);
+void USART0_IrqHandler(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/* Console speed: override with e.g. make EXTRA_DEFINES=-DU32_DEBUG_BAUD=1000000 (MCK / 16 / BRGR,
+so 1000000 and 115200 are exact or close; 921600 is not) */
+#ifndef U32_DEBUG_BAUD
+#define U32_DEBUG_BAUD            (u32)115200
+#endif /* U32_DEBUG_BAUD */
+
+#define U8_DEBUG_TX_BUFFERS       (u8)16        /*!< @brief Messages that can wait for the PDC (at most 32) */
+#define U16_DEBUG_TX_BUFFER_SIZE  (u16)128      /*!< @brief Longest message including the vsnprintf terminator */
+#define U8_DEBUG_TX_NONE          (u8)0xFF      /*!< @brief Debug_u8TxActive while the PDC is not sending */
+#define U16_DEBUG_RX_BUFFER_SIZE  (u16)128      /*!< @brief Receive ring: two halves the PDC fills in turn */
+#define U16_DEBUG_RX_HALF         (u16)(U16_DEBUG_RX_BUFFER_SIZE / 2)
+#define U8_DEBUG_LINE_SIZE        (u8)64        /*!< @brief Longest command line */
+#define U8_DEBUG_READ_MAX_WORDS   (u8)16        /*!< @brief Most words the rd command prints */
+#define U32_DEBUG_SRAM1_BASE      (u32)0x20080000 /*!< @brief SRAM1 (AT91SAM3U4.h only has SRAM0, AT91C_IRAM) */
+#define U32_DEBUG_SRAM1_SIZE      (u32)0x00004000
+#define U32_DEBUG_PERIPH_BASE     (u32)0x40000000 /*!< @brief Peripherals and the system controller */
+#define U32_DEBUG_PERIPH_SIZE     (u32)0x00100000
+#define U32_DEBUG_PPB_BASE        (u32)0xE0000000 /*!< @brief Cortex-M3 private peripheral bus (NVIC, SysTick, DWT...) */
+#define U32_DEBUG_PPB_SIZE        (u32)0x00100000
+#define U8_DEBUG_DUMP_LINE_BYTES  (u8)32        /*!< @brief Trace ring bytes per hex dump line */
+#define DEBUG_PROMPT              "> "
+
+/* Characters handled by the line editor */
+#define U8_DEBUG_CHAR_CTRL_C      (u8)0x03
+#define U8_DEBUG_CHAR_BACKSPACE   (u8)0x08
+#define U8_DEBUG_CHAR_LF          (u8)0x0A
+#define U8_DEBUG_CHAR_CR          (u8)0x0D
+#define U8_DEBUG_CHAR_DELETE      (u8)0x7F
+
+#define DEBUG_US_BRGR_INIT        (u32)( ((MCK) + (8 * U32_DEBUG_BAUD)) / (16 * U32_DEBUG_BAUD) ) /*!< @brief CD, rounded */
+
+/* Line idle time that ends a burst of input: two characters */
+#define DEBUG_US_RTOR_INIT        (u32)20
+
+#define DEBUG_US_MR_INIT          (u32)0x000008C0
+/*
+    31 [0] ONEBIT start frame delimiter is COMMAND or DATA SYNC
+    30 [0] MODSYNC Manchester sync not used
+    29 [0] MAN Manchester encoding off
+    28 [0] FILTER no receive filter
+
+    27 [0] Reserved
+    26 [0] MAX_ITERATION not used (ISO7816)
+    25 [0] "
+    24 [0] "
+
+    23 [0] INVDATA data not inverted
+    22 [0] VAR_SYNC sync field not variable
+    21 [0] DSNACK not used (ISO7816)
+    20 [0] INACK not used (ISO7816)
+
+    19 [0] OVER 16x oversampling
+    18 [0] CLKO SCK not driven
+    17 [0] MODE9 CHRL sets the character length
+    16 [0] MSBF LSB first
+
+    15 [0] CHMODE normal mode
+    14 [0] "
+    13 [0] NBSTOP 1 stop bit
+    12 [0] "
+
+    11 [1] PAR no parity
+    10 [0] "
+    09 [0] "
+    08 [0] SYNC asynchronous
+
+    07 [1] CHRL 8 bits
+    06 [1] "
+    05 [0] USCLKS MCK
+    04 [0] "
+
+    03 [0] USART_MODE normal
+    02 [0] "
+    01 [0] "
+    00 [0] "
+*/
+
+#define DEBUG_US_CR_RESET         (u32)0x000001AC
+/*
+    31-16 [0] Reserved / not used
+
+    15 [0] RETTO no time-out rearm
+    14 [0] RSTNACK no effect
+    13 [0] RSTIT no effect
+    12 [0] SENDA no effect
+
+    11 [0] STTTO no effect
+    10 [0] STPBRK no effect
+    09 [0] STTBRK no effect
+    08 [1] RSTSTA status bits reset
+
+    07 [1] TXDIS transmitter disabled
+    06 [0] TXEN no effect
+    05 [1] RXDIS receiver disabled
+    04 [0] RXEN no effect
+
+    03 [1] RSTTX transmitter reset
+    02 [1] RSTRX receiver reset
+    01 [0] Reserved
+    00 [0] "
+*/
+
+#define DEBUG_US_CR_ENABLE        (u32)0x00000850
+/*
+    31-12 [0] as above
+
+    11 [1] STTTO time-out waits for the first character
+    10 [0] STPBRK no effect
+    09 [0] STTBRK no effect
+    08 [0] RSTSTA no effect
+
+    07 [0] TXDIS no effect
+    06 [1] TXEN transmitter enabled
+    05 [0] RXDIS no effect
+    04 [1] RXEN receiver enabled
+
+    03-00 [0] no effect
+*/
+
+#define DEBUG_US_IER_INIT         (u32)0x00000108
+/*
+    31-13 [0] not enabled
+
+    12 [0] RXBUFF not enabled
+    11 [0] TXBUFE not enabled
+    10 [0] ITER not enabled (ISO7816)
+    09 [0] TXEMPTY not enabled
+
+    08 [1] TIMEOUT enabled (the line went quiet after some input)
+    07 [0] PARE not enabled
+    06 [0] FRAME not enabled
+    05 [0] OVRE not enabled
+
+    04 [0] ENDTX enabled only while a message is going out
+    03 [1] ENDRX enabled (half of the receive ring is full)
+    02 [0] RXBRK not enabled
+    01 [0] TXRDY not enabled
+    00 [0] RXRDY not enabled (the PDC takes every character)
+*/
+
+
+#endif /* __DEBUG_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
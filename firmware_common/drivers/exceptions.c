@@ -57,11 +57,35 @@ their place when the code is built.
 
 //------------------------------------------------------------------------------
 // Default irq handler
+//
+// Every fault, NMI and interrupt without a handler of its own ends up here.
+// The core pushed R0-R3, R12, LR, PC and xPSR on the stack it was using
+// (EXC_RETURN bit 2 in LR says which); that frame and LR are passed on to
+// FaultCapture() (fault.c), which records them and resets the board.  The
+// handler is stackless so nothing is pushed on top of the frame first.
 //------------------------------------------------------------------------------
+#if defined ( __ICCARM__ )
+__stackless void IrqHandlerNotUsed(void)
+{
+    u32* pu32Frame;
+    u32 u32ExcReturn;
+
+    __asm volatile("TST   LR, #4   \n"
+                   "ITE   EQ       \n"
+                   "MRSEQ %0, MSP  \n"
+                   "MRSNE %0, PSP  \n"
+                   "MOV   %1, LR   \n"
+                   : "=r" (pu32Frame), "=r" (u32ExcReturn));
+
+    FaultCapture(pu32Frame, u32ExcReturn);
+}
+#else
 void IrqHandlerNotUsed(void)
 {
-    while(1);
+    /* Host simulation: there is no exception frame */
+    FaultCapture(NULL, 0);
 }
+#endif
 
 //------------------------------------------------------------------------------
 // Provide weak aliases for each Exception handler to the IrqHandlerNotUsed. 
@@ -72,67 +96,19 @@ void IrqHandlerNotUsed(void)
 //------------------------------------------------------------------------------
 // System interrupt
 //------------------------------------------------------------------------------
-WEAK void NMI_Handler(void)
-{   
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void HardFault_Handler(void)
-{
-  while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void MemManage_Handler(void)
-{
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void BusFault_Handler(void)
-{
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void UsageFault_Handler(void)
-{
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void SVC_Handler(void)
-{
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void DebugMon_Handler(void)
-{
-    while(1);
-}
-
-//------------------------------------------------------------------------------
-//------------------------------------------------------------------------------
-WEAK void PendSV_Handler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(NMI_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(HardFault_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(MemManage_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(BusFault_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(UsageFault_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(SVC_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(DebugMon_Handler, IrqHandlerNotUsed)
+WEAK_ALIAS(PendSV_Handler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // for Cortex M3
 //------------------------------------------------------------------------------
-WEAK void SysTick_Handler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(SysTick_Handler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // External interrupt
@@ -149,242 +125,149 @@ void SYS_IrqHandler( void )
 //------------------------------------------------------------------------------
 // SUPPLY CONTROLLER
 //------------------------------------------------------------------------------
-WEAK void SUPC_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(SUPC_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // RESET CONTROLLER
 //------------------------------------------------------------------------------
-WEAK void RSTC_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(RSTC_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // REAL TIME CLOCK
 //------------------------------------------------------------------------------
-WEAK void RTC_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(RTC_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // REAL TIME TIMER
 //------------------------------------------------------------------------------
-WEAK void RTT_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(RTT_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // WATCHDOG TIMER
 //------------------------------------------------------------------------------
-WEAK void WDT_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(WDT_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // PMC
 //------------------------------------------------------------------------------
-WEAK void PMC_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(PMC_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // EFC0
 //------------------------------------------------------------------------------
-WEAK void EFC0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(EFC0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // EFC1
 //------------------------------------------------------------------------------
-WEAK void EFC1_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(EFC1_IrqHandler, IrqHandlerNotUsed)
+
 //------------------------------------------------------------------------------
 // DBGU
 //------------------------------------------------------------------------------
-WEAK void DBGU_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(DBGU_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // HSMC4
 //------------------------------------------------------------------------------
-WEAK void HSMC4_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(HSMC4_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Parallel IO Controller A
 //------------------------------------------------------------------------------
-WEAK void PIOA_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(PIOA_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Parallel IO Controller B
 //------------------------------------------------------------------------------
-WEAK void PIOB_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(PIOB_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Parallel IO Controller C
 //------------------------------------------------------------------------------
-WEAK void PIOC_IrqHandler(void)
-{
-    while(1);
-}
-
+WEAK_ALIAS(PIOC_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // USART 0
 //------------------------------------------------------------------------------
-WEAK void USART0_IrqHandler(void)
-{
-    while(1);
-}
-
+WEAK_ALIAS(USART0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // USART 1
 //------------------------------------------------------------------------------
-#if 0
-WEAK void USART1_IrqHandler(void)
-{
-    while(1);
-}
-#endif
+WEAK_ALIAS(USART1_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // USART 2
 //------------------------------------------------------------------------------
-WEAK void USART2_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(USART2_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // USART 3
 //------------------------------------------------------------------------------
-WEAK void USART3_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(USART3_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Multimedia Card Interface
 //------------------------------------------------------------------------------
-WEAK void MCI0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(MCI0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // TWI 0
 //------------------------------------------------------------------------------
-WEAK void TWI0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(TWI0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // TWI 1
 //------------------------------------------------------------------------------
-WEAK void TWI1_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(TWI1_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Serial Peripheral Interface 0
 //------------------------------------------------------------------------------
-WEAK void SPI0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(SPI0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Serial Synchronous Controller 0
 //------------------------------------------------------------------------------
-WEAK void SSC0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(SSC0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Timer Counter 0
 //------------------------------------------------------------------------------
-WEAK void TC0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(TC0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Timer Counter 1
 //------------------------------------------------------------------------------
-WEAK void TC1_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(TC1_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // Timer Counter 2
 //------------------------------------------------------------------------------
-WEAK void TC2_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(TC2_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // PWM Controller
 //------------------------------------------------------------------------------
-WEAK void PWM_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(PWM_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // ADC controller0
 //------------------------------------------------------------------------------
-WEAK void ADCC0_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(ADCC0_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // ADC controller1
 //------------------------------------------------------------------------------
-WEAK void ADCC1_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(ADCC1_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // HDMA
 //------------------------------------------------------------------------------
-WEAK void HDMA_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(HDMA_IrqHandler, IrqHandlerNotUsed)
 
 //------------------------------------------------------------------------------
 // USB Device High Speed UDP_HS
 //------------------------------------------------------------------------------
-WEAK void UDPD_IrqHandler(void)
-{
-    while(1);
-}
+WEAK_ALIAS(UDPD_IrqHandler, IrqHandlerNotUsed)
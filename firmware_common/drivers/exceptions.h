@@ -48,7 +48,27 @@
 typedef void( *IntFunc )( void );
 
 /// Weak attribute
+#if defined ( __ICCARM__ )
     #define WEAK __weak
+#else
+    #define WEAK __attribute__((weak))
+#endif
+
+/// Weak alias: name_ is target_ unless a function called name_ is defined elsewhere
+/// (target_ must be defined in the same file)
+#if defined ( __ICCARM__ )
+    #define WEAK_ALIAS_PRAGMA(x_)         _Pragma(#x_)
+    #define WEAK_ALIAS(name_, target_)    WEAK_ALIAS_PRAGMA(weak name_=target_)
+#else
+    #define WEAK_ALIAS(name_, target_)    void name_(void) __attribute__((weak, alias(#target_)));
+#endif
+
+/// No-init attribute: the variable keeps its contents through a reset (.noinit section)
+#if defined ( __ICCARM__ )
+    #define NOINIT __no_init
+#else
+    #define NOINIT __attribute__((section(".noinit")))
+#endif
 
 //------------------------------------------------------------------------------
 //         Global functions
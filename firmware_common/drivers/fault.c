@@ -0,0 +1,306 @@
+/*!**********************************************************************************************************************
+@file fault.c
+@brief Fault capture: records why the processor faulted, resets, and reports it on the next start up.
+
+Every exception handler that is not defined elsewhere (the faults, NMI and all the
+unused interrupts) is a weak alias of IrqHandlerNotUsed() in exceptions.c, which
+finds the registers the core stacked and calls FaultCapture().  That saves them with
+the fault status registers, the active exception, the top of the interrupted stack
+and the task that was running into G_sFaultRecord (.noinit, so it survives the
+reset), then resets the processor and peripherals through the RSTC straight away
+instead of spinning until the watchdog runs out.
+
+The main loop's task supervisor (main.c) uses the same record and reset through
+FaultTaskWatchdog() when a task stops checking in.  A reset by the hardware watchdog
+leaves no record, but G_u8MainActiveTask (.noinit too) still names the task the loop
+was stuck in.
+
+On the way back up, FaultInitialize() moves the record to G_sFaultLast, clears it
+and sets _SYSTEM_FAULT_RESET, so the application (or a debugger) can see what
+happened with FaultGetLast().
+
+With a debugger connected the handler stops after the capture so the fault can be
+inspected where it happened.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_sFaultRecord, G_sFaultLast
+
+CONSTANTS
+- U32_FAULT_MAGIC, U8_FAULT_STACK_WORDS, U32_FAULT_NO_FRAME
+
+TYPES
+- FaultCauseType, FaultFrameType, FaultRecordType
+
+PUBLIC FUNCTIONS
+- bool FaultGetLast(FaultRecordType* psRecord_)
+
+PROTECTED FUNCTIONS
+- void FaultInitialize(void)
+- void FaultCapture(u32* pu32Frame_, u32 u32ExcReturn_)
+- void FaultTaskWatchdog(u8 u8Task_)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Fault"
+***********************************************************************************************************************/
+/* New variables */
+NOINIT FaultRecordType G_sFaultRecord;                 /*!< @brief Written by FaultCapture(), read at the next start up */
+FaultRecordType G_sFaultLast;                          /*!< @brief The fault that caused the last reset (u32Magic 0 if none) */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u8 G_u8MainActiveTask;                 /*!< @brief From main.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void FaultRecordStart(FaultCauseType eCause_);
+static void FaultReset(void);
+static bool FaultIsStackAddress(u32 u32Address_, u32 u32Bytes_);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Fault_<type>" and be declared as static.
+***********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn bool FaultGetLast(FaultRecordType* psRecord_)
+
+@brief Returns the fault that caused the last reset, if there was one.
+
+Requires:
+- FaultInitialize() has run
+@param psRecord_ receives the record (may be NULL to only ask)
+
+Promises:
+- Returns TRUE and copies the record if the last reset was FaultCapture()'s
+- Returns FALSE otherwise
+
+*/
+bool FaultGetLast(FaultRecordType* psRecord_)
+{
+  if(G_sFaultLast.u32Magic != U32_FAULT_MAGIC)
+  {
+    return(FALSE);
+  }
+
+  if(psRecord_ != NULL)
+  {
+    *psRecord_ = G_sFaultLast;
+  }
+
+  return(TRUE);
+
+} /* end FaultGetLast() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void FaultInitialize(void)
+
+@brief Picks up what caused the last reset if the firmware did not ask for it.
+
+A record only counts after a software reset: at power on the .noinit RAM holds
+whatever it powered up with.  After a hardware watchdog reset there is no record,
+but G_u8MainActiveTask (also .noinit) still says which task the loop was stuck in.
+
+Requires:
+- Called once at start up, before G_u8MainActiveTask is set
+
+Promises:
+- If the last reset was a fault or a watchdog reset: G_sFaultLast describes it and
+  _SYSTEM_FAULT_RESET is set in G_u32SystemFlags
+- G_sFaultRecord is cleared
+
+*/
+void FaultInitialize(void)
+{
+  u32 u32ResetType = AT91C_BASE_RSTC->RSTC_RSR & AT91C_RSTC_RSTTYP;
+
+  if( (G_sFaultRecord.u32Magic == U32_FAULT_MAGIC) && (u32ResetType == AT91C_RSTC_RSTTYP_SOFTWARE) )
+  {
+    G_sFaultLast = G_sFaultRecord;
+    G_u32SystemFlags |= _SYSTEM_FAULT_RESET;
+  }
+  else if(u32ResetType == AT91C_RSTC_RSTTYP_WATCHDOG)
+  {
+    memset(&G_sFaultLast, 0, sizeof(G_sFaultLast));
+    G_sFaultLast.u32Magic = U32_FAULT_MAGIC;
+    G_sFaultLast.u8Cause = FAULT_CAUSE_WATCHDOG;
+    G_sFaultLast.u8Task = G_u8MainActiveTask;
+    G_sFaultLast.u32StackPointer = U32_FAULT_NO_FRAME;
+    G_u32SystemFlags |= _SYSTEM_FAULT_RESET;
+  }
+
+  memset(&G_sFaultRecord, 0, sizeof(G_sFaultRecord));
+
+} /* end FaultInitialize() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void FaultCapture(u32* pu32Frame_, u32 u32ExcReturn_)
+
+@brief Saves the state of a fault or unexpected interrupt and resets.
+
+Does not return.  Only reads RAM it has checked is on the stack, so a fault caused
+by a broken stack pointer does not fault again in here.
+
+Requires:
+- Called from IrqHandlerNotUsed() in handler mode
+@param pu32Frame_ is the stack pointer the core stacked the exception frame at (NULL if unknown)
+@param u32ExcReturn_ is LR on entry to the handler
+
+Promises:
+- G_sFaultRecord holds the capture
+- The processor and peripherals are reset (unless a debugger is connected, in which
+  case the handler waits here)
+
+*/
+void FaultCapture(u32* pu32Frame_, u32 u32ExcReturn_)
+{
+  FaultRecordType* psRecord = &G_sFaultRecord;
+  u32 u32Frame = (u32)pu32Frame_;
+  u32* pu32Stack;
+  u8 u8Words = 0;
+
+  FaultRecordStart(FAULT_CAUSE_EXCEPTION);
+  psRecord->u32ExcReturn = u32ExcReturn_;
+
+  /* The stacked registers, then the interrupted code's stack above them */
+  if( FaultIsStackAddress(u32Frame, sizeof(FaultFrameType)) )
+  {
+    psRecord->sFrame = *(FaultFrameType*)pu32Frame_;
+    psRecord->u32StackPointer = u32Frame + sizeof(FaultFrameType);
+    if(psRecord->sFrame.u32Xpsr & U32_FAULT_XPSR_ALIGNED)
+    {
+      psRecord->u32StackPointer += sizeof(u32);
+    }
+
+    pu32Stack = (u32*)psRecord->u32StackPointer;
+    while( (u8Words < U8_FAULT_STACK_WORDS) &&
+           FaultIsStackAddress((u32)&pu32Stack[u8Words], sizeof(u32)) )
+    {
+      psRecord->au32Stack[u8Words] = pu32Stack[u8Words];
+      u8Words++;
+    }
+  }
+  psRecord->u8StackWords = u8Words;
+
+  FaultReset();
+
+} /* end FaultCapture() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void FaultTaskWatchdog(u8 u8Task_)
+
+@brief Records that a supervised task missed its check in deadline and resets.
+
+Does not return.
+
+Requires:
+- Called by the main loop's supervisor
+@param u8Task_ is the Main_asTasks index of the late task
+
+Promises:
+- G_sFaultRecord holds the task and time
+- The processor and peripherals are reset (unless a debugger is connected)
+
+*/
+void FaultTaskWatchdog(u8 u8Task_)
+{
+  FaultRecordStart(FAULT_CAUSE_TASK_WATCHDOG);
+  G_sFaultRecord.u8Task = u8Task_;
+
+  FaultReset();
+
+} /* end FaultTaskWatchdog() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void FaultRecordStart(FaultCauseType eCause_)
+
+@brief Masks interrupts and fills in the parts of G_sFaultRecord every cause has.
+*/
+static void FaultRecordStart(FaultCauseType eCause_)
+{
+  FaultRecordType* psRecord = &G_sFaultRecord;
+
+  __disable_irq();
+  memset(psRecord, 0, sizeof(FaultRecordType));
+
+  psRecord->u8Cause = (u8)eCause_;
+  psRecord->u32Exception = SCB->ICSR & U32_FAULT_ICSR_VECTACTIVE;
+  psRecord->u32Cfsr = SCB->CFSR;
+  psRecord->u32Hfsr = SCB->HFSR;
+  psRecord->u32Mmfar = SCB->MMFAR;
+  psRecord->u32Bfar = SCB->BFAR;
+  psRecord->u32SystemTime1ms = G_u32SystemTime1ms;
+  psRecord->u8Task = G_u8MainActiveTask;
+  psRecord->u32StackPointer = U32_FAULT_NO_FRAME;
+
+} /* end FaultRecordStart() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void FaultReset(void)
+
+@brief Marks G_sFaultRecord complete and resets the processor and peripherals.
+
+With a debugger connected it waits here instead so the state can be inspected.
+*/
+static void FaultReset(void)
+{
+  G_sFaultRecord.u32Magic = U32_FAULT_MAGIC;
+
+  while(CoreDebug->DHCSR & U32_FAULT_DHCSR_C_DEBUGEN);
+
+  AT91C_BASE_RSTC->RSTC_RCR = FAULT_RSTC_RCR_RESET;
+  __DSB();
+  while(1);
+
+} /* end FaultReset() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static bool FaultIsStackAddress(u32 u32Address_, u32 u32Bytes_)
+
+@brief TRUE if u32Bytes_ at u32Address_ are word aligned and in the RAM the stack lives in.
+*/
+static bool FaultIsStackAddress(u32 u32Address_, u32 u32Bytes_)
+{
+  return( ((u32Address_ & 0x3) == 0) &&
+          (u32Address_ >= U32_FAULT_RAM_START) &&
+          (u32Address_ <= U32_FAULT_RAM_END - u32Bytes_) );
+
+} /* end FaultIsStackAddress() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
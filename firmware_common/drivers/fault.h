@@ -0,0 +1,114 @@
+/*!**********************************************************************************************************************
+@file fault.h
+@brief Header file for fault.c
+**********************************************************************************************************************/
+
+#ifndef __FAULT_H
+#define __FAULT_H
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_FAULT_MAGIC           (u32)0x46415554   /*!< @brief "FAUT": G_sFaultRecord holds a capture */
+#define U8_FAULT_STACK_WORDS      (u8)16            /*!< @brief Words of the interrupted code's stack kept */
+#define U32_FAULT_NO_FRAME        (u32)0xFFFFFFFF   /*!< @brief u32StackPointer when the stacked frame was not readable */
+
+/* Where a stacked frame can be (RAM0, see the linker file): anything else is not read */
+#define U32_FAULT_RAM_START       (u32)0x20000000
+#define U32_FAULT_RAM_END         (u32)0x20004000
+
+#define U32_FAULT_EXC_RETURN_PSP  (u32)0x00000004   /*!< @brief EXC_RETURN bit 2: the frame is on the process stack */
+#define U32_FAULT_XPSR_ALIGNED    (u32)0x00000200   /*!< @brief Stacked xPSR bit 9: a pad word was pushed to 8-byte align the frame */
+#define U32_FAULT_ICSR_VECTACTIVE (u32)0x000001FF   /*!< @brief SCB_ICSR active exception number */
+#define U32_FAULT_DHCSR_C_DEBUGEN (u32)0x00000001   /*!< @brief CoreDebug_DHCSR: a debugger is connected */
+
+#define FAULT_RSTC_RCR_RESET      (u32)0xA5000005
+/*
+    31-24 [0xA5] KEY password
+
+    23-04 [0] Reserved
+
+    03 [0] EXTRST NRST pin not asserted
+    02 [1] PERRST peripherals reset
+    01 [0] Reserved
+    00 [1] PROCRST processor reset
+*/
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum FaultCauseType
+@brief Why the record was written.
+*/
+typedef enum {FAULT_CAUSE_NONE = 0,                 /*!< No record */
+              FAULT_CAUSE_EXCEPTION,                /*!< A fault or unexpected interrupt (FaultCapture()) */
+              FAULT_CAUSE_TASK_WATCHDOG,            /*!< A supervised task did not check in (FaultTaskWatchdog()) */
+              FAULT_CAUSE_WATCHDOG                  /*!< The hardware watchdog ran out: the loop was stuck in u8Task */
+} FaultCauseType;
+
+
+/*!
+@struct FaultFrameType
+@brief Registers the core pushes on exception entry, in stack order.
+*/
+typedef struct
+{
+  u32 u32R0;
+  u32 u32R1;
+  u32 u32R2;
+  u32 u32R3;
+  u32 u32R12;
+  u32 u32Lr;                              /*!< @brief Return address of the function that was running */
+  u32 u32Pc;                              /*!< @brief Instruction that faulted (or was next, for an interrupt) */
+  u32 u32Xpsr;
+} FaultFrameType;
+
+
+/*!
+@struct FaultRecordType
+@brief What is saved before a reset the firmware did not ask for (see u8Cause).
+*/
+typedef struct
+{
+  u32 u32Magic;                           /*!< @brief U32_FAULT_MAGIC while the record holds a capture */
+  u32 u32Exception;                       /*!< @brief Exception number (3 HardFault ... 6 UsageFault, IRQn + 16; 0 in thread mode) */
+  u32 u32ExcReturn;                       /*!< @brief LR on entry (0 if not known) */
+  u32 u32StackPointer;                    /*!< @brief SP of the interrupted code or U32_FAULT_NO_FRAME */
+  FaultFrameType sFrame;                  /*!< @brief Stacked registers (0 if not readable) */
+  u32 u32Cfsr;                            /*!< @brief SCB_CFSR: MemManage / BusFault / UsageFault status */
+  u32 u32Hfsr;                            /*!< @brief SCB_HFSR: HardFault status */
+  u32 u32Mmfar;                           /*!< @brief SCB_MMFAR: address of a MemManage fault (CFSR MMARVALID) */
+  u32 u32Bfar;                            /*!< @brief SCB_BFAR: address of a precise bus fault (CFSR BFARVALID) */
+  u32 u32SystemTime1ms;                   /*!< @brief G_u32SystemTime1ms at the fault */
+  u8 u8Task;                              /*!< @brief Main_asTasks index running or U8_MAIN_NO_TASK */
+  u8 u8StackWords;                        /*!< @brief Valid words in au32Stack */
+  u8 u8Cause;                             /*!< @brief FaultCauseType */
+  u8 u8Reserved;
+  u32 au32Stack[U8_FAULT_STACK_WORDS];    /*!< @brief Interrupted code's stack from u32StackPointer up */
+} FaultRecordType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool FaultGetLast(FaultRecordType* psRecord_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void FaultInitialize(void);
+void FaultCapture(u32* pu32Frame_, u32 u32ExcReturn_);
+void FaultTaskWatchdog(u8 u8Task_);
+
+
+#endif /* __FAULT_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -33,10 +33,11 @@ All Global variable names shall start with "G_<type>ISR"
 /* Existing variables (defined in other files -- should all contain the "extern" keyword)  */
 extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
 extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1msHigh;            /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
-extern volatile u32 Timer_u32Timer1Counter;            /*!< @brief From timer.c */
-extern fnCode_type Timer_fpTimer1Callback_srsly;      /*!< @brief From timer.c */
+
+extern const u8 G_au8BspButtonIndex[U8_BUTTON_PORTS][U8_BUTTON_PORT_BITS]; /*!< @brief From board-specific file */
 
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
@@ -127,7 +128,9 @@ void PIOA_IrqHandler(void)
 {
   u32 u32GPIOInterruptSources;
   u32 u32ButtonInterrupts;
-  u32 u32CurrentButtonLocation;
+  u8 u8Bit;
+
+  TRACE_ISR_ENTER(IRQn_PIOA);
 
   /* Grab a snapshot of the current PORTA status flags (clears all flags) */
   u32GPIOInterruptSources = AT91C_BASE_PIOA->PIO_ISR;
@@ -138,27 +141,20 @@ void PIOA_IrqHandler(void)
   /* Examine button interrupts */
   u32ButtonInterrupts = u32GPIOInterruptSources & GPIOA_BUTTONS;
   
-  /* Check if any port A buttons interrupted */
-  if(u32ButtonInterrupts)
+  /* Visit only the set flags: CLZ finds each one directly and the BSP table names its button,
+  so the time taken depends on how many buttons changed, not where they are on the port */
+  while(u32ButtonInterrupts)
   {
-    /* Scan through the flags looking for ones that are set */
-    u32CurrentButtonLocation = 0x00000001;
-    for(u8 i = 0; i < 32; i++)
-    {
-      /* If the bit is set, then start debouncing (also disables interrupt) */
-      if(u32ButtonInterrupts & u32CurrentButtonLocation)
-      {
-        ButtonStartDebounce(u32CurrentButtonLocation, PORTA);
-      }
-      
-      /* Shift the mask to look at the next bit */
-      u32CurrentButtonLocation <<= 1;
-    }
-        
-  } /* end port A button interrupt checking */
+    u8Bit = (u8)(31 - __CLZ(u32ButtonInterrupts));
+    u32ButtonInterrupts &= ~((u32)1 << u8Bit);
+
+    /* Start debouncing (also disables the interrupt) */
+    ButtonStartDebounce( (ButtonNameType)G_au8BspButtonIndex[0][u8Bit] );
+  }
   
   /* Clear the PIOA pending flag and exit */
   NVIC_ClearPendingIRQ(IRQn_PIOA);
+  TRACE_ISR_EXIT(IRQn_PIOA);
   
 } /* end PIOA_IrqHandler() */
 
@@ -183,7 +179,9 @@ void PIOB_IrqHandler(void)
 {
   u32 u32GPIOInterruptSources;
   u32 u32ButtonInterrupts;
-  u32 u32CurrentButtonLocation;
+  u8 u8Bit;
+
+  TRACE_ISR_ENTER(IRQn_PIOB);
 
   /* Grab a snapshot of the current PORTB status flags (clears all flags) */
   u32GPIOInterruptSources = AT91C_BASE_PIOB->PIO_ISR;
@@ -194,27 +192,19 @@ void PIOB_IrqHandler(void)
   /* Examine button interrupts */
   u32ButtonInterrupts = u32GPIOInterruptSources & GPIOB_BUTTONS;
   
-  /* Check if any port B buttons interrupted */
-  if(u32ButtonInterrupts)
+  /* Visit only the set flags (see PIOA_IrqHandler()) */
+  while(u32ButtonInterrupts)
   {
-    /* Scan through the flags looking for ones that are set */
-    u32CurrentButtonLocation = 0x00000001;
-    for(u8 i = 0; i < 32; i++)
-    {
-      /* If the bit is set, then start debouncing (also disables interrupt) */
-      if(u32ButtonInterrupts & u32CurrentButtonLocation)
-      {
-        ButtonStartDebounce(u32CurrentButtonLocation, PORTB);
-      }
-      
-      /* Shift the mask to look at the next bit */
-      u32CurrentButtonLocation <<= 1;
-    }
-        
-  } /* end port B button interrupt checking */
+    u8Bit = (u8)(31 - __CLZ(u32ButtonInterrupts));
+    u32ButtonInterrupts &= ~((u32)1 << u8Bit);
+
+    /* Start debouncing (also disables the interrupt) */
+    ButtonStartDebounce( (ButtonNameType)G_au8BspButtonIndex[1][u8Bit] );
+  }
   
   /* Clear the PIOB pending flag and exit */
   NVIC_ClearPendingIRQ(IRQn_PIOB);
+  TRACE_ISR_EXIT(IRQn_PIOB);
   
 } /* end PIOB_IrqHandler() */
 
@@ -232,15 +222,28 @@ Promises:
 
 void SysTick_Handler(void)
 {
+  TRACE_ISR_ENTER(SysTick_IRQn);
+
   /* Clear the sleep flag */
   G_u32SystemFlags &= ~_SYSTEM_SLEEPING;
   
   /* Update Timers */
   G_u32SystemTime1ms++;
+  if(G_u32SystemTime1ms == 0)
+  {
+    G_u32SystemTime1msHigh++;
+  }
+  
   if( (G_u32SystemTime1ms % 1000) == 0)
   {
     G_u32SystemTime1s++;
   }
+
+  /* The decoder's time base: only recorded when the cycle count has lost pace or
+  U32_TRACE_TICK_MS have passed */
+  TRACE_TICK(G_u32SystemTime1ms);
+  TRACE_ISR_EXIT(SysTick_IRQn);
+  
 } /* end SysTick_Handler()  */
 
 
@@ -321,7 +321,7 @@ All unused interrupt sources will be set to priority 31.
     00 [0] "
 */
 
-#define IPR5_INIT (u32)0x4000F020
+#define IPR5_INIT (u32)0x4050F020
 /*!< Bit Set Description
     31 [0] (23) // Timer Counter 1 priority 4
     30 [1] "
@@ -333,10 +333,10 @@ All unused interrupt sources will be set to priority 31.
     25 [0] "
     24 [0] "
 
-    23 [0] (22) // Timer Counter 0 priority 0
-    22 [0] "
+    23 [0] (22) // Timer Counter 0 priority 5 (keypad scan)
+    22 [1] "
     21 [0] "
-    20 [0] "
+    20 [1] "
 
     19 [0] Unimplemented
     18 [0] "
@@ -364,7 +364,7 @@ All unused interrupt sources will be set to priority 31.
     00 [0] "
 */
 
-#define IPR6_INIT (u32)0xF0F0F040
+#define IPR6_INIT (u32)0xF0F06040
 /*!< Bit Set Description
     31 [1] (27) // 10-bit ADC Controller (ADC) priority 15
     30 [1] "
@@ -386,10 +386,10 @@ All unused interrupt sources will be set to priority 31.
     17 [0] "
     16 [0] "
 
-    15 [1] (25) // Pulse Width Modulation Controller priority 15
+    15 [0] (25) // Pulse Width Modulation Controller priority 6 (music sequencer tick)
     14 [1] "
     13 [1] "
-    12 [1] "
+    12 [0] "
 
     11 [0] Unimplemented
     10 [0] "
@@ -0,0 +1,404 @@
+/*!**********************************************************************************************************************
+@file keypad.c
+@brief Key matrix scanning on the blade connector (EIE_KEYPAD builds).
+
+The keys are scanned from the TC0 interrupt so the main loop never waits on them.
+While nothing is pressed all rows are held low and a single PIO_PDSR read every
+U16_KEYPAD_IDLE_TICKS shows if any column has been pulled down.  Once one has, the
+interrupt steps through the rows one at a time (one row per U16_KEYPAD_ROW_TICKS, so
+the lines settle between the write and the read) and builds a full 16 key map every
+1ms until the keypad is released and settled again.
+
+A set of keys is accepted after U8_KEYPAD_DEBOUNCE_SCANS identical scans.  Without
+diodes, three keys on the corners of a rectangle make the fourth corner read as
+pressed, so a scan in which two rows share two or more columns is ignored (and counted
+in G_u32KeypadGhosts) rather than reporting a key that may not be there.
+
+The button task picks up the accepted keys with KeypadGetKeys() and reports them as
+KEY0..KEY15 through the usual button API.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_u32KeypadGhosts
+
+CONSTANTS
+- U8_KEYPAD_DEBOUNCE_SCANS, U16_KEYPAD_ROW_TICKS, U16_KEYPAD_IDLE_TICKS
+
+TYPES
+- NONE
+
+PUBLIC FUNCTIONS
+- u32 KeypadGetKeys(u32* pu32ChangeTime_)
+
+PROTECTED FUNCTIONS
+- void KeypadInitialize(void)
+- void TC0_IrqHandler(void)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+#ifdef EIE_KEYPAD
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Keypad"
+***********************************************************************************************************************/
+/* New variables */
+u32 G_u32KeypadGhosts;                                 /*!< @brief Scans ignored because keys could be ghosts */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+extern volatile u32 G_u32SystemTime1s;                 /*!< @brief From main.c */
+extern volatile u32 G_u32SystemFlags;                  /*!< @brief From main.c */
+extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c */
+
+extern const PinConfigurationType G_asBspKeypadRows[U8_KEYPAD_ROWS]; /*!< @brief from board-specific file */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void KeypadDriveRow(u8 u8Row_, bool bLow_);
+static void KeypadIdleProbe(void);
+static bool KeypadScanComplete(u32 u32Scan_);
+static bool KeypadIsGhosted(u32 u32Scan_);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Keypad_<type>" and be declared as static.
+***********************************************************************************************************************/
+static u8 Keypad_u8Row;                                /*!< @brief Row being scanned or U8_KEYPAD_IDLE_PROBE (TC0 interrupt only) */
+static u32 Keypad_u32Scan;                             /*!< @brief Keys found so far in the current scan */
+static u32 Keypad_u32LastScan;                         /*!< @brief Previous complete scan */
+static u32 Keypad_u32LastScanTime;                     /*!< @brief G_u32SystemTime1ms of the first scan equal to Keypad_u32LastScan */
+static u8 Keypad_u8StableScans;                        /*!< @brief Scans in a row equal to Keypad_u32LastScan */
+
+static volatile u32 Keypad_u32Keys;                    /*!< @brief Accepted keys: bit n set while KEYn is pressed */
+static volatile u32 Keypad_u32KeysTime;                /*!< @brief G_u32SystemTime1ms when Keypad_u32Keys was first seen */
+static volatile u8 Keypad_u8Sequence;                  /*!< @brief Counts updates of the two above so readers can see a torn read */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 KeypadGetKeys(u32* pu32ChangeTime_)
+
+@brief Returns the debounced keys and when they were first seen.
+
+Requires:
+@param pu32ChangeTime_ is where to put the G_u32SystemTime1ms of the first scan that
+showed these keys, or NULL
+
+Promises:
+- Returns the accepted keys (bit n = KEYn pressed) and the matching time, read again
+  if the TC0 interrupt changed them in between
+
+*/
+u32 KeypadGetKeys(u32* pu32ChangeTime_)
+{
+  u8 u8Sequence;
+  u32 u32Keys;
+
+  do
+  {
+    u8Sequence = Keypad_u8Sequence;
+    u32Keys = Keypad_u32Keys;
+    if(pu32ChangeTime_ != NULL)
+    {
+      *pu32ChangeTime_ = Keypad_u32KeysTime;
+    }
+  } while(u8Sequence != Keypad_u8Sequence);
+
+  return(u32Keys);
+
+} /* end KeypadGetKeys() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void KeypadInitialize(void)
+
+@brief Takes the blade lines for the keypad and starts the idle probe on TC0.
+
+Called from ButtonInitialize().
+
+Requires:
+- The TC0 peripheral clock is enabled (PMC_PCER_INIT)
+
+Promises:
+- Row lines are open drain outputs with pull-ups, all low for the idle probe
+- Column lines are inputs with pull-ups
+- TC0 interrupts every U16_KEYPAD_IDLE_TICKS
+
+*/
+void KeypadInitialize(void)
+{
+  u32 u32Dummy;
+
+  /* Rows: open drain so a row that is not being scanned floats up to its pull-up */
+  for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+  {
+    *(&(AT91C_BASE_PIOA->PIO_PER)   + G_asBspKeypadRows[i].ePort) = G_asBspKeypadRows[i].u32BitPosition;
+    *(&(AT91C_BASE_PIOA->PIO_MDER)  + G_asBspKeypadRows[i].ePort) = G_asBspKeypadRows[i].u32BitPosition;
+    *(&(AT91C_BASE_PIOA->PIO_PPUER) + G_asBspKeypadRows[i].ePort) = G_asBspKeypadRows[i].u32BitPosition;
+    *(&(AT91C_BASE_PIOA->PIO_OER)   + G_asBspKeypadRows[i].ePort) = G_asBspKeypadRows[i].u32BitPosition;
+  }
+
+  /* Columns */
+  AT91C_BASE_PIOA->PIO_PER   = KEYPAD_COLUMN_PINS;
+  AT91C_BASE_PIOA->PIO_ODR   = KEYPAD_COLUMN_PINS;
+  AT91C_BASE_PIOA->PIO_PPUER = KEYPAD_COLUMN_PINS;
+
+  G_u32KeypadGhosts = 0;
+  Keypad_u32Keys = 0;
+  Keypad_u32LastScan = 0;
+  Keypad_u8StableScans = U8_KEYPAD_DEBOUNCE_SCANS;
+  KeypadIdleProbe();
+
+  AT91C_BASE_TC0->TC_CMR = KEYPAD_TC_CMR_INIT;
+  AT91C_BASE_TC0->TC_RC  = U16_KEYPAD_IDLE_TICKS;
+  AT91C_BASE_TC0->TC_IDR = KEYPAD_TC_IDR_INIT;
+  AT91C_BASE_TC0->TC_IER = KEYPAD_TC_IER_INIT;
+  u32Dummy = AT91C_BASE_TC0->TC_SR;
+  (void)u32Dummy;
+
+  NVIC_ClearPendingIRQ(IRQn_TC0);
+  NVIC_EnableIRQ(IRQn_TC0);
+  AT91C_BASE_TC0->TC_CCR = KEYPAD_TC_CCR_START;
+
+} /* end KeypadInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void TC0_IrqHandler(void)
+
+@brief Reads the keypad columns and moves on to the next row or probe.
+
+Requires:
+- TC0 set up by KeypadInitialize()
+- The row read now was pulled low by the previous interrupt (or all rows while idle)
+
+Promises:
+- Idle probe: if any column is low, all rows are released, row 0 is pulled low and
+  the interrupt rate goes to U16_KEYPAD_ROW_TICKS
+- Scanning: the row's keys are added to the scan and the row released; after the last
+  row the scan is handed to KeypadScanComplete(), which may drop back to the idle probe;
+  otherwise the next row is pulled low
+
+*/
+void TC0_IrqHandler(void)
+{
+  u32 u32Columns;
+
+  TRACE_ISR_ENTER(IRQn_TC0);
+
+  /* Check for the RC compare - READING THE TC_SR clears the bit if set */
+  if(AT91C_BASE_TC0->TC_SR & AT91C_TC_CPCS)
+  {
+    /* A pressed key pulls its column down to the low row */
+    u32Columns = (~AT91C_BASE_PIOA->PIO_PDSR >> U8_KEYPAD_COLUMN_SHIFT) & U32_KEYPAD_COLUMN_MASK;
+
+    if(Keypad_u8Row == U8_KEYPAD_IDLE_PROBE)
+    {
+      if(u32Columns)
+      {
+        for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+        {
+          KeypadDriveRow(i, FALSE);
+        }
+
+        Keypad_u8Row = 0;
+        Keypad_u32Scan = 0;
+        KeypadDriveRow(0, TRUE);
+        AT91C_BASE_TC0->TC_RC = U16_KEYPAD_ROW_TICKS;
+      }
+    }
+    else
+    {
+      Keypad_u32Scan |= u32Columns << (Keypad_u8Row * U8_KEYPAD_COLUMNS);
+      KeypadDriveRow(Keypad_u8Row, FALSE);
+      Keypad_u8Row++;
+
+      if(Keypad_u8Row == U8_KEYPAD_ROWS)
+      {
+        Keypad_u8Row = 0;
+        if( !KeypadScanComplete(Keypad_u32Scan) )
+        {
+          KeypadIdleProbe();
+          AT91C_BASE_TC0->TC_RC = U16_KEYPAD_IDLE_TICKS;
+        }
+        Keypad_u32Scan = 0;
+      }
+
+      if(Keypad_u8Row != U8_KEYPAD_IDLE_PROBE)
+      {
+        KeypadDriveRow(Keypad_u8Row, TRUE);
+      }
+    }
+  }
+
+  /* Clear the TC0 pending flag and exit */
+  NVIC_ClearPendingIRQ(IRQn_TC0);
+  TRACE_ISR_EXIT(IRQn_TC0);
+
+} /* end TC0_IrqHandler() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void KeypadDriveRow(u8 u8Row_, bool bLow_)
+
+@brief Pulls a row line low or releases it to its pull-up.
+
+Requires:
+@param u8Row_ is a valid row
+@param bLow_ is TRUE to pull the row low
+
+Promises:
+- The row's PIO_CODR (low) or PIO_SODR (released) is written
+
+*/
+static void KeypadDriveRow(u8 u8Row_, bool bLow_)
+{
+  if(bLow_)
+  {
+    *(&(AT91C_BASE_PIOA->PIO_CODR) + G_asBspKeypadRows[u8Row_].ePort) = G_asBspKeypadRows[u8Row_].u32BitPosition;
+  }
+  else
+  {
+    *(&(AT91C_BASE_PIOA->PIO_SODR) + G_asBspKeypadRows[u8Row_].ePort) = G_asBspKeypadRows[u8Row_].u32BitPosition;
+  }
+
+} /* end KeypadDriveRow() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void KeypadIdleProbe(void)
+
+@brief Pulls every row low so any pressed key shows on its column.
+
+Requires:
+- NONE
+
+Promises:
+- All rows are low and Keypad_u8Row is U8_KEYPAD_IDLE_PROBE
+
+*/
+static void KeypadIdleProbe(void)
+{
+  for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+  {
+    KeypadDriveRow(i, TRUE);
+  }
+
+  Keypad_u8Row = U8_KEYPAD_IDLE_PROBE;
+
+} /* end KeypadIdleProbe() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool KeypadScanComplete(u32 u32Scan_)
+
+@brief Debounces a complete scan and publishes a new set of keys.
+
+Requires:
+@param u32Scan_ is the keys seen in every row (bit n = KEYn)
+
+Promises:
+- A ghosted scan is counted in G_u32KeypadGhosts and restarts the debounce
+- After U8_KEYPAD_DEBOUNCE_SCANS identical scans that differ from Keypad_u32Keys, the
+  keys and the time of the first of those scans are published (Keypad_u8Sequence moves on)
+- Returns FALSE once no key is pressed or settling (the scan can drop to the idle probe)
+
+*/
+static bool KeypadScanComplete(u32 u32Scan_)
+{
+  if( KeypadIsGhosted(u32Scan_) )
+  {
+    G_u32KeypadGhosts++;
+    Keypad_u8StableScans = 0;
+    return(TRUE);
+  }
+
+  if(u32Scan_ != Keypad_u32LastScan)
+  {
+    Keypad_u32LastScan = u32Scan_;
+    Keypad_u32LastScanTime = G_u32SystemTime1ms;
+    Keypad_u8StableScans = 1;
+  }
+  else if(Keypad_u8StableScans < U8_KEYPAD_DEBOUNCE_SCANS)
+  {
+    Keypad_u8StableScans++;
+  }
+
+  if( (Keypad_u8StableScans == U8_KEYPAD_DEBOUNCE_SCANS) && (u32Scan_ != Keypad_u32Keys) )
+  {
+    Keypad_u32Keys = u32Scan_;
+    Keypad_u32KeysTime = Keypad_u32LastScanTime;
+    Keypad_u8Sequence++;
+  }
+
+  return( (bool)( (u32Scan_ != 0) || (Keypad_u32Keys != 0) ||
+                  (Keypad_u8StableScans < U8_KEYPAD_DEBOUNCE_SCANS) ) );
+
+} /* end KeypadScanComplete() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool KeypadIsGhosted(u32 u32Scan_)
+
+@brief Checks a scan for keys that could be ghosts.
+
+A ghost needs three pressed keys on the corners of a rectangle, and then shows as the
+fourth, so any two rows that share two or more columns may include one.
+
+Requires:
+@param u32Scan_ is a complete scan (bit n = KEYn)
+
+Promises:
+- Returns TRUE if any two rows have two or more columns in common
+
+*/
+static bool KeypadIsGhosted(u32 u32Scan_)
+{
+  u32 u32Shared;
+
+  for(u8 i = 1; i < U8_KEYPAD_ROWS; i++)
+  {
+    for(u8 j = 0; j < i; j++)
+    {
+      u32Shared = (u32Scan_ >> (i * U8_KEYPAD_COLUMNS)) & (u32Scan_ >> (j * U8_KEYPAD_COLUMNS)) & U32_KEYPAD_COLUMN_MASK;
+
+      /* More than one bit set */
+      if(u32Shared & (u32Shared - 1))
+      {
+        return(TRUE);
+      }
+    }
+  }
+
+  return(FALSE);
+
+} /* end KeypadIsGhosted() */
+
+#endif /* EIE_KEYPAD */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
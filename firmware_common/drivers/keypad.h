@@ -0,0 +1,133 @@
+/*!**********************************************************************************************************************
+@file keypad.h
+@brief Header file for keypad.c
+**********************************************************************************************************************/
+
+#ifndef __KEYPAD_H
+#define __KEYPAD_H
+
+#ifdef EIE_KEYPAD
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+u32 KeypadGetKeys(u32* pu32ChangeTime_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void KeypadInitialize(void);
+void TC0_IrqHandler(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U8_KEYPAD_DEBOUNCE_SCANS  (u8)5       /*!< @brief Identical scans before a new set of keys is accepted (5ms at full rate) */
+#define U8_KEYPAD_IDLE_PROBE      (u8)0xFF    /*!< @brief Keypad_u8Row while all rows are low waiting for any key */
+#define U32_KEYPAD_COLUMN_MASK    (u32)((1 << U8_KEYPAD_COLUMNS) - 1) /*!< @brief One row's keys after the shift */
+
+/* TC0 runs from TIMER_CLOCK4 (MCK/128 = 2.67us / tick) */
+#define U16_KEYPAD_ROW_TICKS      (u16)94     /*!< @brief 250us per row while scanning: every key every 1ms */
+#define U16_KEYPAD_IDLE_TICKS     (u16)7500   /*!< @brief 20ms between idle probes */
+
+#define KEYPAD_TC_CCR_START       (u32)0x00000005
+/*
+    31-04 [0] Reserved
+
+    03 [0] Reserved
+    02 [1] SWTRG counter reset and started
+    01 [0] CLKDIS Clock not disabled
+    00 [1] CLKEN Clock enabled
+*/
+
+#define KEYPAD_TC_CMR_INIT        (u32)0x0000C003
+/*
+    31 [0] BSWTRG no software trigger effect on TIOB
+    30 [0] "
+    29 [0] BEEVT no external event effect on TIOB
+    28 [0] "
+
+    27 [0] BCPC no RC compare effect on TIOB
+    26 [0] "
+    25 [0] BCPB no RB compare effect on TIOB
+    24 [0] "
+
+    23 [0] ASWTRG no TIOA software trigger effect
+    22 [0] "
+    21 [0] AEEVT no TIOA effect on external compare
+    20 [0] "
+
+    19 [0] ACPC no RC compare effect on TIOA
+    18 [0] "
+    17 [0] ACPA no RA compare effect on TIOA
+    16 [0] "
+
+    15 [1] WAVE Waveform Mode is enabled
+    14 [1] WAVSEL/CPCTRG - Up to RC mode/ Trigger on RC compare
+    13 [0] "
+    12 [0] ENETRG external event has no effect
+
+    11 [0] EEVT external event assigned to TIOB
+    10 [0] "
+    09 [0] EEVTEDG no external event trigger
+    08 [0] "
+
+    07 [0] CPCDIS clock is NOT disabled when reaches RC
+    06 [0] CPCSTOP clock is NOT stopped when reaches RC
+    05 [0] BURST not gated
+    04 [0] "
+
+    03 [0] CLKI Counter incremented on rising edge
+    02 [0] TCCLKS TIMER_CLOCK4 (MCK/128 = 2.67us / tick)
+    01 [1] "
+    00 [1] "
+*/
+
+#define KEYPAD_TC_IER_INIT        (u32)0x00000010
+/*
+    31 -08 [0] Reserved
+
+    07 [0] ETRGS RC Load interrupt not enabled
+    06 [0] LDRBS RB Load interrupt not enabled
+    05 [0] LDRAS RA Load interrupt not enabled
+    04 [1] CPCS RC compare interrupt is enabled (next row / next probe)
+
+    03 [0] CPBS RB compare interrupt not enabled
+    02 [0] CPAS RA Compare Interrupt not enabled
+    01 [0] LOVRS Load Overrun interrupt not enabled
+    00 [0] COVFS Counter Overflow interrupt not enabled
+*/
+
+#define KEYPAD_TC_IDR_INIT        (u32)0x000000EF
+/*
+    31-08 [0] Reserved
+
+    07 [1] ETRGS RC Load interrupt disabled
+    06 [1] LDRBS RB Load interrupt disabled
+    05 [1] LDRAS RA Load interrupt disabled
+    04 [0] CPCS RC compare interrupt left enabled
+
+    03 [1] CPBS RB compare interrupt disabled
+    02 [1] CPAS RA Compare Interrupt disabled
+    01 [1] LOVRS Load Overrun interrupt disabled
+    00 [1] COVFS Counter Overflow interrupt disabled
+*/
+
+
+#endif /* EIE_KEYPAD */
+
+#endif /* __KEYPAD_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
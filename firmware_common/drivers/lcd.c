@@ -0,0 +1,593 @@
+/*!**********************************************************************************************************************
+@file lcd.c
+@brief Character LCD (the ASCII board's 2 x 20 NHD-C0220BiZ on TWI0) run from a RAM framebuffer.
+
+Apps write text into G_aau8LcdFrame whenever they like, directly or with LcdWrite() and
+LcdClear(); nothing is sent at that point.  The LCD task keeps a copy of what the
+display shows and, at most every U32_LCD_REFRESH_MS, compares the two.  Each run of
+changed characters goes out as one TWI transaction: a DDRAM address command and the
+characters.  Runs on a line that are only U8_LCD_MERGE_GAP or fewer characters apart
+are sent as one (the unchanged characters cost less than another transaction), so a
+counter ticking over costs a few bytes on the bus rather than the whole screen.
+
+Up to U8_LCD_BUFFERS runs can be on the TWI queue at once; a pass that has more
+leaves the rest for the next tick.  Because the display is cleared at the end of its
+start up, the copy starts as all spaces and only the text apps wrote is sent.
+
+If a transaction fails (the LCD does not answer), the LCD is reset and set up again
+after U32_LCD_RETRY_MS, and the whole frame is sent again from a clear display.
+
+The start up delays, the retry wait and the refresh interval all run on one software
+timer (Lcd_sWait), so while the task waits the Timer task's wheel decides when the
+system next wakes up; the LCD task is skipped until the wait is over.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- u8 G_aau8LcdFrame[U8_LCD_LINES][U8_LCD_COLUMNS]
+- LcdStatsType G_sLcdStats
+
+CONSTANTS
+- U8_LCD_LINES, U8_LCD_COLUMNS
+
+TYPES
+- LcdStatsType
+
+PUBLIC FUNCTIONS
+- void LcdWrite(u8 u8Line_, u8 u8Column_, const char* pcText_)
+- void LcdClear(void)
+
+PROTECTED FUNCTIONS
+- void LcdInitialize(void)
+- void LcdRunActiveState(void)
+- bool LcdIsIdle(void)
+- u32 LcdNextDeadline(void)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Lcd"
+***********************************************************************************************************************/
+/* New variables */
+u8 G_aau8LcdFrame[U8_LCD_LINES][U8_LCD_COLUMNS];       /*!< @brief What apps want on the display */
+LcdStatsType G_sLcdStats;                              /*!< @brief Refresh counters */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static bool LcdSend(const u8* pu8Bytes_, u8 u8Length_);
+static u8 LcdRefresh(void);
+static bool LcdChanged(u8 u8Line_, u8 u8Column_);
+static void LcdTwiDone(TwiResultType eResult_, void* pvContext_);
+static void LcdRestart(void);
+static void LcdFailed(void);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void LcdSM_ResetHold(void);
+static void LcdSM_PowerUp(void);
+static void LcdSM_Setup(void);
+static void LcdSM_DisplayOn(void);
+static void LcdSM_Idle(void);
+static void LcdSM_Error(void);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Lcd_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Lcd_pfnStateMachine;                /*!< @brief The state machine function pointer */
+
+static u8 Lcd_aau8Shown[U8_LCD_LINES][U8_LCD_COLUMNS]; /*!< @brief What the display shows once the queued runs are sent */
+
+/* Transactions are called back in queue order, so the buffers are used as a ring */
+static u8 Lcd_aau8Buffers[U8_LCD_BUFFERS][U8_LCD_RUN_OVERHEAD + U8_LCD_COLUMNS]; /*!< @brief Bytes of queued transactions */
+static u8 Lcd_u8Sent;                                  /*!< @brief Transactions queued since start up */
+static u8 Lcd_u8Done;                                  /*!< @brief Transactions called back since start up */
+static bool Lcd_bError;                                /*!< @brief A transaction failed */
+static TwiResultType Lcd_eError;                       /*!< @brief How it failed */
+
+static TimerSoftType Lcd_sWait;                        /*!< @brief Running during a start up step, retry wait or refresh interval */
+
+/*! @brief Start up, part 1: 8-bit interface, 2 lines, then (instruction table 1) bias,
+contrast, booster and follower for 3.3 V */
+static const u8 Lcd_au8Setup[] = {LCD_CONTROL_COMMANDS, 0x38, 0x39, 0x14, 0x78, 0x5E, 0x6D};
+
+/*! @brief Start up, part 2: display on without cursor, clear, cursor moves right */
+static const u8 Lcd_au8DisplayOn[] = {LCD_CONTROL_COMMANDS, 0x0C, 0x01, 0x06};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LcdWrite(u8 u8Line_, u8 u8Column_, const char* pcText_)
+
+@brief Copies text into the framebuffer; the LCD task sends what changed.
+
+Example:
+
+LcdWrite(0, 0, "Hello world!");
+
+Requires:
+@param u8Line_ is the line (0 or 1)
+@param u8Column_ is where the text starts (0 - 19)
+@param pcText_ is a NUL-terminated string
+
+Promises:
+- The characters of pcText_ are in G_aau8LcdFrame from u8Column_, up to the end of
+  the line (the rest is cut off)
+- Nothing is written if u8Line_ or u8Column_ is off the display
+
+*/
+void LcdWrite(u8 u8Line_, u8 u8Column_, const char* pcText_)
+{
+  if(u8Line_ >= U8_LCD_LINES)
+  {
+    return;
+  }
+
+  while( (u8Column_ < U8_LCD_COLUMNS) && (*pcText_ != '\0') )
+  {
+    G_aau8LcdFrame[u8Line_][u8Column_++] = (u8)*pcText_++;
+  }
+
+} /* end LcdWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LcdClear(void)
+
+@brief Blanks the framebuffer.
+
+Requires:
+- NONE
+
+Promises:
+- G_aau8LcdFrame is all spaces
+
+*/
+void LcdClear(void)
+{
+  memset(G_aau8LcdFrame, ' ', sizeof(G_aau8LcdFrame));
+
+} /* end LcdClear() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LcdInitialize(void)
+
+@brief Blanks the framebuffer and starts the LCD's reset.
+
+The rest of the start up is timed by the state machine so no one waits for it.
+
+Requires:
+- PB_09_LCD_RST is an output (GpioSetup())
+- TwiInitialize() has run before the task first runs
+- TimerInitialize() has run
+
+Promises:
+- G_aau8LcdFrame is all spaces; apps may write to it from now on
+- The LCD is held in reset and Lcd_pfnStateMachine = LcdSM_ResetHold
+
+*/
+void LcdInitialize(void)
+{
+  TimerSoftCreate(&Lcd_sWait, U32_LCD_RESET_MS, TIMER_ONE_SHOT, NULL, NULL);
+  LcdClear();
+  memset(&G_sLcdStats, 0, sizeof(G_sLcdStats));
+  Lcd_u8Sent = 0;
+  Lcd_u8Done = 0;
+  Lcd_bError = FALSE;
+
+  LcdRestart();
+
+} /* end LcdInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LcdRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void LcdRunActiveState(void)
+{
+  Lcd_pfnStateMachine();
+
+} /* end LcdRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool LcdIsIdle(void)
+
+@brief TRUE when the display shows the framebuffer, so the scheduler can skip the task.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE while Lcd_sWait runs, or when the display is up to date
+- Returns FALSE otherwise: start up or an error has a step to take, or
+  G_aau8LcdFrame has changes that are not queued yet
+
+*/
+bool LcdIsIdle(void)
+{
+  if( TimerSoftIsRunning(&Lcd_sWait) )
+  {
+    return(TRUE);
+  }
+
+  return( (Lcd_pfnStateMachine == LcdSM_Idle) && !Lcd_bError &&
+          (memcmp(G_aau8LcdFrame, Lcd_aau8Shown, sizeof(Lcd_aau8Shown)) == 0) );
+
+} /* end LcdIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 LcdNextDeadline(void)
+
+@brief Reports how many ms until the task next has work (used by the main loop scheduler).
+
+Requires:
+- NONE
+
+Promises:
+- Returns U32_NO_DEADLINE while Lcd_sWait runs (the Timer task wakes the system when
+  it expires), while the display is up to date, or while every buffer is on the TWI
+  queue (a transaction ending wakes the system anyway)
+- Otherwise returns 1
+
+*/
+u32 LcdNextDeadline(void)
+{
+  if( TimerSoftIsRunning(&Lcd_sWait) )
+  {
+    return(U32_NO_DEADLINE);
+  }
+
+  if( (Lcd_pfnStateMachine == LcdSM_Idle) && !Lcd_bError )
+  {
+    if( (memcmp(G_aau8LcdFrame, Lcd_aau8Shown, sizeof(Lcd_aau8Shown)) == 0) ||
+        ((u8)(Lcd_u8Sent - Lcd_u8Done) >= U8_LCD_BUFFERS) )
+    {
+      return(U32_NO_DEADLINE);
+    }
+  }
+
+  return(1);
+
+} /* end LcdNextDeadline() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LcdSend(const u8* pu8Bytes_, u8 u8Length_)
+
+@brief Queues one write to the LCD from the next free buffer.
+
+Returns FALSE if every buffer is in use or the TWI queue is full.
+*/
+static bool LcdSend(const u8* pu8Bytes_, u8 u8Length_)
+{
+  u8* pu8Buffer = Lcd_aau8Buffers[Lcd_u8Sent % U8_LCD_BUFFERS];
+  TwiTransactionType sTransaction = {U8_LCD_ADDRESS, pu8Buffer, u8Length_, NULL, 0, LcdTwiDone, NULL};
+
+  if( ((u8)(Lcd_u8Sent - Lcd_u8Done) >= U8_LCD_BUFFERS) || (u8Length_ > sizeof(Lcd_aau8Buffers[0])) )
+  {
+    return(FALSE);
+  }
+
+  memcpy(pu8Buffer, pu8Bytes_, u8Length_);
+  if( !TwiQueue(&sTransaction) )
+  {
+    return(FALSE);
+  }
+
+  Lcd_u8Sent++;
+  return(TRUE);
+
+} /* end LcdSend() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LcdChanged(u8 u8Line_, u8 u8Column_)
+
+@brief TRUE if a framebuffer character differs from what the display shows.
+*/
+static bool LcdChanged(u8 u8Line_, u8 u8Column_)
+{
+  return( (bool)(G_aau8LcdFrame[u8Line_][u8Column_] != Lcd_aau8Shown[u8Line_][u8Column_]) );
+
+} /* end LcdChanged() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 LcdRefresh(void)
+
+@brief Queues the changed runs of the framebuffer; returns how many were queued.
+
+A run starts at a changed character and takes in every changed character that
+follows within U8_LCD_MERGE_GAP unchanged ones.  It goes out as a single command
+(the DDRAM address) and then its characters as data:
+
+  LCD_CONTROL_COMMAND, LCD_SET_DDRAM_ADDRESS | address, LCD_CONTROL_DATA, characters...
+
+Lcd_aau8Shown is updated as each run is queued, so changes made after this pass are
+found by the next one.  Stops when there is no buffer left.
+*/
+static u8 LcdRefresh(void)
+{
+  u8 au8Run[U8_LCD_RUN_OVERHEAD + U8_LCD_COLUMNS];
+  u8 u8Runs = 0;
+  u8 u8Column;
+  u8 u8End;
+
+  for(u8 u8Line = 0; u8Line < U8_LCD_LINES; u8Line++)
+  {
+    u8Column = 0;
+    while(u8Column < U8_LCD_COLUMNS)
+    {
+      if( !LcdChanged(u8Line, u8Column) )
+      {
+        u8Column++;
+        continue;
+      }
+
+      /* Extend the run over each changed character that is close enough */
+      u8End = u8Column + 1;
+      for(u8 i = u8End; (i < U8_LCD_COLUMNS) && ((u8)(i - u8End) <= U8_LCD_MERGE_GAP); i++)
+      {
+        if( LcdChanged(u8Line, i) )
+        {
+          u8End = i + 1;
+        }
+      }
+
+      au8Run[0] = LCD_CONTROL_COMMAND;
+      au8Run[1] = LCD_SET_DDRAM_ADDRESS | (u8)(u8Line * U8_LCD_LINE_ADDRESS + u8Column);
+      au8Run[2] = LCD_CONTROL_DATA;
+      memcpy(&au8Run[U8_LCD_RUN_OVERHEAD], &G_aau8LcdFrame[u8Line][u8Column], u8End - u8Column);
+
+      if( !LcdSend(au8Run, (u8)(U8_LCD_RUN_OVERHEAD + u8End - u8Column)) )
+      {
+        return(u8Runs);
+      }
+
+      memcpy(&Lcd_aau8Shown[u8Line][u8Column], &au8Run[U8_LCD_RUN_OVERHEAD], u8End - u8Column);
+      G_sLcdStats.u32Runs++;
+      G_sLcdStats.u32Characters += (u32)(u8End - u8Column);
+      u8Runs++;
+      u8Column = u8End;
+    }
+  }
+
+  return(u8Runs);
+
+} /* end LcdRefresh() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdTwiDone(TwiResultType eResult_, void* pvContext_)
+
+@brief TWI callback: frees the oldest buffer and notes a failure for the task.
+*/
+static void LcdTwiDone(TwiResultType eResult_, void* pvContext_)
+{
+  (void)pvContext_;
+
+  Lcd_u8Done++;
+  if( (eResult_ != TWI_RESULT_OK) && !Lcd_bError )
+  {
+    Lcd_bError = TRUE;
+    Lcd_eError = eResult_;
+  }
+
+} /* end LcdTwiDone() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdRestart(void)
+
+@brief Puts the LCD in reset and starts its set up from the beginning.
+
+The set up ends by clearing the display, so that is what it will show.
+*/
+static void LcdRestart(void)
+{
+  AT91C_BASE_PIOB->PIO_CODR = PB_09_LCD_RST;
+  memset(Lcd_aau8Shown, ' ', sizeof(Lcd_aau8Shown));
+
+  TimerSoftRestart(&Lcd_sWait, U32_LCD_RESET_MS);
+  Lcd_pfnStateMachine = LcdSM_ResetHold;
+
+} /* end LcdRestart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LcdFailed(void)
+
+@brief Reports the failed transaction and waits U32_LCD_RETRY_MS before starting again.
+*/
+static void LcdFailed(void)
+{
+  LOG1("lcd: transaction failed (result %u), restarting", Lcd_eError);
+  G_sLcdStats.u32Errors++;
+
+  TimerSoftRestart(&Lcd_sWait, U32_LCD_RETRY_MS);
+  Lcd_pfnStateMachine = LcdSM_Error;
+
+} /* end LcdFailed() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_ResetHold(void)
+
+@brief Releases the reset once it has been held long enough and nothing is left on the TWI queue.
+*/
+static void LcdSM_ResetHold(void)
+{
+  if( TimerSoftIsRunning(&Lcd_sWait) || (Lcd_u8Sent != Lcd_u8Done) )
+  {
+    return;
+  }
+
+  /* Failures of transactions sent before the reset do not count */
+  Lcd_bError = FALSE;
+  AT91C_BASE_PIOB->PIO_SODR = PB_09_LCD_RST;
+
+  TimerSoftRestart(&Lcd_sWait, U32_LCD_POWER_UP_MS);
+  Lcd_pfnStateMachine = LcdSM_PowerUp;
+
+} /* end LcdSM_ResetHold() */
+
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_PowerUp(void)
+
+@brief Sends the interface, bias and power set up once the LCD is out of reset.
+*/
+static void LcdSM_PowerUp(void)
+{
+  if( !TimerSoftIsRunning(&Lcd_sWait) && LcdSend(Lcd_au8Setup, (u8)sizeof(Lcd_au8Setup)) )
+  {
+    TimerSoftRestart(&Lcd_sWait, U32_LCD_SETUP_MS);
+    Lcd_pfnStateMachine = LcdSM_Setup;
+  }
+
+} /* end LcdSM_PowerUp() */
+
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_Setup(void)
+
+@brief Turns the display on and clears it once the voltage follower has settled.
+*/
+static void LcdSM_Setup(void)
+{
+  if( TimerSoftIsRunning(&Lcd_sWait) || (Lcd_u8Sent != Lcd_u8Done) )
+  {
+    return;
+  }
+
+  if(Lcd_bError)
+  {
+    LcdFailed();
+    return;
+  }
+
+  if( LcdSend(Lcd_au8DisplayOn, (u8)sizeof(Lcd_au8DisplayOn)) )
+  {
+    TimerSoftRestart(&Lcd_sWait, U32_LCD_CLEAR_MS);
+    Lcd_pfnStateMachine = LcdSM_DisplayOn;
+  }
+
+} /* end LcdSM_Setup() */
+
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_DisplayOn(void)
+
+@brief Waits for the clear to finish; the first refresh follows straight away.
+*/
+static void LcdSM_DisplayOn(void)
+{
+  if( TimerSoftIsRunning(&Lcd_sWait) || (Lcd_u8Sent != Lcd_u8Done) )
+  {
+    return;
+  }
+
+  if(Lcd_bError)
+  {
+    LcdFailed();
+    return;
+  }
+
+  Lcd_pfnStateMachine = LcdSM_Idle;
+
+} /* end LcdSM_DisplayOn() */
+
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_Idle(void)
+
+@brief Sends what changed in the framebuffer, at most once per U32_LCD_REFRESH_MS.
+
+The interval (Lcd_sWait) starts when a pass has sent everything, so the first change
+after a quiet spell goes out at once.  A pass that ran out of buffers carries on next tick.
+*/
+static void LcdSM_Idle(void)
+{
+  if(Lcd_bError)
+  {
+    LcdFailed();
+    return;
+  }
+
+  if( TimerSoftIsRunning(&Lcd_sWait) )
+  {
+    return;
+  }
+
+  if(LcdRefresh() != 0)
+  {
+    G_sLcdStats.u32Refreshes++;
+    if(memcmp(G_aau8LcdFrame, Lcd_aau8Shown, sizeof(Lcd_aau8Shown)) == 0)
+    {
+      TimerSoftRestart(&Lcd_sWait, U32_LCD_REFRESH_MS);
+    }
+  }
+
+} /* end LcdSM_Idle() */
+
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LcdSM_Error(void)
+
+@brief A transaction failed: starts again after U32_LCD_RETRY_MS.
+*/
+static void LcdSM_Error(void)
+{
+  if( !TimerSoftIsRunning(&Lcd_sWait) )
+  {
+    LcdRestart();
+  }
+
+} /* end LcdSM_Error() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
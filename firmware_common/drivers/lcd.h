@@ -0,0 +1,77 @@
+/*!**********************************************************************************************************************
+@file lcd.h
+@brief Header file for lcd.c
+**********************************************************************************************************************/
+
+#ifndef __LCD_H
+#define __LCD_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@struct LcdStatsType
+@brief What the refresh has sent, to see how much the diffing saves.
+*/
+typedef struct
+{
+  u32 u32Refreshes;                       /*!< @brief Passes that found a change */
+  u32 u32Runs;                            /*!< @brief Changed runs sent (one address command each) */
+  u32 u32Characters;                      /*!< @brief Characters sent, including unchanged ones inside merged runs */
+  u32 u32Errors;                          /*!< @brief Transactions that failed (each restarts the LCD) */
+} LcdStatsType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void LcdWrite(u8 u8Line_, u8 u8Column_, const char* pcText_);
+void LcdClear(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void LcdInitialize(void);
+void LcdRunActiveState(void);
+bool LcdIsIdle(void);
+u32 LcdNextDeadline(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+/* NHD-C0220BiZ-FSW-FBW-3V3M: 2 x 20 characters, ST7036i controller */
+#define U8_LCD_LINES                (u8)2         /*!< @brief Lines on the display */
+#define U8_LCD_COLUMNS              (u8)20        /*!< @brief Characters per line */
+#define U8_LCD_ADDRESS              (u8)0x3C      /*!< @brief 7-bit TWI address */
+
+#define U8_LCD_BUFFERS              (u8)4         /*!< @brief Run transactions that can be on the TWI queue at once (power of 2) */
+#define U8_LCD_RUN_OVERHEAD         (u8)3         /*!< @brief Bytes in front of a run's characters */
+#define U8_LCD_MERGE_GAP            (u8)4         /*!< @brief Unchanged characters sent rather than starting another run */
+#define U32_LCD_REFRESH_MS          (u32)20       /*!< @brief Shortest time between refresh passes (changes in between go together) */
+
+#define U32_LCD_RESET_MS            (u32)2        /*!< @brief Reset pulse */
+#define U32_LCD_POWER_UP_MS         (u32)40       /*!< @brief Reset released to first command */
+#define U32_LCD_SETUP_MS            (u32)200      /*!< @brief Follower (booster) settling after the setup commands */
+#define U32_LCD_CLEAR_MS            (u32)2        /*!< @brief Clear display command */
+#define U32_LCD_RETRY_MS            (u32)1000     /*!< @brief Wait after a failed transaction before starting again */
+
+/* I2C control bytes: Co (bit 7) = another control byte follows the next byte; RS (bit 6) = data */
+#define LCD_CONTROL_COMMANDS        (u8)0x00      /*!< @brief Command bytes follow to the STOP */
+#define LCD_CONTROL_COMMAND         (u8)0x80      /*!< @brief One command byte, then another control byte */
+#define LCD_CONTROL_DATA            (u8)0x40      /*!< @brief Character bytes follow to the STOP */
+
+/* ST7036 commands */
+#define LCD_SET_DDRAM_ADDRESS       (u8)0x80      /*!< @brief OR in the DDRAM address */
+#define U8_LCD_LINE_ADDRESS         (u8)0x40      /*!< @brief DDRAM address step between lines */
+
+
+#endif /* __LCD_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -2,10 +2,28 @@
 @file leds.c                                                                
 @brief LED driver and API
 
-This driver provides on, off, toggle, and blink functionality.
-The basic on/off/toggle functionality is applied directly to the LEDs.
-Blinking of LEDs rely on the EIE operating system to provide timing at
-regular 1ms calls to LedSM_Idle().
+This driver provides on, off, toggle, blink and PWM functionality.
+On/off/toggle changes (and blink edges) are staged in per-port set and clear masks 
+and written by LedCommit(), which the super loop calls once per tick after all 
+tasks have run.  However many LEDs change in a tick, that is at most one PIO_SODR 
+and one PIO_CODR write per port, and LEDs changed together switch together.
+Blinking of LEDs rely on the EIE operating system to call LedSM_Idle().
+The counters are run down by the ms that passed since the last call, and 
+LedNextDeadline() tells the scheduler when the next LED edge is due so the 
+system can sleep through the ticks in between.
+
+Animations play const keyframe sequences (LedSequenceType, normally in flash) on 
+up to U8_LED_ANIMATION_PLAYERS players.  Each keyframe fades a group of LEDs to a 
+brightness over a duration with an easing curve; LedSM_Idle() moves every player 
+along from G_u32SystemTime1ms and sets the LED PWM duties, so an app only starts a 
+sequence and optionally gets a callback when it finishes.
+
+PWM does not use the task at all.  TC2 runs a 1.46kHz carrier with 10-bit duty and its interrupt 
+walks a schedule of port masks built by LedPwmScheduleUpdate(): every PWM LED 
+turns on at the start of the period and each distinct duty is one "off" edge, 
+so each edge is a single PIO_SODR / PIO_CODR write per port no matter how many 
+LEDs change.  The schedule is double-buffered and swapped by the interrupt at the 
+start of a period, so changing a duty never produces a partial period.
 
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
@@ -36,10 +54,20 @@ PUBLIC FUNCTIONS
 - void LedToggle(LedNameType eLED_)
 - void LedBlink(LedNameType eLED_, LedRateType eBlinkRate_)
 - void LedPWM(LedNameType eLED_, LedRateType ePwmRate_)
+- void LedPWMDuty(LedNameType eLED_, u8 u8Duty_)
+- void LedSetBacklightRGB(u8 u8Red_, u8 u8Green_, u8 u8Blue_)
+- void LedSetMask(u32 u32Leds_, u32 u32OnLeds_)
+- void LedCommit(void)
+- bool LedAnimationStart(const LedSequenceType* psSequence_)
+- void LedAnimationStop(const LedSequenceType* psSequence_)
+- bool LedAnimationIsPlaying(const LedSequenceType* psSequence_)
 
 PROTECTED FUNCTIONS
 - void LedInitialize(void)
 - void LedRunActiveState(void)
+- bool LedIsIdle(void)
+- u32 LedNextDeadline(void)
+- void TC2_IrqHandler(void)
 
 ***********************************************************************************************************************/
 
@@ -64,6 +92,32 @@ extern volatile u32 G_u32ApplicationFlags;             /*!< @brief From main.c *
 extern const PinConfigurationType G_asBspLedConfigurations[U8_TOTAL_LEDS]; /*!< @brief from board-specific file */
 
 
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static u16 LedCountFromNow(u16 u16Count_);
+static void LedPwmRelease(u32 u32Leds_);
+static void LedStage(LedNameType eLED_, bool bOn_);
+static bool LedStagedIsOn(LedNameType eLED_);
+static u16 LedDuty(LedNameType eLED_);
+static bool LedPwmSetDuty(LedNameType eLED_, u16 u16Duty_);
+static u32 LedSequenceLeds(const LedSequenceType* psSequence_);
+static void LedAnimationSequenceStart(LedAnimationPlayerType* psPlayer_, const LedSequenceType* psSequence_);
+static bool LedAnimationKeyframeStart(LedAnimationPlayerType* psPlayer_);
+static bool LedAnimationSet(LedAnimationPlayerType* psPlayer_, u16 u16Progress_);
+static u16 LedEase(LedEasingType eEasing_, u32 u32Elapsed_, u32 u32Duration_);
+static void LedAnimationRun(void);
+static u32 LedAnimationNextDeadline(void);
+static void LedPwmScheduleUpdate(void);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void LedSM_Idle(void);
+static void LedSM_Error(void);
+
+
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "Led_<type>" and be declared as static.
@@ -72,6 +126,30 @@ static fnCode_type Led_StateMachine;                   /*!< @brief The state mac
 //static u32 Led_u32Timeout;                             /*!< @brief Timeout counter used across states */
 
 static LedControlType Led_asControl[U8_TOTAL_LEDS];    /*!< @brief Holds individual control parameters for LEDs */
+static u32 Led_u32ActiveMask;                          /*!< @brief Bit n set while LED n is in BLINK mode */
+static u32 Led_u32LastUpdate;                          /*!< @brief G_u32SystemTime1ms when the counters were last run down */
+
+static u32 Led_au32StagedSet[U8_LED_PORTS];          /*!< @brief Pins LedCommit() will drive high */
+static u32 Led_au32StagedClear[U8_LED_PORTS];        /*!< @brief Pins LedCommit() will drive low */
+
+/*! @brief 8-bit perceptual level to PWM duty (gamma ~2.2), built by the compiler */
+static const u16 Led_au16Gamma[U8_LED_BRIGHTNESS_MAX + 1] =
+{
+  LED_GAMMA_ROW(0),   LED_GAMMA_ROW(16),  LED_GAMMA_ROW(32),  LED_GAMMA_ROW(48),
+  LED_GAMMA_ROW(64),  LED_GAMMA_ROW(80),  LED_GAMMA_ROW(96),  LED_GAMMA_ROW(112),
+  LED_GAMMA_ROW(128), LED_GAMMA_ROW(144), LED_GAMMA_ROW(160), LED_GAMMA_ROW(176),
+  LED_GAMMA_ROW(192), LED_GAMMA_ROW(208), LED_GAMMA_ROW(224), LED_GAMMA_ROW(240)
+};
+
+static LedAnimationPlayerType Led_asAnimations[U8_LED_ANIMATION_PLAYERS]; /*!< @brief Keyframe sequence players */
+
+static u32 Led_u32PwmMask;                             /*!< @brief Bit n set while LED n is in the PWM schedule */
+static volatile u32 Led_au32PwmPins[U8_LED_PORTS];     /*!< @brief Pins the TC2 interrupt may drive, per port */
+static LedPwmEdgeType Led_asPwmSchedule[2][U8_LED_PWM_EDGES]; /*!< @brief Double-buffered PWM edge schedules */
+static u8 Led_au8PwmEdges[2];                          /*!< @brief Number of edges in each schedule */
+static volatile u8 Led_u8PwmActive;                    /*!< @brief Schedule the TC2 interrupt is running */
+static volatile bool Led_bPwmUpdate;                   /*!< @brief The other schedule is ready to swap in at the next period */
+static u8 Led_u8PwmEdge;                               /*!< @brief Next edge to apply in the active schedule (TC2 interrupt only) */
 
 
 /**********************************************************************************************************************
@@ -88,10 +166,11 @@ Function Definitions
 @brief Turn the specified LED on.  
 
 This function automatically takes care of the active low vs. active high LEDs.
-The function works immediately (it does not require the main application
-loop to be running). 
+The change is staged and written with the other LED changes of this tick by 
+LedCommit() at the end of the super loop; call LedCommit() to write it sooner 
+(e.g. before the main loop is running).
 
-Currently it only supports one LED at a time.
+Currently it only supports one LED at a time.  Use LedSetMask() for several.
 
 Example:
 
@@ -104,31 +183,19 @@ Requires:
 @param eLED_ is a valid LED index
 
 Promises:
-- eLED_ is turned on 
+- eLED_ is staged to turn on 
 - eLED_ is set to LED_NORMAL_MODE mode
 
 */
 void LedOn(LedNameType eLED_)
 {
-  u32 *pu32OnAddress;
-
-  /* Configure set and clear addresses */
-  if(G_asBspLedConfigurations[eLED_].eActiveState == ACTIVE_HIGH)
-  {
-    /* Active high LEDs use SODR to turn on */
-    pu32OnAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_SODR) + G_asBspLedConfigurations[(u8)eLED_].ePort);
-  }
-  else
-  {
-    /* Active low LEDs use CODR to turn on */
-    pu32OnAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_CODR) + G_asBspLedConfigurations[(u8)eLED_].ePort);
-  }
-  
-  /* Turn on the LED */
-  *pu32OnAddress = G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+  /* Take the pin back from the PWM interrupt before staging it */
+  LedPwmRelease(LED_MASK(eLED_));
+  LedStage(eLED_, TRUE);
   
   /* Always set the LED back to LED_NORMAL_MODE mode */
 	Led_asControl[(u8)eLED_].eMode = LED_NORMAL_MODE;
+  Led_u32ActiveMask &= ~LED_MASK(eLED_);
 
 } /* end LedOn() */
 
@@ -139,10 +206,9 @@ void LedOn(LedNameType eLED_)
 @brief Turn the specified LED off.
 
 This function automatically takes care of the active low vs. active high LEDs.
-It works immediately (it does not require the main application
-loop to be running). 
+The change is staged and written by LedCommit() like LedOn().
 
-Currently it only supports one LED at a time.
+Currently it only supports one LED at a time.  Use LedSetMask() for several.
 
 Example:
 
@@ -155,31 +221,19 @@ Requires:
 @param eLED_ is a valid LED index
 
 Promises:
-- eLED_ is turned off 
+- eLED_ is staged to turn off 
 - eLED_ is set to LED_NORMAL_MODE mode
 
 */
 void LedOff(LedNameType eLED_)
 {
-  u32 *pu32OffAddress;
-
-  /* Configure set and clear addresses */
-  if(G_asBspLedConfigurations[(u8)eLED_].eActiveState == ACTIVE_HIGH)
-  {
-    /* Active high LEDs use CODR to turn off */
-    pu32OffAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_CODR) + G_asBspLedConfigurations[(u8)eLED_].ePort);
-  }
-  else
-  {
-    /* Active low LEDs use SODR to turn off */
-    pu32OffAddress = (u32*)(&(AT91C_BASE_PIOA->PIO_SODR) + G_asBspLedConfigurations[(u8)eLED_].ePort);
-  }
-  
-  /* Clear the bit corresponding to eLED_ */
-	*pu32OffAddress = G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+  /* Take the pin back from the PWM interrupt before staging it */
+  LedPwmRelease(LED_MASK(eLED_));
+  LedStage(eLED_, FALSE);
 
   /* Always set the LED back to LED_NORMAL_MODE mode */
 	Led_asControl[(u8)eLED_].eMode = LED_NORMAL_MODE;
+  Led_u32ActiveMask &= ~LED_MASK(eLED_);
   
 } /* end LedOff() */
 
@@ -190,8 +244,8 @@ void LedOff(LedNameType eLED_)
 @brief Toggles the specified LED from on to off or vise-versa.
 
 This function automatically takes care of the active low vs. active high LEDs.
-It works immediately (it does not require the main application
-loop to be running). 
+The toggle is applied to the staged state, so toggling twice in one tick leaves 
+the LED as it was.  It is written by LedCommit() like LedOn().
 
 Currently it only supports one LED at a time.
 
@@ -201,27 +255,235 @@ LedToggle(BLUE);
 
 
 Requires:
-- Write access to PIOx_ODSR is enabled
+- NONE
 
 @param eLED_ is a valid LED index
 
 Promises:
-- eLED_ is toggled 
+- eLED_ is staged to toggle 
 - eLED_ is set to LED_NORMAL_MODE
 
 */
 void LedToggle(LedNameType eLED_)
 {
-  u32* pu32Address = (u32*)(&(AT91C_BASE_PIOA->PIO_ODSR) + G_asBspLedConfigurations[eLED_].ePort);
-
-  *pu32Address ^= G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+  /* Take the pin back from the PWM interrupt before staging it */
+  LedPwmRelease(LED_MASK(eLED_));
+  LedStage(eLED_, (bool)!LedStagedIsOn(eLED_));
   
   /* Set the LED to LED_NORMAL_MODE mode */
 	Led_asControl[(u8)eLED_].eMode = LED_NORMAL_MODE;
+  Led_u32ActiveMask &= ~LED_MASK(eLED_);
 
 } /* end LedToggle() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LedSetMask(u32 u32Leds_, u32 u32OnLeds_)
+
+@brief Turns a group of LEDs on or off in one call.
+
+Bit n of each mask is LED n of LedNameType (use LED_MASK()).  Every LED in u32Leds_ 
+is set to LED_NORMAL_MODE and staged on if its bit is set in u32OnLeds_ or off if 
+not; LEDs outside u32Leds_ are not touched.  They all change on the same LedCommit().
+
+Example to show 0101 on the RED (bit 0) to GREEN (bit 3) LEDs:
+
+LedSetMask(LED_MASK(RED) | LED_MASK(ORANGE) | LED_MASK(YELLOW) | LED_MASK(GREEN),
+           LED_MASK(RED) | LED_MASK(YELLOW));
+
+
+Requires:
+@param u32Leds_ has bits set only for valid LED indexes
+@param u32OnLeds_ has the bits of the LEDs in u32Leds_ to turn on
+
+Promises:
+- Each LED in u32Leds_ is staged on or off and set to LED_NORMAL_MODE
+
+*/
+void LedSetMask(u32 u32Leds_, u32 u32OnLeds_)
+{
+  /* One schedule rebuild for every PWM LED in the group */
+  LedPwmRelease(u32Leds_);
+  Led_u32ActiveMask &= ~u32Leds_;
+  
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if(u32Leds_ & LED_MASK(i))
+    {
+      LedStage((LedNameType)i, (bool)((u32OnLeds_ & LED_MASK(i)) != 0));
+      Led_asControl[i].eMode = LED_NORMAL_MODE;
+    }
+  }
+
+} /* end LedSetMask() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LedCommit(void)
+
+@brief Writes all staged LED changes to the ports.
+
+The super loop calls this once per tick after the tasks have run.  Call it 
+directly when a change must show before then.
+
+Requires:
+- NONE
+
+Promises:
+- Each port with staged changes gets one PIO_SODR and/or one PIO_CODR write
+- The staged masks are cleared
+
+*/
+void LedCommit(void)
+{
+  for(u8 i = 0; i < U8_LED_PORTS; i++)
+  {
+    if(Led_au32StagedSet[i])
+    {
+      *(&(AT91C_BASE_PIOA->PIO_SODR) + (i * PORTB)) = Led_au32StagedSet[i];
+      Led_au32StagedSet[i] = 0;
+    }
+    
+    if(Led_au32StagedClear[i])
+    {
+      *(&(AT91C_BASE_PIOA->PIO_CODR) + (i * PORTB)) = Led_au32StagedClear[i];
+      Led_au32StagedClear[i] = 0;
+    }
+  }
+
+} /* end LedCommit() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool LedAnimationStart(const LedSequenceType* psSequence_)
+
+@brief Starts playing a keyframe sequence from its first keyframe.
+
+Each keyframe fades the LEDs in its mask from wherever they are to u8Brightness 
+over u16DurationMs using its easing curve.  A keyframe with no LEDs is a pause.
+The sequence plays u8Loops times (LED_LOOP_FOREVER = until stopped), then 
+pfnDone is called (if not NULL) and psNext (if not NULL) starts playing.
+
+Any sequence already playing on one of the same LEDs is stopped first (without 
+its callback).  LEDs in a sequence should not also be set by LedOn() etc. while 
+it plays since the next frame will overwrite them.
+
+Example to fade the LCD backlight to blue and back once, then call 
+UserAppFadeDone():
+
+static const LedKeyframeType asFade[] = 
+{
+  {LED_MASK(LCD_BLUE), 255, LED_EASE_IN_OUT, 500},
+  {LED_MASK(LCD_BLUE),   0, LED_EASE_IN_OUT, 500}
+};
+static const LedSequenceType sFade = {asFade, 2, 1, UserAppFadeDone, NULL};
+
+LedAnimationStart(&sFade);
+
+
+Requires:
+@param psSequence_ points to a sequence with at least one keyframe that stays valid
+while it plays; a looping sequence must not have a total duration of 0
+
+Promises:
+- Returns TRUE and the sequence is playing from now, or 
+- Returns FALSE if all U8_LED_ANIMATION_PLAYERS players are busy
+
+*/
+bool LedAnimationStart(const LedSequenceType* psSequence_)
+{
+  LedAnimationPlayerType* psPlayer = NULL;
+  u32 u32Leds = LedSequenceLeds(psSequence_);
+
+  /* One player per LED: stop anything already driving these LEDs */
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    if( (Led_asAnimations[i].psSequence != NULL) &&
+        ( (Led_asAnimations[i].u32Leds & u32Leds) || (Led_asAnimations[i].psFirst == psSequence_) ) )
+    {
+      Led_asAnimations[i].psSequence = NULL;
+    }
+    
+    if( (psPlayer == NULL) && (Led_asAnimations[i].psSequence == NULL) )
+    {
+      psPlayer = &Led_asAnimations[i];
+    }
+  }
+
+  if(psPlayer == NULL)
+  {
+    return(FALSE);
+  }
+
+  psPlayer->psFirst = psSequence_;
+  psPlayer->u32KeyframeStart = G_u32SystemTime1ms;
+  LedAnimationSequenceStart(psPlayer, psSequence_);
+  if(LedAnimationKeyframeStart(psPlayer))
+  {
+    LedPwmScheduleUpdate();
+  }
+
+  return(TRUE);
+  
+} /* end LedAnimationStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LedAnimationStop(const LedSequenceType* psSequence_)
+
+@brief Stops a sequence started by LedAnimationStart(), including any sequence it 
+has chained to.
+
+The LEDs are left at their current brightness and pfnDone is not called.
+
+Requires:
+@param psSequence_ is the sequence passed to LedAnimationStart()
+
+Promises:
+- The player running psSequence_ (if any) is free
+
+*/
+void LedAnimationStop(const LedSequenceType* psSequence_)
+{
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    if(Led_asAnimations[i].psFirst == psSequence_)
+    {
+      Led_asAnimations[i].psSequence = NULL;
+    }
+  }
+
+} /* end LedAnimationStop() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool LedAnimationIsPlaying(const LedSequenceType* psSequence_)
+
+@brief Reports whether a sequence started by LedAnimationStart() (or a sequence it 
+has chained to) is still playing.
+
+Requires:
+@param psSequence_ is the sequence passed to LedAnimationStart()
+
+Promises:
+- Returns TRUE if a player is still running it
+
+*/
+bool LedAnimationIsPlaying(const LedSequenceType* psSequence_)
+{
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    if( (Led_asAnimations[i].psSequence != NULL) && (Led_asAnimations[i].psFirst == psSequence_) )
+    {
+      return(TRUE);
+    }
+  }
+
+  return(FALSE);
+
+} /* end LedAnimationIsPlaying() */
+
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void LedBlink(LedNameType eLED_, LedRateType eBlinkRate_)
 
@@ -246,9 +508,11 @@ Promises:
 */
 void LedBlink(LedNameType eLED_, LedRateType eBlinkRate_)
 {
+  LedPwmRelease(LED_MASK(eLED_));
 	Led_asControl[(u8)eLED_].eMode = LED_BLINK_MODE;
 	Led_asControl[(u8)eLED_].eRate = eBlinkRate_;
-	Led_asControl[(u8)eLED_].u16Count = eBlinkRate_;
+	Led_asControl[(u8)eLED_].u16Count = LedCountFromNow((u16)eBlinkRate_);
+  Led_u32ActiveMask |= LED_MASK(eLED_);
 
 } /* end LedBlink() */
 
@@ -258,11 +522,8 @@ void LedBlink(LedNameType eLED_, LedRateType eBlinkRate_)
 
 @brief Sets an LED to PWM mode with the rate given.
 
-The PWM output is bit-bashed based on the 1ms system timing.  Therefore,
-PWM mode requires the main loop to be running properly. If the main 
-loop timing is longer than 1ms, noticeable glitches will be observed
-in the PWM signal to the LED.  Even if all applications are working properly,
-there still may be some jitter due to applications taking processor time.
+The 5% steps of LedRateType are mapped onto the 8-bit duty of LedPWMDuty(), so 
+the output is generated by the TC2 interrupt and does not depend on the main loop.
 
 Use LedOff(eLED_) to stop PWM mode and return to NORMAL mode.
 
@@ -281,14 +542,91 @@ Promises:
 */
 void LedPWM(LedNameType eLED_, LedRateType ePwmRate_)
 {
-  Led_asControl[(u8)eLED_].eMode = LED_PWM_MODE;
+  LedPWMDuty(eLED_, (u8)( ((u32)ePwmRate_ * U8_LED_BRIGHTNESS_MAX) / LED_PWM_100 ));
   Led_asControl[(u8)eLED_].eRate = ePwmRate_;
-  Led_asControl[(u8)eLED_].u16Count = (u16)ePwmRate_;
-  Led_asControl[(u8)eLED_].eCurrentDuty = LED_PWM_DUTY_HIGH;
 
 } /* end LedPWM() */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LedPWMDuty(LedNameType eLED_, u8 u8Duty_)
+
+@brief Sets an LED to PWM mode with an 8-bit duty cycle.
+
+The LED is on for u8Duty_ / 255 of each 683us period (scaled to 10 bits with 
+LED_PWM_DUTY(), so the duty is linear, not gamma corrected).  0 and 255 
+are steady levels: they change with the other PWM LEDs at the next period start, 
+or with the next LedCommit() once no LED is left with a duty in between.
+
+Use LedOff(eLED_) to stop PWM mode and return to NORMAL mode.
+
+Example to run the LCD backlight red at about 25%:
+
+LedPWMDuty(LCD_RED, 64);
+
+
+Requires:
+@param eLED_ is a valid LED index
+@param u8Duty_ is the on time from 0 (off) to U8_LED_BRIGHTNESS_MAX (on)
+
+Promises:
+- eLED_ is set to PWM mode at the duty specified
+- The new duty is used from the start of the next PWM period
+
+*/
+void LedPWMDuty(LedNameType eLED_, u8 u8Duty_)
+{
+  if(LedPwmSetDuty(eLED_, LED_PWM_DUTY(u8Duty_)))
+  {
+    LedPwmScheduleUpdate();
+  }
+
+} /* end LedPWMDuty() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LedSetBacklightRGB(u8 u8Red_, u8 u8Green_, u8 u8Blue_)
+
+@brief Sets the LCD backlight to a color with perceptually linear 8-bit channels.
+
+Each channel is looked up in the gamma table, so 128 looks about half as bright 
+as 255 and low levels fade smoothly.  All three channels go into one PWM 
+schedule rebuild, so they change at the same PWM period start, steady 0 and 255 
+channels included.  If all three are 0 or 255 the PWM stops and they go out 
+together with the next LedCommit().
+
+Example for orange:
+
+LedSetBacklightRGB(255, 96, 0);
+
+
+Requires:
+- Any animation on LCD_RED, LCD_GREEN or LCD_BLUE is stopped (it would overwrite them)
+
+@param u8Red_ is the LCD_RED level, 0 (off) to U8_LED_BRIGHTNESS_MAX
+@param u8Green_ is the LCD_GREEN level, 0 (off) to U8_LED_BRIGHTNESS_MAX
+@param u8Blue_ is the LCD_BLUE level, 0 (off) to U8_LED_BRIGHTNESS_MAX
+
+Promises:
+- LCD_RED, LCD_GREEN and LCD_BLUE are in PWM mode at the gamma corrected duties
+
+*/
+void LedSetBacklightRGB(u8 u8Red_, u8 u8Green_, u8 u8Blue_)
+{
+  bool bUpdate;
+
+  bUpdate  = LedPwmSetDuty(LCD_RED,   Led_au16Gamma[u8Red_]);
+  bUpdate |= LedPwmSetDuty(LCD_GREEN, Led_au16Gamma[u8Green_]);
+  bUpdate |= LedPwmSetDuty(LCD_BLUE,  Led_au16Gamma[u8Blue_]);
+
+  if(bUpdate)
+  {
+    LedPwmScheduleUpdate();
+  }
+
+} /* end LedSetBacklightRGB() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -304,6 +642,7 @@ Requires:
 
 Promises:
 - Led_asControl is initialized (all LEDs in LED_NORMAL_MODE)
+- The backlight is on and white when this returns (not staged for the first LedCommit())
 
 */
 void LedInitialize(void)
@@ -315,13 +654,31 @@ void LedInitialize(void)
     Led_asControl[i].eMode = LED_NORMAL_MODE;
     Led_asControl[i].eRate = LED_0HZ;
     Led_asControl[i].u16Count = 0;
-    Led_asControl[i].eCurrentDuty = LED_PWM_DUTY_LOW;
+    Led_asControl[i].u16Duty = 0;
+  }
+  Led_u32LastUpdate = G_u32SystemTime1ms;
+
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    Led_asAnimations[i].psSequence = NULL;
+    Led_asAnimations[i].psFirst = NULL;
   }
 
-  /* Backlight on and white */
+  /* TC2 is the PWM timebase; it only runs while an LED is in the schedule */
+  AT91C_BASE_TC2->TC_CCR = LED_PWM_TC_CCR_STOP;
+  AT91C_BASE_TC2->TC_CMR = LED_PWM_TC_CMR_INIT;
+  AT91C_BASE_TC2->TC_RC  = U16_LED_PWM_PERIOD;
+  AT91C_BASE_TC2->TC_RA  = U32_LED_PWM_NO_EDGE;
+  AT91C_BASE_TC2->TC_IDR = LED_PWM_TC_IDR_INIT;
+  NVIC_ClearPendingIRQ(IRQn_TC2);
+  NVIC_EnableIRQ(IRQn_TC2);
+
+  /* Backlight on and white; committed now since the super loop's first LedCommit()
+  comes only after every task has initialized */
   LedOn(LCD_RED);
   LedOn(LCD_GREEN);
   LedOn(LCD_BLUE);
+  LedCommit();
 
   /* If good initialization, set state to Idle */
   if( 1 )
@@ -361,84 +718,877 @@ void LedRunActiveState(void)
 } /* end LedRunActiveState */
 
 
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool LedIsIdle(void)
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
+@brief Reports whether the LED task has any work this tick (used by the main loop scheduler).
 
+Requires:
+- NONE
 
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
+Promises:
+- Returns TRUE if the state machine is in LedSM_Idle, no LED is blinking and no
+  animation is playing
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void LedSM_Idle(void)
+*/
+bool LedIsIdle(void)
+{
+  return( (bool)((Led_StateMachine == LedSM_Idle) && (Led_u32ActiveMask == 0) && 
+                 (LedAnimationNextDeadline() == U32_NO_DEADLINE)) );
+
+} /* end LedIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 LedNextDeadline(void)
+
+@brief Reports how many ms until the next blink edge or animation frame (used by the 
+main loop scheduler).
+
+LEDs in PWM mode are run by the TC2 interrupt and do not need the task.  A fading
+keyframe needs every tick; a step or pause keyframe only needs its end.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the ms until the earliest LED counter or keyframe runs out (at least 1), or
+  U32_NO_DEADLINE if no LED is blinking and no animation is playing
 
-@brief Run through all the LEDs to check for blinking updates.
 */
-static void LedSM_Idle(void)
+u32 LedNextDeadline(void)
 {
-  u32* pu32Address;
-  
-	/* Loop through each LED to check for blinkers */
+  u32 u32Deadline;
+  u32 u32Elapsed = G_u32SystemTime1ms - Led_u32LastUpdate;
+
+  if(Led_StateMachine != LedSM_Idle)
+  {
+    return(U32_NO_DEADLINE);
+  }
+
+  u32Deadline = LedAnimationNextDeadline();
+
   for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
   {
-    /* Check if LED is in LED_BLINK_MODE */
-    if(Led_asControl[(LedNameType)i].eMode == LED_BLINK_MODE)
+    if( !(Led_u32ActiveMask & LED_MASK(i)) )
     {
-      /* Decrement counter and check for 0 */
-      if( --Led_asControl[(LedNameType)i].u16Count == 0)
-      {
-        /* Toggle and reload the LED */
-        pu32Address = (u32*)(&(AT91C_BASE_PIOA->PIO_ODSR) + G_asBspLedConfigurations[i].ePort);
-        *pu32Address ^= G_asBspLedConfigurations[i].u32BitPosition;
-        Led_asControl[(LedNameType)i].u16Count = Led_asControl[(LedNameType)i].eRate;
-      }
-    } /* end LED_BLINK_MODE */
-    
-    /* Check if LED is in LED_PWM_MODE */
-    if(Led_asControl[(LedNameType)i].eMode == LED_PWM_MODE)
+      continue;
+    }
+
+    if(Led_asControl[i].u16Count <= u32Elapsed)
+    {
+      return(1);
+    }
+
+    if(Led_asControl[i].u16Count - u32Elapsed < u32Deadline)
+    {
+      u32Deadline = Led_asControl[i].u16Count - u32Elapsed;
+    }
+  }
+
+  return(u32Deadline);
+
+} /* end LedNextDeadline() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void TC2_IrqHandler(void)
+
+@brief Applies the LED PWM edges that are due and sets TC_RA to the next one.
+
+The RC compare starts a period: a pending schedule is swapped in and the "on" 
+edge is applied.  Each RA compare applies the next "off" edge plus any others 
+within U16_LED_PWM_EDGE_MARGIN ticks, since an RA value already passed would not 
+compare until the next period.  Only pins in Led_au32PwmPins are written, so an 
+LED taken out of PWM mode is never touched by a schedule that still holds it.
+
+Requires:
+- TC2 set up by LedInitialize() and started by LedPwmScheduleUpdate()
+
+Promises:
+- All edges of the active schedule up to TC_CV + U16_LED_PWM_EDGE_MARGIN are written
+  to PIO_SODR / PIO_CODR
+- TC_RA holds the time of the next edge or U32_LED_PWM_NO_EDGE
+
+*/
+void TC2_IrqHandler(void)
+{
+  LedPwmEdgeType* psEdge;
+  u32 u32Now;
+  u8 u8Edges;
+  
+  TRACE_ISR_ENTER(IRQn_TC2);
+
+  /* Check for the RC compare (period start) - READING THE TC_SR clears the bit if set */
+  if(AT91C_BASE_TC2->TC_SR & AT91C_TC_CPCS)
+  {
+    if(Led_bPwmUpdate)
+    {
+      Led_u8PwmActive ^= 1;
+      Led_bPwmUpdate = FALSE;
+    }
+    Led_u8PwmEdge = 0;
+  }
+  
+  u8Edges = Led_au8PwmEdges[Led_u8PwmActive];
+  u32Now = AT91C_BASE_TC2->TC_CV + U16_LED_PWM_EDGE_MARGIN;
+  psEdge = &Led_asPwmSchedule[Led_u8PwmActive][Led_u8PwmEdge];
+
+  while( (Led_u8PwmEdge < u8Edges) && (psEdge->u16Time <= u32Now) )
+  {
+    for(u8 i = 0; i < U8_LED_PORTS; i++)
     {
-      /* Handle special case of 0% duty cycle */
-      if( Led_asControl[i].eRate == LED_PWM_0 )
+      if(psEdge->au32Set[i] & Led_au32PwmPins[i])
       {
-        LedOff( (LedNameType)i );
+        *(&(AT91C_BASE_PIOA->PIO_SODR) + (i * PORTB)) = psEdge->au32Set[i] & Led_au32PwmPins[i];
       }
-      
-      /* Handle special case of 100% duty cycle */
-      else if( Led_asControl[i].eRate == LED_PWM_100 )
+      if(psEdge->au32Clear[i] & Led_au32PwmPins[i])
       {
-        LedOn( (LedNameType)i );
+        *(&(AT91C_BASE_PIOA->PIO_CODR) + (i * PORTB)) = psEdge->au32Clear[i] & Led_au32PwmPins[i];
       }
+    }
+    
+    Led_u8PwmEdge++;
+    psEdge++;
+  }
   
-      /* Otherwise, regular PWM: decrement counter; toggle and reload if counter reaches 0 */
-      else
-      {
-        if(--Led_asControl[(LedNameType)i].u16Count == 0)
-        {
-          if(Led_asControl[(LedNameType)i].eCurrentDuty == LED_PWM_DUTY_HIGH)
-          {
-            /* Turn the LED off and update the counters for the next cycle */
-            LedOff( (LedNameType)i );
-            Led_asControl[(LedNameType)i].u16Count = LED_PWM_100 - Led_asControl[(LedNameType)i].eRate;
-            Led_asControl[(LedNameType)i].eCurrentDuty = LED_PWM_DUTY_LOW;
+  AT91C_BASE_TC2->TC_RA = (Led_u8PwmEdge < u8Edges) ? psEdge->u16Time : U32_LED_PWM_NO_EDGE;
+
+  /* Clear the TC2 pending flag and exit */
+  NVIC_ClearPendingIRQ(IRQn_TC2);
+  TRACE_ISR_EXIT(IRQn_TC2);
+
+} /* end TC2_IrqHandler() */
+
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */                                                                                            
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u16 LedCountFromNow(u16 u16Count_)
+
+@brief Returns the counter value that runs out u16Count_ ms from now.
+
+LedSM_Idle() runs every counter down by the time since Led_u32LastUpdate, which may
+be a while ago when the system has been sleeping, so a new count is lengthened by that
+time.
+
+Requires:
+- Called before the LED's bit is set in Led_u32ActiveMask
+
+@param u16Count_ is the number of ms from now
+
+Promises:
+- Returns the adjusted counter value
+- Led_u32LastUpdate is moved to now if no LED was being timed
+
+*/
+static u16 LedCountFromNow(u16 u16Count_)
+{
+  if(Led_u32ActiveMask == 0)
+  {
+    Led_u32LastUpdate = G_u32SystemTime1ms;
+  }
+
+  return( (u16)(u16Count_ + (G_u32SystemTime1ms - Led_u32LastUpdate)) );
+
+} /* end LedCountFromNow() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LedPwmRelease(u32 u32Leds_)
+
+@brief Takes LEDs out of the PWM schedule so the caller can drive them directly.
+
+Requires:
+@param u32Leds_ has bit n set for each LED n to release (LED_MASK())
+
+Promises:
+- The TC2 interrupt no longer writes the pins of LEDs in u32Leds_ 
+- If any of them were in the schedule, it is rebuilt once without them
+
+*/
+static void LedPwmRelease(u32 u32Leds_)
+{
+  u32Leds_ &= Led_u32PwmMask;
+  if(u32Leds_ == 0)
+  {
+    return;
+  }
+
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if(u32Leds_ & LED_MASK(i))
+    {
+      Led_au32PwmPins[G_asBspLedConfigurations[i].ePort / PORTB] &= 
+        ~G_asBspLedConfigurations[i].u32BitPosition;
+    }
+  }
+  
+  Led_u32PwmMask &= ~u32Leds_;
+  LedPwmScheduleUpdate();
+  
+} /* end LedPwmRelease() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LedStage(LedNameType eLED_, bool bOn_)
+
+@brief Stages eLED_ to turn on or off at the next LedCommit().
+
+Requires:
+@param eLED_ is a valid LED index
+@param bOn_ is TRUE to turn the LED on, FALSE to turn it off
+
+Promises:
+- The LED's pin is in exactly one of the staged set / clear masks of its port,
+  chosen by its active state
+
+*/
+static void LedStage(LedNameType eLED_, bool bOn_)
+{
+  u8 u8Port = (u8)(G_asBspLedConfigurations[(u8)eLED_].ePort / PORTB);
+  u32 u32Pin = G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+
+  /* Active high LEDs use SODR to turn on, active low LEDs use CODR */
+  if( bOn_ == (G_asBspLedConfigurations[(u8)eLED_].eActiveState == ACTIVE_HIGH) )
+  {
+    Led_au32StagedSet[u8Port] |= u32Pin;
+    Led_au32StagedClear[u8Port] &= ~u32Pin;
+  }
+  else
+  {
+    Led_au32StagedClear[u8Port] |= u32Pin;
+    Led_au32StagedSet[u8Port] &= ~u32Pin;
+  }
+  
+} /* end LedStage() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LedStagedIsOn(LedNameType eLED_)
+
+@brief Reports whether eLED_ will be on after the next LedCommit().
+
+Requires:
+@param eLED_ is a valid LED index
+
+Promises:
+- Returns the staged state if the LED has a staged change, otherwise the state of 
+  its pin in PIO_ODSR
+
+*/
+static bool LedStagedIsOn(LedNameType eLED_)
+{
+  u8 u8Port = (u8)(G_asBspLedConfigurations[(u8)eLED_].ePort / PORTB);
+  u32 u32Pin = G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+  bool bHigh;
+
+  if(Led_au32StagedSet[u8Port] & u32Pin)
+  {
+    bHigh = TRUE;
+  }
+  else if(Led_au32StagedClear[u8Port] & u32Pin)
+  {
+    bHigh = FALSE;
+  }
+  else
+  {
+    bHigh = (bool)( (*(&(AT91C_BASE_PIOA->PIO_ODSR) + G_asBspLedConfigurations[(u8)eLED_].ePort) & u32Pin) != 0 );
+  }
+
+  return( (bool)(bHigh == (G_asBspLedConfigurations[(u8)eLED_].eActiveState == ACTIVE_HIGH)) );
+  
+} /* end LedStagedIsOn() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u16 LedDuty(LedNameType eLED_)
+
+@brief Returns the brightness an LED is set to, as a PWM duty.
+
+Requires:
+@param eLED_ is a valid LED index
+
+Promises:
+- Returns the duty of an LED in PWM mode, otherwise U16_LED_PWM_PERIOD if it is 
+  (staged) on or 0 if it is off
+
+*/
+static u16 LedDuty(LedNameType eLED_)
+{
+  if(Led_asControl[(u8)eLED_].eMode == LED_PWM_MODE)
+  {
+    return(Led_asControl[(u8)eLED_].u16Duty);
+  }
+
+  return( LedStagedIsOn(eLED_) ? U16_LED_PWM_PERIOD : 0 );
+  
+} /* end LedDuty() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LedPwmSetDuty(LedNameType eLED_, u16 u16Duty_)
+
+@brief Puts an LED in PWM mode at u16Duty_ without rebuilding the schedule.
+
+Lets a caller change several LEDs and rebuild once.  0 and U16_LED_PWM_PERIOD are 
+steady levels, but the LED still goes into the schedule so it changes at the same 
+period start as the others; LedPwmScheduleUpdate() hands it back to LedCommit() 
+when no LED with a duty in between is left.
+
+Requires:
+@param eLED_ is a valid LED index
+@param u16Duty_ is the on time from 0 (off) to U16_LED_PWM_PERIOD (on)
+
+Promises:
+- eLED_ is in LED_PWM_MODE at u16Duty_
+- Returns TRUE if LedPwmScheduleUpdate() must run for the change to take effect
+
+*/
+static bool LedPwmSetDuty(LedNameType eLED_, u16 u16Duty_)
+{
+  u32 u32Bit = LED_MASK(eLED_);
+  u8 u8Port = (u8)(G_asBspLedConfigurations[(u8)eLED_].ePort / PORTB);
+  u32 u32Pin = G_asBspLedConfigurations[(u8)eLED_].u32BitPosition;
+  bool bSteady = (bool)( (u16Duty_ == 0) || (u16Duty_ >= U16_LED_PWM_PERIOD) );
+
+  if(u16Duty_ > U16_LED_PWM_PERIOD)
+  {
+    u16Duty_ = U16_LED_PWM_PERIOD;
+  }
+
+  /* Nothing to do if the duty is unchanged (a steady level already handed back is still staged) */
+  if( (Led_asControl[(u8)eLED_].eMode == LED_PWM_MODE) && (Led_asControl[(u8)eLED_].u16Duty == u16Duty_) &&
+      (bSteady || (Led_u32PwmMask & u32Bit)) )
+  {
+    return(FALSE);
+  }
+  
+  Led_u32ActiveMask &= ~u32Bit;
+  
+  /* The interrupt may drive the pin once it is in the schedule, so drop any staged write */
+  Led_u32PwmMask |= u32Bit;
+  Led_au32StagedSet[u8Port]   &= ~u32Pin;
+  Led_au32StagedClear[u8Port] &= ~u32Pin;
+  Led_au32PwmPins[u8Port] |= u32Pin;
+
+  Led_asControl[(u8)eLED_].eMode = LED_PWM_MODE;
+  Led_asControl[(u8)eLED_].eRate = LED_0HZ;
+  Led_asControl[(u8)eLED_].u16Duty = u16Duty_;
+  
+  return(TRUE);
+
+} /* end LedPwmSetDuty() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 LedSequenceLeds(const LedSequenceType* psSequence_)
+
+@brief Returns the LEDs used by any keyframe of a sequence.
+
+Requires:
+@param psSequence_ points to a valid sequence
+
+Promises:
+- Returns the OR of the u32Leds masks of all keyframes
+
+*/
+static u32 LedSequenceLeds(const LedSequenceType* psSequence_)
+{
+  u32 u32Leds = 0;
+
+  for(u8 i = 0; i < psSequence_->u8Keyframes; i++)
+  {
+    u32Leds |= psSequence_->psKeyframes[i].u32Leds;
+  }
+
+  return(u32Leds);
+  
+} /* end LedSequenceLeds() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LedAnimationSequenceStart(LedAnimationPlayerType* psPlayer_, const LedSequenceType* psSequence_)
+
+@brief Loads a sequence into a player at its first keyframe.
+
+Requires:
+- psPlayer_->u32KeyframeStart is the time the first keyframe starts
+
+@param psPlayer_ points to the player
+@param psSequence_ points to a valid sequence
+
+Promises:
+- The player runs psSequence_ from keyframe 0 with its loop count loaded
+- LedAnimationKeyframeStart() must be called next
+
+*/
+static void LedAnimationSequenceStart(LedAnimationPlayerType* psPlayer_, const LedSequenceType* psSequence_)
+{
+  psPlayer_->psSequence = psSequence_;
+  psPlayer_->u32Leds = LedSequenceLeds(psSequence_);
+  psPlayer_->u8Keyframe = 0;
+  psPlayer_->u8LoopsLeft = psSequence_->u8Loops;
+  
+} /* end LedAnimationSequenceStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LedAnimationKeyframeStart(LedAnimationPlayerType* psPlayer_)
+
+@brief Records where the LEDs of the player's current keyframe start from.
+
+A LED_EASE_STEP keyframe sets its LEDs here and then holds them.
+
+Requires:
+@param psPlayer_ points to a player with a sequence loaded
+
+Promises:
+- psPlayer_->au16From holds the current duty of each LED in the keyframe
+- Returns TRUE if LedPwmScheduleUpdate() must run
+
+*/
+static bool LedAnimationKeyframeStart(LedAnimationPlayerType* psPlayer_)
+{
+  const LedKeyframeType* psKeyframe = &psPlayer_->psSequence->psKeyframes[psPlayer_->u8Keyframe];
+
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if(psKeyframe->u32Leds & LED_MASK(i))
+    {
+      psPlayer_->au16From[i] = LedDuty((LedNameType)i);
+    }
+  }
+
+  if(psKeyframe->eEasing == LED_EASE_STEP)
+  {
+    return( LedAnimationSet(psPlayer_, U16_LED_EASE_END) );
+  }
+
+  return(FALSE);
+  
+} /* end LedAnimationKeyframeStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LedAnimationSet(LedAnimationPlayerType* psPlayer_, u16 u16Progress_)
+
+@brief Sets the LEDs of the player's current keyframe part way to the target.
+
+Requires:
+@param psPlayer_ points to a player with a sequence loaded and au16From recorded
+@param u16Progress_ is the eased progress from 0 (au16From) to U16_LED_EASE_END (target)
+
+Promises:
+- Each LED of the keyframe is in PWM mode at its interpolated brightness
+- Returns TRUE if LedPwmScheduleUpdate() must run
+
+*/
+static bool LedAnimationSet(LedAnimationPlayerType* psPlayer_, u16 u16Progress_)
+{
+  const LedKeyframeType* psKeyframe = &psPlayer_->psSequence->psKeyframes[psPlayer_->u8Keyframe];
+  s32 s32To = (s32)LED_PWM_DUTY(psKeyframe->u8Brightness);
+  bool bUpdate = FALSE;
+  s32 s32From;
+  u16 u16Duty;
+
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if(psKeyframe->u32Leds & LED_MASK(i))
+    {
+      s32From = psPlayer_->au16From[i];
+      u16Duty = (u16)( s32From + (((s32To - s32From) * (s32)u16Progress_) / (s32)U16_LED_EASE_END) );
+      
+      if( (Led_asControl[i].eMode != LED_PWM_MODE) || (Led_asControl[i].u16Duty != u16Duty) )
+      {
+        bUpdate |= LedPwmSetDuty((LedNameType)i, u16Duty);
+      }
+    }
+  }
+
+  return(bUpdate);
+
+} /* end LedAnimationSet() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u16 LedEase(LedEasingType eEasing_, u32 u32Elapsed_, u32 u32Duration_)
+
+@brief Returns the eased progress through a keyframe.
+
+Requires:
+@param eEasing_ is the keyframe's curve
+@param u32Elapsed_ is the ms since the keyframe started (less than u32Duration_)
+@param u32Duration_ is the keyframe length in ms (not 0)
+
+Promises:
+- Returns 0 to U16_LED_EASE_END
+
+*/
+static u16 LedEase(LedEasingType eEasing_, u32 u32Elapsed_, u32 u32Duration_)
+{
+  u32 u32Linear = (u32Elapsed_ * U16_LED_EASE_END) / u32Duration_;
+  u32 u32Rest = U16_LED_EASE_END - u32Linear;
+
+  switch(eEasing_)
+  {
+    case LED_EASE_STEP:
+      return(U16_LED_EASE_END);
+      
+    case LED_EASE_IN:
+      return( (u16)((u32Linear * u32Linear) / U16_LED_EASE_END) );
+
+    case LED_EASE_OUT:
+      return( (u16)(U16_LED_EASE_END - ((u32Rest * u32Rest) / U16_LED_EASE_END)) );
+
+    case LED_EASE_IN_OUT:
+      if(u32Linear < (U16_LED_EASE_END / 2))
+      {
+        return( (u16)((2 * u32Linear * u32Linear) / U16_LED_EASE_END) );
+      }
+      return( (u16)(U16_LED_EASE_END - ((2 * u32Rest * u32Rest) / U16_LED_EASE_END)) );
+
+    default:
+      return( (u16)u32Linear );
+  }
+
+} /* end LedEase() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LedAnimationRun(void)
+
+@brief Moves every playing animation to G_u32SystemTime1ms.
+
+Keyframe times are kept from the sequence start rather than from when the task 
+ran, so a late or skipped tick does not stretch the animation.  Keyframes that 
+ended since the last run are finished in order (up to U8_LED_ANIMATION_MAX_STEPS 
+per run).  pfnDone is called once the player has moved on, and ends that player's 
+run for this tick so the callback may start or stop animations.
+
+Requires:
+- NONE
+
+Promises:
+- Every playing LED is at the brightness for the current time
+- Finished sequences have chained to psNext or freed their player, and their 
+  pfnDone has been called
+- The PWM schedule is rebuilt at most once
+
+*/
+static void LedAnimationRun(void)
+{
+  LedAnimationPlayerType* psPlayer;
+  const LedKeyframeType* psKeyframe;
+  fnCode_type pfnDone;
+  bool bUpdate = FALSE;
+  u32 u32Elapsed;
+
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    psPlayer = &Led_asAnimations[i];
+    
+    for(u8 u8Steps = 0; (psPlayer->psSequence != NULL) && (u8Steps < U8_LED_ANIMATION_MAX_STEPS); u8Steps++)
+    {
+      psKeyframe = &psPlayer->psSequence->psKeyframes[psPlayer->u8Keyframe];
+      u32Elapsed = G_u32SystemTime1ms - psPlayer->u32KeyframeStart;
+
+      /* Part way through: fade and wait for the next tick */
+      if(u32Elapsed < psKeyframe->u16DurationMs)
+      {
+        bUpdate |= LedAnimationSet(psPlayer, LedEase(psKeyframe->eEasing, u32Elapsed, psKeyframe->u16DurationMs));
+        break;
+      }
+
+      /* Finish the keyframe and move on */
+      bUpdate |= LedAnimationSet(psPlayer, U16_LED_EASE_END);
+      psPlayer->u32KeyframeStart += psKeyframe->u16DurationMs;
+      pfnDone = NULL;
+
+      if(++psPlayer->u8Keyframe >= psPlayer->psSequence->u8Keyframes)
+      {
+        psPlayer->u8Keyframe = 0;
+        
+        if( (psPlayer->u8LoopsLeft != LED_LOOP_FOREVER) && (--psPlayer->u8LoopsLeft == 0) )
+        {
+          pfnDone = psPlayer->psSequence->pfnDone;
+          
+          if(psPlayer->psSequence->psNext != NULL)
+          {
+            LedAnimationSequenceStart(psPlayer, psPlayer->psSequence->psNext);
           }
           else
           {
-            /* Turn the LED on and update the counters for the next cycle */
-            LedOn( (LedNameType)i );
-            Led_asControl[i].u16Count = Led_asControl[i].eRate;
-            Led_asControl[i].eCurrentDuty = LED_PWM_DUTY_HIGH;
+            psPlayer->psSequence = NULL;
           }
         }
       }
 
-      /* Set the LED back to PWM mode since LedOff and LedOn set it to normal mode */
-     	Led_asControl[(LedNameType)i].eMode = LED_PWM_MODE;
+      if(psPlayer->psSequence != NULL)
+      {
+        bUpdate |= LedAnimationKeyframeStart(psPlayer);
+      }
+
+      if(pfnDone != NULL)
+      {
+        pfnDone();
+        break;
+      }
+    }
+  }
+
+  if(bUpdate)
+  {
+    LedPwmScheduleUpdate();
+  }
+
+} /* end LedAnimationRun() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 LedAnimationNextDeadline(void)
+
+@brief Returns how many ms until an animation needs the task.
+
+Requires:
+- NONE
+
+Promises:
+- Returns 1 if a fading keyframe is playing or a keyframe is already over, the ms
+  to the end of the earliest step or pause keyframe otherwise, or U32_NO_DEADLINE 
+  if nothing is playing
+
+*/
+static u32 LedAnimationNextDeadline(void)
+{
+  const LedKeyframeType* psKeyframe;
+  u32 u32Deadline = U32_NO_DEADLINE;
+  u32 u32Elapsed;
+
+  for(u8 i = 0; i < U8_LED_ANIMATION_PLAYERS; i++)
+  {
+    if(Led_asAnimations[i].psSequence == NULL)
+    {
+      continue;
+    }
+
+    psKeyframe = &Led_asAnimations[i].psSequence->psKeyframes[Led_asAnimations[i].u8Keyframe];
+    u32Elapsed = G_u32SystemTime1ms - Led_asAnimations[i].u32KeyframeStart;
+    
+    if( (u32Elapsed >= psKeyframe->u16DurationMs) || 
+        ((psKeyframe->eEasing != LED_EASE_STEP) && (psKeyframe->u32Leds != 0)) )
+    {
+      return(1);
+    }
+
+    if(psKeyframe->u16DurationMs - u32Elapsed < u32Deadline)
+    {
+      u32Deadline = psKeyframe->u16DurationMs - u32Elapsed;
+    }
+  }
+
+  return(u32Deadline);
+  
+} /* end LedAnimationNextDeadline() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void LedPwmScheduleUpdate(void)
+
+@brief Builds the PWM schedule for the LEDs in Led_u32PwmMask and hands it to TC2.
+
+Edge 0 at count 0 turns every PWM LED on, or off for a duty of 0.  The LEDs are 
+then sorted by duty and each distinct duty between 0 and U16_LED_PWM_PERIOD becomes 
+one edge that turns those LEDs off, so at most U8_TOTAL_LEDS + 1 interrupts run per 
+period.  Steady LEDs stay in the schedule while any LED needs edges so they change 
+at the same period start; once none does, they are all handed back to LedCommit().
+
+The schedule is built in the buffer the interrupt is not using.  Led_bPwmUpdate is
+cleared first so the interrupt cannot swap buffers while the build is in progress.
+
+Requires:
+- Led_asControl[].u16Duty is 0 to U16_LED_PWM_PERIOD for every LED in Led_u32PwmMask
+
+Promises:
+- If any LED in Led_u32PwmMask has a duty between 0 and U16_LED_PWM_PERIOD, TC2 is 
+  running and the new schedule is used from the next period
+- Otherwise those LEDs are staged at their steady levels and taken out of 
+  Led_u32PwmMask, and TC2 and its interrupt are stopped
+
+*/
+static void LedPwmScheduleUpdate(void)
+{
+  u8 au8Order[U8_TOTAL_LEDS];
+  u8 u8Leds = 0;
+  u8 u8Next;
+  u8 u8Edges;
+  u8 u8Port;
+  u8 u8Led;
+  u16 u16Duty;
+  bool bOn;
+  bool bEdges = FALSE;
+  LedPwmEdgeType* psEdge;
+
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if( (Led_u32PwmMask & LED_MASK(i)) && 
+        (Led_asControl[i].u16Duty != 0) && (Led_asControl[i].u16Duty < U16_LED_PWM_PERIOD) )
+    {
+      bEdges = TRUE;
+    }
+  }
+
+  /* With only steady levels left, hand them to LedCommit() and stop TC2 */
+  if(!bEdges)
+  {
+    for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+    {
+      if(Led_u32PwmMask & LED_MASK(i))
+      {
+        Led_au32PwmPins[G_asBspLedConfigurations[i].ePort / PORTB] &= 
+          ~G_asBspLedConfigurations[i].u32BitPosition;
+        LedStage((LedNameType)i, (bool)(Led_asControl[i].u16Duty != 0));
+      }
+    }
+    Led_u32PwmMask = 0;
+
+    AT91C_BASE_TC2->TC_IDR = LED_PWM_TC_IDR_INIT;
+    AT91C_BASE_TC2->TC_CCR = LED_PWM_TC_CCR_STOP;
+    NVIC_ClearPendingIRQ(IRQn_TC2);
+    Led_bPwmUpdate = FALSE;
+    return;
+  }
+
+  /* Insertion sort of the PWM LEDs by duty */
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    if(Led_u32PwmMask & LED_MASK(i))
+    {
+      u8 j = u8Leds++;
       
-    } /* end LED_PWM_MODE */
+      while( (j > 0) && (Led_asControl[au8Order[j - 1]].u16Duty > Led_asControl[i].u16Duty) )
+      {
+        au8Order[j] = au8Order[j - 1];
+        j--;
+      }
+      au8Order[j] = i;
+    }
+  }
+
+  /* Build into the buffer the interrupt is not using */
+  Led_bPwmUpdate = FALSE;
+  u8Next = Led_u8PwmActive ^ 1;
+  psEdge = &Led_asPwmSchedule[u8Next][0];
+  memset(psEdge, 0, sizeof(Led_asPwmSchedule[0]));
+  u8Edges = 1;
+
+  for(u8 i = 0; i < u8Leds; i++)
+  {
+    u8Led = au8Order[i];
+    u8Port = (u8)(G_asBspLedConfigurations[u8Led].ePort / PORTB);
+    u16Duty = Led_asControl[u8Led].u16Duty;
+    bOn = (bool)( (G_asBspLedConfigurations[u8Led].eActiveState == ACTIVE_HIGH) == (u16Duty != 0) );
+
+    /* A steady level is only driven at the period start */
+    if( (u16Duty == 0) || (u16Duty >= U16_LED_PWM_PERIOD) )
+    {
+      if(bOn)
+      {
+        Led_asPwmSchedule[u8Next][0].au32Set[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+      }
+      else
+      {
+        Led_asPwmSchedule[u8Next][0].au32Clear[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+      }
+      continue;
+    }
+
+    /* Start a new "off" edge for each new duty (no duty left here is edge 0's time 0) */
+    if(psEdge->u16Time != u16Duty)
+    {
+      psEdge = &Led_asPwmSchedule[u8Next][u8Edges++];
+      psEdge->u16Time = u16Duty;
+    }
+
+    if(bOn)
+    {
+      Led_asPwmSchedule[u8Next][0].au32Set[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+      psEdge->au32Clear[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+    }
+    else
+    {
+      Led_asPwmSchedule[u8Next][0].au32Clear[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+      psEdge->au32Set[u8Port] |= G_asBspLedConfigurations[u8Led].u32BitPosition;
+    }
+  }
+  Led_au8PwmEdges[u8Next] = u8Edges;
+
+  if(AT91C_BASE_TC2->TC_IMR & AT91C_TC_CPCS)
+  {
+    /* Running: the interrupt swaps at the start of the next period */
+    Led_bPwmUpdate = TRUE;
+  }
+  else
+  {
+    /* Stopped: the first RC compare starts the new schedule */
+    Led_u8PwmActive = u8Next;
+    Led_u8PwmEdge = 0;
+    AT91C_BASE_TC2->TC_RA = U32_LED_PWM_NO_EDGE;
+    (void)AT91C_BASE_TC2->TC_SR;
+    AT91C_BASE_TC2->TC_IER = LED_PWM_TC_IER_INIT;
+    AT91C_BASE_TC2->TC_CCR = LED_PWM_TC_CCR_START;
+  }
+  
+} /* end LedPwmScheduleUpdate() */
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LedSM_Idle(void)
+
+@brief Run through all the LEDs to check for blinking updates, then move the 
+animations along.
+
+PWM LEDs are run by TC2_IrqHandler() and are not serviced here.
+
+Counters are run down by the ms since the last update (1 when the task runs every
+tick, more after a tickless sleep).  A counter that has run out toggles its LED once
+and is reloaded from the rate.
+*/
+static void LedSM_Idle(void)
+{
+  u32 u32Elapsed = G_u32SystemTime1ms - Led_u32LastUpdate;
+  
+  Led_u32LastUpdate = G_u32SystemTime1ms;
+  
+	/* Loop through each LED to check for blinkers */
+  for(u8 i = 0; i < U8_TOTAL_LEDS; i++)
+  {
+    /* Check if LED is in LED_BLINK_MODE */
+    if(Led_asControl[(LedNameType)i].eMode == LED_BLINK_MODE)
+    {
+      /* Run the counter down and check for 0 */
+      if(Led_asControl[(LedNameType)i].u16Count <= u32Elapsed)
+      {
+        /* Stage the toggle (LedCommit() writes it) and reload the LED */
+        LedStage((LedNameType)i, (bool)!LedStagedIsOn((LedNameType)i));
+        Led_asControl[(LedNameType)i].u16Count = Led_asControl[(LedNameType)i].eRate;
+      }
+      else
+      {
+        Led_asControl[(LedNameType)i].u16Count -= (u16)u32Elapsed;
+      }
+    } /* end LED_BLINK_MODE */
     
   } /* end for(u8 i = 0; i < U8_TOTAL_LEDS; i++) */
+
+  LedAnimationRun();
    
 } /* end LedSM_Idle() */
 
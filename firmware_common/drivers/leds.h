@@ -12,17 +12,15 @@
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
+#define U8_LED_PORTS            (u8)2               /*!< @brief LED pins may be on PORTA and PORTB */
+#define LED_MASK(eLED_)         ((u32)1 << (u8)(eLED_)) /*!< @brief LedSetMask() bit for an LED */
+#define U8_LED_ANIMATION_PLAYERS (u8)4              /*!< @brief Sequences that can play at once */
 
 /*! 
 @enum LedModeType
 @brief The mode determines how the task manages the LED */
 typedef enum {LED_NORMAL_MODE, LED_BLINK_MODE, LED_PWM_MODE} LedModeType;  
 
-/*! 
-@enum LedPWMDutyType
-@brief Duty cycle state when tracking PWM mode*/
-typedef enum {LED_PWM_DUTY_LOW = 0, LED_PWM_DUTY_HIGH = 1} LedPWMDutyType; 
-
 /*! 
 @enum LedRateType
 @brief Standard blinky values for blinking.  
@@ -49,11 +47,79 @@ typedef struct
 {
   LedModeType eMode;              /*!< @brief Current mode */
   LedRateType eRate;              /*!< @brief Current rate */
-  u16 u16Count;                   /*!< @brief Value of current duty cycle counter */
-  LedPWMDutyType eCurrentDuty;    /*!< @brief Phase of the current duty cycle */
+  u16 u16Count;                   /*!< @brief Value of current blink counter */
+  u16 u16Duty;                    /*!< @brief PWM on time in TC2 ticks, 0 to U16_LED_PWM_PERIOD */
 }LedControlType;
 
 
+/*! 
+@struct LedPwmEdgeType
+@brief One edge of the LED PWM schedule: the pins that change when TC2 reaches u16Time.
+
+Masks are indexed by port (0 = PORTA, 1 = PORTB) and written straight to PIO_SODR / PIO_CODR.
+*/
+typedef struct 
+{
+  u16 u16Time;                              /*!< @brief TC2 count of the edge within the period */
+  u32 au32Set[U8_LED_PORTS];                /*!< @brief Pins to drive high */
+  u32 au32Clear[U8_LED_PORTS];              /*!< @brief Pins to drive low */
+}LedPwmEdgeType;
+
+
+/*! 
+@enum LedEasingType
+@brief How a keyframe moves from the starting brightness to the target. */
+typedef enum {LED_EASE_STEP,              /*!< @brief Jump to the target at the start and hold */
+              LED_EASE_LINEAR,            /*!< @brief Constant rate */
+              LED_EASE_IN,                /*!< @brief Start slow, end fast (quadratic) */
+              LED_EASE_OUT,               /*!< @brief Start fast, end slow (quadratic) */
+              LED_EASE_IN_OUT             /*!< @brief Slow at both ends */
+             } LedEasingType;
+
+
+/*! 
+@struct LedKeyframeType
+@brief One step of an LED animation: where a group of LEDs goes and how it gets there. 
+*/
+typedef struct 
+{
+  u32 u32Leds;                    /*!< @brief LEDs moved by this keyframe (LED_MASK() bits); 0 for a pause */
+  u8 u8Brightness;                /*!< @brief Target PWM duty, 0 (off) to U8_LED_BRIGHTNESS_MAX (on) */
+  LedEasingType eEasing;          /*!< @brief Curve from the current brightness to u8Brightness */
+  u16 u16DurationMs;              /*!< @brief Length of the keyframe in ms */
+}LedKeyframeType;
+
+
+/*! 
+@struct LedSequenceType
+@brief A keyframe animation, normally const so it is stored in flash. 
+*/
+typedef struct LedSequence
+{
+  const LedKeyframeType* psKeyframes;   /*!< @brief Keyframes in play order */
+  u8 u8Keyframes;                       /*!< @brief Number of keyframes (at least 1) */
+  u8 u8Loops;                           /*!< @brief Times to play, or LED_LOOP_FOREVER */
+  fnCode_type pfnDone;                  /*!< @brief Called from the LED task when the last loop ends, or NULL */
+  const struct LedSequence* psNext;     /*!< @brief Sequence to chain to when the last loop ends, or NULL */
+}LedSequenceType;
+
+
+/*! 
+@struct LedAnimationPlayerType
+@brief State of one sequence player. 
+*/
+typedef struct 
+{
+  const LedSequenceType* psSequence;    /*!< @brief Sequence playing now or NULL if the player is free */
+  const LedSequenceType* psFirst;       /*!< @brief Sequence passed to LedAnimationStart() (before chaining) */
+  u32 u32Leds;                          /*!< @brief LEDs used by psSequence */
+  u32 u32KeyframeStart;                 /*!< @brief G_u32SystemTime1ms when the current keyframe started */
+  u8 u8Keyframe;                        /*!< @brief Current keyframe index */
+  u8 u8LoopsLeft;                       /*!< @brief Loops left including this one, or LED_LOOP_FOREVER */
+  u16 au16From[U8_TOTAL_LEDS];          /*!< @brief Duty of each LED when the keyframe started */
+}LedAnimationPlayerType;
+
+
 
 /**********************************************************************************************************************
 Function Declarations
@@ -67,6 +133,13 @@ void LedOff(LedNameType eLED_);
 void LedToggle(LedNameType eLED_);
 void LedBlink(LedNameType eLED_, LedRateType eBlinkRate_);
 void LedPWM(LedNameType eLED_, LedRateType ePwmRate_);
+void LedPWMDuty(LedNameType eLED_, u8 u8Duty_);
+void LedSetBacklightRGB(u8 u8Red_, u8 u8Green_, u8 u8Blue_);
+void LedSetMask(u32 u32Leds_, u32 u32OnLeds_);
+void LedCommit(void);
+bool LedAnimationStart(const LedSequenceType* psSequence_);
+void LedAnimationStop(const LedSequenceType* psSequence_);
+bool LedAnimationIsPlaying(const LedSequenceType* psSequence_);
 
 
 /*------------------------------------------------------------------------------------------------------------------*/
@@ -74,22 +147,149 @@ void LedPWM(LedNameType eLED_, LedRateType ePwmRate_);
 /*--------------------------------------------------------------------------------------------------------------------*/
 void LedInitialize(void);
 void LedRunActiveState(void);
+bool LedIsIdle(void);
+u32 LedNextDeadline(void);
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-
-
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
-static void LedSM_Idle(void);
-static void LedSM_Error(void);
+void TC2_IrqHandler(void);
 
 
 /**********************************************************************************************************************
 Constants / Definitions
 **********************************************************************************************************************/
+/*----------------------------------------------------------------------------------------------------------------------
+LED PWM Setup
+TC2 counts TIMER_CLOCK3 (MCK/32 = 667ns / tick) up to RC, so one PWM period is 
+1024 ticks = 683us (1.46kHz carrier) with 10 bits of duty resolution.  The schedule 
+is one "on" edge at count 0 (RC compare) and one "off" edge per distinct duty (RA compare).
+Duties up to U16_LED_PWM_EDGE_MARGIN past the period start interrupt's TC_CV all give 
+the shortest pulse the interrupt can make, so the gamma table starts its non-zero 
+levels at U16_LED_PWM_MIN_DUTY.
+
+The 8-bit APIs (LedPWMDuty(), keyframe brightness) are scaled up with LED_PWM_DUTY().
+LedSetBacklightRGB() goes through the gamma table built from LED_GAMMA() so equal 
+steps of its 8-bit channels look like equal steps of brightness.
+*/
+#define U16_LED_PWM_PERIOD      (u16)1023           /*!< @brief Last count of the period (TC_RC); also full duty */
+#define U16_LED_PWM_EDGE_MARGIN (u16)12             /*!< @brief Edges this close to TC_CV (8us) are applied in the same interrupt */
+#define U16_LED_PWM_MIN_DUTY    (u16)(2 * U16_LED_PWM_EDGE_MARGIN) /*!< @brief Shortest duty that gets its own RA compare after the
+                                                       period start interrupt (margin plus its latency) */
+#define U8_LED_BRIGHTNESS_MAX   (u8)255             /*!< @brief Full scale of the 8-bit brightness APIs */
+
+/*! @brief 8-bit level to PWM duty, linear (255 = U16_LED_PWM_PERIOD) */
+#define LED_PWM_DUTY(u8Level_)  (u16)( ((u32)(u8Level_) * U16_LED_PWM_PERIOD + (U8_LED_BRIGHTNESS_MAX / 2)) / U8_LED_BRIGHTNESS_MAX )
+
+/*! @brief 8-bit level to PWM duty through gamma ~2.2, approximated by 0.8x^2 + 0.2x^3 so
+the compiler can build the table (evaluated only in the const initializer of Led_au16Gamma).
+Level 0 is off; levels 1 to 255 run from U16_LED_PWM_MIN_DUTY to U16_LED_PWM_PERIOD, and
+where the curve is flatter than one tick per level each level still gets its own tick */
+#define LED_GAMMA_CURVE(x_)     (u16)( ((u64)(x_) * (x_) * (4 * 255 + (x_)) * (U16_LED_PWM_PERIOD - U16_LED_PWM_MIN_DUTY) + \
+                                        (5ULL * 255 * 255 * 255 / 2)) / (5ULL * 255 * 255 * 255) )
+#define LED_GAMMA(x_)           (u16)( ((x_) == 0) ? 0 : U16_LED_PWM_MIN_DUTY + \
+                                       ((LED_GAMMA_CURVE(x_) > (x_) - 1) ? LED_GAMMA_CURVE(x_) : (x_) - 1) )
+#define LED_GAMMA_ROW(x_)       LED_GAMMA((x_) +  0), LED_GAMMA((x_) +  1), LED_GAMMA((x_) +  2), LED_GAMMA((x_) +  3), \
+                                LED_GAMMA((x_) +  4), LED_GAMMA((x_) +  5), LED_GAMMA((x_) +  6), LED_GAMMA((x_) +  7), \
+                                LED_GAMMA((x_) +  8), LED_GAMMA((x_) +  9), LED_GAMMA((x_) + 10), LED_GAMMA((x_) + 11), \
+                                LED_GAMMA((x_) + 12), LED_GAMMA((x_) + 13), LED_GAMMA((x_) + 14), LED_GAMMA((x_) + 15)
+#define U8_LED_PWM_EDGES        (u8)(U8_TOTAL_LEDS + 1) /*!< @brief Period start plus one edge per LED */
+#define U32_LED_PWM_NO_EDGE     (u32)0x0000FFFF     /*!< @brief TC_RA value past RC so there is no RA compare */
+
+/* LED animation */
+#define LED_LOOP_FOREVER        (u8)0               /*!< @brief LedSequenceType u8Loops: play until stopped */
+#define U16_LED_EASE_END        (u16)256            /*!< @brief Eased progress at the end of a keyframe */
+#define U8_LED_ANIMATION_MAX_STEPS (u8)16           /*!< @brief Keyframes one player may finish per LED task run */
+
+#define LED_PWM_TC_CCR_START    (u32)0x00000005
+/*
+    31-04 [0] Reserved
+
+    03 [0] Reserved
+    02 [1] SWTRG counter reset and started
+    01 [0] CLKDIS Clock not disabled
+    00 [1] CLKEN Clock enabled
+*/
+
+#define LED_PWM_TC_CCR_STOP     (u32)0x00000002
+/*
+    31-04 [0] Reserved
+
+    03 [0] Reserved
+    02 [0] SWTRG no software trigger
+    01 [1] CLKDIS Clock disabled
+    00 [0] CLKEN Clock not enabled
+*/
+
+#define LED_PWM_TC_CMR_INIT     (u32)0x0000C002
+/*
+    31 [0] BSWTRG no software trigger effect on TIOB
+    30 [0] "
+    29 [0] BEEVT no external event effect on TIOB
+    28 [0] "
+
+    27 [0] BCPC no RC compare effect on TIOB
+    26 [0] "
+    25 [0] BCPB no RB compare effect on TIOB
+    24 [0] "
+
+    23 [0] ASWTRG no TIOA software trigger effect
+    22 [0] "
+    21 [0] AEEVT no TIOA effect on external compare
+    20 [0] "
+
+    19 [0] ACPC no RC compare effect on TIOA (the LEDs are driven by the PIO)
+    18 [0] "
+    17 [0] ACPA no RA compare effect on TIOA
+    16 [0] "
+
+    15 [1] WAVE Waveform Mode is enabled
+    14 [1] WAVSEL/CPCTRG - Up to RC mode/ Trigger on RC compare
+    13 [0] "
+    12 [0] ENETRG external event has no effect
+
+    11 [0] EEVT external event assigned to TIOB
+    10 [0] "
+    09 [0] EEVTEDG no external event trigger
+    08 [0] "
+
+    07 [0] CPCDIS clock is NOT disabled when reaches RC
+    06 [0] CPCSTOP clock is NOT stopped when reaches RC
+    05 [0] BURST not gated
+    04 [0] "
+
+    03 [0] CLKI Counter incremented on rising edge
+    02 [0] TCCLKS TIMER_CLOCK3 (MCK/32 = 667ns / tick)
+    01 [1] "
+    00 [0] "
+*/
+
+#define LED_PWM_TC_IER_INIT     (u32)0x00000014
+/*
+    31 -08 [0] Reserved 
+
+    07 [0] ETRGS RC Load interrupt not enabled
+    06 [0] LDRBS RB Load interrupt not enabled
+    05 [0] LDRAS RA Load interrupt not enabled
+    04 [1] CPCS RC compare interrupt is enabled (period start)
+
+    03 [0] CPBS RB compare interrupt not enabled
+    02 [1] CPAS RA Compare Interrupt enabled (next off edge)
+    01 [0] LOVRS Load Overrun interrupt not enabled 
+    00 [0] COVFS Counter Overflow interrupt not enabled
+*/
+
+#define LED_PWM_TC_IDR_INIT     (u32)0x000000FF
+/*
+    31-08 [0] Reserved 
+
+    07 [1] ETRGS RC Load interrupt disabled
+    06 [1] LDRBS RB Load interrupt disabled
+    05 [1] LDRAS RA Load interrupt disabled
+    04 [1] CPCS RC compare interrupt disabled
+
+    03 [1] CPBS RB compare interrupt disabled
+    02 [1] CPAS RA Compare Interrupt disabled
+    01 [1] LOVRS Load Overrun interrupt disabled 
+    00 [1] COVFS Counter Overflow interrupt disabled
+*/
 
 
 
@@ -0,0 +1,246 @@
+/*!**********************************************************************************************************************
+@file log.c
+@brief Deferred binary logging: call sites queue a format ID and raw arguments, a task sends them.
+
+A LOGn("format %u", x) call site does no formatting.  The format string is placed in
+the eie_log section at build time and the record carries only its offset there, the
+time and up to four u32 arguments, written with LogWrite() in a handful of stores.
+It is safe from interrupt handlers.
+
+The Log task is last in the loop and sends the records out over the debug console, one
+line per record: LOG_LINE_START then the record's words in hex.  The console's own
+output always has U8_LOG_TX_RESERVE buffers left.  If the ring fills, new records are
+dropped, and the task reports how many.
+
+On the host, log_decode turns a console capture back into text.  It needs the format
+table from the same build:
+  objcopy -O binary --only-section=eie_log build/eie_sim log_formats.bin  (make logformats)
+  log_decode log_formats.bin console.txt
+For the target image, run arm-none-eabi-objcopy with the same options on the IAR .out file.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_sLog
+
+CONSTANTS
+- U32_LOG_WORDS, U8_LOG_MAX_ARGS
+
+TYPES
+- LogBufferType
+
+PUBLIC FUNCTIONS
+- LOG0(pcFormat_) ... LOG4(pcFormat_, a_, b_, c_, d_)
+- static inline void LogWrite(const char* pcFormat_, u32 u32Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_, u32 u32Arg3_)
+
+PROTECTED FUNCTIONS
+- void LogInitialize(void)
+- void LogRunActiveState(void)
+- bool LogIsIdle(void)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Log"
+***********************************************************************************************************************/
+/* New variables */
+LogBufferType G_sLog;                                  /*!< @brief The log ring (zeroed at start up, so LOGn() works before LogInitialize()) */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static bool LogSendRecord(void);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void LogSM_Idle(void);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Log_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Log_pfnStateMachine;                /*!< @brief The state machine function pointer */
+static u32 Log_u32DroppedReported;                     /*!< @brief G_sLog.u32Dropped at the last report */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LogInitialize(void)
+
+@brief Starts the drain task.
+
+Requires:
+- The debug console is set up (DebugInitialize())
+
+Promises:
+- Records queued before now, and from now on, are sent by LogRunActiveState()
+
+*/
+void LogInitialize(void)
+{
+  Log_u32DroppedReported = 0;
+  Log_pfnStateMachine = LogSM_Idle;
+
+} /* end LogInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void LogRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void LogRunActiveState(void)
+{
+  Log_pfnStateMachine();
+
+} /* end LogRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool LogIsIdle(void)
+
+@brief TRUE when there is nothing to send, so the scheduler can skip the task.
+
+Requires:
+- NONE
+
+Promises:
+- Returns FALSE while records are queued or a drop has not been reported
+
+*/
+bool LogIsIdle(void)
+{
+  return( (G_sLog.u32Tail == G_sLog.u32Head) && (G_sLog.u32Dropped == Log_u32DroppedReported) );
+
+} /* end LogIsIdle() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool LogSendRecord(void)
+
+@brief Sends the oldest record as a line of hex words and frees its words.
+
+Returns FALSE if there is no complete record to send.  The oldest record may still
+be claimed but not filled: an interrupt that logged inside it cannot be sent first.
+*/
+static bool LogSendRecord(void)
+{
+  static const char acHex[] = "0123456789ABCDEF";
+  char acLine[1 + (U8_LOG_RECORD_HEADER + U8_LOG_MAX_ARGS) * 9 + 2];
+  char* pcLine = acLine;
+  u32 u32Tail = G_sLog.u32Tail;
+  u32 u32Header;
+  u32 u32Words;
+  u32 u32Word;
+  u32 u32PriMask;
+
+  if(u32Tail == G_sLog.u32Head)
+  {
+    return(FALSE);
+  }
+
+  u32Header = G_sLog.au32Ring[u32Tail & (U32_LOG_WORDS - 1)];
+  if(u32Header == 0)
+  {
+    return(FALSE);
+  }
+
+  u32Words = U8_LOG_RECORD_HEADER + (u32Header & U32_LOG_ARGS_MASK) - 1;
+  *pcLine++ = LOG_LINE_START;
+  for(u32 i = 0; i < u32Words; i++)
+  {
+    u32Word = G_sLog.au32Ring[(u32Tail + i) & (U32_LOG_WORDS - 1)];
+    G_sLog.au32Ring[(u32Tail + i) & (U32_LOG_WORDS - 1)] = 0;
+
+    if(i != 0)
+    {
+      *pcLine++ = ' ';
+    }
+    for(s8 j = 28; j >= 0; j -= 4)
+    {
+      *pcLine++ = acHex[(u32Word >> j) & 0xF];
+    }
+  }
+  *pcLine++ = '\r';
+  *pcLine++ = '\n';
+
+  /* The record leaves the ring even if the console has no room for it */
+  G_sLog.u32Tail = u32Tail + u32Words;
+  if( !DebugWrite((u8*)acLine, (u16)(pcLine - acLine)) )
+  {
+    /* LogWrite() may count a drop from an interrupt, so count under the same mask */
+    u32PriMask = __get_PRIMASK();
+    __disable_irq();
+    G_sLog.u32Dropped++;
+    __set_PRIMASK(u32PriMask);
+  }
+
+  return(TRUE);
+
+} /* end LogSendRecord() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void LogSM_Idle(void)
+
+@brief Sends what is queued, a few records per call, while the console has buffers to spare.
+*/
+static void LogSM_Idle(void)
+{
+  u32 u32Dropped = G_sLog.u32Dropped;
+  u8 u8Sent = 0;
+
+  if( (u32Dropped != Log_u32DroppedReported) && (DebugTxFreeBuffers() > U8_LOG_TX_RESERVE) &&
+      DebugPrintf("log: %u records dropped\r\n", (unsigned)(u32Dropped - Log_u32DroppedReported)) )
+  {
+    Log_u32DroppedReported = u32Dropped;
+  }
+
+  while( (u8Sent < U8_LOG_RECORDS_PER_RUN) && (DebugTxFreeBuffers() > U8_LOG_TX_RESERVE) && LogSendRecord() )
+  {
+    u8Sent++;
+  }
+
+} /* end LogSM_Idle() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
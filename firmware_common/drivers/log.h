@@ -0,0 +1,162 @@
+/*!**********************************************************************************************************************
+@file log.h
+@brief Header file for log.c
+***********************************************************************************************************************/
+
+#ifndef __LOG_H
+#define __LOG_H
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_LOG_WORDS             (u32)256          /*!< @brief Ring size in words (power of 2) */
+#define U8_LOG_MAX_ARGS           (u8)4             /*!< @brief Most arguments a record carries */
+#define U8_LOG_RECORD_HEADER      (u8)2             /*!< @brief Header and time stamp words in front of the arguments */
+#define U32_LOG_ARGS_MASK         (u32)0x0000000F   /*!< @brief Header bits 0-3: argument count + 1 (never 0 once written) */
+#define U8_LOG_FORMAT_SHIFT       (u8)4             /*!< @brief Header bits 4-31: format offset in the eie_log section */
+
+#define U8_LOG_RECORDS_PER_RUN    (u8)4             /*!< @brief Most records the drain sends per call */
+#define U8_LOG_TX_RESERVE         (u8)4             /*!< @brief Console buffers the drain leaves for everything else */
+#define LOG_LINE_START            '!'               /*!< @brief First character of a record line on the console */
+
+/* Format strings live in their own section so a host tool can pull the table out of
+the linked image (objcopy -O binary --only-section=eie_log image formats.bin) and the
+record only needs the string's offset in it */
+#if defined ( __ICCARM__ )
+    #pragma section="eie_log"
+    #define LOG_FORMAT_SECTION    _Pragma("location=\"eie_log\"")
+    #define LOG_FORMATS_START     ((const char*)__section_begin("eie_log"))
+#else
+    extern const char __start_eie_log[];
+    #define LOG_FORMAT_SECTION    __attribute__((section("eie_log")))
+    #define LOG_FORMATS_START     (__start_eie_log)
+#endif
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@struct LogBufferType
+@brief The log ring: producers add records at u32Head, the drain task takes them from u32Tail.
+
+A record is a header word (format offset and argument count), G_u32SystemTime1ms and
+0-4 argument words.  The header is written last and the drain clears every word it
+takes, so a slot whose header is 0 has been claimed but not filled yet.
+*/
+typedef struct
+{
+  volatile u32 u32Head;                   /*!< @brief Words claimed since start up (next record at u32Head % U32_LOG_WORDS) */
+  volatile u32 u32Tail;                   /*!< @brief Words the drain has sent */
+  volatile u32 u32Dropped;                /*!< @brief Records lost because the ring was full */
+  volatile u32 au32Ring[U32_LOG_WORDS];   /*!< @brief The records */
+} LogBufferType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static inline void LogWrite(const char* pcFormat_, u32 u32Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_, u32 u32Arg3_)
+
+@brief Adds one record to the log ring.
+
+Nothing is formatted here: the cost is claiming the words with interrupts masked
+(about 10 cycles on target) and one store per word.  Safe from any ISR and from tasks.
+Use through the LOGn() macros, which put the format string in the eie_log section.
+
+Requires:
+@param pcFormat_ is a format string in the eie_log section (integer conversions only:
+       %d %i %u %x %X %c %o, with flags and widths)
+@param u32Args_ is the number of arguments used (0-4)
+@param u32Arg0_ - u32Arg3_ are the arguments
+
+Promises:
+- The record is queued for the drain task, or if the ring is full it is dropped and
+  counted in u32Dropped
+
+*/
+static inline void LogWrite(const char* pcFormat_, u32 u32Args_, u32 u32Arg0_, u32 u32Arg1_, u32 u32Arg2_, u32 u32Arg3_)
+{
+  extern LogBufferType G_sLog;
+  extern volatile u32 G_u32SystemTime1ms;
+  u32 u32Words = U8_LOG_RECORD_HEADER + u32Args_;
+  u32 u32Start;
+  u32 u32PriMask;
+
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+  u32Start = G_sLog.u32Head;
+  if( (u32Start - G_sLog.u32Tail) > (U32_LOG_WORDS - u32Words) )
+  {
+    G_sLog.u32Dropped++;
+    __set_PRIMASK(u32PriMask);
+    return;
+  }
+  G_sLog.u32Head = u32Start + u32Words;
+  __set_PRIMASK(u32PriMask);
+
+  /* u32Args_ is a constant at every call site, so only the stores needed are left */
+  G_sLog.au32Ring[(u32Start + 1) & (U32_LOG_WORDS - 1)] = G_u32SystemTime1ms;
+  if(u32Args_ > 0)
+  {
+    G_sLog.au32Ring[(u32Start + 2) & (U32_LOG_WORDS - 1)] = u32Arg0_;
+  }
+  if(u32Args_ > 1)
+  {
+    G_sLog.au32Ring[(u32Start + 3) & (U32_LOG_WORDS - 1)] = u32Arg1_;
+  }
+  if(u32Args_ > 2)
+  {
+    G_sLog.au32Ring[(u32Start + 4) & (U32_LOG_WORDS - 1)] = u32Arg2_;
+  }
+  if(u32Args_ > 3)
+  {
+    G_sLog.au32Ring[(u32Start + 5) & (U32_LOG_WORDS - 1)] = u32Arg3_;
+  }
+
+  /* Publish the record */
+  G_sLog.au32Ring[u32Start & (U32_LOG_WORDS - 1)] =
+    ((u32)(pcFormat_ - LOG_FORMATS_START) << U8_LOG_FORMAT_SHIFT) | (u32Args_ + 1);
+
+} /* end LogWrite() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void LogInitialize(void);
+void LogRunActiveState(void);
+bool LogIsIdle(void);
+
+
+/**********************************************************************************************************************
+Log points
+**********************************************************************************************************************/
+/* e.g. LOG2("button %u held %u ms", u8Button, u32Time): arguments are passed as u32 */
+#define LOG0(pcFormat_) \
+  do { LOG_FORMAT_SECTION static const char acLogFormat[] = pcFormat_; \
+       LogWrite(acLogFormat, 0, 0, 0, 0, 0); } while(0)
+#define LOG1(pcFormat_, a_) \
+  do { LOG_FORMAT_SECTION static const char acLogFormat[] = pcFormat_; \
+       LogWrite(acLogFormat, 1, (u32)(a_), 0, 0, 0); } while(0)
+#define LOG2(pcFormat_, a_, b_) \
+  do { LOG_FORMAT_SECTION static const char acLogFormat[] = pcFormat_; \
+       LogWrite(acLogFormat, 2, (u32)(a_), (u32)(b_), 0, 0); } while(0)
+#define LOG3(pcFormat_, a_, b_, c_) \
+  do { LOG_FORMAT_SECTION static const char acLogFormat[] = pcFormat_; \
+       LogWrite(acLogFormat, 3, (u32)(a_), (u32)(b_), (u32)(c_), 0); } while(0)
+#define LOG4(pcFormat_, a_, b_, c_, d_) \
+  do { LOG_FORMAT_SECTION static const char acLogFormat[] = pcFormat_; \
+       LogWrite(acLogFormat, 4, (u32)(a_), (u32)(b_), (u32)(c_), (u32)(d_)); } while(0)
+
+
+#endif /* __LOG_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -1,22 +1,82 @@
 /*!**********************************************************************************************************************
-@file timer.c                                                                
+@file timer.c
 @brief Provide easy access to set up and run a Timer Counter (TC) Peripheral.
 
+Each channel of TCB0 that no other driver uses can run periodically or once, with the
+period set in ticks (TimerSet()) or in microseconds (TimerSetPeriodUs(), which picks
+the finest TIMER_CLOCKx that fits).  A callback assigned with TimerAssignCallback() is
+called from the channel's interrupt with its context pointer at the end of each period.
+
+TC2 runs the LED PWM (leds.c) and, in EIE_KEYPAD builds, TC0 scans the keypad
+(keypad.c); calls for a channel in TIMER_RESERVED_CHANNELS do nothing.
+
+Software timers (TimerSoftType) run on a hierarchical timer wheel driven by the timer
+task instead of each app comparing its own timestamps every loop.  Starting or stopping
+one is a linked list insert or unlink.  Each tick the task looks at one level 0 slot,
+and every 32, 1024 and 32768 ticks moves a higher level slot down a level.  An expired
+timer sets its flag (TimerSoftExpired()) and calls its callback from the task.  The
+wheel knows its next non-empty slot, so the scheduler skips the task until then and
+TimerNextDeadline() lets the system sleep through the wait.  The TimerSoft functions
+are for tasks, not interrupts.
+
+A channel can instead measure its TIOA input (TimerCaptureStart()): RA latches the start
+edge of each period and RB the opposite edge, and the interrupt extends both to 32 bits
+with the overflow count and queues {period, active time} for TimerCaptureRead() or
+TimerCaptureAverage().  TimerQuadratureStart() runs TC0 and TC1 from the block's
+quadrature decoder for an encoder on TIOA0 / TIOB0 (position) and TIOB1 (index, counted
+in revolutions).  Both take pins listed in the BSP (G_asBspTimerTioaPins,
+TIMER_QUADRATURE_PIOA_PINS); TC2 is never used, so speed measurement is left to the
+caller (position deltas over a software timer).
+
 ------------------------------------------------------------------------------------------------------------------------
 GLOBALS
 - NONE
 
 CONSTANTS
-- NONE
+- TIMER_RESERVED_CHANNELS, U32_TIMER_MAX_PERIOD_US, U8_TIMER_CAPTURE_BUFFER
 
 TYPES
-- 
+- TimerChannelType
+- TimerModeType
+- TimerCallbackType
+- TimerSoftType
+- TimerCaptureEdgeType
+- TimerCaptureType
 
 PUBLIC FUNCTIONS
-- 
+- void TimerSet(TimerChannelType eTimerChannel_, u16 u16TimerValue_)
+- bool TimerSetPeriodUs(TimerChannelType eTimerChannel_, u32 u32PeriodUs_, TimerModeType eMode_)
+- void TimerStart(TimerChannelType eTimerChannel_)
+- void TimerStop(TimerChannelType eTimerChannel_)
+- u16 TimerGetTime(TimerChannelType eTimerChannel_)
+- bool TimerAssignCallback(TimerChannelType eTimerChannel_, TimerCallbackType pfnCallback_, void* pvContext_)
+- void TimerSoftCreate(TimerSoftType* psTimer_, u32 u32PeriodMs_, TimerModeType eMode_,
+                       TimerCallbackType pfnCallback_, void* pvContext_)
+- void TimerSoftStart(TimerSoftType* psTimer_)
+- void TimerSoftRestart(TimerSoftType* psTimer_, u32 u32PeriodMs_)
+- void TimerSoftStop(TimerSoftType* psTimer_)
+- bool TimerSoftExpired(TimerSoftType* psTimer_)
+- bool TimerSoftIsRunning(TimerSoftType* psTimer_)
+- bool TimerCaptureStart(TimerChannelType eTimerChannel_, u32 u32MaxPeriodUs_, TimerCaptureEdgeType eStartEdge_)
+- void TimerCaptureStop(TimerChannelType eTimerChannel_)
+- bool TimerCaptureRead(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+- u8 TimerCaptureAverage(TimerChannelType eTimerChannel_, TimerCaptureType* psAverage_)
+- u32 TimerCaptureTickHz(TimerChannelType eTimerChannel_)
+- u32 TimerCaptureFrequencyMilliHz(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+- u32 TimerCapturePeriodUs(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+- u16 TimerCaptureDutyPermille(TimerCaptureType* psCapture_)
+- bool TimerQuadratureStart(bool bIndex_)
+- void TimerQuadratureStop(void)
+- s32 TimerQuadratureGetPosition(void)
+- s16 TimerQuadratureGetRevolutions(void)
+
 PROTECTED FUNCTIONS
 - void TimerInitialize(void)
 - void TimerRunActiveState(void)
+- bool TimerIsIdle(void)
+- u32 TimerNextDeadline(void)
+- void TC0_IrqHandler(void) (not in EIE_KEYPAD builds)
+- void TC1_IrqHandler(void)
 
 **********************************************************************************************************************/
 
@@ -37,24 +97,65 @@ extern volatile u32 G_u32SystemTime1s;             /*!< @brief From main.c */
 extern volatile u32 G_u32SystemFlags;              /*!< @brief From main.c */
 extern volatile u32 G_u32ApplicationFlags;         /*!< @brief From main.c */
 
+extern const PinConfigurationType G_asBspTimerTioaPins[U8_TIMER_CHANNELS]; /*!< @brief from board-specific file */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static bool TimerChannelAvailable(TimerChannelType eTimerChannel_);
+static void TimerChannelInterrupt(TimerChannelType eTimerChannel_);
+static void TimerCaptureInterrupt(TimerChannelType eTimerChannel_, u32 u32Status_);
+static void TimerCaptureEdge(TimerChannelStatusType* psChannel_, u8 u8Channel_, u32 u32Stamp_, bool bStartEdge_);
+static void TimerCapturePin(TimerChannelType eTimerChannel_, bool bPeripheral_);
+static void TimerQuadraturePoll(void* pvContext_);
+static void TimerWheelInsert(TimerSoftType* psTimer_);
+static void TimerWheelUnlink(TimerSoftType* psTimer_);
+static void TimerWheelTick(void);
+static void TimerWheelPlan(void);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void TimerSM_Idle(void);
+static void TimerSM_Error(void);
+
 
 /***********************************************************************************************************************
 Global variable definitions with scope limited to this local application.
 Variable names shall start with "Timer_<type>" and be declared as static.
 ***********************************************************************************************************************/
-//Discrepency in coding style between text and salvaged code
-static fnCode_type Timer_StateMachine;            /*!< @brief The state machine function pointer */
-//Putting it in scope of interrupts.c is tricky. Don't use.
-static fnCode_type Timer_fpTimer1Callback;            /*!< @brief The Timer ISR callback pointer */
+static fnCode_type Timer_StateMachine;             /*!< @brief The state machine function pointer */
+
+static TimerChannelStatusType Timer_asChannels[U8_TIMER_CHANNELS]; /*!< @brief Callback and mode of each channel */
+
+/*! @brief MCK divider of TIMER_CLOCK1..4 */
+static const u8 Timer_au8ClockDividers[U8_TIMER_MCK_CLOCKS] = {2, 8, 32, 128};
+
+static TimerSoftType* Timer_apsWheel[U8_TIMER_WHEEL_LEVELS * U8_TIMER_WHEEL_SLOTS]; /*!< @brief First timer in each slot */
+static u32 Timer_au32WheelOccupied[U8_TIMER_WHEEL_LEVELS]; /*!< @brief Bit n set while slot n of the level has timers */
+static u32 Timer_u32WheelTime;                     /*!< @brief Last G_u32SystemTime1ms the wheel processed */
+static u32 Timer_u32WheelNext;                     /*!< @brief When the next non-empty slot is processed */
+static bool Timer_bWheelBusy;                      /*!< @brief TRUE while any software timer is running */
+
+/*! @brief Captures of each channel, queued by its interrupt */
+static TimerCaptureType Timer_aasCaptures[U8_TIMER_CHANNELS][U8_TIMER_CAPTURE_BUFFER];
+static volatile u8 Timer_au8CaptureHead[U8_TIMER_CHANNELS]; /*!< @brief Next entry the interrupt writes */
+static volatile u8 Timer_au8CaptureTail[U8_TIMER_CHANNELS]; /*!< @brief Next entry TimerCaptureRead() returns */
+
+static bool Timer_bQuadratureIndex;                /*!< @brief The decoder was started with the index input */
+static s32 Timer_s32QuadraturePosition;            /*!< @brief 32-bit position without the index */
+static u16 Timer_u16QuadratureLast;                /*!< @brief TC0 count folded into Timer_s32QuadraturePosition */
+static TimerSoftType Timer_sQuadraturePoll;        /*!< @brief Folds TC0 into the position before it can wrap */
+
 
-//??
-volatile u32 Timer_u32Timer1Counter = 0;
 /**********************************************************************************************************************
 Function Definitions
 **********************************************************************************************************************/
 
 /*--------------------------------------------------------------------------------------------------------------------*/
-/*! @publicsection */                                                                                            
+/*! @publicsection */
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void TimerSet(TimerChannelType eTimerChannel_, u16 u16TimerValue_)
@@ -66,91 +167,132 @@ Requires:
 function to reset the counter and avoid gliches.
 
 @param eTimerChannel_ holds a valid channel
-@param u16TimerValue_ x in ticks
+@param u16TimerValue_ x in ticks of the channel's current clock
 
 Promises:
-- Updates register TC_RC value with u16TimerValue_
+- Updates register TC_RC value with u16TimerValue_ (not for a reserved channel)
 
 */
 void TimerSet(TimerChannelType eTimerChannel_, u16 u16TimerValue_)
 {
-  
-  /* Build the offset to the selected peripheral */
-  u32 u32TimerBaseAddress = (u32)AT91C_BASE_TC0;
-  u32TimerBaseAddress += (u32)eTimerChannel_;
-   
+  if( !TimerChannelAvailable(eTimerChannel_) )
+  {
+    return;
+  }
+
   /* Load the new timer value */
-  (AT91_CAST(AT91PS_TC)u32TimerBaseAddress)->TC_RC =
-                                          (u32)(u16TimerValue_) & 0x0000FFFF;
+  TIMER_CHANNEL_BASE(eTimerChannel_)->TC_RC = (u32)(u16TimerValue_) & 0x0000FFFF;
 
 } /* end TimerSet() */
 
+
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn void TimerStart(TimerChannelType eTimerChannel_)
+@fn bool TimerSetPeriodUs(TimerChannelType eTimerChannel_, u32 u32PeriodUs_, TimerModeType eMode_)
+
+@brief Sets a channel's period in microseconds and whether it repeats.
 
-@brief  Start the timer
+The fastest of TIMER_CLOCK1..4 that fits the period in 16 bits is used (41.7ns
+resolution up to 2.7ms, 2.67us resolution up to 174ms); longer periods up to
+U32_TIMER_MAX_PERIOD_US run from the slow clock (TIMER_CLOCK5, 30.5us).
 
 Requires:
--
+- The channel is stopped; TimerStart() runs it with the new period
 
 @param eTimerChannel_ holds a valid channel
+@param u32PeriodUs_ is the period in us, 1 to U32_TIMER_MAX_PERIOD_US
+@param eMode_ is TIMER_PERIODIC or TIMER_ONE_SHOT (the clock stops at the end of the period)
 
 Promises:
-- Updates register TC_RC value with u16TimerValue_
+- Returns TRUE with TC_CMR and TC_RC set to the nearest period the channel can count
+- Returns FALSE and changes nothing if the channel is reserved or the period rounds
+  to 0 or does not fit
 
 */
-void TimerStart(TimerChannelType eTimerChannel_)
+bool TimerSetPeriodUs(TimerChannelType eTimerChannel_, u32 u32PeriodUs_, TimerModeType eMode_)
 {
-  /* Light-Duty Hardfault Diagnosis Local Variables*/
-  u32Dummy CCR_Value = (TC1_CCR_INIT | AT91C_TC_CLKEN | AT91C_TC_SWTRG);
-  CCR_Value ^= AT91C_TC_CLKDIS;
-  
-  /* Build the offset to the selected peripheral */
-  u32 u32TimerBaseAddress = (u32)AT91C_BASE_TC0;
-  u32TimerBaseAddress += (u32)eTimerChannel_;
-   
-  /* Ensure clock is enabled and triggered */
-  (AT91_CAST(AT91PS_TC)u32TimerBaseAddress)->TC_CCR ^= AT91C_TC_CLKDIS;
-  (AT91_CAST(AT91PS_TC)u32TimerBaseAddress)->TC_CCR |= (AT91C_TC_CLKEN | 
-                                                         AT91C_TC_SWTRG);
-   
-   
-   }/* end TimerStart() */
+  AT91PS_TC psTc;
+  u32 u32Ticks = 0;
+  u32 u32Clock;
 
-/*!----------------------------------------------------------------------------------------------------------------------
-@fn ISR void TC1_IrqHandler(void)
+  if( !TimerChannelAvailable(eTimerChannel_) )
+  {
+    return(FALSE);
+  }
+
+  /* The fastest clock that fits gives the finest resolution */
+  for(u32Clock = 0; u32Clock < U8_TIMER_MCK_CLOCKS; u32Clock++)
+  {
+    u32Ticks = (u32)( ((u64)u32PeriodUs_ * (MCK / 1000000) + (Timer_au8ClockDividers[u32Clock] / 2)) /
+                      Timer_au8ClockDividers[u32Clock] );
+    if(u32Ticks <= U32_TIMER_MAX_TICKS)
+    {
+      break;
+    }
+  }
 
-@brief Parses the TC1 interrupts and handles them appropriately.  
+  /* Too long for MCK: TIMER_CLOCK5 is SLCK */
+  if(u32Clock == U8_TIMER_MCK_CLOCKS)
+  {
+    u32Ticks = (u32)( ((u64)u32PeriodUs_ * U32_SLCK_VALUE + 500000) / 1000000 );
+  }
 
-Note that all enabled TC1 interrupts are ORed and will trigger this handler, 
-therefore, any expected interrupt that is enabled must be parsed out and handled.
+  if( (u32Ticks == 0) || (u32Ticks > U32_TIMER_MAX_TICKS) )
+  {
+    return(FALSE);
+  }
+
+  psTc = TIMER_CHANNEL_BASE(eTimerChannel_);
+  psTc->TC_CMR = (TIMER_TC_CMR_INIT & ~AT91C_TC_CLKS) | u32Clock |
+                 ((eMode_ == TIMER_ONE_SHOT) ? AT91C_TC_CPCDIS : 0);
+  psTc->TC_RC = u32Ticks;
+  Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)].eMode = eMode_;
+
+  return(TRUE);
+
+} /* end TimerSetPeriodUs() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerStart(TimerChannelType eTimerChannel_)
+
+@brief  Start the timer from 0.
 
-Requires: NONE 
+Requires:
+@param eTimerChannel_ holds a valid channel
 
 Promises:
-- If Chanel1 RC: Timer Channel 1 is reset and automatically 
--
+- Stale compare flags are cleared, then the counter is reset and its clock enabled
+  (TC_CCR is write-only: the command is written, never read back and modified)
+- The RC compare interrupt is enabled if the channel has a callback
+- Nothing happens for a reserved channel
 
 */
-
-void TC1_IrqHandler(void)
+void TimerStart(TimerChannelType eTimerChannel_)
 {
-  /* Check for RC compare interrupt - READING THE TC_SR clears the bit if set */
-  if( AT91C_BASE_TC1->TC_SR & AT91C_TC_CPCS)
+  AT91PS_TC psTc;
+  u32 u32Dummy;
+
+  if( !TimerChannelAvailable(eTimerChannel_) )
   {
-    Timer_u32Timer1Counter++;
-   
-  
-  //   Timer_fpTimer1Callback();
+    return;
+  }
+
+  psTc = TIMER_CHANNEL_BASE(eTimerChannel_);
+  psTc->TC_IDR = AT91C_TC_CPCS;
 
-  //  UserApp1TimerCallback();
-   
+  /* Reading TC_SR clears a compare left over from the last run */
+  u32Dummy = psTc->TC_SR;
+  (void)u32Dummy;
+  NVIC_ClearPendingIRQ( (IRQn_Type)(IRQn_TC0 + TIMER_CHANNEL_INDEX(eTimerChannel_)) );
+
+  psTc->TC_CCR = TIMER_TC_CCR_START;
+  if(Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)].pfnCallback != NULL)
+  {
+    psTc->TC_IER = AT91C_TC_CPCS;
   }
-  
-   /* Clear the TC1 pending flag and exit */
-      NVIC_ClearPendingIRQ(IRQn_TC1);
 
-} /* End TC1_IrqHandler */
+} /* end TimerStart() */
+
 
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn void TimerStop(TimerChannelType eTimerChannel_)
@@ -158,212 +300,1424 @@ void TC1_IrqHandler(void)
 @brief  Stop the timer
 
 Requires:
--
 @param eTimerChannel_ holds a valid channel
 
-
 Promises:
--
+- The channel's clock and interrupts are disabled (not for a reserved channel)
 
 */
 void TimerStop(TimerChannelType eTimerChannel_)
 {
-  
-  /* Build the offset to the selected peripheral */
-  u32 u32TimerBaseAddress = (u32)AT91C_BASE_TC0;
-  u32TimerBaseAddress += (u32)eTimerChannel_;
-   
-    /* Disable counter if enabled */
+  if( !TimerChannelAvailable(eTimerChannel_) )
+  {
+    return;
+  }
 
-  /* Ensure clock is enabled and triggered */
-  (AT91_CAST(AT91PS_TC)u32TimerBaseAddress)->TC_CCR |= AT91C_TC_CLKDIS;
-  
+  TIMER_CHANNEL_BASE(eTimerChannel_)->TC_IDR = TIMER_TC_IDR_INIT;
+  TIMER_CHANNEL_BASE(eTimerChannel_)->TC_CCR = TIMER_TC_CCR_STOP;
 
 } /* end TimerStop() */
 
+
 /*!----------------------------------------------------------------------------------------------------------------------
 @fn u16 TimerGetTime(TimerChannelType eTimerChannel_)
 
 @brief Returns timer counter value for a channel.
 
 Requires:
--
-
 @param eTimerChannel_ holds a valid channel
 
-
 Promises:
+- Returns TC_CV of the channel (any channel can be read)
 
 */
 u16 TimerGetTime(TimerChannelType eTimerChannel_)
 {
-  
-  /* Build the offset to the selected peripheral */
-  u32 u32TimerBaseAddress = (u32)AT91C_BASE_TC0;
-  u32TimerBaseAddress += (u32)eTimerChannel_;
-   
   /* Get the current timer value */
-  return ((u16) ((AT91_CAST(AT91PS_TC)u32TimerBaseAddress)->TC_CV & 0x0000FFFF));
+  return ((u16)(TIMER_CHANNEL_BASE(eTimerChannel_)->TC_CV & 0x0000FFFF));
+
 } /* end TimerGetTime() */
 
+
 /*!----------------------------------------------------------------------------------------------------------------------
-@fn  void TimerAssignCallBack(TimerChannelType eTimerChannel_, fnCode_type fpUserCallback_ )
+@fn bool TimerAssignCallback(TimerChannelType eTimerChannel_, TimerCallbackType pfnCallback_, void* pvContext_)
 
-@brief  Sets callback function pointer passed to Timer Counter ISR.
+@brief  Sets the function the channel's interrupt calls at the end of each period.
 
-Requires:
-- Requesite ISR to be written for channel
-- Seperate, channel specific function pointer to be defined with global scope
+The callback runs in interrupt context: keep it short.
 
+Requires:
 @param eTimerChannel_ holds a valid channel
-@param eTimerChannel_ holds a valid function pointer
-
+@param pfnCallback_ is the function to call, or NULL for none
+@param pvContext_ is passed to pfnCallback_
 
 Promises:
+- Returns TRUE with the callback and context stored together (the channel's interrupt
+  is held off while they change); TimerStart() enables the interrupt for a new callback
+- Returns FALSE for a reserved channel
 
 */
-void TimerAssignCallback(TimerChannelType eTimerChannel_, fnCode_type fpUserCallback_ )
+bool TimerAssignCallback(TimerChannelType eTimerChannel_, TimerCallbackType pfnCallback_, void* pvContext_)
 {
-  
-   switch(eTimerChannel_)
+  TimerChannelStatusType* psChannel;
+  IRQn_Type eIrq;
+
+  if( !TimerChannelAvailable(eTimerChannel_) )
   {
-    case TIMER0_CHANNEL0:
-    {
-      break;
-    }
-    case TIMER0_CHANNEL1:
-    {
-      Timer_fpTimer1Callback = fpUserCallback_;
-      break;
-    }
-    case TIMER0_CHANNEL2:
-    {
-      break;
-    }
-    default:
-    {
-      break;
-    }
-  }   
-} /* end TimerAssignCallBack() */
+    return(FALSE);
+  }
 
+  psChannel = &Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)];
+  eIrq = (IRQn_Type)(IRQn_TC0 + TIMER_CHANNEL_INDEX(eTimerChannel_));
 
+  NVIC_DisableIRQ(eIrq);
+  psChannel->pfnCallback = pfnCallback_;
+  psChannel->pvContext   = pvContext_;
+  if(pfnCallback_ == NULL)
+  {
+    TIMER_CHANNEL_BASE(eTimerChannel_)->TC_IDR = AT91C_TC_CPCS;
+  }
+  NVIC_EnableIRQ(eIrq);
 
+  return(TRUE);
 
-/*--------------------------------------------------------------------------------------------------------------------*/
-/*! @protectedsection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
+} /* end TimerAssignCallback() */
 
-  /*!----------------------------------------------------------------------------------------------------------------------
-@fn void TimerDefaultCallBack(void)
 
-@brief An empty function that the timer Callback points to by default. Expected 
-that the user will set their own.
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerSoftCreate(TimerSoftType* psTimer_, u32 u32PeriodMs_, TimerModeType eMode_,
+                         TimerCallbackType pfnCallback_, void* pvContext_)
+
+@brief Sets up a software timer (stopped).
+
+e.g. a timer that calls UserApp1Timeout(&UserApp1_sData) 250ms after each start:
+
+static TimerSoftType UserApp1_sTimeout;
+
+TimerSoftCreate(&UserApp1_sTimeout, 250, TIMER_ONE_SHOT, UserApp1Timeout, &UserApp1_sData);
+TimerSoftStart(&UserApp1_sTimeout);
 
 Requires:
-Nothing. 
+@param psTimer_ points to timer memory that lasts as long as the timer runs; it must
+not be running
+@param u32PeriodMs_ is the time to expiry in ms (1 to 0x7FFFFFFF; 0 is taken as 1)
+@param eMode_ is TIMER_ONE_SHOT or TIMER_PERIODIC (expires every u32PeriodMs_ until stopped)
+@param pfnCallback_ is called from the timer task on expiry, or NULL to only set the flag
+@param pvContext_ is passed to pfnCallback_
+
+Promises:
+- The timer is stopped with its flag clear
+
 */
+void TimerSoftCreate(TimerSoftType* psTimer_, u32 u32PeriodMs_, TimerModeType eMode_,
+                     TimerCallbackType pfnCallback_, void* pvContext_)
+{
+  psTimer_->psNext      = NULL;
+  psTimer_->ppsPrev     = NULL;
+  psTimer_->u32PeriodMs = u32PeriodMs_;
+  psTimer_->eMode       = eMode_;
+  psTimer_->pfnCallback = pfnCallback_;
+  psTimer_->pvContext   = pvContext_;
+  psTimer_->bExpired    = FALSE;
+
+} /* end TimerSoftCreate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerSoftStart(TimerSoftType* psTimer_)
+
+@brief Starts a software timer from now, or starts it again if it is running.
+
+Requires:
+@param psTimer_ was set up with TimerSoftCreate()
 
+Promises:
+- The timer expires u32PeriodMs from the current G_u32SystemTime1ms
+- Its expired flag is cleared
 
-static void TimerDefaultCallBack(void)
+*/
+void TimerSoftStart(TimerSoftType* psTimer_)
 {
-  
+  if(psTimer_->ppsPrev != NULL)
+  {
+    TimerWheelUnlink(psTimer_);
+  }
 
-  
-} /* end TimerDefaultCallBack() */
+  /* An empty wheel stops keeping time while the task is skipped: catch it up */
+  if(!Timer_bWheelBusy)
+  {
+    Timer_u32WheelTime = G_u32SystemTime1ms;
+  }
 
-/*!--------------------------------------------------------------------------------------------------------------------
-@fn void TimerInitialize(void)
+  psTimer_->u32Expiry = G_u32SystemTime1ms + ((psTimer_->u32PeriodMs != 0) ? psTimer_->u32PeriodMs : 1);
+  psTimer_->bExpired = FALSE;
+  TimerWheelInsert(psTimer_);
+  TimerWheelPlan();
 
-@brief Initializes the State Machine and its variables.
+} /* end TimerSoftStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerSoftRestart(TimerSoftType* psTimer_, u32 u32PeriodMs_)
+
+@brief Changes the period of a software timer and starts it from now.
 
 Requires:
-- NONE
+@param psTimer_ was set up with TimerSoftCreate()
+@param u32PeriodMs_ is the new period (see TimerSoftCreate())
 
 Promises:
-- 
+- As TimerSoftStart() with the new period
 
 */
-void TimerInitialize(void)
+void TimerSoftRestart(TimerSoftType* psTimer_, u32 u32PeriodMs_)
 {
-  /* Load the block configuration regusters*/
-  
-  AT91C_BASE_TCB0->TCB_BMR = TCB_BMR_INIT;
-  
-  /* Load Channel 1 settings */
-  
-  AT91C_BASE_TC1->TC_CMR = TC1_CMR_INIT;
-  AT91C_BASE_TC1->TC_RC = TC1_RC_INIT;
-  AT91C_BASE_TC1->TC_IER  = TC1_IER_INIT;
-  AT91C_BASE_TC1->TC_IDR  = TC1_IDR_INIT;    
-  AT91C_BASE_TC1->TC_CCR  = TC1_CCR_INIT;
+  psTimer_->u32PeriodMs = u32PeriodMs_;
+  TimerSoftStart(psTimer_);
 
-  /* If good initialization, set state to Idle */
-  if( 1 )
+} /* end TimerSoftRestart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerSoftStop(TimerSoftType* psTimer_)
+
+@brief Stops a software timer (it may be stopped already).
+
+Requires:
+@param psTimer_ was set up with TimerSoftCreate()
+
+Promises:
+- The timer is off the wheel; its expired flag is left for TimerSoftExpired()
+
+*/
+void TimerSoftStop(TimerSoftType* psTimer_)
+{
+  if(psTimer_->ppsPrev != NULL)
   {
-    
-    NVIC_ClearPendingIRQ(IRQn_TC1);
-    NVIC_EnableIRQ(IRQn_TC1);
-    Timer_StateMachine = TimerSM_Idle;
-    
+    TimerWheelUnlink(psTimer_);
+    TimerWheelPlan();
+  }
+
+} /* end TimerSoftStop() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerSoftExpired(TimerSoftType* psTimer_)
+
+@brief Reports and clears a software timer's expired flag.
+
+Requires:
+@param psTimer_ was set up with TimerSoftCreate()
+
+Promises:
+- Returns TRUE if the timer expired since it was started or last checked
+
+*/
+bool TimerSoftExpired(TimerSoftType* psTimer_)
+{
+  bool bExpired = psTimer_->bExpired;
+
+  psTimer_->bExpired = FALSE;
+  return(bExpired);
+
+} /* end TimerSoftExpired() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerSoftIsRunning(TimerSoftType* psTimer_)
+
+@brief Reports whether a software timer is on the wheel.
+
+Requires:
+@param psTimer_ was set up with TimerSoftCreate()
+
+Promises:
+- Returns TRUE from start until a one shot timer expires or the timer is stopped
+
+*/
+bool TimerSoftIsRunning(TimerSoftType* psTimer_)
+{
+  return( (bool)(psTimer_->ppsPrev != NULL) );
+
+} /* end TimerSoftIsRunning() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerCaptureStart(TimerChannelType eTimerChannel_, u32 u32MaxPeriodUs_, TimerCaptureEdgeType eStartEdge_)
+
+@brief Starts measuring the period and active time of the channel's TIOA input.
+
+The fastest of TIMER_CLOCK1..4 that counts u32MaxPeriodUs_ in 16 bits is used so the
+counter overflow interrupt is rare; longer periods run on TIMER_CLOCK4 (2.67us) and
+lean on the overflow count.  Either way a period up to 0xFFFF counter wraps long is
+measured (e.g. TIMER0_CHANNEL1 on PB5 with 1000us: 41.7ns resolution).
+
+e.g. duty cycle of a 1kHz PWM signal on TIOA1:
+
+TimerCaptureType sCapture;
+
+TimerCaptureStart(TIMER0_CHANNEL1, 1000, TIMER_CAPTURE_RISING);
+...
+if( TimerCaptureAverage(TIMER0_CHANNEL1, &sCapture) )
+{
+  u16Duty = TimerCaptureDutyPermille(&sCapture);
+}
+
+Requires:
+@param eTimerChannel_ holds a valid channel; its TIOA pin (G_asBspTimerTioaPins) is
+free (TIOA0 is the SD card write protect line)
+@param u32MaxPeriodUs_ is the longest period expected (0 for the finest resolution)
+@param eStartEdge_ is the edge each period starts on (TIMER_CAPTURE_RISING measures
+the high time)
+
+Promises:
+- Returns TRUE with the pin given to the TC, the channel counting from 0 and the
+  capture queue empty; each period is queued from the channel's interrupt
+- Any callback is kept but not called while capturing
+- Returns FALSE and changes nothing for a reserved channel or one running the decoder
+
+*/
+bool TimerCaptureStart(TimerChannelType eTimerChannel_, u32 u32MaxPeriodUs_, TimerCaptureEdgeType eStartEdge_)
+{
+  AT91PS_TC psTc;
+  TimerChannelStatusType* psChannel;
+  u8 u8Index = TIMER_CHANNEL_INDEX(eTimerChannel_);
+  u32 u32Clock;
+  u32 u32Dummy;
 
-    Timer_fpTimer1Callback = TimerDefaultCallBack;
+  if( !TimerChannelAvailable(eTimerChannel_) || (Timer_asChannels[u8Index].eMode == TIMER_QUADRATURE) )
+  {
+    return(FALSE);
   }
-  else
+
+  /* The fastest clock that holds the longest period without wrapping */
+  for(u32Clock = 0; u32Clock < (U8_TIMER_MCK_CLOCKS - 1); u32Clock++)
   {
-    /* The task isn't properly initialized, so shut it down and don't run */
-    Timer_StateMachine = TimerSM_Error;
+    if( ((u64)u32MaxPeriodUs_ * (MCK / 1000000)) / Timer_au8ClockDividers[u32Clock] <= U32_TIMER_MAX_TICKS )
+    {
+      break;
+    }
   }
 
-} /* end TimerInitialize() */
+  TimerStop(eTimerChannel_);
 
+  psTc = TIMER_CHANNEL_BASE(eTimerChannel_);
+  psChannel = &Timer_asChannels[u8Index];
+  psChannel->eMode = TIMER_CAPTURE;
+  psChannel->u32Overflows = 0;
+  psChannel->bStarted = FALSE;
+  psChannel->bActive = FALSE;
+  Timer_au8CaptureHead[u8Index] = 0;
+  Timer_au8CaptureTail[u8Index] = 0;
 
-/*!----------------------------------------------------------------------------------------------------------------------
-@fn void TimerRunActiveState(void)
+  psTc->TC_CMR = ((eStartEdge_ == TIMER_CAPTURE_RISING) ? TIMER_TC_CMR_CAPTURE_RISING : TIMER_TC_CMR_CAPTURE_FALLING) |
+                 u32Clock;
+  TimerCapturePin(eTimerChannel_, TRUE);
 
-@brief Selects and runs one iteration of the current state in the state machine.
+  /* Reading TC_SR clears anything left over from the last run */
+  u32Dummy = psTc->TC_SR;
+  (void)u32Dummy;
+  NVIC_ClearPendingIRQ( (IRQn_Type)(IRQn_TC0 + u8Index) );
 
-All state machines have a TOTAL of 1ms to execute, so on average n state machines
-may take 1ms / n to execute.
+  psTc->TC_CCR = TIMER_TC_CCR_START;
+  psTc->TC_IER = TIMER_TC_IER_CAPTURE;
+
+  return(TRUE);
+
+} /* end TimerCaptureStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerCaptureStop(TimerChannelType eTimerChannel_)
+
+@brief Stops capturing and gives the TIOA pin back to the PIO.
 
 Requires:
-- State machine function pointer points at current state
+@param eTimerChannel_ holds a valid channel
 
 Promises:
-- Calls the function to pointed by the state machine function pointer
+- A capturing channel is stopped and left as TimerInitialize() set it (periodic on
+  TIMER_CLOCK4, with TC_RC as it was); captures still queued can be read
+- Nothing happens for a channel that is not capturing
 
 */
-void TimerRunActiveState(void)
+void TimerCaptureStop(TimerChannelType eTimerChannel_)
 {
-  Timer_StateMachine();
+  if( !TimerChannelAvailable(eTimerChannel_) ||
+      (Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)].eMode != TIMER_CAPTURE) )
+  {
+    return;
+  }
 
-} /* end TimerRunActiveState */
+  TimerStop(eTimerChannel_);
+  TimerCapturePin(eTimerChannel_, FALSE);
+  TIMER_CHANNEL_BASE(eTimerChannel_)->TC_CMR = TIMER_TC_CMR_INIT;
+  Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)].eMode = TIMER_PERIODIC;
 
+} /* end TimerCaptureStop() */
 
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-  
 
-/**********************************************************************************************************************
-State Machine Function Definitions
-**********************************************************************************************************************/
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerCaptureRead(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
 
-/*!-------------------------------------------------------------------------------------------------------------------
-@fn static void TimerSM_Idle(void)
+@brief Takes the oldest queued capture of a channel.
+
+Requires:
+@param eTimerChannel_ holds a valid channel
+@param psCapture_ points to where the capture is copied
+
+Promises:
+- Returns TRUE with *psCapture_ loaded and the capture removed from the queue
+- Returns FALSE if nothing is queued (including for a reserved channel)
 
-@brief Wait for a message to be queued 
-*/static void TimerSM_Idle(void)
+*/
+bool TimerCaptureRead(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
 {
-   
-} /* end TimerSM_Idle() */
-     
+  u8 u8Index = TIMER_CHANNEL_INDEX(eTimerChannel_);
+  u8 u8Tail;
 
-/*-------------------------------------------------------------------------------------------------------------------*/
-/* Handle an error */
-static void TimerSM_Error(void)          
+  if( !TimerChannelAvailable(eTimerChannel_) )
+  {
+    return(FALSE);
+  }
+
+  u8Tail = Timer_au8CaptureTail[u8Index];
+  if(u8Tail == Timer_au8CaptureHead[u8Index])
+  {
+    return(FALSE);
+  }
+
+  /* Read the entry only after seeing the head that published it, and free it only after the copy */
+  __DMB();
+  *psCapture_ = Timer_aasCaptures[u8Index][u8Tail];
+  __DMB();
+  Timer_au8CaptureTail[u8Index] = (u8)((u8Tail + 1) & (U8_TIMER_CAPTURE_BUFFER - 1));
+
+  return(TRUE);
+
+} /* end TimerCaptureRead() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8 TimerCaptureAverage(TimerChannelType eTimerChannel_, TimerCaptureType* psAverage_)
+
+@brief Empties a channel's capture queue into one averaged capture.
+
+Requires:
+@param eTimerChannel_ holds a valid channel
+@param psAverage_ points to where the average is written
+
+Promises:
+- Returns the number of captures averaged; if it is not 0, *psAverage_ holds their
+  mean period and active time
+- The queue is empty
+
+*/
+u8 TimerCaptureAverage(TimerChannelType eTimerChannel_, TimerCaptureType* psAverage_)
 {
-  
+  TimerCaptureType sCapture;
+  u64 u64Period = 0;
+  u64 u64Active = 0;
+  u8 u8Count = 0;
+
+  while( TimerCaptureRead(eTimerChannel_, &sCapture) )
+  {
+    u64Period += sCapture.u32PeriodTicks;
+    u64Active += sCapture.u32ActiveTicks;
+    u8Count++;
+  }
+
+  if(u8Count != 0)
+  {
+    psAverage_->u32PeriodTicks = (u32)( (u64Period + (u8Count / 2)) / u8Count );
+    psAverage_->u32ActiveTicks = (u32)( (u64Active + (u8Count / 2)) / u8Count );
+  }
+
+  return(u8Count);
+
+} /* end TimerCaptureAverage() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 TimerCaptureTickHz(TimerChannelType eTimerChannel_)
+
+@brief Returns the clock rate a channel counts at (the unit of TimerCaptureType).
+
+Requires:
+@param eTimerChannel_ holds a valid channel
+
+Promises:
+- Returns the frequency of the channel's TIMER_CLOCKx in Hz, or 0 for an external clock
+
+*/
+u32 TimerCaptureTickHz(TimerChannelType eTimerChannel_)
+{
+  u32 u32Clock = TIMER_CHANNEL_BASE(eTimerChannel_)->TC_CMR & AT91C_TC_CLKS;
+
+  if(u32Clock < U8_TIMER_MCK_CLOCKS)
+  {
+    return(MCK / Timer_au8ClockDividers[u32Clock]);
+  }
+
+  if(u32Clock == AT91C_TC_CLKS_TIMER_DIV5_CLOCK)
+  {
+    return(U32_SLCK_VALUE);
+  }
+
+  return(0);
+
+} /* end TimerCaptureTickHz() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 TimerCaptureFrequencyMilliHz(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+
+@brief Converts a capture's period to a frequency.
+
+Requires:
+@param eTimerChannel_ is the channel the capture came from (still on the same clock)
+@param psCapture_ points to a capture
+
+Promises:
+- Returns the input frequency in mHz (0 for an empty period)
+
+*/
+u32 TimerCaptureFrequencyMilliHz(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+{
+  if(psCapture_->u32PeriodTicks == 0)
+  {
+    return(0);
+  }
+
+  return( (u32)( ((u64)TimerCaptureTickHz(eTimerChannel_) * 1000 + (psCapture_->u32PeriodTicks / 2)) /
+                 psCapture_->u32PeriodTicks ) );
+
+} /* end TimerCaptureFrequencyMilliHz() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 TimerCapturePeriodUs(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+
+@brief Converts a capture's period to microseconds.
+
+Requires:
+@param eTimerChannel_ is the channel the capture came from (still on the same clock)
+@param psCapture_ points to a capture
+
+Promises:
+- Returns the period rounded to the nearest us (0 if the channel has no tick rate)
+
+*/
+u32 TimerCapturePeriodUs(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_)
+{
+  u32 u32TickHz = TimerCaptureTickHz(eTimerChannel_);
+
+  if(u32TickHz == 0)
+  {
+    return(0);
+  }
+
+  return( (u32)( ((u64)psCapture_->u32PeriodTicks * 1000000 + (u32TickHz / 2)) / u32TickHz ) );
+
+} /* end TimerCapturePeriodUs() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u16 TimerCaptureDutyPermille(TimerCaptureType* psCapture_)
+
+@brief Returns the active part of a capture's period.
+
+Requires:
+@param psCapture_ points to a capture
+
+Promises:
+- Returns the active time in 0.1% of the period, 0 to 1000 (0 for an empty period)
+
+*/
+u16 TimerCaptureDutyPermille(TimerCaptureType* psCapture_)
+{
+  if( (psCapture_->u32PeriodTicks == 0) || (psCapture_->u32ActiveTicks > psCapture_->u32PeriodTicks) )
+  {
+    return(0);
+  }
+
+  return( (u16)( ((u64)psCapture_->u32ActiveTicks * 1000 + (psCapture_->u32PeriodTicks / 2)) /
+                 psCapture_->u32PeriodTicks ) );
+
+} /* end TimerCaptureDutyPermille() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerQuadratureStart(bool bIndex_)
+
+@brief Starts decoding a quadrature encoder on PHA (TIOA0), PHB (TIOB0) and IDX (TIOB1).
+
+Every edge of PHA and PHB is counted (4 counts per encoder line) up when PHA leads.
+With the index, TC0 is reset by each index pulse and TC1 counts revolutions;
+without it, the timer task folds TC0 into a 32-bit position every
+U32_TIMER_QUADRATURE_POLL_MS.
+
+Requires:
+- TC0 and TC1 are not reserved (the decoder can't run in EIE_KEYPAD builds) and the SD
+  card is not used (PA1 is its write protect line)
+@param bIndex_ is TRUE if the encoder's index is wired to PB6
+
+Promises:
+- Returns TRUE with the pins given to the TC, TCB_BMR set to TCB_BMR_QUADRATURE and
+  both channels counting from 0; neither channel can be used for anything else until
+  TimerQuadratureStop()
+- Returns FALSE and changes nothing if either channel is reserved or capturing
+
+*/
+bool TimerQuadratureStart(bool bIndex_)
+{
+  if( !TimerChannelAvailable(TIMER0_CHANNEL0) || !TimerChannelAvailable(TIMER0_CHANNEL1) ||
+      (Timer_asChannels[0].eMode == TIMER_CAPTURE) || (Timer_asChannels[1].eMode == TIMER_CAPTURE) )
+  {
+    return(FALSE);
+  }
+
+  TimerStop(TIMER0_CHANNEL0);
+  TimerStop(TIMER0_CHANNEL1);
+
+  /* Peripheral A for the phases and the index */
+  AT91C_BASE_PIOA->PIO_ABSR &= ~TIMER_QUADRATURE_PIOA_PINS;
+  AT91C_BASE_PIOA->PIO_PDR = TIMER_QUADRATURE_PIOA_PINS;
+  if(bIndex_)
+  {
+    AT91C_BASE_PIOB->PIO_ABSR &= ~TIMER_QUADRATURE_INDEX_PIN;
+    AT91C_BASE_PIOB->PIO_PDR = TIMER_QUADRATURE_INDEX_PIN;
+  }
+
+  AT91C_BASE_TCB0->TCB_BMR = TCB_BMR_QUADRATURE;
+
+  /* Only TC0 is reset by the index; TC1 just counts it */
+  TIMER_CHANNEL_BASE(TIMER0_CHANNEL0)->TC_CMR = bIndex_ ? TIMER_TC_CMR_QUADRATURE :
+                                                          (TIMER_TC_CMR_QUADRATURE & AT91C_TC_CLKS);
+  TIMER_CHANNEL_BASE(TIMER0_CHANNEL1)->TC_CMR = TIMER_TC_CMR_QUADRATURE & AT91C_TC_CLKS;
+  Timer_asChannels[0].eMode = TIMER_QUADRATURE;
+  Timer_asChannels[1].eMode = TIMER_QUADRATURE;
+
+  Timer_bQuadratureIndex = bIndex_;
+  Timer_s32QuadraturePosition = 0;
+  Timer_u16QuadratureLast = 0;
+
+  TIMER_CHANNEL_BASE(TIMER0_CHANNEL0)->TC_CCR = TIMER_TC_CCR_START;
+  TIMER_CHANNEL_BASE(TIMER0_CHANNEL1)->TC_CCR = TIMER_TC_CCR_START;
+
+  if(!bIndex_)
+  {
+    TimerSoftCreate(&Timer_sQuadraturePoll, U32_TIMER_QUADRATURE_POLL_MS, TIMER_PERIODIC, TimerQuadraturePoll, NULL);
+    TimerSoftStart(&Timer_sQuadraturePoll);
+  }
+
+  return(TRUE);
+
+} /* end TimerQuadratureStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerQuadratureStop(void)
+
+@brief Stops the quadrature decoder and gives its pins back to the PIO.
+
+Requires:
+- NONE
+
+Promises:
+- If the decoder was running, TCB_BMR is back to TCB_BMR_INIT and TC0 / TC1 are
+  stopped as TimerInitialize() left them
+
+*/
+void TimerQuadratureStop(void)
+{
+  if(Timer_asChannels[0].eMode != TIMER_QUADRATURE)
+  {
+    return;
+  }
+
+  TimerSoftStop(&Timer_sQuadraturePoll);
+
+  for(u8 i = 0; i < 2; i++)
+  {
+    TimerStop( (TimerChannelType)(i * TIMER0_CHANNEL1) );
+    TIMER_CHANNEL_BASE(i * TIMER0_CHANNEL1)->TC_CMR = TIMER_TC_CMR_INIT;
+    Timer_asChannels[i].eMode = TIMER_PERIODIC;
+  }
+
+  AT91C_BASE_TCB0->TCB_BMR = TCB_BMR_INIT;
+  AT91C_BASE_PIOA->PIO_PER = TIMER_QUADRATURE_PIOA_PINS;
+  if(Timer_bQuadratureIndex)
+  {
+    AT91C_BASE_PIOB->PIO_PER = TIMER_QUADRATURE_INDEX_PIN;
+  }
+
+} /* end TimerQuadratureStop() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn s32 TimerQuadratureGetPosition(void)
+
+@brief Returns the encoder position in counts (4 per line).
+
+Requires:
+- The decoder is running; call from a task
+
+Promises:
+- With the index: returns the counts since the last index pulse (negative when
+  turning backwards)
+- Without it: returns the counts since TimerQuadratureStart()
+
+*/
+s32 TimerQuadratureGetPosition(void)
+{
+  if(Timer_bQuadratureIndex)
+  {
+    return( (s16)TimerGetTime(TIMER0_CHANNEL0) );
+  }
+
+  TimerQuadraturePoll(NULL);
+  return(Timer_s32QuadraturePosition);
+
+} /* end TimerQuadratureGetPosition() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn s16 TimerQuadratureGetRevolutions(void)
+
+@brief Returns the index pulses counted by TC1.
+
+Requires:
+- The decoder was started with the index
+
+Promises:
+- Returns the revolutions since TimerQuadratureStart(), counted down when turning backwards
+
+*/
+s16 TimerQuadratureGetRevolutions(void)
+{
+  return( (s16)TimerGetTime(TIMER0_CHANNEL1) );
+
+} /* end TimerQuadratureGetRevolutions() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!--------------------------------------------------------------------------------------------------------------------
+@fn void TimerInitialize(void)
+
+@brief Initializes the State Machine and its variables.
+
+Requires:
+- The TC0, TC1 and TC2 peripheral clocks are enabled (PMC_PCER_INIT)
+
+Promises:
+- Every channel the driver owns is stopped, periodic on TIMER_CLOCK4 with TC_RC at
+  TIMER_TC_RC_INIT, no callback and its NVIC interrupt enabled
+- The software timer wheel is empty
+
+*/
+void TimerInitialize(void)
+{
+  AT91PS_TC psTc;
+
+  /* Load the block configuration regusters*/
+  AT91C_BASE_TCB0->TCB_BMR = TCB_BMR_INIT;
+
+  /* Load the settings of each channel the driver owns */
+  for(u8 i = 0; i < U8_TIMER_CHANNELS; i++)
+  {
+    if(TIMER_RESERVED_CHANNELS & (1 << i))
+    {
+      continue;
+    }
+
+    psTc = TIMER_CHANNEL_BASE(i * TIMER0_CHANNEL1);
+    psTc->TC_CCR = TIMER_TC_CCR_STOP;
+    psTc->TC_IDR = TIMER_TC_IDR_INIT;
+    psTc->TC_CMR = TIMER_TC_CMR_INIT;
+    psTc->TC_RC  = TIMER_TC_RC_INIT;
+
+    Timer_asChannels[i].pfnCallback = NULL;
+    Timer_asChannels[i].pvContext   = NULL;
+    Timer_asChannels[i].eMode       = TIMER_PERIODIC;
+
+    NVIC_ClearPendingIRQ( (IRQn_Type)(IRQn_TC0 + i) );
+    NVIC_EnableIRQ( (IRQn_Type)(IRQn_TC0 + i) );
+  }
+
+  /* Empty timer wheel */
+  for(u8 i = 0; i < U8_TIMER_WHEEL_LEVELS; i++)
+  {
+    Timer_au32WheelOccupied[i] = 0;
+  }
+  Timer_u32WheelTime = G_u32SystemTime1ms;
+  Timer_bWheelBusy = FALSE;
+
+  /* If good initialization, set state to Idle */
+  if( 1 )
+  {
+    Timer_StateMachine = TimerSM_Idle;
+  }
+  else
+  {
+    /* The task isn't properly initialized, so shut it down and don't run */
+    Timer_StateMachine = TimerSM_Error;
+  }
+
+} /* end TimerInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TimerRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void TimerRunActiveState(void)
+{
+  Timer_StateMachine();
+
+} /* end TimerRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TimerIsIdle(void)
+
+@brief Reports whether the timer task has any work this tick (used by the main loop scheduler).
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE while the state machine is in TimerSM_Idle and no software timer slot
+  is due
+
+*/
+bool TimerIsIdle(void)
+{
+  return( (bool)( (Timer_StateMachine == TimerSM_Idle) &&
+                  (!Timer_bWheelBusy || TIME_IS_AFTER(Timer_u32WheelNext, G_u32SystemTime1ms)) ) );
+
+} /* end TimerIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 TimerNextDeadline(void)
+
+@brief Reports how many ms until the timer wheel next has a slot to process (used by
+the main loop scheduler).
+
+Requires:
+- NONE
+
+Promises:
+- Returns the ms until the next non-empty wheel slot (at least 1), or U32_NO_DEADLINE
+  if no software timer is running
+
+*/
+u32 TimerNextDeadline(void)
+{
+  u32 u32Deadline;
+
+  if(!Timer_bWheelBusy)
+  {
+    return(U32_NO_DEADLINE);
+  }
+
+  u32Deadline = Timer_u32WheelNext - G_u32SystemTime1ms;
+  if((s32)u32Deadline <= 0)
+  {
+    return(1);
+  }
+
+  return(u32Deadline);
+
+} /* end TimerNextDeadline() */
+
+
+#ifndef EIE_KEYPAD
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void TC0_IrqHandler(void)
+
+@brief Services TC0 for the timer driver (the keypad owns TC0 in EIE_KEYPAD builds).
+
+Requires:
+- NONE
+
+Promises:
+- See TimerChannelInterrupt()
+
+*/
+void TC0_IrqHandler(void)
+{
+  TRACE_ISR_ENTER(IRQn_TC0);
+  TimerChannelInterrupt(TIMER0_CHANNEL0);
+  TRACE_ISR_EXIT(IRQn_TC0);
+
+} /* end TC0_IrqHandler() */
+#endif /* EIE_KEYPAD */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void TC1_IrqHandler(void)
+
+@brief Services TC1 for the timer driver.
+
+Requires:
+- NONE
+
+Promises:
+- See TimerChannelInterrupt()
+
+*/
+void TC1_IrqHandler(void)
+{
+  TRACE_ISR_ENTER(IRQn_TC1);
+  TimerChannelInterrupt(TIMER0_CHANNEL1);
+  TRACE_ISR_EXIT(IRQn_TC1);
+
+} /* end TC1_IrqHandler() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool TimerChannelAvailable(TimerChannelType eTimerChannel_)
+
+@brief Checks that a channel is one the timer driver runs.
+
+Requires:
+@param eTimerChannel_ is any value
+
+Promises:
+- Returns TRUE for TIMER0_CHANNEL0..2 that are not in TIMER_RESERVED_CHANNELS
+
+*/
+static bool TimerChannelAvailable(TimerChannelType eTimerChannel_)
+{
+  if( (eTimerChannel_ != TIMER0_CHANNEL0) && (eTimerChannel_ != TIMER0_CHANNEL1) &&
+      (eTimerChannel_ != TIMER0_CHANNEL2) )
+  {
+    return(FALSE);
+  }
+
+  return( (bool)!(TIMER_RESERVED_CHANNELS & (1 << TIMER_CHANNEL_INDEX(eTimerChannel_))) );
+
+} /* end TimerChannelAvailable() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerChannelInterrupt(TimerChannelType eTimerChannel_)
+
+@brief Handles the RC compare or the captures of a channel the driver owns.
+
+Note that all enabled interrupts of a channel are ORed and will trigger this handler,
+therefore, any expected interrupt that is enabled must be parsed out and handled.
+
+Requires:
+@param eTimerChannel_ is an available channel
+
+Promises:
+- On RC compare: a one shot channel (already stopped by CPCDIS) has its interrupt
+  disabled, then the callback is called with its context
+- A capturing channel's loads and overflows go to TimerCaptureInterrupt()
+- The channel's NVIC pending flag is cleared
+
+*/
+static void TimerChannelInterrupt(TimerChannelType eTimerChannel_)
+{
+  AT91PS_TC psTc = TIMER_CHANNEL_BASE(eTimerChannel_);
+  TimerChannelStatusType* psChannel = &Timer_asChannels[TIMER_CHANNEL_INDEX(eTimerChannel_)];
+  u32 u32Status;
+
+  /* READING THE TC_SR clears every flag, so it is read once */
+  u32Status = psTc->TC_SR & psTc->TC_IMR;
+
+  if(psChannel->eMode == TIMER_CAPTURE)
+  {
+    TimerCaptureInterrupt(eTimerChannel_, u32Status);
+  }
+
+  /* Check for RC compare interrupt */
+  if( u32Status & AT91C_TC_CPCS )
+  {
+    /* Disable first so a callback can start the channel again */
+    if(psChannel->eMode == TIMER_ONE_SHOT)
+    {
+      psTc->TC_IDR = AT91C_TC_CPCS;
+    }
+
+    if(psChannel->pfnCallback != NULL)
+    {
+      psChannel->pfnCallback(psChannel->pvContext);
+    }
+  }
+
+  /* Clear the pending flag and exit */
+  NVIC_ClearPendingIRQ( (IRQn_Type)(IRQn_TC0 + TIMER_CHANNEL_INDEX(eTimerChannel_)) );
+
+} /* end TimerChannelInterrupt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerCaptureInterrupt(TimerChannelType eTimerChannel_, u32 u32Status_)
+
+@brief Turns RA / RB loads into 32-bit time stamps and passes them on in the order they happened.
+
+A time stamp is the overflow count above the 16-bit capture.  If the counter wrapped
+in the same interrupt, a small capture value was taken after the wrap and a large one
+before it (the interrupt is never half a wrap late).
+
+Requires:
+@param eTimerChannel_ is a capturing channel
+@param u32Status_ is its TC_SR masked with TC_IMR
+
+Promises:
+- Each load is handed to TimerCaptureEdge() (RA is the start edge), earliest first
+- u32Overflows counts the wrap
+
+*/
+static void TimerCaptureInterrupt(TimerChannelType eTimerChannel_, u32 u32Status_)
+{
+  AT91PS_TC psTc = TIMER_CHANNEL_BASE(eTimerChannel_);
+  u8 u8Index = TIMER_CHANNEL_INDEX(eTimerChannel_);
+  TimerChannelStatusType* psChannel = &Timer_asChannels[u8Index];
+  u32 au32Stamps[2];
+  bool abLoaded[2];
+  u32 u32Value;
+
+  abLoaded[0] = (bool)((u32Status_ & AT91C_TC_LDRAS) != 0);
+  abLoaded[1] = (bool)((u32Status_ & AT91C_TC_LDRBS) != 0);
+
+  for(u8 i = 0; i < 2; i++)
+  {
+    if(abLoaded[i])
+    {
+      u32Value = (i == 0) ? (psTc->TC_RA & 0xFFFF) : (psTc->TC_RB & 0xFFFF);
+      au32Stamps[i] = ( (psChannel->u32Overflows +
+                         (((u32Status_ & AT91C_TC_COVFS) && (u32Value < 0x8000)) ? 1 : 0)) << 16 ) | u32Value;
+    }
+  }
+
+  /* RB first if both loaded and it is the older one */
+  if( abLoaded[0] && abLoaded[1] && ((s32)(au32Stamps[1] - au32Stamps[0]) < 0) )
+  {
+    TimerCaptureEdge(psChannel, u8Index, au32Stamps[1], FALSE);
+    abLoaded[1] = FALSE;
+  }
+
+  if(abLoaded[0])
+  {
+    TimerCaptureEdge(psChannel, u8Index, au32Stamps[0], TRUE);
+  }
+  if(abLoaded[1])
+  {
+    TimerCaptureEdge(psChannel, u8Index, au32Stamps[1], FALSE);
+  }
+
+  if(u32Status_ & AT91C_TC_COVFS)
+  {
+    psChannel->u32Overflows++;
+  }
+
+} /* end TimerCaptureInterrupt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerCaptureEdge(TimerChannelStatusType* psChannel_, u8 u8Channel_, u32 u32Stamp_, bool bStartEdge_)
+
+@brief Measures from the last start edge and queues a finished period.
+
+Requires:
+@param psChannel_ is the capturing channel's status
+@param u8Channel_ is its index
+@param u32Stamp_ is the 32-bit time stamp of the edge
+@param bStartEdge_ is TRUE for the start edge (RA), FALSE for the opposite edge (RB)
+
+Promises:
+- Opposite edge: u32ActiveTicks is the time since the start edge
+- Start edge: the period since the last start edge is queued with its active time (0
+  if the opposite edge was missed) unless the last start is too old to measure or the
+  queue is full; this edge becomes the start of the next period
+
+*/
+static void TimerCaptureEdge(TimerChannelStatusType* psChannel_, u8 u8Channel_, u32 u32Stamp_, bool bStartEdge_)
+{
+  u8 u8Head;
+  u8 u8Next;
+
+  if(!bStartEdge_)
+  {
+    if(psChannel_->bStarted)
+    {
+      psChannel_->u32ActiveTicks = u32Stamp_ - psChannel_->u32StartStamp;
+      psChannel_->bActive = TRUE;
+    }
+    return;
+  }
+
+  if( psChannel_->bStarted &&
+      ((psChannel_->u32Overflows - psChannel_->u32StartOverflows) < U32_TIMER_CAPTURE_STALE) )
+  {
+    u8Head = Timer_au8CaptureHead[u8Channel_];
+    u8Next = (u8)((u8Head + 1) & (U8_TIMER_CAPTURE_BUFFER - 1));
+
+    /* Full: the reader is behind, so the newest period is dropped */
+    if(u8Next != Timer_au8CaptureTail[u8Channel_])
+    {
+      Timer_aasCaptures[u8Channel_][u8Head].u32PeriodTicks = u32Stamp_ - psChannel_->u32StartStamp;
+      Timer_aasCaptures[u8Channel_][u8Head].u32ActiveTicks = psChannel_->bActive ? psChannel_->u32ActiveTicks : 0;
+
+      /* The entry must be complete before TimerCaptureRead() can see it */
+      __DMB();
+      Timer_au8CaptureHead[u8Channel_] = u8Next;
+    }
+  }
+
+  psChannel_->u32StartStamp = u32Stamp_;
+  psChannel_->u32StartOverflows = psChannel_->u32Overflows;
+  psChannel_->bStarted = TRUE;
+  psChannel_->bActive = FALSE;
+
+} /* end TimerCaptureEdge() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerCapturePin(TimerChannelType eTimerChannel_, bool bPeripheral_)
+
+@brief Gives a channel's TIOA pin to the TC (peripheral A) or back to the PIO.
+
+Requires:
+@param eTimerChannel_ is an available channel
+@param bPeripheral_ is TRUE to hand the pin to the TC
+
+Promises:
+- The pin from G_asBspTimerTioaPins is under TC or PIO control
+
+*/
+static void TimerCapturePin(TimerChannelType eTimerChannel_, bool bPeripheral_)
+{
+  const PinConfigurationType* psPin = &G_asBspTimerTioaPins[TIMER_CHANNEL_INDEX(eTimerChannel_)];
+
+  if(bPeripheral_)
+  {
+    *(&(AT91C_BASE_PIOA->PIO_ABSR) + psPin->ePort) &= ~psPin->u32BitPosition;
+    *(&(AT91C_BASE_PIOA->PIO_PDR) + psPin->ePort) = psPin->u32BitPosition;
+  }
+  else
+  {
+    *(&(AT91C_BASE_PIOA->PIO_PER) + psPin->ePort) = psPin->u32BitPosition;
+  }
+
+} /* end TimerCapturePin() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerQuadraturePoll(void* pvContext_)
+
+@brief Folds the 16-bit TC0 count into the 32-bit position (decoder without index).
+
+The position can move at most 32767 counts between calls (3.2M counts/s at
+U32_TIMER_QUADRATURE_POLL_MS).
+
+Requires:
+@param pvContext_ is unused (Timer_sQuadraturePoll callback)
+
+Promises:
+- Timer_s32QuadraturePosition has the counts since the last call added
+
+*/
+static void TimerQuadraturePoll(void* pvContext_)
+{
+  u16 u16Count = TimerGetTime(TIMER0_CHANNEL0);
+
+  (void)pvContext_;
+  Timer_s32QuadraturePosition += (s16)(u16)(u16Count - Timer_u16QuadratureLast);
+  Timer_u16QuadratureLast = u16Count;
+
+} /* end TimerQuadraturePoll() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerWheelInsert(TimerSoftType* psTimer_)
+
+@brief Puts a software timer in the wheel slot for its expiry.
+
+The level is the smallest one whose span holds the time left, so a timer only moves
+down when the slot it is in comes up.  A timer moved down in the tick it expires goes
+in the current level 0 slot, which that tick processes next; one past due goes in the
+next tick's slot and one beyond U32_TIMER_WHEEL_SPAN goes round the top level again.
+
+Requires:
+- psTimer_ is not on the wheel and u32Expiry is set
+
+Promises:
+- psTimer_ is first in its slot and the slot is marked in Timer_au32WheelOccupied
+
+*/
+static void TimerWheelInsert(TimerSoftType* psTimer_)
+{
+  TimerSoftType** ppsHead;
+  u32 u32SlotTime = psTimer_->u32Expiry;
+  u32 u32Delta = psTimer_->u32Expiry - Timer_u32WheelTime;
+  u8 u8Level = 0;
+
+  if((s32)u32Delta < 0)
+  {
+    u32Delta = 1;
+    u32SlotTime = Timer_u32WheelTime + 1;
+  }
+  else if(u32Delta >= U32_TIMER_WHEEL_SPAN)
+  {
+    u32Delta = U32_TIMER_WHEEL_SPAN - 1;
+    u32SlotTime = Timer_u32WheelTime + u32Delta;
+  }
+
+  while( u32Delta >= ((u32)1 << (U8_TIMER_WHEEL_SLOT_BITS * (u8Level + 1))) )
+  {
+    u8Level++;
+  }
+
+  psTimer_->u8Slot = (u8)( (u8Level * U8_TIMER_WHEEL_SLOTS) +
+                           ((u32SlotTime >> (U8_TIMER_WHEEL_SLOT_BITS * u8Level)) & (U8_TIMER_WHEEL_SLOTS - 1)) );
+
+  ppsHead = &Timer_apsWheel[psTimer_->u8Slot];
+  psTimer_->psNext = *ppsHead;
+  if(*ppsHead != NULL)
+  {
+    (*ppsHead)->ppsPrev = &psTimer_->psNext;
+  }
+  *ppsHead = psTimer_;
+  psTimer_->ppsPrev = ppsHead;
+
+  Timer_au32WheelOccupied[u8Level] |= (u32)1 << (psTimer_->u8Slot & (U8_TIMER_WHEEL_SLOTS - 1));
+
+} /* end TimerWheelInsert() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerWheelUnlink(TimerSoftType* psTimer_)
+
+@brief Takes a software timer out of its slot (or a list taken from a slot).
+
+Requires:
+- psTimer_ is on the wheel (ppsPrev is not NULL)
+
+Promises:
+- psTimer_ is unlinked with ppsPrev NULL; an emptied slot is cleared in
+  Timer_au32WheelOccupied
+
+*/
+static void TimerWheelUnlink(TimerSoftType* psTimer_)
+{
+  *psTimer_->ppsPrev = psTimer_->psNext;
+  if(psTimer_->psNext != NULL)
+  {
+    psTimer_->psNext->ppsPrev = psTimer_->ppsPrev;
+  }
+  psTimer_->ppsPrev = NULL;
+
+  if(Timer_apsWheel[psTimer_->u8Slot] == NULL)
+  {
+    Timer_au32WheelOccupied[psTimer_->u8Slot / U8_TIMER_WHEEL_SLOTS] &=
+      ~((u32)1 << (psTimer_->u8Slot & (U8_TIMER_WHEEL_SLOTS - 1)));
+  }
+
+} /* end TimerWheelUnlink() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerWheelTick(void)
+
+@brief Moves the wheel on one ms and expires the timers in that slot.
+
+Requires:
+- Timer_u32WheelTime + 1 is at most the current G_u32SystemTime1ms
+
+Promises:
+- Timer_u32WheelTime is incremented
+- Every higher level slot that starts now is moved down (highest level first, as its
+  timers can land in a lower slot that is moved in the same tick)
+- Each timer in the level 0 slot sets its flag and calls its callback; a periodic
+  timer goes back on the wheel first so the callback can stop it
+
+*/
+static void TimerWheelTick(void)
+{
+  TimerSoftType* psList;
+  TimerSoftType* psTimer;
+  u8 u8Slot;
+
+  Timer_u32WheelTime++;
+
+  for(u8 i = U8_TIMER_WHEEL_LEVELS - 1; i > 0; i--)
+  {
+    if( (Timer_u32WheelTime & (((u32)1 << (U8_TIMER_WHEEL_SLOT_BITS * i)) - 1)) == 0 )
+    {
+      u8Slot = (u8)( (i * U8_TIMER_WHEEL_SLOTS) +
+                     ((Timer_u32WheelTime >> (U8_TIMER_WHEEL_SLOT_BITS * i)) & (U8_TIMER_WHEEL_SLOTS - 1)) );
+
+      /* Take the whole slot so re-inserted timers can't be seen twice */
+      psList = Timer_apsWheel[u8Slot];
+      Timer_apsWheel[u8Slot] = NULL;
+      if(psList != NULL)
+      {
+        psList->ppsPrev = &psList;
+      }
+
+      while(psList != NULL)
+      {
+        psTimer = psList;
+        TimerWheelUnlink(psTimer);
+        TimerWheelInsert(psTimer);
+      }
+    }
+  }
+
+  u8Slot = (u8)(Timer_u32WheelTime & (U8_TIMER_WHEEL_SLOTS - 1));
+  psList = Timer_apsWheel[u8Slot];
+  Timer_apsWheel[u8Slot] = NULL;
+  if(psList != NULL)
+  {
+    psList->ppsPrev = &psList;
+  }
+
+  /* A callback may stop or start any timer, including ones still in psList */
+  while(psList != NULL)
+  {
+    psTimer = psList;
+    TimerWheelUnlink(psTimer);
+
+    /* Parked here on its way round the top level */
+    if( TIME_IS_AFTER(psTimer->u32Expiry, Timer_u32WheelTime) )
+    {
+      TimerWheelInsert(psTimer);
+      continue;
+    }
+
+    if(psTimer->eMode == TIMER_PERIODIC)
+    {
+      psTimer->u32Expiry += (psTimer->u32PeriodMs != 0) ? psTimer->u32PeriodMs : 1;
+
+      /* A whole period behind (the loop was held up): skip the expiries that were missed */
+      if( !TIME_IS_AFTER(psTimer->u32Expiry, Timer_u32WheelTime) )
+      {
+        psTimer->u32Expiry = Timer_u32WheelTime + psTimer->u32PeriodMs;
+      }
+      TimerWheelInsert(psTimer);
+    }
+
+    psTimer->bExpired = TRUE;
+    if(psTimer->pfnCallback != NULL)
+    {
+      psTimer->pfnCallback(psTimer->pvContext);
+    }
+  }
+
+} /* end TimerWheelTick() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TimerWheelPlan(void)
+
+@brief Finds when the wheel next has a non-empty slot to process.
+
+Requires:
+- Timer_au32WheelOccupied is up to date
+
+Promises:
+- Timer_bWheelBusy is TRUE if any slot has a timer, and Timer_u32WheelNext is the
+  earliest time one of them comes up (a higher level slot comes up when it is moved
+  down, which may be before its timers expire)
+
+*/
+static void TimerWheelPlan(void)
+{
+  u32 u32Rotated;
+  u32 u32Time;
+  u8 u8Shift;
+  u8 u8Next;
+
+  Timer_bWheelBusy = FALSE;
+  for(u8 i = 0; i < U8_TIMER_WHEEL_LEVELS; i++)
+  {
+    if(Timer_au32WheelOccupied[i] == 0)
+    {
+      continue;
+    }
+
+    /* Rotate bit 0 to the slot after the current one: the lowest set bit is the next due */
+    u8Shift = (u8)(U8_TIMER_WHEEL_SLOT_BITS * i);
+    u8Next = (u8)( ((Timer_u32WheelTime >> u8Shift) + 1) & (U8_TIMER_WHEEL_SLOTS - 1) );
+    u32Rotated = Timer_au32WheelOccupied[i];
+    if(u8Next != 0)
+    {
+      u32Rotated = (u32Rotated >> u8Next) | (u32Rotated << (U8_TIMER_WHEEL_SLOTS - u8Next));
+    }
+
+    u32Time = ( (Timer_u32WheelTime >> u8Shift) + 1 + (31 - __CLZ(u32Rotated & (0 - u32Rotated))) ) << u8Shift;
+    if( !Timer_bWheelBusy || TIME_IS_AFTER(Timer_u32WheelNext, u32Time) )
+    {
+      Timer_u32WheelNext = u32Time;
+    }
+    Timer_bWheelBusy = TRUE;
+  }
+
+} /* end TimerWheelPlan() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void TimerSM_Idle(void)
+
+@brief Brings the software timer wheel up to the current time.
+
+The channels are serviced from their interrupts.  The scheduler skips this state until
+the next wheel slot is due, so it jumps over the time that went by with nothing to do
+and ticks only the slots that have timers.
+*/
+static void TimerSM_Idle(void)
+{
+  u32 u32Now = G_u32SystemTime1ms;
+
+  while(Timer_u32WheelTime != u32Now)
+  {
+    if( !Timer_bWheelBusy || TIME_IS_AFTER(Timer_u32WheelNext, u32Now) )
+    {
+      Timer_u32WheelTime = u32Now;
+      break;
+    }
+
+    Timer_u32WheelTime = Timer_u32WheelNext - 1;
+    TimerWheelTick();
+    TimerWheelPlan();
+  }
+
+} /* end TimerSM_Idle() */
+
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Handle an error */
+static void TimerSM_Error(void)
+{
+
 } /* end TimerSM_Error() */
 
 
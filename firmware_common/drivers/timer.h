@@ -1,5 +1,5 @@
 /*!**********************************************************************************************************************
-@file timer.h                                                                
+@file timer.h
 @brief Header file for timer.c
 
 **********************************************************************************************************************/
@@ -10,46 +10,150 @@
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
-/*! 
+/*!
 @enum TimerChannelType
-@brief  Controlled list of avalable timer channels used in the member functions */
+@brief  Controlled list of avalable timer channels used in the member functions (offset of the channel from TC0) */
 typedef enum {TIMER0_CHANNEL0 = 0, TIMER0_CHANNEL1 = 0x40, TIMER0_CHANNEL2 = 0x80
 } TimerChannelType;
+
+/*!
+@enum TimerModeType
+@brief What a channel does when it reaches its period, or the input mode it was started in */
+typedef enum {TIMER_PERIODIC = 0, TIMER_ONE_SHOT, TIMER_CAPTURE, TIMER_QUADRATURE
+} TimerModeType;
+
+/*!
+@enum TimerCaptureEdgeType
+@brief Edge of the capture input that starts each period (the active part of the period
+runs from it to the opposite edge) */
+typedef enum {TIMER_CAPTURE_RISING = 0, TIMER_CAPTURE_FALLING
+} TimerCaptureEdgeType;
+
+/*!
+@struct TimerCaptureType
+@brief One period of a capture input in ticks of the channel's clock (TimerCaptureTickHz()) */
+typedef struct
+{
+  u32 u32PeriodTicks;                     /*!< @brief Start edge to the next start edge */
+  u32 u32ActiveTicks;                     /*!< @brief Start edge to the opposite edge */
+} TimerCaptureType;
+
+/*! @brief Function called from a channel's interrupt at the end of each period */
+typedef void(*TimerCallbackType)(void* pvContext_);
+
+/*!
+@struct TimerChannelStatusType
+@brief Callback and mode of one channel */
+typedef struct
+{
+  TimerCallbackType pfnCallback;          /*!< @brief Called from the channel interrupt, or NULL */
+  void* pvContext;                        /*!< @brief Passed to pfnCallback */
+  TimerModeType eMode;                    /*!< @brief Set by TimerSetPeriodUs(), TimerCaptureStart() or TimerQuadratureStart() */
+  u32 u32Overflows;                       /*!< @brief Capture: counter wraps, the upper bits of each time stamp */
+  u32 u32StartStamp;                      /*!< @brief Capture: time stamp of the last start edge */
+  u32 u32StartOverflows;                  /*!< @brief Capture: u32Overflows at the last start edge */
+  u32 u32ActiveTicks;                     /*!< @brief Capture: active part of the period being measured */
+  bool bStarted;                          /*!< @brief Capture: u32StartStamp is valid */
+  bool bActive;                           /*!< @brief Capture: u32ActiveTicks is valid */
+} TimerChannelStatusType;
+
+/*!
+@struct TimerSoftType
+@brief A software timer on the timer wheel.  The app owns the memory (usually a static);
+only the TimerSoft functions should touch the fields. */
+typedef struct TimerSoftStruct
+{
+  struct TimerSoftStruct* psNext;         /*!< @brief Next timer in the same wheel slot */
+  struct TimerSoftStruct** ppsPrev;       /*!< @brief The pointer that points at this timer, NULL while stopped */
+  u32 u32Expiry;                          /*!< @brief G_u32SystemTime1ms when the timer expires */
+  u32 u32PeriodMs;                        /*!< @brief Time from start to expiry (and between expiries) */
+  TimerModeType eMode;                    /*!< @brief TIMER_PERIODIC or TIMER_ONE_SHOT */
+  TimerCallbackType pfnCallback;          /*!< @brief Called from the timer task on expiry, or NULL */
+  void* pvContext;                        /*!< @brief Passed to pfnCallback */
+  u8 u8Slot;                              /*!< @brief Wheel slot while running (level * U8_TIMER_WHEEL_SLOTS + slot) */
+  bool bExpired;                          /*!< @brief Set on expiry, cleared by TimerSoftExpired() */
+} TimerSoftType;
+
+
 /**********************************************************************************************************************
 Function Declarations
 **********************************************************************************************************************/
 
 /*------------------------------------------------------------------------------------------------------------------*/
-/*! @publicsection */                                                                                            
+/*! @publicsection */
 /*--------------------------------------------------------------------------------------------------------------------*/
 void TimerSet(TimerChannelType eTimerChannel_, u16 u16TimerValue_);
+bool TimerSetPeriodUs(TimerChannelType eTimerChannel_, u32 u32PeriodUs_, TimerModeType eMode_);
 void TimerStart(TimerChannelType eTimerChannel_ );
 void TimerStop(TimerChannelType eTimerChannel_ );
 u16 TimerGetTime(TimerChannelType eTimerChannel_ );
-void TimerAssignCallback(TimerChannelType eTimerChannel_, fnCode_type fpUserCallback);
+bool TimerAssignCallback(TimerChannelType eTimerChannel_, TimerCallbackType pfnCallback_, void* pvContext_);
+
+bool TimerCaptureStart(TimerChannelType eTimerChannel_, u32 u32MaxPeriodUs_, TimerCaptureEdgeType eStartEdge_);
+void TimerCaptureStop(TimerChannelType eTimerChannel_);
+bool TimerCaptureRead(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_);
+u8 TimerCaptureAverage(TimerChannelType eTimerChannel_, TimerCaptureType* psAverage_);
+u32 TimerCaptureTickHz(TimerChannelType eTimerChannel_);
+u32 TimerCaptureFrequencyMilliHz(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_);
+u32 TimerCapturePeriodUs(TimerChannelType eTimerChannel_, TimerCaptureType* psCapture_);
+u16 TimerCaptureDutyPermille(TimerCaptureType* psCapture_);
+
+bool TimerQuadratureStart(bool bIndex_);
+void TimerQuadratureStop(void);
+s32 TimerQuadratureGetPosition(void);
+s16 TimerQuadratureGetRevolutions(void);
+
+void TimerSoftCreate(TimerSoftType* psTimer_, u32 u32PeriodMs_, TimerModeType eMode_,
+                     TimerCallbackType pfnCallback_, void* pvContext_);
+void TimerSoftStart(TimerSoftType* psTimer_);
+void TimerSoftRestart(TimerSoftType* psTimer_, u32 u32PeriodMs_);
+void TimerSoftStop(TimerSoftType* psTimer_);
+bool TimerSoftExpired(TimerSoftType* psTimer_);
+bool TimerSoftIsRunning(TimerSoftType* psTimer_);
 
 /*------------------------------------------------------------------------------------------------------------------*/
-/*! @protectedsection */                                                                                            
+/*! @protectedsection */
 /*--------------------------------------------------------------------------------------------------------------------*/
 void TimerInitialize(void);
 void TimerRunActiveState(void);
+bool TimerIsIdle(void);
+u32 TimerNextDeadline(void);
 
-
-/*------------------------------------------------------------------------------------------------------------------*/
-/*! @privatesection */                                                                                            
-/*--------------------------------------------------------------------------------------------------------------------*/
-
-
-/***********************************************************************************************************************
-State Machine Declarations
-***********************************************************************************************************************/
-static void TimerSM_Idle(void);    
-static void TimerSM_Error(void);         
+#ifndef EIE_KEYPAD
+void TC0_IrqHandler(void);
+#endif /* EIE_KEYPAD */
+void TC1_IrqHandler(void);
 
 
 /**********************************************************************************************************************
 Constants / Definitions
 **********************************************************************************************************************/
+#define U8_TIMER_CHANNELS         (u8)3         /*!< @brief Channels of TCB0 */
+#define TIMER_CHANNEL_INDEX(eTimerChannel_)  ((u8)((u32)(eTimerChannel_) >> 6)) /*!< @brief 0-2 from a TimerChannelType */
+#define TIMER_CHANNEL_BASE(eTimerChannel_)   ((AT91PS_TC)((u8*)AT91C_BASE_TC0 + (u32)(eTimerChannel_))) /*!< @brief Registers of a channel */
+
+/*! @brief Channels run by other drivers (bit n = channel n): TC2 is the LED PWM (leds.c)
+and TC0 the keypad scan in EIE_KEYPAD builds (keypad.c) */
+#ifdef EIE_KEYPAD
+#define TIMER_RESERVED_CHANNELS   (u8)0x05
+#else
+#define TIMER_RESERVED_CHANNELS   (u8)0x04
+#endif /* EIE_KEYPAD */
+
+#define U8_TIMER_MCK_CLOCKS       (u8)4         /*!< @brief TIMER_CLOCK1..4 are MCK / Timer_au8ClockDividers[] */
+#define U32_TIMER_MAX_TICKS       (u32)0xFFFF   /*!< @brief Largest RC */
+#define U32_TIMER_MAX_PERIOD_US   (u32)( ((u64)U32_TIMER_MAX_TICKS * 1000000) / U32_SLCK_VALUE ) /*!< @brief Just under 2s on TIMER_CLOCK5 */
+
+#define U8_TIMER_CAPTURE_BUFFER   (u8)16        /*!< @brief Captures held per channel (power of 2) */
+#define U32_TIMER_CAPTURE_STALE   (u32)0xFFFF   /*!< @brief Counter wraps after which a period can't be measured (32-bit time stamps) */
+#define U32_TIMER_QUADRATURE_POLL_MS (u32)10    /*!< @brief How often the 16-bit position count is folded into the 32-bit position */
+
+/* Software timer wheel: each level has 32 slots of 32x the length of the level below
+(1ms, 32ms, 1.024s, 32.8s) so one level spans 32ms, 1.024s, 32.8s and 17.5 minutes */
+#define U8_TIMER_WHEEL_LEVELS     (u8)4         /*!< @brief Levels of the wheel */
+#define U8_TIMER_WHEEL_SLOT_BITS  (u8)5         /*!< @brief log2 of the slots per level */
+#define U8_TIMER_WHEEL_SLOTS      (u8)(1 << U8_TIMER_WHEEL_SLOT_BITS) /*!< @brief Slots per level (one bit each in a u32) */
+#define U32_TIMER_WHEEL_SPAN      ((u32)1 << (U8_TIMER_WHEEL_LEVELS * U8_TIMER_WHEEL_SLOT_BITS)) /*!< @brief ms the wheel spans; longer timers go round the top level again */
 
 
 //This should be in eief1-pcb-01.h as it is board specific!
@@ -66,29 +170,44 @@ TIMER_CLOCK4 = MCK/128 (2.67us / tick)
 TIMER_CLOCK5(1) SLCK
 
 PA0 is an open pin available for TIOB0
-PA26 is an open pin availble as external clock input TCLK2 if set for Peripheral B function 
-PB5 is an open pin available for TIOA1 I/O function if set for Peripheral A 
-PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A 
-
+PA26 is an open pin availble as external clock input TCLK2 if set for Peripheral B function
+PB5 is an open pin available for TIOA1 I/O function if set for Peripheral A
+PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
+
+Capture loads RA and RB from edges on TIOA only (TIOB is just a trigger input in capture
+mode), so TIOA1 on PB5 is the free capture pin; TIOA0 is the SD write protect line.  TC2
+(and so TCLK2) belongs to the LED PWM.  The quadrature decoder uses TIOA0 / TIOB0 / TIOB1
+(see TIMER_QUADRATURE_PIOA_PINS).
 */
 
-/* Timer Channel 1 Setup */
+/* Setup of each channel the timer driver owns */
 
-/* Default Timer 1 interrupt period of just about 100us (1 tick = 2.67us); max 65535 */
-#define TC1_RC_INIT (u32)38
+/* Default interrupt period of just about 100us (1 tick = 2.67us); max 65535 */
+#define TIMER_TC_RC_INIT (u32)38
 
-#define TC1_CCR_INIT (u32)0x00000002
+#define TIMER_TC_CCR_START (u32)0x00000005
+/*
+    31-04 [0] Reserved
+
+    03 [0] Reserved
+    02 [1] SWTRG counter reset and started
+    01 [0] CLKDIS Clock not disabled
+    00 [1] CLKEN Clock enabled
+*/
+
+#define TIMER_TC_CCR_STOP (u32)0x00000002
 /*
     31-04 [0] Reserved
 
     03 [0] Reserved
     02 [0] SWTRG no software trigger
-    01 [1] CLKDIS Clock disabled to start
-    00 [0] CLKEN Clock not enabled 
+    01 [1] CLKDIS Clock disabled
+    00 [0] CLKEN Clock not enabled
 */
 
-/* Remeber this register configures both CAPTURE and WAVEFORM modes. Check User Guide */
-#define TC1_CMR_INIT (u32)0x000CC403
+/* Remeber this register configures both CAPTURE and WAVEFORM modes. Check User Guide.
+TimerSetPeriodUs() replaces TCCLKS with the clock it picks and sets CPCDIS for TIMER_ONE_SHOT */
+#define TIMER_TC_CMR_INIT (u32)0x0000C003
 /*
     31 [0] BSWTRG no software trigger effect on TIOB
     30 [0] "
@@ -105,8 +224,8 @@ PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
     21 [0] AEEVT no TIOA effect on external compare
     20 [0] "
 
-    19 [1] ACPC Toggle TIOA on RC compare
-    18 [1] "
+    19 [0] ACPC no RC compare effect on TIOA
+    18 [0] "
     17 [0] ACPA No RA compare effect on TIOA
     16 [0] "
 
@@ -115,12 +234,12 @@ PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
     13 [0] "
     12 [0] ENETRG external event has no effect
 
-    11 [0] EEVT external event assigned to XC0
-    10 [1] "
+    11 [0] EEVT external event assigned to TIOB
+    10 [0] "
     09 [0] EEVTEDG no external event trigger
     08 [0] "
 
-    07 [0] CPCDIS clock is NOT disabled when reaches RC
+    07 [0] CPCDIS clock is NOT disabled when reaches RC (periodic)
     06 [0] CPCSTOP clock is NOT stopped when reaches RC
     05 [0] BURST not gated
     04 [0] "
@@ -131,33 +250,96 @@ PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
     00 [1] "
 */
 
-#define TC1_IER_INIT (u32)0x00000010
+/* Capture mode: free running on the clock TimerCaptureStart() picks, with RA loaded on the
+start edge of TIOA and RB on the opposite edge.  TIMER_CAPTURE_FALLING swaps LDRA and LDRB
+(TIMER_TC_CMR_CAPTURE_FALLING). */
+#define TIMER_TC_CMR_CAPTURE_RISING (u32)0x00090000
+/*
+    31-20 [0] Reserved
+
+    19 [1] LDRB RB loaded on the falling edge of TIOA
+    18 [0] "
+    17 [0] LDRA RA loaded on the rising edge of TIOA
+    16 [1] "
+
+    15 [0] WAVE Capture Mode
+    14 [0] CPCTRG RC compare has no effect (the counter wraps at 0xFFFF)
+    13 [0] Reserved
+    12 [0] "
+
+    11 [0] "
+    10 [0] ABETRG TIOB is the external trigger (not used)
+    09 [0] ETRGEDG no external trigger
+    08 [0] "
+
+    07 [0] LDBDIS counter clock not disabled on RB load
+    06 [0] LDBSTOP counter clock not stopped on RB load
+    05 [0] BURST not gated
+    04 [0] "
+
+    03 [0] CLKI Counter incremented on rising edge
+    02 [0] TCCLKS set by TimerCaptureStart()
+    01 [0] "
+    00 [0] "
+*/
+
+#define TIMER_TC_CMR_CAPTURE_FALLING (u32)0x00060000  /*!< @brief As above with RA on the falling edge and RB on the rising edge */
+
+#define TIMER_TC_IER_CAPTURE (u32)0x00000061
 /*
-    31 -08 [0] Reserved 
+    31-08 [0] Reserved
 
-    07 [0] ETRGS RC Load interrupt not enabled
-    06 [0] LDRBS RB Load interrupt not enabled
-    05 [0] LDRAS RA Load interrupt not enabled
-    04 [1] CPCS RC compare interrupt is enabled
+    07 [0] ETRGS External trigger interrupt not enabled
+    06 [1] LDRBS RB Load interrupt enabled (end of the active part)
+    05 [1] LDRAS RA Load interrupt enabled (start of a period)
+    04 [0] CPCS RC compare interrupt not enabled
 
     03 [0] CPBS RB compare interrupt not enabled
-    02 [0] CPAS RA Compare Interrupt enabled
-    01 [0] LOVRS Lover's bit? Load Overrun interrupt not enabled 
-    00 [0] COVFS Counter Overflow interrupt not enabled
+    02 [0] CPAS RA Compare Interrupt not enabled
+    01 [0] LOVRS Load Overrun interrupt not enabled
+    00 [1] COVFS Counter Overflow interrupt enabled (upper bits of the time stamps)
 */
 
-#define TC1_IDR_INIT (u32)0x000000EF
+/* Quadrature decoder: channel 0 counts PHA / PHB edges up or down from the decoder and 
+channel 1 counts index pulses; the index resets channel 0 */
+#define TIMER_TC_CMR_QUADRATURE (u32)0x00000505
 /*
-    31-08 [0] Reserved 
+    31-16 [0] No RA / RB loading
+
+    15 [0] WAVE Capture Mode
+    14 [0] CPCTRG RC compare has no effect
+    13 [0] Reserved
+    12 [0] "
+
+    11 [0] "
+    10 [1] ABETRG TIOA is the external trigger (the index for channel 0)
+    09 [0] ETRGEDG trigger on the rising edge
+    08 [1] "
+
+    07 [0] LDBDIS counter clock not disabled on RB load
+    06 [0] LDBSTOP counter clock not stopped on RB load
+    05 [0] BURST not gated
+    04 [0] "
+
+    03 [0] CLKI Counter incremented on rising edge
+    02 [1] TCCLKS XC0 (the quadrature decoder)
+    01 [0] "
+    00 [1] "
+*/
+
+/* The RC compare interrupt is enabled by TimerStart() for a channel with a callback */
+#define TIMER_TC_IDR_INIT (u32)0x000000FF
+/*
+    31-08 [0] Reserved
 
     07 [1] ETRGS RC Load interrupt disabled
     06 [1] LDRBS RB Load interrupt disabled
     05 [1] LDRAS RA Load interrupt disabled
-    04 [0] CPCS RC compare interrupt not disabled
+    04 [1] CPCS RC compare interrupt disabled
 
     03 [1] CPBS RB compare interrupt disabled
-    02 [1] CPAS RA Compare Interrupt not disabled
-    01 [1] LOVRS Lover's bit?!? Load Overrun interrupt disabled 
+    02 [1] CPAS RA Compare Interrupt disabled
+    01 [1] LOVRS Load Overrun interrupt disabled
     00 [1] COVFS Counter Overflow interrupt disabled
 */
 
@@ -206,6 +388,53 @@ PB6 is an open pin available for TIOB1 I/O function if set for Peripheral A
 */
 
 
+/* TC Block Mode Register while the quadrature decoder runs (TimerQuadratureStart()) */
+#define TCB_BMR_QUADRATURE (u32)0x00781300
+/*
+    31 [0] Reserved
+    30 [0] "
+    29 [0] "
+    28 [0] "
+
+    27 [0] "
+    26 [0] "
+    25 [0] MAXFILT pulses shorter than 8 MCK (167ns) are filtered out
+    24 [0] "
+
+    23 [0] "
+    22 [1] "
+    21 [1] "
+    20 [1] "
+
+    19 [1] FILTER IDX, PHA, PHB filtered
+    18 [0] Reserved
+    17 [0] IDXPHB IDX pin drives TIOA1
+    16 [0] SWAP No swap between PHA and PHB
+
+    15 [0] INVIDX IDX directly drives quadrature logic
+    14 [0] INVB PHB directly drive quadrature decoder logic
+    13 [0] INVA PHA directly drive quadrature decoder logic
+    12 [1] EDGPHA Edges detected on both PHA and PHB (4 counts per cycle)
+
+    11 [0] QDTRANS Quadrature decoding logic is active
+    10 [0] SPEEDEN Speed measure disabled (needs TC2)
+    09 [1] POSEN Position measure enabled
+    08 [1] QDEN Quadrature decoder logic enabled
+
+    07 [0] Reserved
+    06 [0] "
+    05 [0] TC2XC2S TCLK2 connected to XC2
+    04 [0] "
+
+    03 [0] TC1XC1S TCLK1 connected to XC1
+    02 [0] "
+    01 [0] TC0XC0S TCLK0 connected to XC0
+    00 [0] "
+*/
+
+#define TIMER_TCB_BMR_QDEN (u32)0x00000100  /*!< @brief TCB_BMR QDEN (not in AT91SAM3U4.h) */
+
+
 /*! @endcond */
 
 
@@ -0,0 +1,259 @@
+/*!**********************************************************************************************************************
+@file trace.c
+@brief Event trace ring for interrupts, tasks and sleep (EIE_TRACE builds).
+
+Each trace point writes an 8 byte record: the DWT cycle count and a packed event
+and argument.  Nothing is formatted on target; a debugger (or the simulator's -d
+option) saves G_sTrace as raw bytes and trace_decode on the host turns it into a
+Chrome trace (chrome://tracing or ui.perfetto.dev).
+
+The cycle counter wraps every 89 s at 48 MHz and does not count while the core
+is stopped in deep sleep, so the decoder puts the records back on the
+G_u32SystemTime1ms timeline with TRACE_EVENT_TICK records.  SysTick and
+SystemTimeRealign() offer one at every ms count change, but TraceTick() only writes
+it when the cycle count has not kept pace with the ms count since the last one (a
+sleep the counter stopped in) or U32_TRACE_TICK_MS have passed, so ticks do not
+crowd the other events out of the ring.
+
+G_sTrace is not initialized by the startup code.  After a watchdog, software or
+user reset the ring still holds what happened before it: TraceInitialize() adds a
+TRACE_EVENT_RESET record and leaves the ring frozen until TraceStart() so the
+evidence is not overwritten before it can be read out.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- G_sTrace
+
+CONSTANTS
+- U32_TRACE_RECORDS, U32_TRACE_MAGIC
+
+TYPES
+- TraceEventType, TraceRecordType, TraceBufferType
+
+PUBLIC FUNCTIONS
+- void TraceStart(void)
+- void TraceStop(void)
+- void TraceClear(void)
+- TRACE_USER(u8Id_, u16Arg_)
+
+PROTECTED FUNCTIONS
+- void TraceInitialize(void)
+- void TraceTick(u32 u32Ms_)
+- TRACE_ISR_ENTER/EXIT, TRACE_TASK_ENTER/EXIT, TRACE_SLEEP_ENTER/EXIT, TRACE_TICK
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+#ifdef EIE_TRACE
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Trace"
+***********************************************************************************************************************/
+/* New variables */
+NOINIT TraceBufferType G_sTrace;                       /*!< @brief The trace ring (kept through a reset) */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Trace_<type>" and be declared as static.
+***********************************************************************************************************************/
+static bool Trace_bTickDue;                            /*!< @brief The next TraceTick() writes a record whatever the counts */
+static u32 Trace_u32TickMs;                            /*!< @brief G_u32SystemTime1ms of the last tick record */
+static u32 Trace_u32TickCycles;                        /*!< @brief DWT_CYCCNT of the last tick record */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void TraceStart(void)
+
+@brief Starts (or resumes) recording events.
+
+Needed after any reset but a power on one, which leaves the ring frozen (see 
+TraceInitialize()).
+
+Requires:
+- TraceInitialize() has run
+
+Promises:
+- Trace points add records to G_sTrace, starting with a TRACE_EVENT_TICK
+
+*/
+void TraceStart(void)
+{
+  G_sTrace.u32Enabled = 1;
+  Trace_bTickDue = TRUE;
+  TRACE_TICK(G_u32SystemTime1ms);
+
+} /* end TraceStart() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void TraceStop(void)
+
+@brief Stops recording so the ring keeps the events leading up to now.
+
+Useful from a fault path or a check that has just found something wrong.
+
+Requires:
+- NONE
+
+Promises:
+- G_sTrace no longer changes until TraceStart()
+
+*/
+void TraceStop(void)
+{
+  G_sTrace.u32Enabled = 0;
+
+} /* end TraceStop() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void TraceClear(void)
+
+@brief Empties the ring.
+
+Requires:
+- NONE
+
+Promises:
+- G_sTrace holds no records; recording is on or off as before
+- The next TraceTick() writes a record so the decoder has a time base
+
+*/
+void TraceClear(void)
+{
+  u32 u32PriMask = __get_PRIMASK();
+
+  __disable_irq();
+  Trace_bTickDue = TRUE;
+  G_sTrace.u32Head = 0;
+  memset(G_sTrace.asRecords, 0, sizeof(G_sTrace.asRecords));
+  __set_PRIMASK(u32PriMask);
+
+} /* end TraceClear() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void TraceInitialize(void)
+
+@brief Starts the cycle counter and sets up the trace ring.
+
+Requires:
+- Called once at start up (trace points that run before this record nothing)
+- No debugger is using the DWT cycle counter for something else
+
+Promises:
+- DWT_CYCCNT counts core clock cycles
+- After a power on reset (or if G_sTrace does not hold a ring): the ring is empty
+  and recording
+- After any other reset: a TRACE_EVENT_RESET record is added after the old records
+  and recording is off until TraceStart()
+
+*/
+void TraceInitialize(void)
+{
+  u32 u32ResetType = AT91C_BASE_RSTC->RSTC_RSR & AT91C_RSTC_RSTTYP;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA;
+
+  if( (G_sTrace.u32Magic == U32_TRACE_MAGIC) &&
+      (G_sTrace.u32Records == U32_TRACE_RECORDS) &&
+      (u32ResetType != AT91C_RSTC_RSTTYP_GENERAL) )
+  {
+    /* Add the reset marker to the old ring and keep it for the debugger */
+    G_sTrace.u32Enabled = 1;
+    TraceEvent(TRACE_EVENT_RESET, u32ResetType >> 8);
+    G_sTrace.u32Enabled = 0;
+    return;
+  }
+
+  G_sTrace.u32Magic = U32_TRACE_MAGIC;
+  G_sTrace.u32Records = U32_TRACE_RECORDS;
+  G_sTrace.u32CyclesPerUs = CCLK_VALUE / 1000000;
+  G_sTrace.u32Enabled = 0;
+  TraceClear();
+  TraceStart();
+
+} /* end TraceInitialize() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn void TraceTick(u32 u32Ms_)
+
+@brief Adds a TRACE_EVENT_TICK record when the decoder needs a new time base.
+
+Called through TRACE_TICK() whenever G_u32SystemTime1ms changes.  While DWT_CYCCNT
+keeps counting U32_TRACE_CYCLES_PER_MS per ms the last tick still places every record,
+so one is only written every U32_TRACE_TICK_MS (well inside the 44 s a signed cycle
+difference covers).
+
+Requires:
+- TraceInitialize() has run
+@param u32Ms_ is G_u32SystemTime1ms
+
+Promises:
+- If tracing is on, a tick record is added when one is due, the cycle count is more
+  than U32_TRACE_TICK_SLACK away from the ms count since the last tick, or
+  U32_TRACE_TICK_MS have passed
+
+*/
+void TraceTick(u32 u32Ms_)
+{
+  u32 u32PriMask;
+  u32 u32Cycles;
+  u32 u32Ms;
+  s32 s32Error;
+
+  if(!G_sTrace.u32Enabled)
+  {
+    return;
+  }
+
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+  u32Cycles = DWT->CYCCNT;
+  u32Ms = u32Ms_ - Trace_u32TickMs;
+  s32Error = (s32)(u32Cycles - Trace_u32TickCycles - u32Ms * U32_TRACE_CYCLES_PER_MS);
+
+  if( Trace_bTickDue || (u32Ms >= U32_TRACE_TICK_MS) ||
+      (s32Error > (s32)U32_TRACE_TICK_SLACK) || (s32Error < -(s32)U32_TRACE_TICK_SLACK) )
+  {
+    Trace_bTickDue = FALSE;
+    Trace_u32TickMs = u32Ms_;
+    Trace_u32TickCycles = u32Cycles;
+    TraceEvent(TRACE_EVENT_TICK, u32Ms_ & 0xFFFF);
+  }
+  __set_PRIMASK(u32PriMask);
+
+} /* end TraceTick() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+#endif /* EIE_TRACE */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,169 @@
+/*!**********************************************************************************************************************
+@file trace.h
+@brief Header file for trace.c
+***********************************************************************************************************************/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+/* Event tracing: build with EIE_TRACE defined (IAR preprocessor defines or
+make EXTRA_DEFINES=-DEIE_TRACE in gcc_sim).  Without it every TRACE_xxx() macro is empty.
+
+Recording starts by itself only after a power on reset.  After any other reset
+(watchdog, software, user) the ring keeps the records from before the reset plus a
+TRACE_EVENT_RESET record and stays frozen: read it out, then TraceStart() (the
+console's "trace start") to record again. */
+#ifdef EIE_TRACE
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U32_TRACE_RECORDS         (u32)512          /*!< @brief Ring size in records (power of 2, 8 bytes each) */
+#define U32_TRACE_MAGIC           (u32)0x54524345   /*!< @brief "TRCE": G_sTrace holds a ring written since power on */
+#define U32_TRACE_EVENT_MASK      (u32)0x0000FFFF   /*!< @brief u32EventArg bits of the TraceEventType */
+#define U8_TRACE_ARG_SHIFT        (u8)16            /*!< @brief u32EventArg position of the argument */
+#define U32_TRACE_TICK_MS         (u32)100          /*!< @brief Longest gap between TRACE_EVENT_TICK records */
+#define U32_TRACE_CYCLES_PER_MS   (u32)(CCLK_VALUE / 1000) /*!< @brief DWT_CYCCNT counts in one SysTick */
+#define U32_TRACE_TICK_SLACK      (u32)(U32_TRACE_CYCLES_PER_MS / 8) /*!< @brief Cycle count error that needs a new tick */
+
+/* Exception number of an IRQn_Type (as in IPSR) for TRACE_ISR_ENTER() / TRACE_ISR_EXIT() */
+#define TRACE_EXCEPTION(eIrq_)    (u32)((s32)(eIrq_) + 16)
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum TraceEventType
+@brief What a trace record marks; the argument of each is listed.
+*/
+typedef enum {TRACE_EVENT_ISR_ENTER = 1,    /*!< Exception number (SysTick 15, IRQn + 16) */
+              TRACE_EVENT_ISR_EXIT,         /*!< Exception number */
+              TRACE_EVENT_TASK_ENTER,       /*!< Main_asTasks index */
+              TRACE_EVENT_TASK_EXIT,        /*!< Main_asTasks index */
+              TRACE_EVENT_SLEEP_ENTER,      /*!< Ticks the loop asked to sleep (low 16 bits) */
+              TRACE_EVENT_SLEEP_EXIT,       /*!< 0 */
+              TRACE_EVENT_TICK,             /*!< G_u32SystemTime1ms (low 16 bits): the decoder's time base */
+              TRACE_EVENT_RESET,            /*!< RSTC_SR RSTTYP of the reset that ended the records before it */
+              TRACE_EVENT_USER = 0x100      /*!< TRACE_EVENT_USER + n for application events (TRACE_USER()) */
+} TraceEventType;
+
+
+/*!
+@struct TraceRecordType
+@brief One trace event.
+*/
+typedef struct
+{
+  u32 u32Cycles;                          /*!< @brief DWT_CYCCNT when the event happened */
+  u32 u32EventArg;                        /*!< @brief TraceEventType in bits 0-15, its argument in bits 16-31 */
+} TraceRecordType;
+
+
+/*!
+@struct TraceBufferType
+@brief The trace ring as a host tool reads it from a memory dump (see trace_decode.c).
+*/
+typedef struct
+{
+  u32 u32Magic;                           /*!< @brief U32_TRACE_MAGIC once TraceInitialize() has set up the ring */
+  u32 u32Records;                         /*!< @brief U32_TRACE_RECORDS */
+  u32 u32CyclesPerUs;                     /*!< @brief DWT_CYCCNT rate */
+  volatile u32 u32Enabled;                /*!< @brief Not 0 while events are recorded */
+  volatile u32 u32Head;                   /*!< @brief Events written since the ring was cleared (next slot = u32Head % u32Records) */
+  TraceRecordType asRecords[U32_TRACE_RECORDS]; /*!< @brief The ring */
+} TraceBufferType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TraceStart(void);
+void TraceStop(void);
+void TraceClear(void);
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static inline void TraceEvent(u32 u32Event_, u32 u32Arg_)
+
+@brief Adds one record to the trace ring.
+
+Safe from any ISR and from tasks: the slot is claimed and filled with interrupts masked
+for a handful of instructions (about 15 cycles on target), so nested events never share
+a slot.  Use through the TRACE_xxx() macros so EIE_TRACE can take it out of the build.
+
+Requires:
+- TraceInitialize() has run
+@param u32Event_ is a TraceEventType
+@param u32Arg_ is the event's argument (16 bits)
+
+Promises:
+- If tracing is on, the event is the newest record (the oldest is overwritten when
+  the ring is full)
+
+*/
+static inline void TraceEvent(u32 u32Event_, u32 u32Arg_)
+{
+  extern TraceBufferType G_sTrace;
+  TraceRecordType* psRecord;
+  u32 u32PriMask;
+
+  if(G_sTrace.u32Enabled)
+  {
+    u32PriMask = __get_PRIMASK();
+    __disable_irq();
+    psRecord = &G_sTrace.asRecords[G_sTrace.u32Head++ & (U32_TRACE_RECORDS - 1)];
+    psRecord->u32Cycles = DWT->CYCCNT;
+    psRecord->u32EventArg = u32Event_ | (u32Arg_ << U8_TRACE_ARG_SHIFT);
+    __set_PRIMASK(u32PriMask);
+  }
+
+} /* end TraceEvent() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TraceInitialize(void);
+void TraceTick(u32 u32Ms_);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+
+/**********************************************************************************************************************
+Trace points
+**********************************************************************************************************************/
+#define TRACE_ISR_ENTER(eIrq_)      TraceEvent(TRACE_EVENT_ISR_ENTER, TRACE_EXCEPTION(eIrq_))
+#define TRACE_ISR_EXIT(eIrq_)       TraceEvent(TRACE_EVENT_ISR_EXIT, TRACE_EXCEPTION(eIrq_))
+#define TRACE_TASK_ENTER(u8Task_)   TraceEvent(TRACE_EVENT_TASK_ENTER, (u32)(u8Task_))
+#define TRACE_TASK_EXIT(u8Task_)    TraceEvent(TRACE_EVENT_TASK_EXIT, (u32)(u8Task_))
+#define TRACE_SLEEP_ENTER(u32Ticks_) TraceEvent(TRACE_EVENT_SLEEP_ENTER, (u32)(u32Ticks_) & 0xFFFF)
+#define TRACE_SLEEP_EXIT()          TraceEvent(TRACE_EVENT_SLEEP_EXIT, 0)
+#define TRACE_TICK(u32Ms_)          TraceTick((u32)(u32Ms_))
+/*! @brief Application event u8Id_ (0-255) with a 16-bit argument, e.g. TRACE_USER(3, u16Count) */
+#define TRACE_USER(u8Id_, u16Arg_)  TraceEvent(TRACE_EVENT_USER + (u8)(u8Id_), (u16)(u16Arg_))
+
+#else
+
+#define TRACE_ISR_ENTER(eIrq_)
+#define TRACE_ISR_EXIT(eIrq_)
+#define TRACE_TASK_ENTER(u8Task_)
+#define TRACE_TASK_EXIT(u8Task_)
+#define TRACE_SLEEP_ENTER(u32Ticks_)
+#define TRACE_SLEEP_EXIT()
+#define TRACE_TICK(u32Ms_)
+#define TRACE_USER(u8Id_, u16Arg_)
+
+#endif /* EIE_TRACE */
+
+#endif /* __TRACE_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,474 @@
+/*!**********************************************************************************************************************
+@file twi.c
+@brief TWI0 master (PA9 SDA / PA10 SCL: the ASCII board's LCD bus) with a transaction queue.
+
+Apps describe a transfer in a TwiTransactionType and hand it to TwiQueue(), which
+copies the description and returns at once.  The transactions run one after the other
+at 400 kHz, each moved by the TWI's PDC channel: the interrupt only steps between the
+parts of a transaction (about two per transaction, none per byte) and starts the next
+one as soon as the bus is free.  The TWI task then calls each transaction's callback
+with the result, in queue order.
+
+A write is sent whole through the PDC.  A read takes its bytes through the PDC except
+the last, which is read by hand so the STOP can be set in time.  A write followed by a
+read uses the TWI internal address register for the write part, so it is limited to
+U8_TWI_MAX_INTERNAL_ADDRESS bytes (a register number).
+
+A NACK ends the transaction (the TWI sends the STOP itself).  A transaction that takes
+longer than its bytes should (a slave holding SCL low) is timed out by the task, which
+resets the TWI and carries on with the next one.
+
+TWI0 has no clock in Wait mode, so in EIE_DEEP_SLEEP builds the system only deep sleeps
+while no transaction is running.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- U8_TWI_QUEUE_SIZE, U8_TWI_MAX_INTERNAL_ADDRESS
+
+TYPES
+- TwiResultType, TwiCallbackType, TwiTransactionType
+
+PUBLIC FUNCTIONS
+- bool TwiQueue(const TwiTransactionType* psTransaction_)
+- u8 TwiQueueFree(void)
+
+PROTECTED FUNCTIONS
+- void TwiInitialize(void)
+- void TwiRunActiveState(void)
+- bool TwiIsIdle(void)
+- void TWI0_IrqHandler(void)
+
+***********************************************************************************************************************/
+
+#include "configuration.h"
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Twi"
+***********************************************************************************************************************/
+/* New variables */
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern volatile u32 G_u32SystemTime1ms;                /*!< @brief From main.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void TwiReset(void);
+static void TwiStart(void);
+static void TwiFinish(TwiResultType eResult_);
+
+
+/***********************************************************************************************************************
+State Machine Declarations
+***********************************************************************************************************************/
+static void TwiSM_Idle(void);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Twi_<type>" and be declared as static.
+***********************************************************************************************************************/
+static fnCode_type Twi_pfnStateMachine;                /*!< @brief The state machine function pointer */
+
+/* The queue: slots from Twi_u8Done to Twi_u8Active are finished and wait for their
+callback, Twi_u8Active is on the bus, the rest up to Twi_u8Head wait for it.  The
+indexes count up forever and are taken modulo U8_TWI_QUEUE_SIZE. */
+static TwiTransactionType Twi_asQueue[U8_TWI_QUEUE_SIZE]; /*!< @brief Queued transactions */
+static TwiResultType Twi_aeResult[U8_TWI_QUEUE_SIZE];  /*!< @brief How each finished transaction ended */
+static u8 Twi_u8Head;                                  /*!< @brief Next slot TwiQueue() fills */
+static volatile u8 Twi_u8Active;                       /*!< @brief Slot on the bus (== Twi_u8Head when none) */
+static u8 Twi_u8Done;                                  /*!< @brief Oldest slot still waiting for its callback */
+
+static volatile TwiPhaseType Twi_ePhase;               /*!< @brief Step of the active transaction */
+static volatile TwiResultType Twi_eResult;             /*!< @brief Result of the active transaction so far */
+static volatile u32 Twi_u32StartTime;                  /*!< @brief G_u32SystemTime1ms when the active transaction started */
+static volatile u32 Twi_u32TimeoutMs;                  /*!< @brief Time the active transaction may take */
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TwiQueue(const TwiTransactionType* psTransaction_)
+
+@brief Adds a transaction to the queue; it starts straight away if the bus is free.
+
+Example to read two bytes from register 0x10 of the slave at 0x48:
+
+static u8 UserApp1_au8Register[] = {0x10};
+static u8 UserApp1_au8Data[2];
+
+TwiTransactionType sRead = {0x48, UserApp1_au8Register, 1, UserApp1_au8Data, 2, UserApp1TwiDone, NULL};
+TwiQueue(&sRead);
+
+Requires:
+- TwiInitialize() has run; called from a task (not an interrupt)
+@param psTransaction_ describes the transaction (copied; the buffers it points to are not)
+
+Promises:
+- Returns TRUE if the transaction was queued; its callback runs from the TWI task
+  once it has ended
+- Returns FALSE if the queue is full or the transaction is not valid (no bytes at
+  all, an address over 0x7F, or a write of more than U8_TWI_MAX_INTERNAL_ADDRESS
+  bytes in front of a read)
+
+*/
+bool TwiQueue(const TwiTransactionType* psTransaction_)
+{
+  u32 u32PriMask;
+
+  if( (psTransaction_->u8Address > 0x7F) ||
+      ((psTransaction_->u16WriteLength == 0) && (psTransaction_->u16ReadLength == 0)) ||
+      ((psTransaction_->u16ReadLength != 0) && (psTransaction_->u16WriteLength > U8_TWI_MAX_INTERNAL_ADDRESS)) ||
+      ((u8)(Twi_u8Head - Twi_u8Done) >= U8_TWI_QUEUE_SIZE) )
+  {
+    return(FALSE);
+  }
+
+  Twi_asQueue[Twi_u8Head % U8_TWI_QUEUE_SIZE] = *psTransaction_;
+
+  /* The interrupt starts the next queued transaction itself when the bus is busy */
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+  Twi_u8Head++;
+  if(Twi_ePhase == TWI_PHASE_IDLE)
+  {
+    TwiStart();
+  }
+  __set_PRIMASK(u32PriMask);
+
+  return(TRUE);
+
+} /* end TwiQueue() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u8 TwiQueueFree(void)
+
+@brief Returns how many more transactions TwiQueue() would take now.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the number of free queue slots
+
+*/
+u8 TwiQueueFree(void)
+{
+  return( (u8)(U8_TWI_QUEUE_SIZE - (u8)(Twi_u8Head - Twi_u8Done)) );
+
+} /* end TwiQueueFree() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TwiInitialize(void)
+
+@brief Sets up TWI0 as a 400 kHz master with an empty queue.
+
+Requires:
+- PA9 / PA10 are assigned to TWI0 and its peripheral clock is on (GpioSetup(),
+  PMC_PCER_INIT)
+
+Promises:
+- TWI0 is a master with every interrupt disabled until a transaction is queued
+- Twi_pfnStateMachine = TwiSM_Idle
+
+*/
+void TwiInitialize(void)
+{
+  Twi_u8Head = 0;
+  Twi_u8Active = 0;
+  Twi_u8Done = 0;
+
+  TwiReset();
+
+  NVIC_ClearPendingIRQ(IRQn_TWI0);
+  NVIC_EnableIRQ(IRQn_TWI0);
+
+  Twi_pfnStateMachine = TwiSM_Idle;
+
+} /* end TwiInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void TwiRunActiveState(void)
+
+@brief Selects and runs one iteration of the current state in the state machine.
+
+Requires:
+- State machine function pointer points at current state
+
+Promises:
+- Calls the function to pointed by the state machine function pointer
+
+*/
+void TwiRunActiveState(void)
+{
+  Twi_pfnStateMachine();
+
+} /* end TwiRunActiveState */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool TwiIsIdle(void)
+
+@brief TRUE when nothing is queued, so the scheduler can skip the task.
+
+Requires:
+- NONE
+
+Promises:
+- Returns FALSE while a transaction is queued, running or waiting for its callback
+
+*/
+bool TwiIsIdle(void)
+{
+  return( (bool)(Twi_u8Done == Twi_u8Head) );
+
+} /* end TwiIsIdle() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn ISR void TWI0_IrqHandler(void)
+
+@brief Steps the active transaction along and starts the next one when it ends.
+
+Requires:
+- TwiInitialize() has run
+
+Promises:
+- NACK: the transaction fails once the TWI has sent its STOP
+- ENDTX: the last byte to write is going out, so the STOP is set
+- ENDRX: all but the last byte have been read, so the STOP is set before the last one
+- RXRDY: the last byte is stored
+- TXCOMP: the STOP has gone; the transaction ends and the next one starts
+
+*/
+void TWI0_IrqHandler(void)
+{
+  u32 u32Status;
+  TwiTransactionType* psTransaction = &Twi_asQueue[Twi_u8Active % U8_TWI_QUEUE_SIZE];
+
+  TRACE_ISR_ENTER(IRQn_TWI0);
+
+  /* Reading TWI_SR clears NACK, so it is read once */
+  u32Status = AT91C_BASE_TWI0->TWI_SR & AT91C_BASE_TWI0->TWI_IMR;
+
+  if(u32Status & AT91C_TWI_NACK_MASTER)
+  {
+    AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+    AT91C_BASE_TWI0->TWI_IDR = 0xFFFFFFFF;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_TXCOMP_MASTER;
+    Twi_eResult = TWI_RESULT_NACK;
+    Twi_ePhase = TWI_PHASE_STOP;
+  }
+  else if(u32Status & AT91C_TWI_ENDTX)
+  {
+    AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_TXTDIS;
+    AT91C_BASE_TWI0->TWI_CR = AT91C_TWI_STOP;
+    AT91C_BASE_TWI0->TWI_IDR = AT91C_TWI_ENDTX;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_TXCOMP_MASTER;
+    Twi_ePhase = TWI_PHASE_STOP;
+  }
+  else if(u32Status & AT91C_TWI_ENDRX)
+  {
+    AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_RXTDIS;
+    AT91C_BASE_TWI0->TWI_CR = AT91C_TWI_STOP;
+    AT91C_BASE_TWI0->TWI_IDR = AT91C_TWI_ENDRX;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_RXRDY;
+    Twi_ePhase = TWI_PHASE_LAST_BYTE;
+  }
+  else if(u32Status & AT91C_TWI_RXRDY)
+  {
+    psTransaction->pu8Read[psTransaction->u16ReadLength - 1] = (u8)AT91C_BASE_TWI0->TWI_RHR;
+    AT91C_BASE_TWI0->TWI_IDR = AT91C_TWI_RXRDY;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_TXCOMP_MASTER;
+    Twi_ePhase = TWI_PHASE_STOP;
+  }
+  else if(u32Status & AT91C_TWI_TXCOMP_MASTER)
+  {
+    TwiFinish(Twi_eResult);
+  }
+
+  NVIC_ClearPendingIRQ(IRQn_TWI0);
+  TRACE_ISR_EXIT(IRQn_TWI0);
+
+} /* end TWI0_IrqHandler() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TwiReset(void)
+
+@brief Resets TWI0 and sets it up as an idle 400 kHz master.
+*/
+static void TwiReset(void)
+{
+  AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+  AT91C_BASE_TWI0->TWI_IDR = 0xFFFFFFFF;
+  AT91C_BASE_TWI0->TWI_CR = AT91C_TWI_SWRST;
+  AT91C_BASE_TWI0->TWI_CWGR = TWI_CWGR_INIT;
+  AT91C_BASE_TWI0->TWI_CR = TWI_CR_INIT;
+
+  Twi_ePhase = TWI_PHASE_IDLE;
+
+} /* end TwiReset() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TwiStart(void)
+
+@brief Puts the transaction at Twi_u8Active on the bus, if there is one.
+
+Called with interrupts masked or from TWI0_IrqHandler(), while the bus is idle.
+*/
+static void TwiStart(void)
+{
+  TwiTransactionType* psTransaction = &Twi_asQueue[Twi_u8Active % U8_TWI_QUEUE_SIZE];
+  u32 u32InternalAddress = 0;
+  u32 u32Mode;
+
+  if(Twi_u8Active == Twi_u8Head)
+  {
+    return;
+  }
+
+  Twi_eResult = TWI_RESULT_OK;
+  Twi_u32StartTime = G_u32SystemTime1ms;
+  Twi_u32TimeoutMs = U32_TWI_TIMEOUT_MS +
+                     (psTransaction->u16WriteLength + psTransaction->u16ReadLength) / U32_TWI_BYTES_PER_MS;
+
+  u32Mode = (u32)psTransaction->u8Address << TWI_MMR_DADR_SHIFT;
+
+  /* Write only: the PDC sends it all, starting the transfer with the first byte */
+  if(psTransaction->u16ReadLength == 0)
+  {
+    AT91C_BASE_TWI0->TWI_MMR = u32Mode;
+    AT91C_BASE_TWI0->TWI_TPR = (u32)psTransaction->pu8Write;
+    AT91C_BASE_TWI0->TWI_TCR = psTransaction->u16WriteLength;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_ENDTX | AT91C_TWI_NACK_MASTER;
+    AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_TXTEN;
+    Twi_ePhase = TWI_PHASE_WRITE;
+    return;
+  }
+
+  /* Read: the write part is the internal address, sent before a repeated start */
+  for(u16 i = 0; i < psTransaction->u16WriteLength; i++)
+  {
+    u32InternalAddress = (u32InternalAddress << 8) | psTransaction->pu8Write[i];
+  }
+  AT91C_BASE_TWI0->TWI_MMR = u32Mode | AT91C_TWI_MREAD |
+                             ((u32)psTransaction->u16WriteLength << TWI_MMR_IADRSZ_SHIFT);
+  AT91C_BASE_TWI0->TWI_IADR = u32InternalAddress;
+
+  if(psTransaction->u16ReadLength == 1)
+  {
+    AT91C_BASE_TWI0->TWI_CR = AT91C_TWI_START | AT91C_TWI_STOP;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_RXRDY | AT91C_TWI_NACK_MASTER;
+    Twi_ePhase = TWI_PHASE_LAST_BYTE;
+  }
+  else
+  {
+    AT91C_BASE_TWI0->TWI_RPR = (u32)psTransaction->pu8Read;
+    AT91C_BASE_TWI0->TWI_RCR = (u32)psTransaction->u16ReadLength - 1;
+    AT91C_BASE_TWI0->TWI_CR = AT91C_TWI_START;
+    AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_RXTEN;
+    AT91C_BASE_TWI0->TWI_IER = AT91C_TWI_ENDRX | AT91C_TWI_NACK_MASTER;
+    Twi_ePhase = TWI_PHASE_READ;
+  }
+
+} /* end TwiStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void TwiFinish(TwiResultType eResult_)
+
+@brief Ends the active transaction with eResult_ and starts the next one.
+
+Called with interrupts masked or from TWI0_IrqHandler().
+*/
+static void TwiFinish(TwiResultType eResult_)
+{
+  AT91C_BASE_TWI0->TWI_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+  AT91C_BASE_TWI0->TWI_IDR = 0xFFFFFFFF;
+
+  Twi_aeResult[Twi_u8Active % U8_TWI_QUEUE_SIZE] = eResult_;
+  Twi_u8Active++;
+  Twi_ePhase = TWI_PHASE_IDLE;
+
+  TwiStart();
+
+} /* end TwiFinish() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
+
+/*!-------------------------------------------------------------------------------------------------------------------
+@fn static void TwiSM_Idle(void)
+
+@brief Calls back finished transactions in order and times out a stuck one.
+*/
+static void TwiSM_Idle(void)
+{
+  TwiTransactionType sTransaction;
+  TwiResultType eResult;
+  u32 u32PriMask;
+
+  /* A slave holding the bus: reset the TWI and go on with the next transaction */
+  u32PriMask = __get_PRIMASK();
+  __disable_irq();
+  if( (Twi_ePhase != TWI_PHASE_IDLE) && ((G_u32SystemTime1ms - Twi_u32StartTime) > Twi_u32TimeoutMs) )
+  {
+    LOG2("twi: address 0x%02X timed out in phase %u", Twi_asQueue[Twi_u8Active % U8_TWI_QUEUE_SIZE].u8Address,
+         Twi_ePhase);
+    TwiReset();
+    NVIC_ClearPendingIRQ(IRQn_TWI0);
+    TwiFinish(TWI_RESULT_TIMEOUT);
+  }
+  __set_PRIMASK(u32PriMask);
+
+  while(Twi_u8Done != Twi_u8Active)
+  {
+    /* Free the slot first so the callback can queue the next transaction */
+    sTransaction = Twi_asQueue[Twi_u8Done % U8_TWI_QUEUE_SIZE];
+    eResult = Twi_aeResult[Twi_u8Done % U8_TWI_QUEUE_SIZE];
+    Twi_u8Done++;
+
+    if(eResult == TWI_RESULT_NACK)
+    {
+      LOG1("twi: address 0x%02X did not answer", sTransaction.u8Address);
+    }
+
+    if(sTransaction.pfnCallback != NULL)
+    {
+      sTransaction.pfnCallback(eResult, sTransaction.pvContext);
+    }
+  }
+
+} /* end TwiSM_Idle() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
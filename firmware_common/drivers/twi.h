@@ -0,0 +1,128 @@
+/*!**********************************************************************************************************************
+@file twi.h
+@brief Header file for twi.c
+**********************************************************************************************************************/
+
+#ifndef __TWI_H
+#define __TWI_H
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*!
+@enum TwiResultType
+@brief How a transaction ended */
+typedef enum {TWI_RESULT_OK = 0, TWI_RESULT_NACK, TWI_RESULT_TIMEOUT
+} TwiResultType;
+
+/*! @brief Function called from the TWI task when a transaction has ended */
+typedef void(*TwiCallbackType)(TwiResultType eResult_, void* pvContext_);
+
+/*!
+@struct TwiTransactionType
+@brief One master transfer: write pu8Write, then read into pu8Read after a repeated start.
+
+Either part may be empty (length 0).  When both are used the write part is the slave's
+internal address (register) and can be at most U8_TWI_MAX_INTERNAL_ADDRESS bytes. */
+typedef struct
+{
+  u8 u8Address;                           /*!< @brief 7-bit slave address */
+  const u8* pu8Write;                     /*!< @brief Bytes to send; must stay valid until the callback */
+  u16 u16WriteLength;                     /*!< @brief Bytes in pu8Write */
+  u8* pu8Read;                            /*!< @brief Where the bytes read go; must stay valid until the callback */
+  u16 u16ReadLength;                      /*!< @brief Bytes to read */
+  TwiCallbackType pfnCallback;            /*!< @brief Called from the TWI task when the transaction ends, or NULL */
+  void* pvContext;                        /*!< @brief Passed to pfnCallback */
+} TwiTransactionType;
+
+/*!
+@enum TwiPhaseType
+@brief Where TWI0_IrqHandler() is in the active transaction */
+typedef enum {TWI_PHASE_IDLE = 0, TWI_PHASE_WRITE, TWI_PHASE_READ, TWI_PHASE_LAST_BYTE, TWI_PHASE_STOP
+} TwiPhaseType;
+
+
+/**********************************************************************************************************************
+Function Declarations
+**********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+bool TwiQueue(const TwiTransactionType* psTransaction_);
+u8 TwiQueueFree(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+void TwiInitialize(void);
+void TwiRunActiveState(void);
+bool TwiIsIdle(void);
+void TWI0_IrqHandler(void);
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define U8_TWI_QUEUE_SIZE           (u8)8         /*!< @brief Transactions that can wait (power of 2) */
+#define U8_TWI_MAX_INTERNAL_ADDRESS (u8)3         /*!< @brief Most write bytes in front of a read (TWI_IADR) */
+#define U32_TWI_TIMEOUT_MS          (u32)5        /*!< @brief Time a transaction may take on top of its bytes */
+#define U32_TWI_BYTES_PER_MS        (u32)40       /*!< @brief Bytes per ms at 400 kHz (9 clocks each), rounded down */
+
+#define TWI_CR_INIT                 (u32)0x00000024
+/*
+    31-08 [0] Reserved
+
+    07 [0] SWRST no reset
+    06 [0] QUICK no quick command
+    05 [1] SVDIS slave mode disabled
+    04 [0] SVEN no effect
+
+    03 [0] MSDIS no effect
+    02 [1] MSEN master mode enabled
+    01 [0] STOP no effect
+    00 [0] START no effect
+*/
+
+#define TWI_CWGR_INIT               (u32)0x0000343C
+/*
+    400 kHz at MCK 48 MHz: Tlow = (CLDIV x 2^CKDIV + 4) / MCK = 64 cycles (1.33 us, the
+    fast mode minimum is 1.3 us), Thigh = (CHDIV x 2^CKDIV + 4) / MCK = 56 cycles
+
+    31-19 [0] Reserved
+
+    18 [0] CKDIV 1
+    17 [0] "
+    16 [0] "
+
+    15 [0] CHDIV 52
+    14 [0] "
+    13 [1] "
+    12 [1] "
+
+    11 [0] "
+    10 [1] "
+    09 [0] "
+    08 [0] "
+
+    07 [0] CLDIV 60
+    06 [0] "
+    05 [1] "
+    04 [1] "
+
+    03 [1] "
+    02 [1] "
+    01 [0] "
+    00 [0] "
+*/
+
+/* TWI_MMR fields */
+#define TWI_MMR_IADRSZ_SHIFT        (u8)8         /*!< @brief Internal address bytes (0-3) */
+#define TWI_MMR_DADR_SHIFT          (u8)16        /*!< @brief Slave address */
+
+
+#endif /* __TWI_H */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -8,13 +8,15 @@ GLOBALS
 - NONE
 
 CONSTANTS
-- NONE
+- TIME_IS_AFTER(u32A_, u32B_)
 
 TYPES
 - NONE
 
 PUBLIC FUNCTIONS
 - bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
+- u64 TimeNowMs(void)
+- u64 TimeNowUs(void) (inline in utilities.h)
 
 PROTECTED FUNCTIONS
 - NONE
@@ -34,6 +36,7 @@ All Global variable names shall start with "G_<type>Util"
 /* Existing variables (defined in other files -- should all contain the "extern" keyword) */
 extern volatile u32 G_u32SystemTime1ms;                /*!< From main.c */
 extern volatile u32 G_u32SystemTime1s;                 /*!< From main.c */
+extern volatile u32 G_u32SystemTime1msHigh;            /*!< From main.c */
 extern volatile u32 G_u32SystemFlags;                  /*!< From main.c */
 extern volatile u32 G_u32ApplicationFlags;             /*!< From main.c */
 
@@ -58,7 +61,7 @@ Function Definitions
 saved G_u32SystemTime1ms is greater than the period specified. 
 
 The referenced current time is always G_u32SystemTime1ms.  The function 
-handles rollover of G_u32SystemTime1ms.
+handles rollover of G_u32SystemTime1ms (unsigned subtraction is exact across it).
 
 Example
 #define U32_PERIOD    (u32)1000
@@ -82,17 +85,7 @@ Promises:
 */
 bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
 {
-  u32 u32TimeElapsed;
-  
-  /* Check to see if the timer in question has rolled */
-  if(G_u32SystemTime1ms >= *pu32SavedTick_)
-  {
-    u32TimeElapsed = G_u32SystemTime1ms - *pu32SavedTick_;
-  }
-  else
-  {
-    u32TimeElapsed = (0xFFFFFFFF - *pu32SavedTick_) + G_u32SystemTime1ms;
-  }
+  u32 u32TimeElapsed = G_u32SystemTime1ms - *pu32SavedTick_;
 
   /* Now determine if time is up */
   if(u32TimeElapsed < u32Period_)
@@ -107,6 +100,36 @@ bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_)
 } /* end IsTimeUp() */
 
 
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn u64 TimeNowMs(void)
+  
+@brief Returns the 64-bit ms count, which does not roll over after 49 days like
+G_u32SystemTime1ms.
+
+Requires:
+- NONE
+
+Promises:
+- Returns G_u32SystemTime1msHigh:G_u32SystemTime1ms read as one value
+
+*/
+u64 TimeNowMs(void)
+{
+  u32 u32Ms;
+  u32 u32High;
+
+  /* Retry if a tick carried into the high word between the reads */
+  do
+  {
+    u32Ms = G_u32SystemTime1ms;
+    u32High = G_u32SystemTime1msHigh;
+  } while(u32Ms != G_u32SystemTime1ms);
+
+  return( ((u64)u32High << 32) | u32Ms );
+
+} /* end TimeNowMs() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /*! @protectedsection */                                                                                            
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -16,6 +16,8 @@ Type Definitions
 /***********************************************************************************************************************
 Constants / Definitions
 ***********************************************************************************************************************/
+/*! @brief TRUE if u32 time stamp u32A_ is later than u32B_, across rollover (they must be under 2^31 apart) */
+#define TIME_IS_AFTER(u32A_, u32B_)     ( (s32)((u32)(u32A_) - (u32)(u32B_)) > 0 )
 
 
 /***********************************************************************************************************************
@@ -27,6 +29,59 @@ Constants / Definitions
 /*--------------------------------------------------------------------------------------------------------------------*/
 
 bool IsTimeUp(u32 *pu32SavedTick_, u32 u32Period_);
+u64 TimeNowMs(void);
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static inline u64 TimeNowUs(void)
+
+@brief Returns the time since SysTickSetup() in microseconds (rolls over after 584000 years).
+
+The ms count is combined with how far SysTick is through the current tick.  Safe from
+any ISR and with interrupts off: a tick that has ended but not been counted yet (its 
+ISR is masked) is added here.  Inline so a time stamp costs a few cycles.
+
+e.g. u64 u64Start = TimeNowUs();
+     ...
+     u32Duration = (u32)(TimeNowUs() - u64Start);
+
+Requires:
+- SysTick runs its 1ms tick (not called in the middle of SystemSleep())
+
+Promises:
+- Returns a count that never goes backwards, to the nearest 1us
+
+*/
+static inline u64 TimeNowUs(void)
+{
+  extern volatile u32 G_u32SystemTime1ms;
+  extern volatile u32 G_u32SystemTime1msHigh;
+  u32 u32Ms;
+  u32 u32High;
+  u32 u32Clocks;
+  u32 u32Tick;
+
+  /* Retry if the SysTick ISR counted a tick part way through */
+  do
+  {
+    u32Ms = G_u32SystemTime1ms;
+    u32High = G_u32SystemTime1msHigh;
+    u32Clocks = AT91C_BASE_NVIC->NVIC_STICKCVR;
+    u32Tick = 0;
+
+    /* SysTick reloaded but its ISR hasn't run: the counter is in the next tick */
+    if(AT91C_BASE_NVIC->NVIC_ICSR & AT91C_NVIC_PENDSTSET)
+    {
+      u32Clocks = AT91C_BASE_NVIC->NVIC_STICKCVR;
+      u32Tick = 1;
+    }
+  } while(u32Ms != G_u32SystemTime1ms);
+
+  /* SysTick counts down to the end of the tick (a short first tick after a sleep still ends on the 1ms grid) */
+  return( ((((u64)u32High << 32) | u32Ms) + u32Tick) * 1000 +
+          ((U32_SYSTICK_COUNT - 1 - u32Clocks) / U32_SYSTICK_CLOCKS_PER_US) );
+
+} /* end TimeNowUs() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,1133 @@
+/*!**********************************************************************************************************************
+@file sim.c
+@brief Host simulation of the EiE development board: virtual time, interrupts and the run loop.
+
+The firmware is compiled for the PC with EIE_SIM defined and runs from its own
+main() exactly as on target. This file supplies what the Cortex-M3 core would:
+- a virtual clock in MCK cycles, advanced by a fixed cost for each memory access
+  and call the firmware makes (see sim.h for the cost model)
+- NVIC style interrupt dispatch with priorities and PRIMASK
+- __WFI(), which skips virtual time forward to the next peripheral event
+- __WFE(), which is __WFI() or, with PMC_FSMR LPM set, Wait mode that only the
+  fast startup inputs end
+- scripted button presses, a square wave and a quadrature encoder on the board
+  inputs, lines typed on the debug console, and a report of what the run did
+
+Usage: eie_sim [-t ms] [-b button:start_ms:hold_ms]... [-w pin:period_us:high_us]
+               [-e counts_per_s[:counts_per_rev]] [-u ms:text]... [-o file] [-d file] [-q] [-v]
+-t  stop after this many simulated milliseconds (default 10000)
+-b  press BUTTONn (0-3) at start_ms for hold_ms; with EIE_KEYPAD, 4-19 press KEY0-KEY15
+-w  drive a square wave onto a pin (e.g. b5 for TIOA1), high for high_us of each period
+-e  turn an encoder on PA1 (PHA) / PA0 (PHB) by counts_per_s edges (negative turns
+    backwards), with an index pulse on PB6 every counts_per_rev edges
+-u  type text and Enter on the debug console (USART0 receive, PA19) at ms
+-o  write what the debug console sends (USART0 transmit, PA18) to file, - for stdout
+-d  save the trace ring (G_sTrace, EIE_TRACE builds) to file at the end of the run,
+    as a debugger would, for trace_decode
+-q  do not print the report
+-v  print every LED / GPIO output change
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- SimStatsType G_sSimStats
+
+CONSTANTS
+- NONE
+
+TYPES
+- NONE
+
+PUBLIC FUNCTIONS
+- uint64_t SimGetCycles(void)
+
+PROTECTED FUNCTIONS
+- void SimAdvance(u32 u32Cycles_)
+- void SimScheduleEvent(uint64_t u64Cycle_)
+- void SimPendIrq(IRQn_Type eIrq_)
+- void SimRequestInterruptCheck(void)
+- void SimSystemReset(const char* pcReason_)
+- void SimConsoleOutput(u8 u8Char_)
+
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Sim"
+***********************************************************************************************************************/
+/* New variables */
+SimStatsType G_sSimStats;                                /*!< @brief Counters printed in the report */
+SimLcdType G_sSimLcd;                                    /*!< @brief The LCD model (sim_registers.c); its text is printed in the report */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern const PinConfigurationType G_asBspButtonConfigurations[U8_TOTAL_BUTTONS]; /*!< @brief From board-specific file */
+
+#ifdef EIE_TASK_PROFILER
+extern TaskProfileType G_asMainTaskProfile[U8_MAIN_TASKS];  /*!< @brief From main.c */
+extern LoopProfileType G_sMainLoopProfile;                           /*!< @brief From main.c */
+#endif /* EIE_TASK_PROFILER */
+
+#ifdef EIE_DEEP_SLEEP
+extern BspDeepSleepStatsType G_sBspDeepSleep;        /*!< @brief From board-specific file */
+#endif /* EIE_DEEP_SLEEP */
+
+#ifdef EIE_TRACE
+extern TraceBufferType G_sTrace;                     /*!< @brief From trace.c */
+#endif /* EIE_TRACE */
+
+extern FaultRecordType G_sFaultRecord;               /*!< @brief From fault.c */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void SimProcessEvents(void);
+static void SimRunGenerators(void);
+static void SimDispatchInterrupts(void);
+static bool SimWakeUpPending(void);
+static u32 SimSysTickPriority(void);
+static void SimTraceOutputs(void);
+static void SimExit(int iCode_, const char* pcReason_);
+#ifdef EIE_TASK_PROFILER
+static void SimPrintTaskProfile(void);
+#endif /* EIE_TASK_PROFILER */
+#ifdef EIE_DEEP_SLEEP
+static void SimPrintDeepSleep(void);
+#endif /* EIE_DEEP_SLEEP */
+static void SimPrintFault(void);
+static void SimSaveTrace(void);
+static void SimHangCheck(int iSignal_);
+static void SimAddButtonPress(const char* pcOption_);
+static void SimAddWave(const char* pcOption_);
+static void SimAddEncoder(const char* pcOption_);
+static void SimAddConsoleInput(const char* pcOption_);
+static void SimOpenConsoleOutput(const char* pcFile_);
+static int SimCompareStimuli(const void* pv1_, const void* pv2_);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Sim_<type>" and be declared as static.
+***********************************************************************************************************************/
+static volatile uint64_t Sim_u64Cycles;                  /*!< @brief Virtual time in MCK cycles */
+static uint64_t Sim_u64NextEvent = SIM_NO_EVENT;         /*!< @brief Earliest cycle something must be processed */
+static uint64_t Sim_u64StopCycle;                        /*!< @brief End of the run */
+
+static bool Sim_bPrimask;                                /*!< @brief Interrupts disabled by __disable_irq() */
+static u32 Sim_u32ActivePriority = SIM_THREAD_PRIORITY;  /*!< @brief Priority of the running exception */
+static bool Sim_bInterruptCheck;                         /*!< @brief Something may be ready to dispatch */
+
+static SimStimulusType Sim_asStimuli[SIM_MAX_STIMULI];   /*!< @brief Pin changes sorted by time */
+static u32 Sim_u32StimulusCount;
+static u32 Sim_u32NextStimulus;
+
+static SimWaveType Sim_sWave = {.u64Next = SIM_NO_EVENT};       /*!< @brief -w square wave */
+static SimEncoderType Sim_sEncoder = {.u64Next = SIM_NO_EVENT}; /*!< @brief -e quadrature encoder */
+
+static FILE* Sim_pConsoleOutput;                         /*!< @brief -o: where the debug console output goes */
+static bool Sim_bQuiet;                                  /*!< @brief -q: no report */
+static const char* Sim_pcTraceFile;                      /*!< @brief -d: where to save the trace ring */
+static bool Sim_bVerbose;                                /*!< @brief -v: trace output changes */
+static u32 Sim_au32LastOutputs[2];                       /*!< @brief PORTA/PORTB ODSR at the last trace */
+
+static struct timespec Sim_sWallStart;                   /*!< @brief Host time when the run started */
+static volatile uint64_t Sim_u64HangCheckCycles;         /*!< @brief Virtual time at the last wall clock check */
+
+/*! @brief Peripheral interrupt handlers in vector table order (see board_cstartup_iar.c) */
+static fnCode_type const Sim_apfIrqHandlers[U8_SAM3U2_INTERRUPT_SOURCES] =
+{
+  SUPC_IrqHandler,  RSTC_IrqHandler,  RTC_IrqHandler,    RTT_IrqHandler,    WDT_IrqHandler,
+  PMC_IrqHandler,   EFC0_IrqHandler,  EFC1_IrqHandler,   DBGU_IrqHandler,   HSMC4_IrqHandler,
+  PIOA_IrqHandler,  PIOB_IrqHandler,  PIOC_IrqHandler,   USART0_IrqHandler, USART1_IrqHandler,
+  USART2_IrqHandler, USART3_IrqHandler, MCI0_IrqHandler, TWI0_IrqHandler,   TWI1_IrqHandler,
+  SPI0_IrqHandler,  SSC0_IrqHandler,  TC0_IrqHandler,    TC1_IrqHandler,    TC2_IrqHandler,
+  PWM_IrqHandler,   ADCC0_IrqHandler, ADCC1_IrqHandler,  HDMA_IrqHandler,   UDPD_IrqHandler
+};
+
+
+/***********************************************************************************************************************
+Function Definitions
+***********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn uint64_t SimGetCycles(void)
+
+@brief Returns the current virtual time.
+
+Requires:
+- NONE
+
+Promises:
+- Returns MCK cycles since the simulated power-on
+
+*/
+uint64_t SimGetCycles(void)
+{
+  return(Sim_u64Cycles);
+
+} /* end SimGetCycles() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimAdvance(u32 u32Cycles_)
+
+@brief Charges firmware execution time and takes any interrupts that are due.
+
+Requires:
+@param u32Cycles_ is the number of MCK cycles to advance
+
+Promises:
+- Peripheral events up to the new time are processed
+- Pending, enabled interrupts with a higher priority than the running code are taken
+
+*/
+void SimAdvance(u32 u32Cycles_)
+{
+  Sim_u64Cycles += u32Cycles_;
+
+  if(Sim_u64Cycles >= Sim_u64NextEvent)
+  {
+    SimProcessEvents();
+  }
+
+  if(Sim_bInterruptCheck && !Sim_bPrimask)
+  {
+    SimDispatchInterrupts();
+  }
+
+} /* end SimAdvance() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimScheduleEvent(uint64_t u64Cycle_)
+
+@brief Makes sure the simulator looks at the peripherals again by a given time.
+
+Requires:
+@param u64Cycle_ is the virtual time of a future peripheral event
+
+Promises:
+- SimPeripheralsUpdate() will run once virtual time reaches u64Cycle_
+
+*/
+void SimScheduleEvent(uint64_t u64Cycle_)
+{
+  if(u64Cycle_ < Sim_u64NextEvent)
+  {
+    Sim_u64NextEvent = u64Cycle_;
+  }
+
+} /* end SimScheduleEvent() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimPendIrq(IRQn_Type eIrq_)
+
+@brief Sets the NVIC pending bit of a peripheral interrupt.
+
+Requires:
+@param eIrq_ is the peripheral interrupt source
+
+Promises:
+- NVIC_ISPR / NVIC_ICPR show the interrupt pending; it is taken at the next
+  access if it is enabled and the priority allows it
+
+*/
+void SimPendIrq(IRQn_Type eIrq_)
+{
+  if((u32)eIrq_ >= U8_SAM3U2_INTERRUPT_SOURCES)
+  {
+    return;
+  }
+
+  AT91C_BASE_NVIC->NVIC_ISPR[0] |= (1 << eIrq_);
+  AT91C_BASE_NVIC->NVIC_ICPR[0] |= (1 << eIrq_);
+  Sim_bInterruptCheck = TRUE;
+
+} /* end SimPendIrq() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimRequestInterruptCheck(void)
+
+@brief Tells the dispatcher that the NVIC or SysTick state changed.
+
+Requires:
+- NONE
+
+Promises:
+- Pending interrupts are re-evaluated at the next access
+
+*/
+void SimRequestInterruptCheck(void)
+{
+  Sim_bInterruptCheck = TRUE;
+
+} /* end SimRequestInterruptCheck() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimSystemReset(const char* pcReason_)
+
+@brief Ends the run because the processor would have reset.
+
+Requires:
+@param pcReason_ describes the reset source
+
+Promises:
+- Prints the report and exits with SIM_EXIT_RESET
+
+*/
+void SimSystemReset(const char* pcReason_)
+{
+  SimExit(SIM_EXIT_RESET, pcReason_);
+
+} /* end SimSystemReset() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimConsoleOutput(u8 u8Char_)
+
+@brief Takes a character the debug console (USART0) finished sending.
+
+Requires:
+@param u8Char_ is the character
+
+Promises:
+- u8Char_ is written to the -o file, if there is one
+
+*/
+void SimConsoleOutput(u8 u8Char_)
+{
+  if(Sim_pConsoleOutput != NULL)
+  {
+    fputc(u8Char_, Sim_pConsoleOutput);
+  }
+
+} /* end SimConsoleOutput() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Core intrinsics (see the EIE_SIM section of core_cm3.h) */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+void __enable_irq(void)
+{
+  SimBusFlush();
+  Sim_bPrimask = FALSE;
+  Sim_bInterruptCheck = TRUE;
+  SimAdvance(1);
+}
+
+void __disable_irq(void)
+{
+  SimBusFlush();
+  Sim_bPrimask = TRUE;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+  return(Sim_bPrimask ? 1 : 0);
+}
+
+void __set_PRIMASK(uint32_t u32PriMask_)
+{
+  if(u32PriMask_ & 1)
+  {
+    __disable_irq();
+  }
+  else
+  {
+    __enable_irq();
+  }
+}
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void __DSB(void)
+
+@brief Completes outstanding register writes (e.g. a reset request before the code waits for it).
+*/
+void __DSB(void)
+{
+  SimBusFlush();
+}
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void __WFE(void)
+
+@brief Sleeps until an interrupt is pending, or in Wait mode until a fast startup event.
+
+With PMC_FSMR LPM set the clocks stop, so interrupts cannot wake the core: only 
+the RTT alarm or a WKUP input enabled in PMC_FSMR ends the sleep.  Peripherals that 
+run from SLCK (RTT, watchdog) keep going.  Otherwise this is __WFI().
+
+Requires:
+- NONE
+
+Promises:
+- Returns when the core would wake up
+- Exits the process at the stop time, on a Backup mode request (SLEEPDEEP) or if
+  nothing can ever wake the core
+
+*/
+void __WFE(void)
+{
+  uint64_t u64SleepStart;
+
+  SimBusFlush();
+  if( !(AT91C_BASE_PMC->PMC_FSMR & AT91C_PMC_LPM) || (AT91C_BASE_NVIC->NVIC_SCR & AT91C_NVIC_SLEEPDEEP) )
+  {
+    __WFI();
+    return;
+  }
+
+  SimTraceOutputs();
+  u64SleepStart = Sim_u64Cycles;
+
+  while(!SimWaitModeWakeUp())
+  {
+    if(Sim_u64NextEvent == SIM_NO_EVENT)
+    {
+      SimExit(SIM_EXIT_DEADLOCK, "Wait mode with no wake up source");
+    }
+
+    if(Sim_u64NextEvent > Sim_u64Cycles)
+    {
+      Sim_u64Cycles = Sim_u64NextEvent;
+    }
+    SimProcessEvents();
+  }
+
+  G_sSimStats.u64SleepCycles += Sim_u64Cycles - u64SleepStart;
+  G_sSimStats.u32WakeUps++;
+  SimAdvance(SIM_CYCLES_PER_EXCEPTION);
+
+} /* end __WFE() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void __WFI(void)
+
+@brief Sleeps until an interrupt is pending.
+
+The core would stop until the next interrupt, so virtual time jumps directly to
+the next peripheral event. As on target, a pending enabled interrupt wakes the
+core even while PRIMASK is set; it is then taken once interrupts are enabled.
+
+Requires:
+- NONE
+
+Promises:
+- Returns when an enabled interrupt is pending
+- Exits the process at the stop time or if nothing can ever wake the core
+- SLEEPDEEP selects Backup mode on this chip, which only wakes up through a reset,
+  so the run ends there
+
+*/
+void __WFI(void)
+{
+  uint64_t u64SleepStart;
+
+  SimBusFlush();
+  if(AT91C_BASE_NVIC->NVIC_SCR & AT91C_NVIC_SLEEPDEEP)
+  {
+    SimSystemReset("Backup mode (SLEEPDEEP) entered");
+  }
+
+  SimTraceOutputs();
+  u64SleepStart = Sim_u64Cycles;
+
+  while(!SimWakeUpPending())
+  {
+    if(Sim_u64NextEvent == SIM_NO_EVENT)
+    {
+      SimExit(SIM_EXIT_DEADLOCK, "sleeping with no wake up source");
+    }
+
+    if(Sim_u64NextEvent > Sim_u64Cycles)
+    {
+      Sim_u64Cycles = Sim_u64NextEvent;
+    }
+    SimProcessEvents();
+  }
+
+  G_sSimStats.u64SleepCycles += Sim_u64Cycles - u64SleepStart;
+  G_sSimStats.u32WakeUps++;
+  SimAdvance(SIM_CYCLES_PER_EXCEPTION);
+
+} /* end __WFI() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimProcessEvents(void)
+
+@brief Handles everything due at the current virtual time and schedules the next check.
+*/
+static void SimProcessEvents(void)
+{
+  if(Sim_u64Cycles >= Sim_u64StopCycle)
+  {
+    SimExit(SIM_EXIT_OK, NULL);
+  }
+
+  while( (Sim_u32NextStimulus < Sim_u32StimulusCount) &&
+         (Sim_asStimuli[Sim_u32NextStimulus].u64Cycle <= Sim_u64Cycles) )
+  {
+    SimStimulusType* psStimulus = &Sim_asStimuli[Sim_u32NextStimulus++];
+    if(psStimulus->s8Key >= 0)
+    {
+      SimKeyDrive((u8)psStimulus->s8Key, (bool)(psStimulus->u32Level != 0));
+    }
+    else
+    {
+      SimPinDrive(psStimulus->ePort, psStimulus->u32Bit, psStimulus->u32Level);
+    }
+  }
+
+  SimRunGenerators();
+
+  Sim_u64NextEvent = Sim_u64StopCycle;
+  if(Sim_u32NextStimulus < Sim_u32StimulusCount)
+  {
+    SimScheduleEvent(Sim_asStimuli[Sim_u32NextStimulus].u64Cycle);
+  }
+  SimScheduleEvent(Sim_sWave.u64Next);
+  SimScheduleEvent(Sim_sEncoder.u64Next);
+
+  /* Also schedules the next peripheral event */
+  SimPeripheralsUpdate();
+
+  if(AT91C_BASE_NVIC->NVIC_ISPR[0] || SimSysTickPending())
+  {
+    Sim_bInterruptCheck = TRUE;
+  }
+
+} /* end SimProcessEvents() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRunGenerators(void)
+
+@brief Moves the -w square wave and the -e encoder up to the current virtual time.
+*/
+static void SimRunGenerators(void)
+{
+  /* Encoder phases in step order from the index: PHA leads PHB going forwards */
+  static const u32 au32Phases[4] = {SIM_TC_QDEC_PHA | SIM_TC_QDEC_PHB, SIM_TC_QDEC_PHB, 0, SIM_TC_QDEC_PHA};
+  u32 u32Phases;
+
+  while(Sim_sWave.u64Next <= Sim_u64Cycles)
+  {
+    Sim_sWave.bHigh = !Sim_sWave.bHigh;
+    SimPinDrive(Sim_sWave.ePort, Sim_sWave.u32Bit, Sim_sWave.bHigh);
+    Sim_sWave.u64Next += Sim_sWave.bHigh ? Sim_sWave.u64HighCycles : (Sim_sWave.u64PeriodCycles - Sim_sWave.u64HighCycles);
+  }
+
+  while(Sim_sEncoder.u64Next <= Sim_u64Cycles)
+  {
+    Sim_sEncoder.s32Position += Sim_sEncoder.s32Direction;
+    u32Phases = au32Phases[(u32)Sim_sEncoder.s32Position & 3];
+    SimPinDrive(PORTA, SIM_TC_QDEC_PHA, u32Phases & SIM_TC_QDEC_PHA);
+    SimPinDrive(PORTA, SIM_TC_QDEC_PHB, u32Phases & SIM_TC_QDEC_PHB);
+
+    if(Sim_sEncoder.u32CountsPerRev != 0)
+    {
+      SimPinDrive(PORTB, SIM_TC_QDEC_IDX,
+                  (u32)((Sim_sEncoder.s32Position % (s32)Sim_sEncoder.u32CountsPerRev) == 0));
+    }
+
+    Sim_sEncoder.u64Next += Sim_sEncoder.u64StepCycles;
+  }
+
+} /* end SimRunGenerators() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimDispatchInterrupts(void)
+
+@brief Runs pending interrupt handlers that can preempt the current code, highest priority first.
+
+Priorities come from NVIC_IPR for peripherals and the SHPR3 byte for SysTick.
+Lower values win; ties go to SysTick and then the lower IRQ number.
+*/
+static void SimDispatchInterrupts(void)
+{
+  for(;;)
+  {
+    u32 u32Ready = AT91C_BASE_NVIC->NVIC_ISPR[0] & AT91C_BASE_NVIC->NVIC_ISER[0];
+    u32 u32BestPriority = Sim_u32ActivePriority;
+    s32 s32Best = SIM_NO_INTERRUPT;
+    u32 u32SavedPriority;
+    u32 u32SavedIcsr;
+
+    if(SimSysTickPending() && (SimSysTickPriority() < u32BestPriority))
+    {
+      u32BestPriority = SimSysTickPriority();
+      s32Best = SIM_SYSTICK_INTERRUPT;
+    }
+
+    for(u8 i = 0; i < U8_SAM3U2_INTERRUPT_SOURCES; i++)
+    {
+      u32 u32Priority = ((volatile u8*)AT91C_BASE_NVIC->NVIC_IPR)[i];
+
+      if( (u32Ready & (1 << i)) && (u32Priority < u32BestPriority) )
+      {
+        u32BestPriority = u32Priority;
+        s32Best = i;
+      }
+    }
+
+    if(s32Best == SIM_NO_INTERRUPT)
+    {
+      Sim_bInterruptCheck = (u32Ready != 0) || SimSysTickPending();
+      return;
+    }
+
+    /* Enter the exception (ICSR VECTACTIVE shows which, as IPSR would) */
+    u32SavedPriority = Sim_u32ActivePriority;
+    u32SavedIcsr = SCB->ICSR;
+    Sim_u32ActivePriority = u32BestPriority;
+    Sim_u64Cycles += SIM_CYCLES_PER_EXCEPTION;
+
+    if(s32Best == SIM_SYSTICK_INTERRUPT)
+    {
+      SCB->ICSR = (u32SavedIcsr & ~SIM_ICSR_VECTACTIVE) | SIM_SYSTICK_EXCEPTION;
+      SimSysTickAcknowledge();
+      G_sSimStats.u32SysTicks++;
+      SysTick_Handler();
+    }
+    else
+    {
+      AT91C_BASE_NVIC->NVIC_ISPR[0] &= ~(1 << s32Best);
+      AT91C_BASE_NVIC->NVIC_ICPR[0] &= ~(1 << s32Best);
+      G_sSimStats.au32IrqCount[s32Best]++;
+      SCB->ICSR = (u32SavedIcsr & ~SIM_ICSR_VECTACTIVE) | (SIM_FIRST_IRQ_EXCEPTION + s32Best);
+      Sim_apfIrqHandlers[s32Best]();
+    }
+
+    SimBusFlush();
+    Sim_u64Cycles += SIM_CYCLES_PER_EXCEPTION;
+    Sim_u32ActivePriority = u32SavedPriority;
+    SCB->ICSR = u32SavedIcsr;
+
+    if(Sim_bPrimask)
+    {
+      return;
+    }
+  }
+
+} /* end SimDispatchInterrupts() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static bool SimWakeUpPending(void)
+
+@brief TRUE if an enabled interrupt is pending (ignoring PRIMASK, as WFI does).
+*/
+static bool SimWakeUpPending(void)
+{
+  return( (AT91C_BASE_NVIC->NVIC_ISPR[0] & AT91C_BASE_NVIC->NVIC_ISER[0]) || SimSysTickPending() );
+
+} /* end SimWakeUpPending() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 SimSysTickPriority(void)
+
+@brief SysTick priority byte (system handler 15 in SHPR3).
+*/
+static u32 SimSysTickPriority(void)
+{
+  return( ((volatile u8*)&AT91C_BASE_NVIC->NVIC_HAND12PR)[3] );
+
+} /* end SimSysTickPriority() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTraceOutputs(void)
+
+@brief -v: prints the GPIO outputs whenever they changed since the last sleep.
+*/
+static void SimTraceOutputs(void)
+{
+  u32 u32PortA = SimPortOutputs(PORTA);
+  u32 u32PortB = SimPortOutputs(PORTB);
+
+  if( Sim_bVerbose &&
+      ((u32PortA != Sim_au32LastOutputs[0]) || (u32PortB != Sim_au32LastOutputs[1])) )
+  {
+    printf("%10.3f ms  PIOA 0x%08X  PIOB 0x%08X\n",
+           (double)Sim_u64Cycles * 1000.0 / SIM_CORE_CLOCK_HZ, (unsigned)u32PortA, (unsigned)u32PortB);
+  }
+
+  Sim_au32LastOutputs[0] = u32PortA;
+  Sim_au32LastOutputs[1] = u32PortB;
+
+} /* end SimTraceOutputs() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimExit(int iCode_, const char* pcReason_)
+
+@brief Prints the report and ends the process.
+*/
+static void SimExit(int iCode_, const char* pcReason_)
+{
+  struct timespec sWallEnd;
+  double dWallSeconds;
+  double dSimSeconds = (double)Sim_u64Cycles / SIM_CORE_CLOCK_HZ;
+
+  SimBusFlush();
+  if(Sim_pConsoleOutput != NULL)
+  {
+    fflush(Sim_pConsoleOutput);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &sWallEnd);
+  dWallSeconds = (double)(sWallEnd.tv_sec - Sim_sWallStart.tv_sec) +
+                 (double)(sWallEnd.tv_nsec - Sim_sWallStart.tv_nsec) / 1e9;
+
+  if(pcReason_ != NULL)
+  {
+    fprintf(stderr, "sim: %s at %.3f ms\n", pcReason_, dSimSeconds * 1000.0);
+  }
+
+  if(Sim_pcTraceFile != NULL)
+  {
+    SimSaveTrace();
+  }
+
+  if(!Sim_bQuiet)
+  {
+    printf("---- EiE simulation report ----\n");
+    printf("simulated     %.3f ms in %.3f s wall (%.1fx real time)\n",
+           dSimSeconds * 1000.0, dWallSeconds, (dWallSeconds > 0.0) ? dSimSeconds / dWallSeconds : 0.0);
+    printf("sleeping      %.1f %%, %u wake ups\n",
+           Sim_u64Cycles ? 100.0 * (double)G_sSimStats.u64SleepCycles / (double)Sim_u64Cycles : 0.0,
+           (unsigned)G_sSimStats.u32WakeUps);
+    printf("SysTicks      %u\n", (unsigned)G_sSimStats.u32SysTicks);
+    printf("bus accesses  %llu reads, %llu writes\n",
+           (unsigned long long)G_sSimStats.u64BusReads, (unsigned long long)G_sSimStats.u64BusWrites);
+    printf("WDT restarts  %u\n", (unsigned)G_sSimStats.u32WatchdogFeeds);
+    if(G_sSimStats.u32UsartTxBytes || G_sSimStats.u32UsartRxBytes || G_sSimStats.u32UsartRxLost)
+    {
+      printf("USART0        %u bytes sent, %u received, %u lost\n", (unsigned)G_sSimStats.u32UsartTxBytes,
+             (unsigned)G_sSimStats.u32UsartRxBytes, (unsigned)G_sSimStats.u32UsartRxLost);
+    }
+    if(G_sSimStats.u32TwiTransfers)
+    {
+      printf("TWI0          %u transfers (%u NACK), %u bytes written, %u read\n", (unsigned)G_sSimStats.u32TwiTransfers,
+             (unsigned)G_sSimStats.u32TwiNacks, (unsigned)G_sSimStats.u32TwiBytesWritten,
+             (unsigned)G_sSimStats.u32TwiBytesRead);
+    }
+    if(G_sSimStats.u32LcdCommands || G_sSimStats.u32LcdCharacters)
+    {
+      printf("LCD           %u commands, %u characters\n", (unsigned)G_sSimStats.u32LcdCommands,
+             (unsigned)G_sSimStats.u32LcdCharacters);
+      for(u8 i = 0; i < U8_LCD_LINES; i++)
+      {
+        printf("LCD line %u    |%.*s|\n", (unsigned)(i + 1), (int)U8_LCD_COLUMNS, G_sSimLcd.aacShown[i]);
+      }
+    }
+    for(u8 i = 0; i < U8_AUDIO_VOICES; i++)
+    {
+      if(G_sSimStats.au32BuzzerTones[i])
+      {
+        printf("BUZZER%u       %u tones, %.1f ms on\n", (unsigned)(i + 1), (unsigned)G_sSimStats.au32BuzzerTones[i],
+               (double)G_sSimStats.au64BuzzerCycles[i] * 1000.0 / SIM_CORE_CLOCK_HZ);
+      }
+    }
+
+    for(u8 i = 0; i < U8_SAM3U2_INTERRUPT_SOURCES; i++)
+    {
+      if(G_sSimStats.au32IrqCount[i])
+      {
+        printf("IRQ %2u        %u\n", (unsigned)i, (unsigned)G_sSimStats.au32IrqCount[i]);
+      }
+    }
+
+    printf("PIOA ODSR     0x%08X\n", (unsigned)SimPortOutputs(PORTA));
+    printf("PIOB ODSR     0x%08X\n", (unsigned)SimPortOutputs(PORTB));
+
+#ifdef EIE_TASK_PROFILER
+    SimPrintTaskProfile();
+#endif /* EIE_TASK_PROFILER */
+#ifdef EIE_DEEP_SLEEP
+    SimPrintDeepSleep();
+#endif /* EIE_DEEP_SLEEP */
+    SimPrintFault();
+  }
+
+  fflush(stdout);
+  exit(iCode_);
+
+} /* end SimExit() */
+
+
+#ifdef EIE_TASK_PROFILER
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPrintTaskProfile(void)
+
+@brief Prints the super loop task profiler results from main.c.
+*/
+static void SimPrintTaskProfile(void)
+{
+  printf("---- task profile (cycles) ----\n");
+  printf("%-10s %10s %10s %8s %8s %8s  log2 histogram (bucket:count)\n", "task", "calls", "idle", "min", "mean", "max");
+
+  for(u8 i = 0; i < U8_MAIN_TASKS; i++)
+  {
+    TaskProfileType* psTask = &G_asMainTaskProfile[i];
+
+    printf("%-10s %10u %10u %8u %8u %8u ", psTask->pcName ? psTask->pcName : "?", (unsigned)psTask->u32Calls,
+           (unsigned)psTask->u32Skips,
+           psTask->u32Calls ? (unsigned)psTask->u32MinCycles : 0,
+           psTask->u32Calls ? (unsigned)(psTask->u64TotalCycles / psTask->u32Calls) : 0,
+           (unsigned)psTask->u32MaxCycles);
+    for(u8 j = 0; j < U8_MAIN_PROFILER_BUCKETS; j++)
+    {
+      if(psTask->au32Histogram[j])
+      {
+        printf(" %u:%u", (unsigned)j, (unsigned)psTask->au32Histogram[j]);
+      }
+    }
+    printf("\n");
+  }
+
+  printf("loop       %10u iterations, max %u cycles, %u overruns (last at %u ms)\n",
+         (unsigned)G_sMainLoopProfile.u32Iterations, (unsigned)G_sMainLoopProfile.u32MaxCycles,
+         (unsigned)G_sMainLoopProfile.u32Overruns, (unsigned)G_sMainLoopProfile.u32LastOverrunTime);
+
+} /* end SimPrintTaskProfile() */
+#endif /* EIE_TASK_PROFILER */
+
+
+#ifdef EIE_DEEP_SLEEP
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPrintDeepSleep(void)
+
+@brief Prints the deep sleep counters kept by the board file.
+*/
+static void SimPrintDeepSleep(void)
+{
+  static const char* apcSources[U8_BSP_WAKE_SOURCES] = {"none", "RTT", "button", "other"};
+
+  printf("---- deep sleep ----\n");
+  printf("sleeps        %u (RTT %u, button %u, other %u), last woken by %s\n", (unsigned)G_sBspDeepSleep.u32Sleeps,
+         (unsigned)G_sBspDeepSleep.au32Wakes[BSP_WAKE_RTT], (unsigned)G_sBspDeepSleep.au32Wakes[BSP_WAKE_BUTTON],
+         (unsigned)G_sBspDeepSleep.au32Wakes[BSP_WAKE_OTHER], apcSources[G_sBspDeepSleep.eLastWakeSource]);
+  printf("wake latency  last %u us, max %u us, margin %u ms\n", (unsigned)G_sBspDeepSleep.u32LastLatencyUs,
+         (unsigned)G_sBspDeepSleep.u32MaxLatencyUs, (unsigned)G_sBspDeepSleep.u32WakeMarginMs);
+
+} /* end SimPrintDeepSleep() */
+#endif /* EIE_DEEP_SLEEP */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPrintFault(void)
+
+@brief Prints the record FaultCapture() or FaultTaskWatchdog() left for the next start up, if the run ended in one.
+*/
+static void SimPrintFault(void)
+{
+  if(G_sFaultRecord.u32Magic != U32_FAULT_MAGIC)
+  {
+    return;
+  }
+
+  printf("---- fault record ----\n");
+  printf("cause %u, exception %u, task %u, at %u ms\n", (unsigned)G_sFaultRecord.u8Cause,
+         (unsigned)G_sFaultRecord.u32Exception, (unsigned)G_sFaultRecord.u8Task,
+         (unsigned)G_sFaultRecord.u32SystemTime1ms);
+  printf("CFSR 0x%08X  HFSR 0x%08X  MMFAR 0x%08X  BFAR 0x%08X\n", (unsigned)G_sFaultRecord.u32Cfsr,
+         (unsigned)G_sFaultRecord.u32Hfsr, (unsigned)G_sFaultRecord.u32Mmfar, (unsigned)G_sFaultRecord.u32Bfar);
+
+} /* end SimPrintFault() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimSaveTrace(void)
+
+@brief Writes the raw trace ring to the -d file, the same bytes a debugger memory save gives.
+*/
+static void SimSaveTrace(void)
+{
+#ifdef EIE_TRACE
+  FILE* pFile = fopen(Sim_pcTraceFile, "wb");
+
+  if( (pFile == NULL) || (fwrite(&G_sTrace, sizeof(G_sTrace), 1, pFile) != 1) )
+  {
+    fprintf(stderr, "sim: cannot write %s\n", Sim_pcTraceFile);
+  }
+  else
+  {
+    fprintf(stderr, "sim: trace ring (%u events) saved to %s\n", (unsigned)G_sTrace.u32Head, Sim_pcTraceFile);
+  }
+
+  if(pFile != NULL)
+  {
+    fclose(pFile);
+  }
+#else
+  fprintf(stderr, "sim: -d needs a build with EIE_TRACE defined\n");
+#endif /* EIE_TRACE */
+
+} /* end SimSaveTrace() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimHangCheck(int iSignal_)
+
+@brief Wall clock watchdog: virtual time stops only when the firmware spins without touching memory.
+*/
+static void SimHangCheck(int iSignal_)
+{
+  static const char acMessage[] = "sim: firmware stopped making progress (stuck in a loop or exception handler)\n";
+  (void)iSignal_;
+
+  if(Sim_u64Cycles == Sim_u64HangCheckCycles)
+  {
+    (void)write(STDERR_FILENO, acMessage, sizeof(acMessage) - 1);
+    _exit(SIM_EXIT_HANG);
+  }
+
+  Sim_u64HangCheckCycles = Sim_u64Cycles;
+
+} /* end SimHangCheck() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimAddButtonPress(const char* pcOption_)
+
+@brief Parses "-b button:start_ms:hold_ms" into a press and a release stimulus.
+
+Button numbers from U8_TOTAL_BUTTONS up are keypad keys in EIE_KEYPAD builds.
+*/
+static void SimAddButtonPress(const char* pcOption_)
+{
+  unsigned uButton, uStart, uHold;
+  const PinConfigurationType* psButton;
+
+  if( (sscanf(pcOption_, "%u:%u:%u", &uButton, &uStart, &uHold) != 3) || (uButton >= U8_BUTTON_INPUTS) ||
+      (Sim_u32StimulusCount + 2 > SIM_MAX_STIMULI) )
+  {
+    fprintf(stderr, "sim: bad button option '%s'\n", pcOption_);
+    exit(SIM_EXIT_SETUP);
+  }
+
+  for(u8 i = 0; i < 2; i++)
+  {
+    SimStimulusType* psStimulus = &Sim_asStimuli[Sim_u32StimulusCount++];
+
+    psStimulus->u64Cycle = ((uint64_t)uStart + (i ? uHold : 0)) * (SIM_CORE_CLOCK_HZ / 1000);
+    if(uButton >= U8_TOTAL_BUTTONS)
+    {
+      psStimulus->s8Key    = (s8)(uButton - U8_TOTAL_BUTTONS);
+      psStimulus->u32Level = (i == 0);
+      continue;
+    }
+
+    psButton = &G_asBspButtonConfigurations[uButton];
+    psStimulus->s8Key    = -1;
+    psStimulus->ePort    = psButton->ePort;
+    psStimulus->u32Bit   = psButton->u32BitPosition;
+    psStimulus->u32Level = (i == 0) ? (psButton->eActiveState == ACTIVE_HIGH) : (psButton->eActiveState != ACTIVE_HIGH);
+  }
+
+} /* end SimAddButtonPress() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimAddWave(const char* pcOption_)
+
+@brief Parses "-w pin:period_us:high_us" (pin as a5 / b5) into the square wave generator.
+
+The pin starts high at time 0.
+*/
+static void SimAddWave(const char* pcOption_)
+{
+  char cPort;
+  unsigned uPin, uPeriod, uHigh;
+
+  if( (sscanf(pcOption_, "%c%u:%u:%u", &cPort, &uPin, &uPeriod, &uHigh) != 4) || (uPin > 31) ||
+      ((cPort != 'a') && (cPort != 'b')) || (uHigh == 0) || (uHigh >= uPeriod) )
+  {
+    fprintf(stderr, "sim: bad wave option '%s'\n", pcOption_);
+    exit(SIM_EXIT_SETUP);
+  }
+
+  Sim_sWave.ePort           = (cPort == 'a') ? PORTA : PORTB;
+  Sim_sWave.u32Bit          = (u32)1 << uPin;
+  Sim_sWave.u64PeriodCycles = (uint64_t)uPeriod * (SIM_CORE_CLOCK_HZ / 1000000);
+  Sim_sWave.u64HighCycles   = (uint64_t)uHigh * (SIM_CORE_CLOCK_HZ / 1000000);
+  Sim_sWave.bHigh           = TRUE;
+  Sim_sWave.u64Next         = Sim_sWave.u64HighCycles;
+
+} /* end SimAddWave() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimAddEncoder(const char* pcOption_)
+
+@brief Parses "-e counts_per_s[:counts_per_rev]" into the quadrature encoder.
+
+The encoder starts at its index with both phases high (the pins' idle level).
+*/
+static void SimAddEncoder(const char* pcOption_)
+{
+  int iRate;
+  unsigned uPerRev = 0;
+
+  if( (sscanf(pcOption_, "%d:%u", &iRate, &uPerRev) < 1) || (iRate == 0) ||
+      ((uint64_t)abs(iRate) > SIM_CORE_CLOCK_HZ) )
+  {
+    fprintf(stderr, "sim: bad encoder option '%s'\n", pcOption_);
+    exit(SIM_EXIT_SETUP);
+  }
+
+  Sim_sEncoder.s32Direction    = (iRate > 0) ? 1 : -1;
+  Sim_sEncoder.s32Position     = 0;
+  Sim_sEncoder.u32CountsPerRev = uPerRev;
+  Sim_sEncoder.u64StepCycles   = SIM_CORE_CLOCK_HZ / (uint64_t)abs(iRate);
+  Sim_sEncoder.u64Next         = Sim_sEncoder.u64StepCycles;
+
+} /* end SimAddEncoder() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimAddConsoleInput(const char* pcOption_)
+
+@brief Parses "-u ms:text" into a line typed on the debug console.
+*/
+static void SimAddConsoleInput(const char* pcOption_)
+{
+  unsigned uStart;
+  int iText = 0;
+
+  if( (sscanf(pcOption_, "%u:%n", &uStart, &iText) != 1) || (iText == 0) ||
+      !SimUsartInput((uint64_t)uStart * (SIM_CORE_CLOCK_HZ / 1000), &pcOption_[iText]) )
+  {
+    fprintf(stderr, "sim: bad console input option '%s'\n", pcOption_);
+    exit(SIM_EXIT_SETUP);
+  }
+
+} /* end SimAddConsoleInput() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimOpenConsoleOutput(const char* pcFile_)
+
+@brief Opens the -o file ("-" is stdout, unbuffered so it interleaves with -v).
+*/
+static void SimOpenConsoleOutput(const char* pcFile_)
+{
+  if(strcmp(pcFile_, "-") == 0)
+  {
+    Sim_pConsoleOutput = stdout;
+    setvbuf(stdout, NULL, _IONBF, 0);
+    return;
+  }
+
+  Sim_pConsoleOutput = fopen(pcFile_, "wb");
+  if(Sim_pConsoleOutput == NULL)
+  {
+    fprintf(stderr, "sim: cannot write %s\n", pcFile_);
+    exit(SIM_EXIT_SETUP);
+  }
+
+} /* end SimOpenConsoleOutput() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static int SimCompareStimuli(const void* pv1_, const void* pv2_)
+
+@brief qsort() ordering of stimuli by time.
+*/
+static int SimCompareStimuli(const void* pv1_, const void* pv2_)
+{
+  uint64_t u64Time1 = ((const SimStimulusType*)pv1_)->u64Cycle;
+  uint64_t u64Time2 = ((const SimStimulusType*)pv2_)->u64Cycle;
+
+  return( (u64Time1 > u64Time2) - (u64Time1 < u64Time2) );
+
+} /* end SimCompareStimuli() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimInitialize(int argc, char** argv)
+
+@brief Sets up the simulated board before the firmware's main() runs.
+
+Runs as a constructor so the firmware keeps its target main(); glibc passes the
+command line to constructors.
+*/
+__attribute__((constructor)) static void SimInitialize(int argc, char** argv)
+{
+  u32 u32StopMs = SIM_DEFAULT_RUN_MS;
+  int iOption;
+  struct itimerval sHangTimer = { {SIM_HANG_CHECK_S, 0}, {SIM_HANG_CHECK_S, 0} };
+
+  while( (iOption = getopt(argc, argv, "t:b:w:e:u:o:d:qv")) != -1 )
+  {
+    switch(iOption)
+    {
+      case 't': u32StopMs = (u32)strtoul(optarg, NULL, 0); break;
+      case 'b': SimAddButtonPress(optarg); break;
+      case 'w': SimAddWave(optarg); break;
+      case 'e': SimAddEncoder(optarg); break;
+      case 'u': SimAddConsoleInput(optarg); break;
+      case 'o': SimOpenConsoleOutput(optarg); break;
+      case 'd': Sim_pcTraceFile = optarg; break;
+      case 'q': Sim_bQuiet = TRUE; break;
+      case 'v': Sim_bVerbose = TRUE; break;
+      default:
+      {
+        fprintf(stderr, "usage: %s [-t ms] [-b button:start_ms:hold_ms]... [-w pin:period_us:high_us]\n"
+                        "       [-e counts_per_s[:counts_per_rev]] [-u ms:text]... [-o file] [-d file] [-q] [-v]\n",
+                argv[0]);
+        exit(SIM_EXIT_SETUP);
+      }
+    }
+  }
+
+  qsort(Sim_asStimuli, Sim_u32StimulusCount, sizeof(SimStimulusType), SimCompareStimuli);
+  Sim_u64StopCycle = (uint64_t)u32StopMs * (SIM_CORE_CLOCK_HZ / 1000);
+
+  SimRegistersInitialize();
+  Sim_u64NextEvent = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &Sim_sWallStart);
+  signal(SIGALRM, SimHangCheck);
+  setitimer(ITIMER_REAL, &sHangTimer, NULL);
+
+} /* end SimInitialize() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,338 @@
+/*!**********************************************************************************************************************
+@file sim.h
+@brief Header file for the host simulation of the AT91SAM3U4 (sim.c and sim_registers.c).
+
+The simulation is only part of the EIE_SIM build (see firmware_ascii/gcc_sim/Makefile)
+and is never compiled into target firmware.
+***********************************************************************************************************************/
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stdint.h>
+
+/***********************************************************************************************************************
+Type Definitions
+***********************************************************************************************************************/
+
+/*!
+@struct SimStimulusType
+@brief One scheduled change of an input pin driven by the simulated board.
+*/
+typedef struct
+{
+  uint64_t u64Cycle;                      /*!< @brief Virtual time (core cycles) when the change happens */
+  PortOffsetType ePort;                   /*!< @brief Port of the pin */
+  u32 u32Bit;                             /*!< @brief Pin bit mask */
+  u32 u32Level;                           /*!< @brief 0 to drive the pin low, anything else to release it high */
+  s8 s8Key;                               /*!< @brief Keypad key to close (u32Level != 0) or open instead of a pin, or -1 */
+}SimStimulusType;
+
+
+/*!
+@struct SimWaveType
+@brief Square wave driven onto one input pin (-w).
+*/
+typedef struct
+{
+  PortOffsetType ePort;                   /*!< @brief Port of the pin */
+  u32 u32Bit;                             /*!< @brief Pin bit mask */
+  uint64_t u64PeriodCycles;               /*!< @brief Period in core cycles */
+  uint64_t u64HighCycles;                 /*!< @brief High part of the period */
+  bool bHigh;                             /*!< @brief Level driven now */
+  uint64_t u64Next;                       /*!< @brief Cycle of the next edge or SIM_NO_EVENT */
+}SimWaveType;
+
+
+/*!
+@struct SimEncoderType
+@brief Quadrature encoder turning at a constant rate (-e).
+*/
+typedef struct
+{
+  s32 s32Position;                        /*!< @brief Edges from the index */
+  s32 s32Direction;                       /*!< @brief +1 forwards (PHA leads), -1 backwards */
+  u32 u32CountsPerRev;                    /*!< @brief Edges between index pulses, 0 for no index */
+  uint64_t u64StepCycles;                 /*!< @brief Core cycles between edges */
+  uint64_t u64Next;                       /*!< @brief Cycle of the next edge or SIM_NO_EVENT */
+}SimEncoderType;
+
+
+/*!
+@struct SimStatsType
+@brief Counters collected during a simulation run and printed on exit.
+*/
+typedef struct
+{
+  uint64_t u64BusReads;                   /*!< @brief Peripheral register reads */
+  uint64_t u64BusWrites;                  /*!< @brief Peripheral register writes */
+  uint64_t u64SleepCycles;                /*!< @brief Cycles spent in __WFI */
+  u32 u32WakeUps;                         /*!< @brief Number of times __WFI returned */
+  u32 u32SysTicks;                        /*!< @brief SysTick exceptions taken */
+  u32 u32WatchdogFeeds;                   /*!< @brief Valid WDT_CR restarts */
+  u32 au32IrqCount[U8_SAM3U2_INTERRUPT_SOURCES]; /*!< @brief Peripheral interrupts taken per IRQn */
+  u32 u32UsartTxBytes;                    /*!< @brief Characters USART0 sent */
+  u32 u32UsartRxBytes;                    /*!< @brief -u characters USART0 received */
+  u32 u32UsartRxLost;                     /*!< @brief -u characters sent while the receiver was off or full */
+  u32 u32TwiTransfers;                    /*!< @brief TWI0 transfers that ended with a STOP */
+  u32 u32TwiBytesWritten;                 /*!< @brief Data bytes TWI0 sent (not addresses) */
+  u32 u32TwiBytesRead;                    /*!< @brief Data bytes TWI0 received */
+  u32 u32TwiNacks;                        /*!< @brief TWI0 transfers to an address nobody answered */
+  u32 u32LcdCommands;                     /*!< @brief Command bytes the LCD took */
+  u32 u32LcdCharacters;                   /*!< @brief Character bytes the LCD took */
+  u32 au32BuzzerTones[U8_AUDIO_VOICES];   /*!< @brief Tones each buzzer started (enables and period changes while on) */
+  uint64_t au64BuzzerCycles[U8_AUDIO_VOICES]; /*!< @brief Cycles each buzzer was on, to the last time it went off */
+}SimStatsType;
+
+
+/*!
+@struct SimTcChannelType
+@brief Counter state of one simulated TC channel.
+*/
+typedef struct
+{
+  bool bRunning;                          /*!< @brief Counter has been triggered and is counting */
+  uint64_t u64Origin;                     /*!< @brief Cycle of the last trigger (counter = 0) */
+  uint64_t u64LastTick;                   /*!< @brief Counter ticks since the trigger already processed */
+  uint64_t u64NextEvent;                  /*!< @brief Cycle of the next compare event or SIM_NO_EVENT */
+  bool bRaLoaded;                         /*!< @brief Capture: RA loaded since the trigger or the last RB load */
+}SimTcChannelType;
+
+
+/*!
+@struct SimPwmChannelType
+@brief Period timing of one simulated PWM channel.
+
+Only channels with their interrupt enabled (PWMC_IMR1) get period events; the others
+take a PWMC_CPRDUPDR write at once rather than at the end of the period.
+*/
+typedef struct
+{
+  uint64_t u64Enabled;                    /*!< @brief Cycle the channel was last enabled */
+  uint64_t u64PeriodEnd;                  /*!< @brief Cycle the running period ends or SIM_NO_EVENT */
+  bool bUpdate;                           /*!< @brief PWMC_CPRDUPDR was written and is loaded at the period end */
+}SimPwmChannelType;
+
+
+/*!
+@struct SimUsartInputType
+@brief A line typed on the debug console (-u).
+*/
+typedef struct
+{
+  uint64_t u64Cycle;                      /*!< @brief Virtual time the first character arrives */
+  const char* pcText;                     /*!< @brief Characters sent; a CR follows them */
+}SimUsartInputType;
+
+
+/*!
+@struct SimUsartType
+@brief Line and PDC state of the simulated USART0 (the debug console).
+*/
+typedef struct
+{
+  bool bRxEnabled;                        /*!< @brief Receiver enabled (US_CR RXEN) */
+  bool bTxEnabled;                        /*!< @brief Transmitter enabled (US_CR TXEN) */
+  u8 u8TxShift;                           /*!< @brief Character on the line */
+  uint64_t u64TxDone;                     /*!< @brief Cycle u8TxShift has been sent or SIM_NO_EVENT */
+  uint64_t u64RxNext;                     /*!< @brief Cycle the next -u character arrives or SIM_NO_EVENT */
+  uint64_t u64Timeout;                    /*!< @brief Cycle the receiver time-out expires or SIM_NO_EVENT */
+  bool bTimeoutWaiting;                   /*!< @brief STTTO: the time-out starts at the next character */
+  u32 u32NextInput;                       /*!< @brief -u line being sent */
+  u32 u32NextChar;                        /*!< @brief Next character of that line */
+}SimUsartType;
+
+
+/*!
+@struct SimTwiType
+@brief Bus state of the simulated TWI0 master, one byte (9 clocks) at a time.
+*/
+typedef struct
+{
+  u8 u8Phase;                             /*!< @brief SIM_TWI_IDLE ... SIM_TWI_READ: what the byte on the bus is */
+  bool bMasterEnabled;                    /*!< @brief TWI_CR MSEN */
+  bool bRead;                             /*!< @brief The transfer reads (TWI_MMR MREAD when it started) */
+  bool bStop;                             /*!< @brief TWI_CR STOP: end after the byte on the bus */
+  bool bThrFull;                          /*!< @brief TWI_THR holds a byte the bus has not taken */
+  u8 u8InternalLeft;                      /*!< @brief TWI_IADR bytes still to send */
+  u8 u8Data;                              /*!< @brief Data byte on the bus in a write */
+  uint64_t u64ByteDone;                   /*!< @brief Cycle the byte on the bus ends or SIM_NO_EVENT (idle or waiting) */
+}SimTwiType;
+
+
+/*!
+@struct SimLcdType
+@brief What the LCD on TWI0 (ST7036, I2C interface) has been told and shows.
+*/
+typedef struct
+{
+  bool bControl;                          /*!< @brief The next byte is a control byte */
+  bool bCo;                               /*!< @brief Last control byte: only one byte follows it */
+  bool bRs;                               /*!< @brief Last control byte: the bytes are characters, not commands */
+  u8 u8Address;                           /*!< @brief DDRAM address the next character goes to */
+  char aacShown[U8_LCD_LINES][U8_LCD_COLUMNS]; /*!< @brief The visible part of the display data RAM */
+}SimLcdType;
+
+
+/*!
+@struct SimWakeUpInputType
+@brief A fast startup (WKUPn) input of the chip and the pin it is on.
+*/
+typedef struct
+{
+  u8 u8Input;                             /*!< @brief WKUP number (FSTT / FSPR bit) */
+  PortOffsetType ePort;                   /*!< @brief Port of the pin */
+  u32 u32Bit;                             /*!< @brief Pin bit mask */
+}SimWakeUpInputType;
+
+
+/***********************************************************************************************************************
+Function Declarations
+***********************************************************************************************************************/
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @publicsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+uint64_t SimGetCycles(void);
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* sim.c */
+void SimAdvance(u32 u32Cycles_);
+void SimScheduleEvent(uint64_t u64Cycle_);
+void SimPendIrq(IRQn_Type eIrq_);
+void SimRequestInterruptCheck(void);
+void SimSystemReset(const char* pcReason_);
+void SimConsoleOutput(u8 u8Char_);
+
+/* sim_registers.c */
+void SimRegistersInitialize(void);
+void SimBusFlush(void);
+void SimPinDrive(PortOffsetType ePort_, u32 u32Bit_, u32 u32Level_);
+void SimKeyDrive(u8 u8Key_, bool bClosed_);
+void SimPeripheralsUpdate(void);
+uint64_t SimPeripheralsNextEvent(void);
+bool SimSysTickPending(void);
+void SimSysTickAcknowledge(void);
+u32 SimPortOutputs(PortOffsetType ePort_);
+bool SimWaitModeWakeUp(void);
+bool SimUsartInput(uint64_t u64Cycle_, const char* pcText_);
+
+
+/***********************************************************************************************************************
+Constants / Definitions
+***********************************************************************************************************************/
+#define SIM_CORE_CLOCK_HZ           (uint64_t)(MCK)          /*!< @brief Virtual core clock (48 MHz) */
+#define SIM_SLOW_CLOCK_HZ           (uint64_t)32768          /*!< @brief Virtual SLCK for WDT / RTT / TIMER_CLOCK5 */
+#define SIM_NO_EVENT                (uint64_t)(~0ULL)        /*!< @brief Marker for "nothing scheduled" */
+
+#define SIM_DEFAULT_RUN_MS          (u32)10000               /*!< @brief Run length without -t */
+#define SIM_HANG_CHECK_S            (long)2                  /*!< @brief Wall clock seconds between progress checks */
+#define SIM_MAX_STIMULI             (u32)64                  /*!< @brief Scripted pin changes (two per -b option) */
+#define SIM_MAX_CONSOLE_INPUTS      (u32)16                  /*!< @brief -u lines */
+
+#define SIM_THREAD_PRIORITY         (u32)0x100               /*!< @brief Lower than any exception priority */
+#define SIM_NO_INTERRUPT            (s32)-1                  /*!< @brief Dispatcher: nothing can run */
+#define SIM_SYSTICK_INTERRUPT       (s32)-2                  /*!< @brief Dispatcher: SysTick wins */
+#define SIM_ICSR_VECTACTIVE         (u32)0x000001FF          /*!< @brief SCB_ICSR active exception number */
+#define SIM_SYSTICK_EXCEPTION       (u32)15                  /*!< @brief SysTick exception number */
+#define SIM_FIRST_IRQ_EXCEPTION     (u32)16                  /*!< @brief Exception number of IRQ 0 */
+
+/* Rough Cortex-M3 cost model charged while firmware code runs.  Only accesses to
+globals, peripherals and calls are visible to the simulator, so these lump the
+surrounding register-only instructions into each visible event. */
+#define SIM_CYCLES_PER_ACCESS       (u32)3                   /*!< @brief SRAM load/store plus nearby ALU work */
+#define SIM_CYCLES_PER_BUS_ACCESS   (u32)6                   /*!< @brief Peripheral access through the APB bridge */
+#define SIM_CYCLES_PER_CALL         (u32)8                   /*!< @brief Call, prologue, epilogue and return */
+#define SIM_CYCLES_PER_EXCEPTION    (u32)24                  /*!< @brief Exception stacking and unstacking */
+
+/* Peripheral address windows backed by host memory at the real addresses */
+#define SIM_PERIPH_WINDOW_BASE      (uintptr_t)0x40000000
+#define SIM_PERIPH_WINDOW_SIZE      (size_t)0x00100000
+#define SIM_SYSTEM_WINDOW_BASE      (uintptr_t)0xE0000000
+#define SIM_SYSTEM_WINDOW_SIZE      (size_t)0x00100000
+
+/* Flash and SRAM windows, so the debug console's rd command can read them.  The firmware's
+code and variables live in the host process, so these only ever read as blank memory */
+#define SIM_FLASH_WINDOW_BASE       (uintptr_t)0x00080000    /*!< @brief IFLASH0 up to the end of IFLASH1 */
+#define SIM_FLASH_WINDOW_SIZE       (size_t)0x000A0000
+#define SIM_SRAM_WINDOW_BASE        (uintptr_t)0x20000000    /*!< @brief SRAM0 up to the end of SRAM1 */
+#define SIM_SRAM_WINDOW_SIZE        (size_t)0x00084000
+
+/* Register keys checked by the model */
+#define SIM_WDT_KEY                 (u32)0xA5000000          /*!< @brief WDT_CR password */
+#define SIM_RSTC_KEY                (u32)0xA5000000          /*!< @brief RSTC_CR password */
+#define SIM_AIRCR_VECTKEY           (u32)0x05FA0000          /*!< @brief AIRCR write key */
+#define SIM_AIRCR_PRIGROUP          (u32)AT91C_NVIC_PRIGROUP /*!< @brief Writable AIRCR bits */
+
+#define SIM_TC_INTERRUPT_FLAGS      (u32)(AT91C_TC_COVFS | AT91C_TC_LOVRS | AT91C_TC_CPAS | AT91C_TC_CPBS | AT91C_TC_CPCS | \
+                                          AT91C_TC_LDRAS | AT91C_TC_LDRBS)
+#define SIM_TC_EXTERNAL_CLOCK       (u32)5                   /*!< @brief TCCLKS XC0-XC2: counted by SimTcStep(), not by time */
+#define SIM_TC_BMR_QDEN             (u32)0x00000100          /*!< @brief TCB_BMR quadrature decoder enable */
+#define SIM_TC_BMR_EDGPHA           (u32)0x00001000          /*!< @brief TCB_BMR count PHB edges too */
+#define SIM_TC_QDEC_PHA             (u32)AT91C_PIO_PA1       /*!< @brief TIOA0 */
+#define SIM_TC_QDEC_PHB             (u32)AT91C_PIO_PA0       /*!< @brief TIOB0 */
+#define SIM_TC_QDEC_IDX             (u32)AT91C_PIO_PB6       /*!< @brief TIOB1 */
+
+#define SIM_PWM_CHANNELS            (u8)4                    /*!< @brief PWMC channels 0-3 */
+#define SIM_PWM_CHANNEL_MASK        (u32)0x0000000F          /*!< @brief CHIDx bits of PWMC_ENA / DIS / SR / IER1 / IDR1 / IMR1 / ISR1 */
+#define SIM_PWM_CPRE_MCK_MAX        (u32)10                  /*!< @brief CPRE 0-10 is MCK / 2^CPRE (CLKA / CLKB are not modelled) */
+#define SIM_PWM_BUZZERS             (u8)2                    /*!< @brief Channels 0 and 1 drive BUZZER1 and BUZZER2 */
+
+/* Clocks with a start-up time counted in SLCK periods (index into Sim_au64PmcReady) */
+#define SIM_PMC_MAIN_OSC            (u8)0                    /*!< @brief Crystal: MOSCXTST x 8 SLCK, sets MOSCXTS */
+#define SIM_PMC_PLLA                (u8)1                    /*!< @brief PLLA: PLLACOUNT SLCK, sets LOCKA */
+#define SIM_PMC_UPLL                (u8)2                    /*!< @brief UTMI PLL: UPLLCOUNT x 8 SLCK, sets LOCKU */
+#define SIM_PMC_CLOCKS              (u8)3
+
+/* USART0: 16x oversampling, 8N1 frames (DEBUG_US_MR_INIT) */
+#define SIM_USART_FRAME_BITS        (uint64_t)10             /*!< @brief Start, 8 data and stop bits */
+#define SIM_USART_CD                (u32)0x0000FFFF          /*!< @brief US_BRGR clock divider: bit time is 16 x CD MCK */
+#define SIM_USART_TO                (u32)0x0000FFFF          /*!< @brief US_RTOR time-out in bit times, 0 for off */
+#define SIM_USART_ERRORS            (u32)(AT91C_US_RXBRK | AT91C_US_OVRE | AT91C_US_FRAME | AT91C_US_PARE) /*!< @brief RSTSTA clears */
+#define SIM_USART_PDC_FLAGS         (u32)(AT91C_US_ENDTX | AT91C_US_TXBUFE | AT91C_US_ENDRX | AT91C_US_RXBUFF)
+
+/* TWI0: the only slave on the bus is the ASCII board's LCD, which acknowledges writes
+and reads back 0xFF (it has no read data) */
+#define SIM_TWI_IDLE                (u8)0                    /*!< @brief No transfer */
+#define SIM_TWI_ADDRESS             (u8)1                    /*!< @brief START and the slave address */
+#define SIM_TWI_INTERNAL            (u8)2                    /*!< @brief A TWI_IADR byte */
+#define SIM_TWI_WRITE               (u8)3                    /*!< @brief A data byte to the slave */
+#define SIM_TWI_READ                (u8)4                    /*!< @brief A data byte from the slave */
+#define SIM_TWI_BYTE_BITS           (u8)9                    /*!< @brief 8 data bits and the acknowledge */
+#define SIM_TWI_LCD_ADDRESS         (u32)0x3C                /*!< @brief 7-bit address that answers */
+#define SIM_TWI_READ_DATA           (u8)0xFF                 /*!< @brief What a read returns */
+#define SIM_TWI_CLDIV               (u32)0x000000FF          /*!< @brief TWI_CWGR clock low divider */
+#define SIM_TWI_CHDIV_SHIFT         (u8)8                    /*!< @brief TWI_CWGR clock high divider */
+#define SIM_TWI_CKDIV_SHIFT         (u8)16                   /*!< @brief TWI_CWGR divider exponent (3 bits) */
+#define SIM_TWI_READ_CLEAR          (u32)(AT91C_TWI_NACK_MASTER | AT91C_TWI_OVRE | AT91C_TWI_ARBLST_MULTI_MASTER) /*!< @brief Cleared by reading TWI_SR */
+#define SIM_TWI_PDC_FLAGS           (u32)(AT91C_TWI_ENDTX | AT91C_TWI_TXBUFE | AT91C_TWI_ENDRX | AT91C_TWI_RXBUFF)
+
+/* LCD on TWI0 (ST7036): DDRAM addresses run 0x00-0x27 on line 1 and 0x40-0x67 on line 2 */
+#define SIM_LCD_CONTROL_CO          (u8)0x80                 /*!< @brief Control byte: one byte follows, then another control byte */
+#define SIM_LCD_CONTROL_RS          (u8)0x40                 /*!< @brief Control byte: characters, not commands */
+#define SIM_LCD_CLEAR               (u8)0x01                 /*!< @brief Command: spaces everywhere, address 0 */
+#define SIM_LCD_HOME                (u8)0x02                 /*!< @brief Command (and 0x03): address 0 */
+#define SIM_LCD_SET_ADDRESS         (u8)0x80                 /*!< @brief Command: DDRAM address in bits 0-6 */
+#define SIM_LCD_LINE_ADDRESS        (u8)0x40                 /*!< @brief Line bit of a DDRAM address */
+#define SIM_LCD_LINE_BYTES          (u8)0x28                 /*!< @brief DDRAM addresses per line */
+
+#define SIM_RTT_RESET_MR            (u32)0x00008000          /*!< @brief RTT_MR out of reset: RTPRES = 0x8000 (1s) */
+#define SIM_RTT_MAX_PRESCALER       (uint64_t)0x10000        /*!< @brief RTPRES = 0 divides by 2^16 */
+
+/* Process exit codes */
+#define SIM_EXIT_OK                 (int)0                   /*!< @brief Ran to the stop time */
+#define SIM_EXIT_RESET              (int)2                   /*!< @brief Watchdog or software reset */
+#define SIM_EXIT_DEADLOCK           (int)3                   /*!< @brief Sleeping with nothing left to wake up */
+#define SIM_EXIT_HANG               (int)4                   /*!< @brief Wall clock watchdog: firmware stuck */
+#define SIM_EXIT_SETUP              (int)5                   /*!< @brief Bad options or host setup failure */
+
+
+#endif /* __SIM_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
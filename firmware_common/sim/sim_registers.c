@@ -0,0 +1,3132 @@
+/*!**********************************************************************************************************************
+@file sim_registers.c
+@brief Memory-backed AT91SAM3U4 register model for the host simulation build.
+
+The peripheral (0x4000_0000) and system (0xE000_0000) address windows are mapped
+into the host process at their real addresses, so AT91SAM3U4.h and core_cm3.h
+are used unchanged and every register is plain RAM.  Flash (erased) and SRAM (zeroed)
+are mapped too, for the debug console's rd command only.
+
+Register side effects (SODR/CODR updating ODSR, read-to-clear status registers,
+NVIC set/clear pairs, SysTick, TC counters and captures, the quadrature decoder, RTT,
+watchdog, oscillator and PLL start-up times, the USART0 console, the TWI0 master and their PDC
+channels...) are applied through
+access hooks. The firmware sources are compiled with -fsanitize=thread which makes
+gcc call __tsan_readN()/__tsan_writeN() before every memory access; the
+simulator provides those functions instead of the ThreadSanitizer runtime.
+A hook records the peripheral access that is about to happen and completes it
+(applies the side effect of the value that was written, or clears a status
+register that was read) on the next hook, which is always after the access.
+
+------------------------------------------------------------------------------------------------------------------------
+GLOBALS
+- NONE
+
+CONSTANTS
+- NONE
+
+TYPES
+- NONE
+
+PUBLIC FUNCTIONS
+- NONE
+
+PROTECTED FUNCTIONS
+- void SimRegistersInitialize(void)
+- void SimBusFlush(void)
+- void SimPinDrive(PortOffsetType ePort_, u32 u32Bit_, u32 u32Level_)
+- void SimKeyDrive(u8 u8Key_, bool bClosed_)
+- void SimPeripheralsUpdate(void)
+- uint64_t SimPeripheralsNextEvent(void)
+- bool SimSysTickPending(void)
+- void SimSysTickAcknowledge(void)
+- u32 SimPortOutputs(PortOffsetType ePort_)
+- bool SimWaitModeWakeUp(void)
+- bool SimUsartInput(uint64_t u64Cycle_, const char* pcText_)
+
+***********************************************************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope across entire project.
+All Global variable names shall start with "G_<type>Sim"
+***********************************************************************************************************************/
+/* New variables */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Existing variables (defined in other files -- should all contain the "extern" keyword) */
+extern SimStatsType G_sSimStats;                         /*!< @brief From sim.c */
+extern SimLcdType G_sSimLcd;                             /*!< @brief From sim.c */
+
+extern const PinConfigurationType G_asBspTimerTioaPins[U8_TIMER_CHANNELS]; /*!< @brief From board-specific file */
+
+#ifdef EIE_KEYPAD
+extern const PinConfigurationType G_asBspKeypadRows[U8_KEYPAD_ROWS]; /*!< @brief From board-specific file */
+#endif /* EIE_KEYPAD */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+static void SimBusAccess(const volatile void* pvAddress_, bool bWrite_);
+static void SimRegisterPrepareRead(volatile u32* pu32Register_);
+static void SimRegisterRead(volatile u32* pu32Register_);
+static void SimRegisterWrite(volatile u32* pu32Register_, u32 u32Old_, u32 u32New_);
+static void SimPioWrite(u8 u8Port_, u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimPioUpdatePins(u8 u8Port_);
+static void SimPioLatchPins(u8 u8Port_, u32 u32PulledLow_);
+#ifdef EIE_KEYPAD
+static void SimKeypadMatrix(u32* pu32PulledLow_);
+#endif /* EIE_KEYPAD */
+static void SimNvicWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimPmcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimPmcSetStatus(u32 u32Flag_, u32 u32Enabled_);
+static void SimPmcStartUp(u8 u8Clock_, u32 u32Enabled_, bool bRestart_, uint64_t u64SlowClocks_);
+static void SimRttWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimRttSchedule(void);
+static u32 SimRttValue(void);
+static uint64_t SimRttPrescaler(void);
+static uint64_t SimSlowClockCycles(uint64_t u64SlowClocks_);
+static void SimWdtWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static uint64_t SimWatchdogPeriod(void);
+static void SimSysTickRestart(void);
+static uint64_t SimSysTickPeriod(void);
+static u32 SimSysTickValue(void);
+static void SimCycleCounterWrite(volatile u32* pu32Register_);
+static void SimTcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimTcTrigger(u8 u8Channel_);
+static void SimTcUpdate(u8 u8Channel_);
+static void SimTcSchedule(u8 u8Channel_);
+static uint64_t SimTcPeriod(u8 u8Channel_);
+static uint64_t SimTcTicks(u8 u8Channel_, uint64_t u64Cycle_);
+static uint64_t SimTcCycles(u8 u8Channel_, uint64_t u64Ticks_);
+static uint64_t SimTcDivider(u8 u8Channel_);
+static u32 SimTcCount(u8 u8Channel_);
+static void SimTcPinEdges(u8 u8Port_, u32 u32OldPins_, u32 u32NewPins_);
+static void SimTcCapture(u8 u8Channel_, bool bRising_);
+static void SimTcStep(u8 u8Channel_, s32 s32Counts_);
+static void SimPwmWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimPwmChannelWrite(u8 u8Channel_, u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimPwmUpdate(void);
+static void SimPwmSchedule(u8 u8Channel_);
+static uint64_t SimPwmPeriod(u8 u8Channel_);
+static void SimPwmInterrupt(void);
+static void SimUsartWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimUsartUpdate(void);
+static void SimUsartTxStart(uint64_t u64Cycle_);
+static void SimUsartReceive(uint64_t u64Cycle_);
+static void SimUsartPdcFlags(void);
+static void SimUsartInterrupt(void);
+static uint64_t SimUsartCharacterCycles(void);
+static uint64_t SimUsartTimeoutCycles(void);
+static void SimTwiWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_);
+static void SimTwiUpdate(void);
+static void SimTwiKick(void);
+static void SimTwiBegin(uint64_t u64Cycle_);
+static void SimTwiByteStart(uint64_t u64Cycle_, u8 u8Bits_);
+static void SimTwiNextWrite(uint64_t u64Cycle_);
+static void SimTwiByteDone(uint64_t u64Cycle_);
+static void SimTwiReceive(uint64_t u64Cycle_);
+static void SimTwiEnd(void);
+static void SimTwiPdcFlags(void);
+static void SimTwiInterrupt(void);
+static uint64_t SimTwiBitCycles(void);
+static void SimLcdStart(void);
+static void SimLcdByte(u8 u8Byte_);
+static AT91PS_PIO SimPio(u8 u8Port_);
+static u8 SimPortIndex(PortOffsetType ePort_);
+static AT91PS_TC SimTc(u8 u8Channel_);
+
+
+/***********************************************************************************************************************
+Global variable definitions with scope limited to this local application.
+Variable names shall start with "Sim_<type>" and be declared as static.
+***********************************************************************************************************************/
+static volatile u32* Sim_pu32PendingRegister;           /*!< @brief Peripheral register accessed by the last hook */
+static u32 Sim_u32PendingOldValue;                       /*!< @brief Register value before that access */
+static bool Sim_bPendingWrite;                           /*!< @brief TRUE if the access was a write */
+
+static u32 Sim_au32PinInputs[3];                         /*!< @brief Level driven onto each port by the board */
+static u32 Sim_u32KeysClosed;                            /*!< @brief Keypad keys held down (bit n = KEYn) */
+
+static uint64_t Sim_u64SysTickNext;                      /*!< @brief Cycle of the next SysTick count to 0 */
+static bool Sim_bSysTickPending;                         /*!< @brief SysTick exception pending */
+
+static bool Sim_bWdtModeWritten;                         /*!< @brief WDT_MR can be written only once after reset */
+static uint64_t Sim_u64WdtDeadline;                      /*!< @brief Cycle when the watchdog expires */
+
+static SimTcChannelType Sim_asTc[3];                     /*!< @brief Counter state for TC0 channels 0-2 */
+static SimPwmChannelType Sim_asPwm[SIM_PWM_CHANNELS];    /*!< @brief Period state for PWMC channels 0-3 */
+static s32 Sim_s32QdecDirection = 1;                     /*!< @brief Direction of the last decoder count (for the index) */
+
+static bool Sim_bCycleCounterRunning;                    /*!< @brief DWT_CYCCNT is counting */
+static u32 Sim_u32CycleCounterOffset;                    /*!< @brief Virtual time minus DWT_CYCCNT while counting */
+
+static uint64_t Sim_au64PmcReady[SIM_PMC_CLOCKS];        /*!< @brief Cycle each starting clock becomes ready or SIM_NO_EVENT */
+static const u32 Sim_au32PmcReadyFlags[SIM_PMC_CLOCKS] = {AT91C_PMC_MOSCXTS, AT91C_PMC_LOCKA, AT91C_PMC_LOCKU}; /*!< @brief PMC_SR flag of each */
+
+static uint64_t Sim_u64RttOrigin;                        /*!< @brief Cycle when the RTT was last restarted from 0 */
+static uint64_t Sim_u64RttAlarm;                         /*!< @brief Cycle when the RTT reaches ALMV + 1 or SIM_NO_EVENT */
+
+static SimUsartType Sim_sUsart;                          /*!< @brief USART0 line and PDC state */
+static SimUsartInputType Sim_asUsartInputs[SIM_MAX_CONSOLE_INPUTS]; /*!< @brief -u lines sorted by time */
+static u32 Sim_u32UsartInputs;                           /*!< @brief Lines in Sim_asUsartInputs */
+
+static SimTwiType Sim_sTwi;                              /*!< @brief TWI0 bus state */
+
+/*! @brief Fast startup (WKUPn) inputs of the chip that are wired on the board: FSTT bit, port, pin */
+static const SimWakeUpInputType Sim_asWakeUpInputs[] =
+{
+  {6,  PORTA, PA_17_BUTTON0},
+  {11, PORTB, PB_00_BUTTON1},
+  {12, PORTB, PB_01_BUTTON2},
+  {13, PORTB, PB_02_BUTTON3},
+};
+
+
+/***********************************************************************************************************************
+Function Definitions
+***********************************************************************************************************************/
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/*! @protectedsection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimRegistersInitialize(void)
+
+@brief Maps the peripheral and memory address windows and loads register reset values.
+
+Requires:
+- The host address space below 4GB is free at the AT91SAM3U4 flash, SRAM and 
+  peripheral addresses
+
+Promises:
+- All four windows are mapped read/write; flash reads as erased (0xFF), the rest 
+  is zeroed
+- Registers that must not read as 0 after reset are loaded
+- Returns only on success; the process exits if the windows cannot be mapped
+
+*/
+void SimRegistersInitialize(void)
+{
+  void* pvPeripherals;
+  void* pvSystem;
+  void* pvFlash;
+  void* pvSram;
+
+  pvPeripherals = mmap((void*)SIM_PERIPH_WINDOW_BASE, SIM_PERIPH_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  pvSystem      = mmap((void*)SIM_SYSTEM_WINDOW_BASE, SIM_SYSTEM_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  pvFlash       = mmap((void*)SIM_FLASH_WINDOW_BASE, SIM_FLASH_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  pvSram        = mmap((void*)SIM_SRAM_WINDOW_BASE, SIM_SRAM_WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if( (pvPeripherals != (void*)SIM_PERIPH_WINDOW_BASE) || (pvSystem != (void*)SIM_SYSTEM_WINDOW_BASE) ||
+      (pvFlash != (void*)SIM_FLASH_WINDOW_BASE) || (pvSram != (void*)SIM_SRAM_WINDOW_BASE) )
+  {
+    fprintf(stderr, "sim: unable to map the flash, SRAM and peripheral address windows\n");
+    exit(SIM_EXIT_SETUP);
+  }
+  memset(pvFlash, 0xFF, SIM_FLASH_WINDOW_SIZE);
+
+  /* All pins are PIO inputs with their pull-ups on; the board pulls unused inputs high */
+  for(u8 i = 0; i < 3; i++)
+  {
+    Sim_au32PinInputs[i] = 0xFFFFFFFF;
+  }
+  AT91C_BASE_PIOA->PIO_PSR  = 0xFFFFFFFF;
+  AT91C_BASE_PIOB->PIO_PSR  = 0xFFFFFFFF;
+  AT91C_BASE_PIOC->PIO_PSR  = 0xFFFFFFFF;
+  AT91C_BASE_PIOA->PIO_PDSR = 0xFFFFFFFF;
+  AT91C_BASE_PIOB->PIO_PDSR = 0xFFFFFFFF;
+  AT91C_BASE_PIOC->PIO_PDSR = 0xFFFFFFFF;
+
+  /* Core runs from the internal RC oscillator out of reset */
+  AT91C_BASE_PMC->PMC_SR = AT91C_PMC_MCKRDY | AT91C_PMC_MOSCRCS | AT91C_PMC_MOSCSELS;
+  for(u8 i = 0; i < SIM_PMC_CLOCKS; i++)
+  {
+    Sim_au64PmcReady[i] = SIM_NO_EVENT;
+  }
+
+  /* RTT counts seconds from power up; the alarm is off */
+  AT91C_BASE_RTTC->RTTC_RTMR = SIM_RTT_RESET_MR;
+  AT91C_BASE_RTTC->RTTC_RTAR = 0xFFFFFFFF;
+  Sim_u64RttAlarm = SIM_NO_EVENT;
+
+  /* Watchdog is enabled out of reset with the maximum timeout (16s) */
+  AT91C_BASE_WDTC->WDTC_WDMR = 0x3FFF2FFF;
+  Sim_u64WdtDeadline = SimWatchdogPeriod();
+
+  AT91C_BASE_NVIC->NVIC_CPUID = 0x412FC230;
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    Sim_asTc[i].u64NextEvent = SIM_NO_EVENT;
+  }
+  memset(Sim_asPwm, 0, sizeof(Sim_asPwm));
+  for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+  {
+    Sim_asPwm[i].u64PeriodEnd = SIM_NO_EVENT;
+  }
+  Sim_u64SysTickNext = SIM_NO_EVENT;
+
+  /* USART0 is off; the first -u line is already on its way */
+  Sim_sUsart.u64TxDone  = SIM_NO_EVENT;
+  Sim_sUsart.u64Timeout = SIM_NO_EVENT;
+  Sim_sUsart.u64RxNext  = Sim_u32UsartInputs ? Sim_asUsartInputs[0].u64Cycle : SIM_NO_EVENT;
+
+  /* TWI0 is idle with nothing to send; the LCD comes up blank */
+  Sim_sTwi.u64ByteDone = SIM_NO_EVENT;
+  memset(G_sSimLcd.aacShown, ' ', sizeof(G_sSimLcd.aacShown));
+  AT91C_BASE_TWI0->TWI_SR = AT91C_TWI_TXCOMP_MASTER | AT91C_TWI_TXRDY_MASTER;
+  SimTwiPdcFlags();
+
+} /* end SimRegistersInitialize() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimBusFlush(void)
+
+@brief Completes the peripheral access recorded by the last hook.
+
+Called by the simulator before it looks at register state from outside of
+instrumented firmware code (e.g. when the firmware executes __WFI).
+
+Requires:
+- NONE
+
+Promises:
+- Side effects of the last firmware register access have been applied
+
+*/
+void SimBusFlush(void)
+{
+  volatile u32* pu32Register = Sim_pu32PendingRegister;
+
+  if(pu32Register == NULL)
+  {
+    return;
+  }
+
+  Sim_pu32PendingRegister = NULL;
+
+  if(Sim_bPendingWrite)
+  {
+    SimRegisterWrite(pu32Register, Sim_u32PendingOldValue, *pu32Register);
+  }
+  else
+  {
+    SimRegisterRead(pu32Register);
+  }
+
+} /* end SimBusFlush() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimPinDrive(PortOffsetType ePort_, u32 u32Bit_, u32 u32Level_)
+
+@brief Drives an input pin from the simulated board (e.g. a button press).
+
+Requires:
+@param ePort_ is PORTA or PORTB
+@param u32Bit_ is the pin bit mask
+@param u32Level_ is 0 to pull the pin low, otherwise the pin is released high
+
+Promises:
+- PIO_PDSR and PIO_ISR of the port are updated and the PIO interrupt is pended
+  if the change is enabled in PIO_IMR
+
+*/
+void SimPinDrive(PortOffsetType ePort_, u32 u32Bit_, u32 u32Level_)
+{
+  u8 u8Port = SimPortIndex(ePort_);
+
+  if(u32Level_)
+  {
+    Sim_au32PinInputs[u8Port] |= u32Bit_;
+  }
+  else
+  {
+    Sim_au32PinInputs[u8Port] &= ~u32Bit_;
+  }
+
+  SimPioUpdatePins(u8Port);
+
+} /* end SimPinDrive() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimKeyDrive(u8 u8Key_, bool bClosed_)
+
+@brief Closes or opens a key of the blade keypad.
+
+Requires:
+@param u8Key_ is the key number (row * U8_KEYPAD_COLUMNS + column)
+@param bClosed_ is TRUE to press the key
+
+Promises:
+- The key connects its row and column lines until it is opened again (EIE_KEYPAD
+  builds only; otherwise the keypad is not fitted and nothing changes)
+
+*/
+void SimKeyDrive(u8 u8Key_, bool bClosed_)
+{
+  if(bClosed_)
+  {
+    Sim_u32KeysClosed |= (u32)1 << u8Key_;
+  }
+  else
+  {
+    Sim_u32KeysClosed &= ~((u32)1 << u8Key_);
+  }
+
+  SimPioUpdatePins(0);
+
+} /* end SimKeyDrive() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn u32 SimPortOutputs(PortOffsetType ePort_)
+
+@brief Returns the output data of a port for tracing.
+
+Requires:
+@param ePort_ is PORTA or PORTB
+
+Promises:
+- Returns PIO_ODSR of the port
+
+*/
+u32 SimPortOutputs(PortOffsetType ePort_)
+{
+  return( SimPio(SimPortIndex(ePort_))->PIO_ODSR );
+
+} /* end SimPortOutputs() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SimSysTickPending(void)
+
+@brief Reports a pending SysTick exception.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if SysTick is pending
+
+*/
+bool SimSysTickPending(void)
+{
+  return(Sim_bSysTickPending);
+
+} /* end SimSysTickPending() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimSysTickAcknowledge(void)
+
+@brief Clears the SysTick pending state when the exception is taken.
+
+Requires:
+- NONE
+
+Promises:
+- SysTick is no longer pending
+
+*/
+void SimSysTickAcknowledge(void)
+{
+  Sim_bSysTickPending = FALSE;
+
+} /* end SimSysTickAcknowledge() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SimWaitModeWakeUp(void)
+
+@brief Reports whether a fast startup event enabled in PMC_FSMR would end Wait mode.
+
+Requires:
+- NONE
+
+Promises:
+- Returns TRUE if the RTT alarm is flagged and RTTAL is set, or a wired WKUP input
+  enabled in FSTT is at the level selected in PMC_FSPR
+
+*/
+bool SimWaitModeWakeUp(void)
+{
+  u32 u32Fsmr = AT91C_BASE_PMC->PMC_FSMR;
+
+  if( (u32Fsmr & AT91C_PMC_RTTAL) && (AT91C_BASE_RTTC->RTTC_RTSR & AT91C_RTTC_ALMS) )
+  {
+    return(TRUE);
+  }
+
+  for(u8 i = 0; i < sizeof(Sim_asWakeUpInputs) / sizeof(SimWakeUpInputType); i++)
+  {
+    const SimWakeUpInputType* psInput = &Sim_asWakeUpInputs[i];
+    u32 u32Input = 1 << psInput->u8Input;
+    bool bHigh = (Sim_au32PinInputs[SimPortIndex(psInput->ePort)] & psInput->u32Bit) != 0;
+
+    if( (u32Fsmr & u32Input) && (bHigh == ((AT91C_BASE_PMC->PMC_FSPR & u32Input) != 0)) )
+    {
+      return(TRUE);
+    }
+  }
+
+  return(FALSE);
+
+} /* end SimWaitModeWakeUp() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn bool SimUsartInput(uint64_t u64Cycle_, const char* pcText_)
+
+@brief Schedules a line to be typed on the debug console (USART0 receive).
+
+Requires:
+- Called before SimRegistersInitialize()
+@param u64Cycle_ is the virtual time the first character arrives
+@param pcText_ is the line without the Enter; it must stay valid for the whole run
+
+Promises:
+- Returns TRUE and queues pcText_ and a CR in time order, or FALSE if the queue is full
+
+*/
+bool SimUsartInput(uint64_t u64Cycle_, const char* pcText_)
+{
+  u32 u32Index = Sim_u32UsartInputs;
+
+  if(Sim_u32UsartInputs >= SIM_MAX_CONSOLE_INPUTS)
+  {
+    return(FALSE);
+  }
+
+  /* Lines at the same time keep the order they were given in */
+  while( (u32Index > 0) && (Sim_asUsartInputs[u32Index - 1].u64Cycle > u64Cycle_) )
+  {
+    Sim_asUsartInputs[u32Index] = Sim_asUsartInputs[u32Index - 1];
+    u32Index--;
+  }
+
+  Sim_asUsartInputs[u32Index].u64Cycle = u64Cycle_;
+  Sim_asUsartInputs[u32Index].pcText   = pcText_;
+  Sim_u32UsartInputs++;
+
+  return(TRUE);
+
+} /* end SimUsartInput() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn uint64_t SimPeripheralsNextEvent(void)
+
+@brief Returns the virtual time of the next peripheral event.
+
+Requires:
+- NONE
+
+Promises:
+- Returns the earliest of the next SysTick count to 0, TC compare, PWM period end,
+  RTT alarm, clock start-up, watchdog expiry, USART0 character and TWI0 byte, or
+  SIM_NO_EVENT
+
+*/
+uint64_t SimPeripheralsNextEvent(void)
+{
+  uint64_t u64Next = Sim_u64SysTickNext;
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    if(Sim_asTc[i].u64NextEvent < u64Next)
+    {
+      u64Next = Sim_asTc[i].u64NextEvent;
+    }
+  }
+
+  for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+  {
+    if(Sim_asPwm[i].u64PeriodEnd < u64Next)
+    {
+      u64Next = Sim_asPwm[i].u64PeriodEnd;
+    }
+  }
+
+  for(u8 i = 0; i < SIM_PMC_CLOCKS; i++)
+  {
+    if(Sim_au64PmcReady[i] < u64Next)
+    {
+      u64Next = Sim_au64PmcReady[i];
+    }
+  }
+
+  if(Sim_u64RttAlarm < u64Next)
+  {
+    u64Next = Sim_u64RttAlarm;
+  }
+
+  if(Sim_u64WdtDeadline < u64Next)
+  {
+    u64Next = Sim_u64WdtDeadline;
+  }
+
+  if(Sim_sUsart.u64TxDone < u64Next)
+  {
+    u64Next = Sim_sUsart.u64TxDone;
+  }
+
+  if(Sim_sUsart.u64RxNext < u64Next)
+  {
+    u64Next = Sim_sUsart.u64RxNext;
+  }
+
+  if(Sim_sUsart.u64Timeout < u64Next)
+  {
+    u64Next = Sim_sUsart.u64Timeout;
+  }
+
+  if(Sim_sTwi.u64ByteDone < u64Next)
+  {
+    u64Next = Sim_sTwi.u64ByteDone;
+  }
+
+  return(u64Next);
+
+} /* end SimPeripheralsNextEvent() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn void SimPeripheralsUpdate(void)
+
+@brief Runs the time-driven peripherals up to the current virtual time.
+
+Requires:
+- NONE
+
+Promises:
+- SysTick, TC, PWM, RTT, PMC, watchdog, USART0 and TWI0 events that are due have been raised
+
+*/
+void SimPeripheralsUpdate(void)
+{
+  uint64_t u64Now = SimGetCycles();
+
+  /* SysTick counted to 0 */
+  while(Sim_u64SysTickNext <= u64Now)
+  {
+    AT91C_BASE_NVIC->NVIC_STICKCSR |= AT91C_NVIC_STICKCOUNTFLAG;
+    if(AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKINT)
+    {
+      Sim_bSysTickPending = TRUE;
+      SimRequestInterruptCheck();
+    }
+
+    /* The counter reloads from whatever RVR holds when it wraps */
+    Sim_u64SysTickNext += SimSysTickPeriod();
+  }
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    if(Sim_asTc[i].u64NextEvent <= u64Now)
+    {
+      SimTcUpdate(i);
+    }
+  }
+
+  SimPwmUpdate();
+
+  /* Oscillator and PLL ready flags */
+  for(u8 i = 0; i < SIM_PMC_CLOCKS; i++)
+  {
+    if(Sim_au64PmcReady[i] <= u64Now)
+    {
+      Sim_au64PmcReady[i] = SIM_NO_EVENT;
+      AT91C_BASE_PMC->PMC_SR |= Sim_au32PmcReadyFlags[i];
+    }
+  }
+
+  /* RTT reached ALMV + 1; the next match is 2^32 counts away */
+  if(Sim_u64RttAlarm <= u64Now)
+  {
+    Sim_u64RttAlarm = SIM_NO_EVENT;
+    AT91C_BASE_RTTC->RTTC_RTSR |= AT91C_RTTC_ALMS;
+    if(AT91C_BASE_RTTC->RTTC_RTMR & AT91C_RTTC_ALMIEN)
+    {
+      SimPendIrq(IRQn_RTT);
+    }
+  }
+
+  if( (Sim_sUsart.u64TxDone <= u64Now) || (Sim_sUsart.u64RxNext <= u64Now) || (Sim_sUsart.u64Timeout <= u64Now) )
+  {
+    SimUsartUpdate();
+  }
+
+  if(Sim_sTwi.u64ByteDone <= u64Now)
+  {
+    SimTwiUpdate();
+  }
+
+  if(Sim_u64WdtDeadline <= u64Now)
+  {
+    SimSystemReset("watchdog timeout");
+  }
+
+  SimScheduleEvent(SimPeripheralsNextEvent());
+
+} /* end SimPeripheralsUpdate() */
+
+
+/*------------------------------------------------------------------------------------------------------------------*/
+/*! @privatesection */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimBusAccess(const volatile void* pvAddress_, bool bWrite_)
+
+@brief Common body of the access hooks called by instrumented firmware code.
+
+Completes the previous peripheral access, charges the access to virtual time
+(which may take interrupts) and records the new access if it targets a peripheral.
+*/
+static void SimBusAccess(const volatile void* pvAddress_, bool bWrite_)
+{
+  uintptr_t uAddress = (uintptr_t)pvAddress_;
+
+  SimBusFlush();
+
+  if( ((uAddress - SIM_PERIPH_WINDOW_BASE) >= SIM_PERIPH_WINDOW_SIZE) &&
+      ((uAddress - SIM_SYSTEM_WINDOW_BASE) >= SIM_SYSTEM_WINDOW_SIZE) )
+  {
+    SimAdvance(SIM_CYCLES_PER_ACCESS);
+    return;
+  }
+
+  /* Interrupts taken here run before the access, so record it afterwards */
+  SimAdvance(SIM_CYCLES_PER_BUS_ACCESS);
+
+  Sim_pu32PendingRegister = (volatile u32*)(uAddress & ~(uintptr_t)0x3);
+  Sim_u32PendingOldValue  = *Sim_pu32PendingRegister;
+  Sim_bPendingWrite       = bWrite_;
+
+  if(bWrite_)
+  {
+    G_sSimStats.u64BusWrites++;
+  }
+  else
+  {
+    G_sSimStats.u64BusReads++;
+    SimRegisterPrepareRead(Sim_pu32PendingRegister);
+  }
+
+} /* end SimBusAccess() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRegisterPrepareRead(volatile u32* pu32Register_)
+
+@brief Loads registers whose value depends on virtual time just before they are read.
+*/
+static void SimRegisterPrepareRead(volatile u32* pu32Register_)
+{
+  uintptr_t uAddress = (uintptr_t)pu32Register_;
+
+  if(pu32Register_ == &AT91C_BASE_NVIC->NVIC_STICKCVR)
+  {
+    *pu32Register_ = SimSysTickValue();
+  }
+  else if(pu32Register_ == &AT91C_BASE_NVIC->NVIC_ICSR)
+  {
+    *pu32Register_ = Sim_bSysTickPending ? (*pu32Register_ | AT91C_NVIC_PENDSTSET) : (*pu32Register_ & ~AT91C_NVIC_PENDSTSET);
+  }
+  else if(pu32Register_ == &AT91C_BASE_RTTC->RTTC_RTVR)
+  {
+    *pu32Register_ = SimRttValue();
+  }
+  else if( (pu32Register_ == &DWT->CYCCNT) && Sim_bCycleCounterRunning )
+  {
+    *pu32Register_ = (u32)SimGetCycles() - Sim_u32CycleCounterOffset;
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_TC0) && (uAddress < (uintptr_t)AT91C_BASE_TC0 + 0xC0) )
+  {
+    u8 u8Channel = (u8)((uAddress - (uintptr_t)AT91C_BASE_TC0) / 0x40);
+
+    if(pu32Register_ == &SimTc(u8Channel)->TC_CV)
+    {
+      SimTcUpdate(u8Channel);
+      *pu32Register_ = SimTcCount(u8Channel);
+    }
+  }
+
+} /* end SimRegisterPrepareRead() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRegisterRead(volatile u32* pu32Register_)
+
+@brief Applies read side effects (read-to-clear status registers).
+*/
+static void SimRegisterRead(volatile u32* pu32Register_)
+{
+  uintptr_t uAddress = (uintptr_t)pu32Register_;
+
+  for(u8 i = 0; i < 3; i++)
+  {
+    if(pu32Register_ == &SimPio(i)->PIO_ISR)
+    {
+      *pu32Register_ = 0;
+      return;
+    }
+  }
+
+  if( (uAddress >= (uintptr_t)AT91C_BASE_TC0) && (uAddress < (uintptr_t)AT91C_BASE_TC0 + 0xC0) )
+  {
+    u8 u8Channel = (u8)((uAddress - (uintptr_t)AT91C_BASE_TC0) / 0x40);
+
+    if(pu32Register_ == &SimTc(u8Channel)->TC_SR)
+    {
+      *pu32Register_ &= AT91C_TC_CLKSTA | AT91C_TC_MTIOA | AT91C_TC_MTIOB;
+    }
+  }
+  else if(pu32Register_ == &AT91C_BASE_NVIC->NVIC_STICKCSR)
+  {
+    *pu32Register_ &= ~AT91C_NVIC_STICKCOUNTFLAG;
+  }
+  else if( (pu32Register_ == &AT91C_BASE_WDTC->WDTC_WDSR) || (pu32Register_ == &AT91C_BASE_RTTC->RTTC_RTSR) )
+  {
+    *pu32Register_ = 0;
+  }
+  else if(pu32Register_ == &AT91C_BASE_US0->US_RHR)
+  {
+    AT91C_BASE_US0->US_CSR &= ~AT91C_US_RXRDY;
+  }
+  else if(pu32Register_ == &AT91C_BASE_PWMC->PWMC_ISR1)
+  {
+    *pu32Register_ = 0;
+  }
+  else if(pu32Register_ == &AT91C_BASE_TWI0->TWI_SR)
+  {
+    *pu32Register_ &= ~SIM_TWI_READ_CLEAR;
+  }
+  else if(pu32Register_ == &AT91C_BASE_TWI0->TWI_RHR)
+  {
+    AT91C_BASE_TWI0->TWI_SR &= ~AT91C_TWI_RXRDY;
+    SimTwiKick();
+  }
+
+} /* end SimRegisterRead() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRegisterWrite(volatile u32* pu32Register_, u32 u32Old_, u32 u32New_)
+
+@brief Routes a completed register write to the model of its peripheral.
+*/
+static void SimRegisterWrite(volatile u32* pu32Register_, u32 u32Old_, u32 u32New_)
+{
+  uintptr_t uAddress = (uintptr_t)pu32Register_;
+
+  if( (pu32Register_ == &DWT->CTRL) || (pu32Register_ == &DWT->CYCCNT) || (pu32Register_ == &CoreDebug->DEMCR) )
+  {
+    SimCycleCounterWrite(pu32Register_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_PIOA) && (uAddress < (uintptr_t)AT91C_BASE_PIOC + sizeof(AT91S_PIO)) )
+  {
+    u8 u8Port = (u8)((uAddress - (uintptr_t)AT91C_BASE_PIOA) / 0x200);
+    SimPioWrite(u8Port, (u32)(uAddress - (uintptr_t)SimPio(u8Port)), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_NVIC) && (uAddress < (uintptr_t)AT91C_BASE_NVIC + sizeof(AT91S_NVIC)) )
+  {
+    SimNvicWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_NVIC), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_PMC) && (uAddress < (uintptr_t)AT91C_BASE_PMC + sizeof(AT91S_PMC)) )
+  {
+    SimPmcWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_PMC), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_WDTC) && (uAddress < (uintptr_t)AT91C_BASE_WDTC + sizeof(AT91S_WDTC)) )
+  {
+    SimWdtWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_WDTC), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_RTTC) && (uAddress < (uintptr_t)AT91C_BASE_RTTC + sizeof(AT91S_RTTC)) )
+  {
+    SimRttWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_RTTC), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_TCB0) && (uAddress < (uintptr_t)AT91C_BASE_TCB0 + sizeof(AT91S_TCB)) )
+  {
+    SimTcWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_TCB0), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_PWMC) &&
+           (uAddress <= (uintptr_t)&AT91C_BASE_PWMC->PWMC_ISR1) )
+  {
+    SimPwmWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_PWMC), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_PWMC_CH0) &&
+           (uAddress < (uintptr_t)AT91C_BASE_PWMC_CH0 + (SIM_PWM_CHANNELS * sizeof(AT91S_PWMC_CH))) )
+  {
+    u32 u32Offset = (u32)(uAddress - (uintptr_t)AT91C_BASE_PWMC_CH0);
+
+    SimPwmChannelWrite((u8)(u32Offset / sizeof(AT91S_PWMC_CH)), u32Offset % sizeof(AT91S_PWMC_CH), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_US0) && (uAddress < (uintptr_t)AT91C_BASE_US0 + sizeof(AT91S_USART)) )
+  {
+    SimUsartWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_US0), u32Old_, u32New_);
+  }
+  else if( (uAddress >= (uintptr_t)AT91C_BASE_TWI0) && (uAddress < (uintptr_t)AT91C_BASE_TWI0 + sizeof(AT91S_TWI)) )
+  {
+    SimTwiWrite((u32)(uAddress - (uintptr_t)AT91C_BASE_TWI0), u32Old_, u32New_);
+  }
+  else if(pu32Register_ == &AT91C_BASE_RSTC->RSTC_RCR)
+  {
+    *pu32Register_ = 0;
+    if( ((u32New_ & AT91C_RSTC_KEY) == SIM_RSTC_KEY) && (u32New_ & AT91C_RSTC_PROCRST) )
+    {
+      SimSystemReset("RSTC_CR processor reset");
+    }
+  }
+
+} /* end SimRegisterWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPioWrite(u8 u8Port_, u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief PIO controller: enable/disable register pairs update their status register.
+*/
+static void SimPioWrite(u8 u8Port_, u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_PIO psPio = SimPio(u8Port_);
+  volatile u32* pu32Register = (volatile u32*)((uintptr_t)psPio + u32Offset_);
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_PIO, PIO_PER):    psPio->PIO_PSR   |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_PDR):    psPio->PIO_PSR   &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_OER):    psPio->PIO_OSR   |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_ODR):    psPio->PIO_OSR   &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_IFER):   psPio->PIO_IFSR  |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_IFDR):   psPio->PIO_IFSR  &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_SODR):   psPio->PIO_ODSR  |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_CODR):   psPio->PIO_ODSR  &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_IER):    psPio->PIO_IMR   |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_IDR):    psPio->PIO_IMR   &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_MDER):   psPio->PIO_MDSR  |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_MDDR):   psPio->PIO_MDSR  &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_PPUDR):  psPio->PIO_PPUSR |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_PPUER):  psPio->PIO_PPUSR &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_SCIFSR): psPio->PIO_IFDGSR &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_DIFSR):  psPio->PIO_IFDGSR |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_OWER):   psPio->PIO_OWSR  |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_OWDR):   psPio->PIO_OWSR  &= ~u32New_; break;
+    case offsetof(AT91S_PIO, PIO_AIMER):  psPio->PIO_AIMMR |=  u32New_; break;
+    case offsetof(AT91S_PIO, PIO_AIMDR):  psPio->PIO_AIMMR &= ~u32New_; break;
+
+    case offsetof(AT91S_PIO, PIO_ODSR):
+    {
+      /* Only bits enabled in PIO_OWSR can be written directly */
+      *pu32Register = (u32Old_ & ~psPio->PIO_OWSR) | (u32New_ & psPio->PIO_OWSR);
+      SimPioUpdatePins(u8Port_);
+      return;
+    }
+
+    /* Read-only registers ignore writes */
+    case offsetof(AT91S_PIO, PIO_PSR):
+    case offsetof(AT91S_PIO, PIO_OSR):
+    case offsetof(AT91S_PIO, PIO_IFSR):
+    case offsetof(AT91S_PIO, PIO_PDSR):
+    case offsetof(AT91S_PIO, PIO_IMR):
+    case offsetof(AT91S_PIO, PIO_ISR):
+    case offsetof(AT91S_PIO, PIO_MDSR):
+    case offsetof(AT91S_PIO, PIO_PPUSR):
+    case offsetof(AT91S_PIO, PIO_IFDGSR):
+    case offsetof(AT91S_PIO, PIO_OWSR):
+    case offsetof(AT91S_PIO, PIO_AIMMR):
+    {
+      *pu32Register = u32Old_;
+      return;
+    }
+
+    /* Everything else (ABSR, SCDR...) is a plain read/write register */
+    default:
+    {
+      return;
+    }
+  }
+
+  /* Set/clear registers are write-only and read back as 0 */
+  *pu32Register = 0;
+  SimPioUpdatePins(u8Port_);
+
+} /* end SimPioWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPioUpdatePins(u8 u8Port_)
+
+@brief Recomputes PIO_PDSR of a port after its outputs or inputs changed.
+
+A keypad key joins a row and a column that can be on different ports, so EIE_KEYPAD
+builds recompute both ports.
+*/
+static void SimPioUpdatePins(u8 u8Port_)
+{
+#ifdef EIE_KEYPAD
+  u32 au32PulledLow[U8_BUTTON_PORTS];
+
+  (void)u8Port_;
+  SimKeypadMatrix(au32PulledLow);
+  for(u8 i = 0; i < U8_BUTTON_PORTS; i++)
+  {
+    SimPioLatchPins(i, au32PulledLow[i]);
+  }
+#else
+  SimPioLatchPins(u8Port_, 0);
+#endif /* EIE_KEYPAD */
+
+} /* end SimPioUpdatePins() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPioLatchPins(u8 u8Port_, u32 u32PulledLow_)
+
+@brief Sets PIO_PDSR from the outputs and board inputs and latches input changes in PIO_ISR.
+
+Changes also reach the TC inputs of pins given to a peripheral (SimTcPinEdges()).
+
+u32PulledLow_ are pins held low by the board whatever drives them (open drain lines
+shorted to a low line).
+*/
+static void SimPioLatchPins(u8 u8Port_, u32 u32PulledLow_)
+{
+  AT91PS_PIO psPio = SimPio(u8Port_);
+  u32 u32Driven = psPio->PIO_OSR & psPio->PIO_PSR;
+  u32 u32OldPins = psPio->PIO_PDSR;
+  u32 u32NewPins = ((psPio->PIO_ODSR & u32Driven) | (Sim_au32PinInputs[u8Port_] & ~u32Driven)) & ~u32PulledLow_;
+
+  psPio->PIO_PDSR = u32NewPins;
+  psPio->PIO_ISR |= (u32OldPins ^ u32NewPins);
+  SimTcPinEdges(u8Port_, u32OldPins, u32NewPins);
+
+  if(psPio->PIO_ISR & psPio->PIO_IMR)
+  {
+    SimPendIrq((IRQn_Type)(IRQn_PIOA + u8Port_));
+  }
+
+} /* end SimPioLatchPins() */
+
+
+#ifdef EIE_KEYPAD
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimKeypadMatrix(u32* pu32PulledLow_)
+
+@brief Finds the keypad lines pulled low through closed keys.
+
+A row driven low pulls down the column of every closed key on it, and a low column
+pulls down the rows of its other closed keys in turn, so three keys on the corners of
+a rectangle show the fourth as a ghost just like the real matrix without diodes.
+*/
+static void SimKeypadMatrix(u32* pu32PulledLow_)
+{
+  AT91PS_PIO psPio;
+  u32 u32Rows = 0;
+  u32 u32Columns = 0;
+  u32 u32Last;
+  u32 u32Key;
+
+  for(u8 i = 0; i < U8_BUTTON_PORTS; i++)
+  {
+    pu32PulledLow_[i] = 0;
+  }
+
+  /* Rows the firmware drives low */
+  for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+  {
+    psPio = SimPio(SimPortIndex(G_asBspKeypadRows[i].ePort));
+    if(psPio->PIO_PSR & psPio->PIO_OSR & ~psPio->PIO_ODSR & G_asBspKeypadRows[i].u32BitPosition)
+    {
+      u32Rows |= (u32)1 << i;
+    }
+  }
+
+  /* Spread the low level through the closed keys until nothing changes */
+  do
+  {
+    u32Last = u32Rows ^ (u32Columns << U8_KEYPAD_ROWS);
+    for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+    {
+      for(u8 j = 0; j < U8_KEYPAD_COLUMNS; j++)
+      {
+        u32Key = (u32)1 << (i * U8_KEYPAD_COLUMNS + j);
+        if( (Sim_u32KeysClosed & u32Key) && ((u32Rows & (1 << i)) || (u32Columns & (1 << j))) )
+        {
+          u32Rows    |= (u32)1 << i;
+          u32Columns |= (u32)1 << j;
+        }
+      }
+    }
+  } while(u32Last != (u32Rows ^ (u32Columns << U8_KEYPAD_ROWS)));
+
+  for(u8 i = 0; i < U8_KEYPAD_ROWS; i++)
+  {
+    if(u32Rows & (1 << i))
+    {
+      pu32PulledLow_[SimPortIndex(G_asBspKeypadRows[i].ePort)] |= G_asBspKeypadRows[i].u32BitPosition;
+    }
+  }
+  pu32PulledLow_[SimPortIndex(PORTA)] |= u32Columns << U8_KEYPAD_COLUMN_SHIFT;
+
+} /* end SimKeypadMatrix() */
+#endif /* EIE_KEYPAD */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimNvicWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief NVIC, SysTick and system control block registers.
+*/
+static void SimNvicWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_NVIC psNvic = AT91C_BASE_NVIC;
+  volatile u32* pu32Register = (volatile u32*)((uintptr_t)psNvic + u32Offset_);
+
+  /* Enables, pending bits and priorities can all make an interrupt ready */
+  SimRequestInterruptCheck();
+
+  /* Set/clear enable and pending registers: both addresses read back the state */
+  if( (u32Offset_ >= offsetof(AT91S_NVIC, NVIC_ISER)) && (u32Offset_ < offsetof(AT91S_NVIC, NVIC_ABR)) )
+  {
+    u32 u32Group = (u32Offset_ - offsetof(AT91S_NVIC, NVIC_ISER)) / 0x80;
+    u32 u32Index = ((u32Offset_ - offsetof(AT91S_NVIC, NVIC_ISER)) % 0x80) / 4;
+    volatile u32* pu32Set   = (u32Group < 2) ? &psNvic->NVIC_ISER[u32Index] : &psNvic->NVIC_ISPR[u32Index];
+    volatile u32* pu32Clear = (u32Group < 2) ? &psNvic->NVIC_ICER[u32Index] : &psNvic->NVIC_ICPR[u32Index];
+    u32 u32State = *((u32Group & 1) ? pu32Set : pu32Clear);
+
+    if(u32Index < 8)
+    {
+      if(u32Group & 1)
+      {
+        u32State &= ~u32New_;
+      }
+      else
+      {
+        u32State = u32Old_ | u32New_;
+      }
+      *pu32Set   = u32State;
+      *pu32Clear = u32State;
+    }
+
+    /* A level-sensitive source that is still asserted pends again straight away */
+    if(u32Group == 3)
+    {
+      SimPwmInterrupt();
+      SimUsartInterrupt();
+      SimTwiInterrupt();
+    }
+    return;
+  }
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_NVIC, NVIC_STICKCSR):
+    {
+      /* Freeze the counter value when the counter is stopped */
+      if( (u32Old_ & AT91C_NVIC_STICKENABLE) && !(u32New_ & AT91C_NVIC_STICKENABLE) )
+      {
+        *pu32Register = u32Old_;
+        psNvic->NVIC_STICKCVR = SimSysTickValue();
+      }
+
+      *pu32Register = (u32New_ & ~AT91C_NVIC_STICKCOUNTFLAG) | (u32Old_ & AT91C_NVIC_STICKCOUNTFLAG);
+      if( (u32New_ ^ u32Old_) & (AT91C_NVIC_STICKENABLE | AT91C_NVIC_STICKCLKSOURCE) )
+      {
+        SimSysTickRestart();
+      }
+
+      /* A counter stopped part way through resumes from the frozen value */
+      if( !(u32Old_ & AT91C_NVIC_STICKENABLE) && (u32New_ & AT91C_NVIC_STICKENABLE) && (psNvic->NVIC_STICKCVR != 0) )
+      {
+        Sim_u64SysTickNext = SimGetCycles() +
+                             (uint64_t)psNvic->NVIC_STICKCVR * ((u32New_ & AT91C_NVIC_STICKCLKSOURCE) ? 1 : SYSTICK_DIVIDER);
+        SimScheduleEvent(Sim_u64SysTickNext);
+      }
+      break;
+    }
+
+    case offsetof(AT91S_NVIC, NVIC_STICKCVR):
+    {
+      /* Any write clears the counter, which then reloads from RVR */
+      *pu32Register = 0;
+      psNvic->NVIC_STICKCSR &= ~AT91C_NVIC_STICKCOUNTFLAG;
+      SimSysTickRestart();
+      break;
+    }
+
+    case offsetof(AT91S_NVIC, NVIC_ICSR):
+    {
+      if(u32New_ & AT91C_NVIC_PENDSTSET)
+      {
+        Sim_bSysTickPending = TRUE;
+      }
+      if(u32New_ & AT91C_NVIC_PENDSTCLR)
+      {
+        Sim_bSysTickPending = FALSE;
+      }
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    case offsetof(AT91S_NVIC, NVIC_AIRCR):
+    {
+      if( ((u32New_ & AT91C_NVIC_VECTKEY) == SIM_AIRCR_VECTKEY) && (u32New_ & AT91C_NVIC_SYSRESETREQ) )
+      {
+        SimSystemReset("AIRCR system reset request");
+      }
+      *pu32Register = (u32Old_ & ~SIM_AIRCR_PRIGROUP) | (u32New_ & SIM_AIRCR_PRIGROUP);
+      break;
+    }
+
+    case offsetof(AT91S_NVIC, NVIC_STIR):
+    {
+      *pu32Register = 0;
+      SimPendIrq((IRQn_Type)(u32New_ & 0x1FF));
+      break;
+    }
+
+    case offsetof(AT91S_NVIC, NVIC_CPUID):
+    case offsetof(AT91S_NVIC, NVIC_STICKCALVR):
+    case offsetof(AT91S_NVIC, NVIC_ABR):
+    {
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+} /* end SimNvicWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPmcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief Power management: clock enables and oscillator / PLL ready flags.
+
+The crystal, PLLA and UTMI PLL become ready after their programmed start-up
+times; the RC oscillator, main clock switch and MCK are ready at once.
+*/
+static void SimPmcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_PMC psPmc = AT91C_BASE_PMC;
+  volatile u32* pu32Register = (volatile u32*)((uintptr_t)psPmc + u32Offset_);
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_PMC, PMC_SCER): psPmc->PMC_SCSR |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_PMC, PMC_SCDR): psPmc->PMC_SCSR &= ~u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_PMC, PMC_PCER): psPmc->PMC_PCSR |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_PMC, PMC_PCDR): psPmc->PMC_PCSR &= ~u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_PMC, PMC_IER):  psPmc->PMC_IMR  |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_PMC, PMC_IDR):  psPmc->PMC_IMR  &= ~u32New_; *pu32Register = 0; break;
+
+    case offsetof(AT91S_PMC, PMC_MOR):
+    {
+      SimPmcStartUp(SIM_PMC_MAIN_OSC, u32New_ & AT91C_CKGR_MOSCXTEN, !(u32Old_ & AT91C_CKGR_MOSCXTEN),
+                    ((u32New_ & AT91C_CKGR_MOSCXTST) >> 8) * 8);
+      SimPmcSetStatus(AT91C_PMC_MOSCRCS, u32New_ & AT91C_CKGR_MOSCRCEN);
+      psPmc->PMC_SR |= AT91C_PMC_MOSCSELS;
+      break;
+    }
+
+    case offsetof(AT91S_PMC, PMC_PLLAR):
+    {
+      /* Any write restarts the lock */
+      SimPmcStartUp(SIM_PMC_PLLA, u32New_ & AT91C_CKGR_MULA, TRUE, (u32New_ & AT91C_CKGR_PLLACOUNT) >> 8);
+      break;
+    }
+
+    case offsetof(AT91S_PMC, PMC_UCKR):
+    {
+      SimPmcStartUp(SIM_PMC_UPLL, u32New_ & AT91C_CKGR_UPLLEN, !(u32Old_ & AT91C_CKGR_UPLLEN),
+                    ((u32New_ & AT91C_CKGR_UPLLCOUNT) >> 20) * 8);
+      break;
+    }
+
+    case offsetof(AT91S_PMC, PMC_MCKR):
+    {
+      psPmc->PMC_SR |= AT91C_PMC_MCKRDY;
+      break;
+    }
+
+    case offsetof(AT91S_PMC, PMC_SCSR):
+    case offsetof(AT91S_PMC, PMC_PCSR):
+    case offsetof(AT91S_PMC, PMC_SR):
+    case offsetof(AT91S_PMC, PMC_IMR):
+    {
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+} /* end SimPmcWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPmcSetStatus(u32 u32Flag_, u32 u32Enabled_)
+
+@brief Sets or clears a PMC_SR ready flag.
+*/
+static void SimPmcSetStatus(u32 u32Flag_, u32 u32Enabled_)
+{
+  if(u32Enabled_)
+  {
+    AT91C_BASE_PMC->PMC_SR |= u32Flag_;
+  }
+  else
+  {
+    AT91C_BASE_PMC->PMC_SR &= ~u32Flag_;
+  }
+
+} /* end SimPmcSetStatus() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPmcStartUp(u8 u8Clock_, u32 u32Enabled_, bool bRestart_, uint64_t u64SlowClocks_)
+
+@brief Starts or stops a clock whose ready flag follows a start-up time (SIM_PMC_xxx).
+*/
+static void SimPmcStartUp(u8 u8Clock_, u32 u32Enabled_, bool bRestart_, uint64_t u64SlowClocks_)
+{
+  if(!u32Enabled_)
+  {
+    AT91C_BASE_PMC->PMC_SR &= ~Sim_au32PmcReadyFlags[u8Clock_];
+    Sim_au64PmcReady[u8Clock_] = SIM_NO_EVENT;
+  }
+  else if(bRestart_)
+  {
+    AT91C_BASE_PMC->PMC_SR &= ~Sim_au32PmcReadyFlags[u8Clock_];
+    Sim_au64PmcReady[u8Clock_] = SimGetCycles() + SimSlowClockCycles(u64SlowClocks_);
+    SimScheduleEvent(Sim_au64PmcReady[u8Clock_]);
+  }
+
+} /* end SimPmcStartUp() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRttWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief Real-time Timer: restart, prescaler and alarm.
+*/
+static void SimRttWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_RTTC psRtt = AT91C_BASE_RTTC;
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_RTTC, RTTC_RTMR):
+    {
+      if(u32New_ & AT91C_RTTC_RTTRST)
+      {
+        Sim_u64RttOrigin = SimGetCycles();
+        psRtt->RTTC_RTMR = u32New_ & ~AT91C_RTTC_RTTRST;
+      }
+      SimRttSchedule();
+      break;
+    }
+
+    case offsetof(AT91S_RTTC, RTTC_RTAR):
+    {
+      SimRttSchedule();
+      break;
+    }
+
+    default:
+    {
+      *(volatile u32*)((uintptr_t)psRtt + u32Offset_) = u32Old_;
+      break;
+    }
+  }
+
+} /* end SimRttWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimRttSchedule(void)
+
+@brief Works out when the RTT next reaches ALMV + 1.
+
+An alarm value the counter has already passed only matches after the 32-bit
+counter wraps, which is beyond any simulation run.
+*/
+static void SimRttSchedule(void)
+{
+  u32 u32Target = AT91C_BASE_RTTC->RTTC_RTAR + 1;
+
+  Sim_u64RttAlarm = SIM_NO_EVENT;
+  if(u32Target > SimRttValue())
+  {
+    Sim_u64RttAlarm = Sim_u64RttOrigin + SimSlowClockCycles((uint64_t)u32Target * SimRttPrescaler());
+    SimScheduleEvent(Sim_u64RttAlarm);
+  }
+
+} /* end SimRttSchedule() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 SimRttValue(void)
+
+@brief RTT count at the current virtual time.
+*/
+static u32 SimRttValue(void)
+{
+  return( (u32)( ((SimGetCycles() - Sim_u64RttOrigin) * SIM_SLOW_CLOCK_HZ) /
+                 (SIM_CORE_CLOCK_HZ * SimRttPrescaler()) ) );
+
+} /* end SimRttValue() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimRttPrescaler(void)
+
+@brief SLCK periods per RTT count (RTPRES, where 0 means 2^16).
+*/
+static uint64_t SimRttPrescaler(void)
+{
+  u32 u32Prescaler = AT91C_BASE_RTTC->RTTC_RTMR & AT91C_RTTC_RTPRES;
+
+  return(u32Prescaler ? u32Prescaler : SIM_RTT_MAX_PRESCALER);
+
+} /* end SimRttPrescaler() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimSlowClockCycles(uint64_t u64SlowClocks_)
+
+@brief Virtual cycles taken by a number of SLCK periods, rounded up.
+*/
+static uint64_t SimSlowClockCycles(uint64_t u64SlowClocks_)
+{
+  return( (u64SlowClocks_ / SIM_SLOW_CLOCK_HZ) * SIM_CORE_CLOCK_HZ +
+          ((u64SlowClocks_ % SIM_SLOW_CLOCK_HZ) * SIM_CORE_CLOCK_HZ + SIM_SLOW_CLOCK_HZ - 1) / SIM_SLOW_CLOCK_HZ );
+
+} /* end SimSlowClockCycles() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimWdtWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief Watchdog: keyed restart and the write-once mode register.
+*/
+static void SimWdtWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_WDTC psWdt = AT91C_BASE_WDTC;
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_WDTC, WDTC_WDCR):
+    {
+      psWdt->WDTC_WDCR = 0;
+      if( ((u32New_ & AT91C_WDTC_KEY) == SIM_WDT_KEY) && (u32New_ & AT91C_WDTC_WDRSTT) )
+      {
+        G_sSimStats.u32WatchdogFeeds++;
+        Sim_u64WdtDeadline = SimGetCycles() + SimWatchdogPeriod();
+        SimScheduleEvent(Sim_u64WdtDeadline);
+      }
+      break;
+    }
+
+    case offsetof(AT91S_WDTC, WDTC_WDMR):
+    {
+      if(Sim_bWdtModeWritten)
+      {
+        psWdt->WDTC_WDMR = u32Old_;
+      }
+      else
+      {
+        Sim_bWdtModeWritten = TRUE;
+        Sim_u64WdtDeadline = SimGetCycles() + SimWatchdogPeriod();
+        SimScheduleEvent(Sim_u64WdtDeadline);
+      }
+      break;
+    }
+
+    default:
+    {
+      psWdt->WDTC_WDSR = u32Old_;
+      break;
+    }
+  }
+
+} /* end SimWdtWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimWatchdogPeriod(void)
+
+@brief Returns the watchdog timeout in cycles (WDV counts of SLCK/128), or SIM_NO_EVENT if disabled.
+*/
+static uint64_t SimWatchdogPeriod(void)
+{
+  u32 u32Mode = AT91C_BASE_WDTC->WDTC_WDMR;
+
+  if(u32Mode & AT91C_WDTC_WDDIS)
+  {
+    return(SIM_NO_EVENT);
+  }
+
+  return( ((uint64_t)(u32Mode & AT91C_WDTC_WDV) * 128 * SIM_CORE_CLOCK_HZ) / SIM_SLOW_CLOCK_HZ );
+
+} /* end SimWatchdogPeriod() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimSysTickRestart(void)
+
+@brief Reloads the SysTick counter from the current virtual time.
+*/
+static void SimSysTickRestart(void)
+{
+  if(AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKENABLE)
+  {
+    Sim_u64SysTickNext = SimGetCycles() + SimSysTickPeriod();
+  }
+  else
+  {
+    Sim_u64SysTickNext = SIM_NO_EVENT;
+  }
+
+  SimScheduleEvent(Sim_u64SysTickNext);
+
+} /* end SimSysTickRestart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimSysTickPeriod(void)
+
+@brief Cycles between SysTick counts to 0: (RVR + 1) ticks of MCK or MCK/8.
+*/
+static uint64_t SimSysTickPeriod(void)
+{
+  uint64_t u64Divider = (AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKCLKSOURCE) ? 1 : SYSTICK_DIVIDER;
+
+  return( ((uint64_t)(AT91C_BASE_NVIC->NVIC_STICKRVR & AT91C_NVIC_STICKRELOAD) + 1) * u64Divider );
+
+} /* end SimSysTickPeriod() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 SimSysTickValue(void)
+
+@brief Current value of the SysTick down-counter.
+
+The value is counted back from the next count to 0 so a RVR write made after
+the last reload (as the tickless sleep does) only takes effect at the next wrap.
+*/
+static u32 SimSysTickValue(void)
+{
+  uint64_t u64Divider = (AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKCLKSOURCE) ? 1 : SYSTICK_DIVIDER;
+  uint64_t u64Now = SimGetCycles();
+
+  if( !(AT91C_BASE_NVIC->NVIC_STICKCSR & AT91C_NVIC_STICKENABLE) )
+  {
+    return(AT91C_BASE_NVIC->NVIC_STICKCVR);
+  }
+
+  if(u64Now >= Sim_u64SysTickNext)
+  {
+    return(0);
+  }
+
+  return( (u32)((Sim_u64SysTickNext - u64Now - 1) / u64Divider) );
+
+} /* end SimSysTickValue() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimCycleCounterWrite(volatile u32* pu32Register_)
+
+@brief DWT cycle counter: counts MCK cycles while DEMCR.TRCENA and DWT_CTRL.CYCCNTENA are set.
+*/
+static void SimCycleCounterWrite(volatile u32* pu32Register_)
+{
+  u32 u32Now = (u32)SimGetCycles();
+
+  /* Freeze the running count unless the firmware just wrote a new one */
+  if(Sim_bCycleCounterRunning && (pu32Register_ != &DWT->CYCCNT))
+  {
+    DWT->CYCCNT = u32Now - Sim_u32CycleCounterOffset;
+  }
+
+  Sim_bCycleCounterRunning = (CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA) && (DWT->CTRL & DWT_CTRL_CYCCNTENA);
+  Sim_u32CycleCounterOffset = u32Now - DWT->CYCCNT;
+
+} /* end SimCycleCounterWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief Timer counter block: channel control, interrupt masks and block sync.
+*/
+static void SimTcWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  u8 u8Channel = (u8)(u32Offset_ / 0x40);
+  AT91PS_TC psTc;
+  volatile u32* pu32Register;
+
+  if(u32Offset_ == offsetof(AT91S_TCB, TCB_BCR))
+  {
+    AT91C_BASE_TCB0->TCB_BCR = 0;
+    if(u32New_ & AT91C_TCB_SYNC)
+    {
+      for(u8 i = 0; i < 3; i++)
+      {
+        SimTcTrigger(i);
+      }
+    }
+    return;
+  }
+
+  if(u8Channel > 2)
+  {
+    return;
+  }
+
+  psTc = SimTc(u8Channel);
+  pu32Register = (volatile u32*)((uintptr_t)AT91C_BASE_TCB0 + u32Offset_);
+  SimTcUpdate(u8Channel);
+
+  switch(u32Offset_ % 0x40)
+  {
+    case offsetof(AT91S_TC, TC_CCR):
+    {
+      *pu32Register = 0;
+      if(u32New_ & AT91C_TC_CLKDIS)
+      {
+        psTc->TC_SR &= ~AT91C_TC_CLKSTA;
+      }
+      else if(u32New_ & AT91C_TC_CLKEN)
+      {
+        psTc->TC_SR |= AT91C_TC_CLKSTA;
+      }
+
+      if( (u32New_ & AT91C_TC_SWTRG) && (psTc->TC_SR & AT91C_TC_CLKSTA) )
+      {
+        SimTcTrigger(u8Channel);
+      }
+      break;
+    }
+
+    case offsetof(AT91S_TC, TC_IER): psTc->TC_IMR |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_TC, TC_IDR): psTc->TC_IMR &= ~u32New_; *pu32Register = 0; break;
+
+    case offsetof(AT91S_TC, TC_CV):
+    case offsetof(AT91S_TC, TC_SR):
+    case offsetof(AT91S_TC, TC_IMR):
+    {
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+  SimTcSchedule(u8Channel);
+
+} /* end SimTcWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcTrigger(u8 u8Channel_)
+
+@brief Resets a channel counter to 0 (software trigger or RC compare trigger).
+*/
+static void SimTcTrigger(u8 u8Channel_)
+{
+  Sim_asTc[u8Channel_].u64Origin = SimGetCycles();
+  Sim_asTc[u8Channel_].u64LastTick = 0;
+  Sim_asTc[u8Channel_].bRaLoaded = FALSE;
+
+  if(SimTc(u8Channel_)->TC_SR & AT91C_TC_CLKSTA)
+  {
+    Sim_asTc[u8Channel_].bRunning = TRUE;
+  }
+
+  SimTcSchedule(u8Channel_);
+
+} /* end SimTcTrigger() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcUpdate(u8 u8Channel_)
+
+@brief Moves a running channel to the current virtual time and raises compare flags it passed.
+
+Waveform mode: RA, RB and RC compares plus counter overflow, with or without the RC
+compare trigger, CPCSTOP and CPCDIS.  Capture mode only raises the overflow (RA and RB
+are loaded by SimTcCapture()).  A channel on an external clock does not move with time.
+*/
+static void SimTcUpdate(u8 u8Channel_)
+{
+  SimTcChannelType* psChannel = &Sim_asTc[u8Channel_];
+  AT91PS_TC psTc = SimTc(u8Channel_);
+  uint64_t u64Tick;
+  uint64_t u64Period;
+  u32 u32Status = 0;
+
+  if( !psChannel->bRunning || !(psTc->TC_SR & AT91C_TC_CLKSTA) )
+  {
+    psChannel->bRunning = FALSE;
+    psChannel->u64NextEvent = SIM_NO_EVENT;
+    return;
+  }
+
+  if( (psTc->TC_CMR & AT91C_TC_CLKS) >= SIM_TC_EXTERNAL_CLOCK )
+  {
+    psChannel->u64NextEvent = SIM_NO_EVENT;
+    return;
+  }
+
+  u64Tick = SimTcTicks(u8Channel_, SimGetCycles());
+  u64Period = SimTcPeriod(u8Channel_);
+
+  /* Walk each compare point passed since the last update */
+  while(psChannel->u64LastTick < u64Tick)
+  {
+    uint64_t u64Position = psChannel->u64LastTick % u64Period;
+    uint64_t u64Base = psChannel->u64LastTick - u64Position;
+    uint64_t u64Next = u64Base + u64Period;
+    u32 u32Flag = (u64Period == 0x10000) ? AT91C_TC_COVFS : AT91C_TC_CPCS;
+    bool bWaveform = (bool)((psTc->TC_CMR & AT91C_TC_WAVE) != 0);
+
+    if( bWaveform && (psTc->TC_RA > u64Position) && (psTc->TC_RA < u64Period) && (u64Base + psTc->TC_RA < u64Next) )
+    {
+      u64Next = u64Base + psTc->TC_RA;
+      u32Flag = AT91C_TC_CPAS;
+    }
+    if( bWaveform && (psTc->TC_RB > u64Position) && (psTc->TC_RB < u64Period) && (u64Base + psTc->TC_RB < u64Next) )
+    {
+      u64Next = u64Base + psTc->TC_RB;
+      u32Flag = AT91C_TC_CPBS;
+    }
+
+    if(u64Next > u64Tick)
+    {
+      psChannel->u64LastTick = u64Tick;
+      break;
+    }
+
+    psChannel->u64LastTick = u64Next;
+    u32Status |= u32Flag;
+
+    if( (u32Flag == AT91C_TC_CPCS) && (psTc->TC_CMR & (AT91C_TC_CPCSTOP | AT91C_TC_CPCDIS)) )
+    {
+      psChannel->bRunning = FALSE;
+      if(psTc->TC_CMR & AT91C_TC_CPCDIS)
+      {
+        psTc->TC_SR &= ~AT91C_TC_CLKSTA;
+      }
+      break;
+    }
+  }
+
+  psTc->TC_SR |= u32Status;
+  if(psTc->TC_SR & psTc->TC_IMR & SIM_TC_INTERRUPT_FLAGS)
+  {
+    SimPendIrq((IRQn_Type)(IRQn_TC0 + u8Channel_));
+  }
+
+  SimTcSchedule(u8Channel_);
+
+} /* end SimTcUpdate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcSchedule(u8 u8Channel_)
+
+@brief Computes the virtual time of the next compare event of a channel.
+*/
+static void SimTcSchedule(u8 u8Channel_)
+{
+  SimTcChannelType* psChannel = &Sim_asTc[u8Channel_];
+  AT91PS_TC psTc = SimTc(u8Channel_);
+  uint64_t u64Period;
+  uint64_t u64Position;
+  uint64_t u64Next;
+
+  if( !psChannel->bRunning || !(psTc->TC_SR & AT91C_TC_CLKSTA) ||
+      ((psTc->TC_CMR & AT91C_TC_CLKS) >= SIM_TC_EXTERNAL_CLOCK) )
+  {
+    psChannel->u64NextEvent = SIM_NO_EVENT;
+    return;
+  }
+
+  u64Period = SimTcPeriod(u8Channel_);
+  u64Position = psChannel->u64LastTick % u64Period;
+  u64Next = u64Period;
+
+  if(psTc->TC_CMR & AT91C_TC_WAVE)
+  {
+    if( (psTc->TC_RA > u64Position) && (psTc->TC_RA < u64Next) )
+    {
+      u64Next = psTc->TC_RA;
+    }
+    if( (psTc->TC_RB > u64Position) && (psTc->TC_RB < u64Next) )
+    {
+      u64Next = psTc->TC_RB;
+    }
+  }
+
+  u64Next += psChannel->u64LastTick - u64Position;
+  psChannel->u64NextEvent = psChannel->u64Origin + SimTcCycles(u8Channel_, u64Next);
+  SimScheduleEvent(psChannel->u64NextEvent);
+
+} /* end SimTcSchedule() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimTcPeriod(u8 u8Channel_)
+
+@brief Counter period in ticks: RC with the RC compare trigger, otherwise the full 16 bits.
+*/
+static uint64_t SimTcPeriod(u8 u8Channel_)
+{
+  AT91PS_TC psTc = SimTc(u8Channel_);
+
+  if( (psTc->TC_CMR & AT91C_TC_CPCTRG) && (psTc->TC_RC & 0xFFFF) )
+  {
+    return(psTc->TC_RC & 0xFFFF);
+  }
+
+  return(0x10000);
+
+} /* end SimTcPeriod() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimTcTicks(u8 u8Channel_, uint64_t u64Cycle_)
+
+@brief Counter ticks elapsed at a virtual time since the last trigger.
+*/
+static uint64_t SimTcTicks(u8 u8Channel_, uint64_t u64Cycle_)
+{
+  uint64_t u64Elapsed = u64Cycle_ - Sim_asTc[u8Channel_].u64Origin;
+
+  if( (SimTc(u8Channel_)->TC_CMR & AT91C_TC_CLKS) == AT91C_TC_CLKS_TIMER_DIV5_CLOCK )
+  {
+    return( (u64Elapsed * SIM_SLOW_CLOCK_HZ) / SIM_CORE_CLOCK_HZ );
+  }
+
+  return( u64Elapsed / SimTcDivider(u8Channel_) );
+
+} /* end SimTcTicks() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimTcCycles(u8 u8Channel_, uint64_t u64Ticks_)
+
+@brief Virtual cycles needed for a number of counter ticks.
+*/
+static uint64_t SimTcCycles(u8 u8Channel_, uint64_t u64Ticks_)
+{
+  if( (SimTc(u8Channel_)->TC_CMR & AT91C_TC_CLKS) == AT91C_TC_CLKS_TIMER_DIV5_CLOCK )
+  {
+    return( (u64Ticks_ * SIM_CORE_CLOCK_HZ + SIM_SLOW_CLOCK_HZ - 1) / SIM_SLOW_CLOCK_HZ );
+  }
+
+  return( u64Ticks_ * SimTcDivider(u8Channel_) );
+
+} /* end SimTcCycles() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimTcDivider(u8 u8Channel_)
+
+@brief MCK divider of TIMER_CLOCK1..4 (external clocks are treated as TIMER_CLOCK1).
+*/
+static uint64_t SimTcDivider(u8 u8Channel_)
+{
+  static const uint64_t au64Dividers[] = {2, 8, 32, 128};
+  u32 u32Clock = SimTc(u8Channel_)->TC_CMR & AT91C_TC_CLKS;
+
+  return( (u32Clock < 4) ? au64Dividers[u32Clock] : 2 );
+
+} /* end SimTcDivider() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u32 SimTcCount(u8 u8Channel_)
+
+@brief Current counter value of a channel.
+*/
+static u32 SimTcCount(u8 u8Channel_)
+{
+  return( (u32)(Sim_asTc[u8Channel_].u64LastTick % SimTcPeriod(u8Channel_)) );
+
+} /* end SimTcCount() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcPinEdges(u8 u8Port_, u32 u32OldPins_, u32 u32NewPins_)
+
+@brief Passes pin changes to the TC inputs: TIOA captures and the quadrature decoder.
+
+Only pins given to a peripheral (PIO_PSR clear) are looked at; the peripheral A / B
+selection is not checked.
+*/
+static void SimTcPinEdges(u8 u8Port_, u32 u32OldPins_, u32 u32NewPins_)
+{
+  AT91PS_PIO psPio = SimPio(u8Port_);
+  u32 u32Changed = (u32OldPins_ ^ u32NewPins_) & ~psPio->PIO_PSR;
+  u32 u32Bmr = AT91C_BASE_TCB0->TCB_BMR;
+  const PinConfigurationType* psPin;
+  s32 s32Counts;
+  u8 u8Old;
+  u8 u8New;
+
+  if(u32Changed == 0)
+  {
+    return;
+  }
+
+  for(u8 i = 0; i < U8_TIMER_CHANNELS; i++)
+  {
+    psPin = &G_asBspTimerTioaPins[i];
+    if( (SimPortIndex(psPin->ePort) == u8Port_) && (u32Changed & psPin->u32BitPosition) )
+    {
+      SimTcCapture(i, (bool)((u32NewPins_ & psPin->u32BitPosition) != 0));
+    }
+  }
+
+  if( !(u32Bmr & SIM_TC_BMR_QDEN) )
+  {
+    return;
+  }
+
+  /* PHA / PHB: a gray code step counts TC0 up (PHA leads) or down */
+  if( (u8Port_ == 0) && (u32Changed & (SIM_TC_QDEC_PHA | SIM_TC_QDEC_PHB)) &&
+      ((u32Bmr & SIM_TC_BMR_EDGPHA) || (u32Changed & SIM_TC_QDEC_PHA)) )
+  {
+    static const u8 au8Gray[4] = {0, 3, 1, 2};   /* Index B | A << 1 to step 00, 10, 11, 01 */
+
+    u8Old = au8Gray[((u32OldPins_ & SIM_TC_QDEC_PHB) ? 1 : 0) | ((u32OldPins_ & SIM_TC_QDEC_PHA) ? 2 : 0)];
+    u8New = au8Gray[((u32NewPins_ & SIM_TC_QDEC_PHB) ? 1 : 0) | ((u32NewPins_ & SIM_TC_QDEC_PHA) ? 2 : 0)];
+    s32Counts = ((u8New - u8Old) & 3) == 1 ? 1 : (((u8New - u8Old) & 3) == 3 ? -1 : 0);
+
+    if(s32Counts != 0)
+    {
+      Sim_s32QdecDirection = s32Counts;
+      SimTcStep(0, s32Counts);
+    }
+  }
+
+  /* IDX rising: TC1 counts the revolution and TC0 is reset if it triggers on TIOA */
+  if( (u8Port_ == 1) && (u32Changed & u32NewPins_ & SIM_TC_QDEC_IDX) )
+  {
+    SimTcStep(1, Sim_s32QdecDirection);
+    if( (SimTc(0)->TC_CMR & AT91C_TC_ABETRG) && (SimTc(0)->TC_CMR & AT91C_TC_ETRGEDG) &&
+        (SimTc(0)->TC_SR & AT91C_TC_CLKSTA) )
+    {
+      SimTcTrigger(0);
+    }
+  }
+
+} /* end SimTcPinEdges() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcCapture(u8 u8Channel_, bool bRising_)
+
+@brief An edge on a channel's TIOA: loads RA or RB as selected by LDRA / LDRB.
+
+RA is loaded only if it has not been loaded since the trigger or the last RB load,
+and RB only after RA.  A load over an unread one sets LOVRS.
+*/
+static void SimTcCapture(u8 u8Channel_, bool bRising_)
+{
+  SimTcChannelType* psChannel = &Sim_asTc[u8Channel_];
+  AT91PS_TC psTc = SimTc(u8Channel_);
+  u32 u32Edge = bRising_ ? 1 : 2;
+  u32 u32Status;
+
+  SimTcUpdate(u8Channel_);
+  if( !psChannel->bRunning || !(psTc->TC_SR & AT91C_TC_CLKSTA) || (psTc->TC_CMR & AT91C_TC_WAVE) )
+  {
+    return;
+  }
+
+  u32Status = 0;
+  if( !psChannel->bRaLoaded && (((psTc->TC_CMR & AT91C_TC_LDRA) >> 16) & u32Edge) )
+  {
+    u32Status = (psTc->TC_SR & AT91C_TC_LDRAS) ? (AT91C_TC_LDRAS | AT91C_TC_LOVRS) : AT91C_TC_LDRAS;
+    psTc->TC_RA = SimTcCount(u8Channel_);
+    psChannel->bRaLoaded = TRUE;
+  }
+  else if( psChannel->bRaLoaded && (((psTc->TC_CMR & AT91C_TC_LDRB) >> 18) & u32Edge) )
+  {
+    u32Status = (psTc->TC_SR & AT91C_TC_LDRBS) ? (AT91C_TC_LDRBS | AT91C_TC_LOVRS) : AT91C_TC_LDRBS;
+    psTc->TC_RB = SimTcCount(u8Channel_);
+    psChannel->bRaLoaded = FALSE;
+  }
+
+  psTc->TC_SR |= u32Status;
+  if(psTc->TC_SR & psTc->TC_IMR & SIM_TC_INTERRUPT_FLAGS)
+  {
+    SimPendIrq((IRQn_Type)(IRQn_TC0 + u8Channel_));
+  }
+
+} /* end SimTcCapture() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTcStep(u8 u8Channel_, s32 s32Counts_)
+
+@brief Counts a channel on an external clock (the quadrature decoder) up or down.
+*/
+static void SimTcStep(u8 u8Channel_, s32 s32Counts_)
+{
+  SimTcChannelType* psChannel = &Sim_asTc[u8Channel_];
+  AT91PS_TC psTc = SimTc(u8Channel_);
+
+  if( !psChannel->bRunning || !(psTc->TC_SR & AT91C_TC_CLKSTA) ||
+      ((psTc->TC_CMR & AT91C_TC_CLKS) < SIM_TC_EXTERNAL_CLOCK) )
+  {
+    return;
+  }
+
+  psChannel->u64LastTick = (u32)(SimTcCount(u8Channel_) + s32Counts_) & 0xFFFF;
+
+} /* end SimTcStep() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPwmWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief PWM controller: channel enable / disable and the channel event interrupts.
+
+Channels 0 and 1 are the buzzers, so their enables are counted as tones and the time
+they are on is added up for the report.
+*/
+static void SimPwmWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_PWMC psPwm = AT91C_BASE_PWMC;
+  uint64_t u64Now = SimGetCycles();
+  u32 u32Changed;
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_PWMC, PWMC_ENA):
+    {
+      u32Changed = u32New_ & ~psPwm->PWMC_SR & SIM_PWM_CHANNEL_MASK;
+      psPwm->PWMC_SR |= u32New_;
+      psPwm->PWMC_ENA = 0;
+      for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+      {
+        if(u32Changed & (1u << i))
+        {
+          Sim_asPwm[i].u64Enabled = u64Now;
+          Sim_asPwm[i].u64PeriodEnd = SIM_NO_EVENT;
+          SimPwmSchedule(i);
+          if(i < SIM_PWM_BUZZERS)
+          {
+            G_sSimStats.au32BuzzerTones[i]++;
+          }
+        }
+      }
+      break;
+    }
+
+    case offsetof(AT91S_PWMC, PWMC_DIS):
+    {
+      u32Changed = u32New_ & psPwm->PWMC_SR & SIM_PWM_CHANNEL_MASK;
+      psPwm->PWMC_SR &= ~u32New_;
+      psPwm->PWMC_DIS = 0;
+      for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+      {
+        if(u32Changed & (1u << i))
+        {
+          Sim_asPwm[i].u64PeriodEnd = SIM_NO_EVENT;
+          if(i < SIM_PWM_BUZZERS)
+          {
+            G_sSimStats.au64BuzzerCycles[i] += u64Now - Sim_asPwm[i].u64Enabled;
+          }
+        }
+      }
+      break;
+    }
+
+    case offsetof(AT91S_PWMC, PWMC_IER1):
+    {
+      psPwm->PWMC_IMR1 |= u32New_;
+      psPwm->PWMC_IER1 = 0;
+      for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+      {
+        SimPwmSchedule(i);
+      }
+      SimPwmInterrupt();
+      break;
+    }
+
+    case offsetof(AT91S_PWMC, PWMC_IDR1):
+    {
+      psPwm->PWMC_IMR1 &= ~u32New_;
+      psPwm->PWMC_IDR1 = 0;
+      for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+      {
+        SimPwmSchedule(i);
+      }
+      break;
+    }
+
+    case offsetof(AT91S_PWMC, PWMC_SR):
+    case offsetof(AT91S_PWMC, PWMC_IMR1):
+    case offsetof(AT91S_PWMC, PWMC_ISR1):
+    {
+      *(volatile u32*)((uintptr_t)psPwm + u32Offset_) = u32Old_;
+      break;
+    }
+
+    default: break;
+  }
+
+} /* end SimPwmWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPwmChannelWrite(u8 u8Channel_, u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief PWM channel registers: the period and duty update registers.
+
+A channel with period events loads PWMC_CPRDUPDR at the end of its period; the others
+take it at once.  A buzzer that changes period while on starts another tone.
+*/
+static void SimPwmChannelWrite(u8 u8Channel_, u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_PWMC_CH psChannel = AT91C_BASE_PWMC_CH0 + u8Channel_;
+  bool bEnabled = (bool)((AT91C_BASE_PWMC->PWMC_SR & (1u << u8Channel_)) != 0);
+
+  (void)u32Old_;
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_PWMC_CH, PWMC_CPRDUPDR):
+    {
+      if(Sim_asPwm[u8Channel_].u64PeriodEnd != SIM_NO_EVENT)
+      {
+        Sim_asPwm[u8Channel_].bUpdate = TRUE;
+        break;
+      }
+
+      if( bEnabled && (u8Channel_ < SIM_PWM_BUZZERS) && (psChannel->PWMC_CPRDR != u32New_) )
+      {
+        G_sSimStats.au32BuzzerTones[u8Channel_]++;
+      }
+      psChannel->PWMC_CPRDR = u32New_;
+      break;
+    }
+
+    case offsetof(AT91S_PWMC_CH, PWMC_CDTYUPDR):
+    {
+      psChannel->PWMC_CDTYR = u32New_;
+      break;
+    }
+
+    default: break;
+  }
+
+} /* end SimPwmChannelWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPwmUpdate(void)
+
+@brief Ends the PWM periods that are due: sets PWMC_ISR1, loads a waiting period update
+and starts the next period.
+*/
+static void SimPwmUpdate(void)
+{
+  AT91PS_PWMC_CH psChannel;
+  uint64_t u64Now = SimGetCycles();
+  uint64_t u64Period;
+
+  for(u8 i = 0; i < SIM_PWM_CHANNELS; i++)
+  {
+    psChannel = AT91C_BASE_PWMC_CH0 + i;
+    while(Sim_asPwm[i].u64PeriodEnd <= u64Now)
+    {
+      AT91C_BASE_PWMC->PWMC_ISR1 |= (1u << i);
+      if(Sim_asPwm[i].bUpdate)
+      {
+        psChannel->PWMC_CPRDR = psChannel->PWMC_CPRDUPDR;
+        Sim_asPwm[i].bUpdate = FALSE;
+      }
+
+      /* A period of 0 never ends */
+      u64Period = SimPwmPeriod(i);
+      Sim_asPwm[i].u64PeriodEnd = u64Period ? (Sim_asPwm[i].u64PeriodEnd + u64Period) : SIM_NO_EVENT;
+    }
+  }
+
+  SimPwmInterrupt();
+
+} /* end SimPwmUpdate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPwmSchedule(u8 u8Channel_)
+
+@brief Starts or stops a channel's period events: only enabled channels with their
+interrupt enabled have them.  A channel that gets them starts a period now.
+*/
+static void SimPwmSchedule(u8 u8Channel_)
+{
+  SimPwmChannelType* psState = &Sim_asPwm[u8Channel_];
+  u32 u32Bit = 1u << u8Channel_;
+
+  if( !(AT91C_BASE_PWMC->PWMC_SR & AT91C_BASE_PWMC->PWMC_IMR1 & u32Bit) || (SimPwmPeriod(u8Channel_) == 0) )
+  {
+    psState->u64PeriodEnd = SIM_NO_EVENT;
+    psState->bUpdate = FALSE;
+    return;
+  }
+
+  if(psState->u64PeriodEnd == SIM_NO_EVENT)
+  {
+    psState->u64PeriodEnd = SimGetCycles() + SimPwmPeriod(u8Channel_);
+    SimScheduleEvent(psState->u64PeriodEnd);
+  }
+
+} /* end SimPwmSchedule() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimPwmPeriod(u8 u8Channel_)
+
+@brief Channel period in cycles: CPRD counts of MCK / 2^CPRE.
+*/
+static uint64_t SimPwmPeriod(u8 u8Channel_)
+{
+  AT91PS_PWMC_CH psChannel = AT91C_BASE_PWMC_CH0 + u8Channel_;
+  u32 u32Prescaler = psChannel->PWMC_CMR & AT91C_PWMC_CPRE;
+
+  if(u32Prescaler > SIM_PWM_CPRE_MCK_MAX)
+  {
+    u32Prescaler = SIM_PWM_CPRE_MCK_MAX;
+  }
+
+  return( (uint64_t)psChannel->PWMC_CPRDR << u32Prescaler );
+
+} /* end SimPwmPeriod() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimPwmInterrupt(void)
+
+@brief Pends IRQn_PWMC while an enabled channel event is set (the PWM line is level-sensitive).
+*/
+static void SimPwmInterrupt(void)
+{
+  if(AT91C_BASE_PWMC->PWMC_ISR1 & AT91C_BASE_PWMC->PWMC_IMR1)
+  {
+    SimPendIrq(IRQn_PWMC);
+  }
+
+} /* end SimPwmInterrupt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief USART0 and its PDC channel: control, interrupt masks and transfers.
+
+Only PDC transfers are modelled (nothing is sent by writing US_THR directly).
+The PDC end flags follow the counters, so writing a counter clears them.
+*/
+static void SimUsartWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_USART psUsart = AT91C_BASE_US0;
+  volatile u32* pu32Register = (volatile u32*)((uintptr_t)psUsart + u32Offset_);
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_USART, US_CR):
+    {
+      if(u32New_ & AT91C_US_RSTRX)
+      {
+        Sim_sUsart.bRxEnabled = FALSE;
+        Sim_sUsart.bTimeoutWaiting = FALSE;
+        Sim_sUsart.u64Timeout = SIM_NO_EVENT;
+        psUsart->US_CSR &= ~(AT91C_US_RXRDY | AT91C_US_TIMEOUT | SIM_USART_ERRORS);
+      }
+      if(u32New_ & AT91C_US_RSTTX)
+      {
+        Sim_sUsart.bTxEnabled = FALSE;
+        Sim_sUsart.u64TxDone = SIM_NO_EVENT;
+        psUsart->US_CSR &= ~(AT91C_US_TXRDY | AT91C_US_TXEMPTY);
+      }
+
+      /* Disable wins over enable; a character on the line is still finished */
+      if(u32New_ & (AT91C_US_RXEN | AT91C_US_RXDIS))
+      {
+        Sim_sUsart.bRxEnabled = !(u32New_ & AT91C_US_RXDIS);
+      }
+      if(u32New_ & (AT91C_US_TXEN | AT91C_US_TXDIS))
+      {
+        Sim_sUsart.bTxEnabled = !(u32New_ & AT91C_US_TXDIS);
+        psUsart->US_CSR &= ~(AT91C_US_TXRDY | AT91C_US_TXEMPTY);
+        if(Sim_sUsart.bTxEnabled)
+        {
+          psUsart->US_CSR |= AT91C_US_TXRDY | ((Sim_sUsart.u64TxDone == SIM_NO_EVENT) ? AT91C_US_TXEMPTY : 0);
+        }
+      }
+
+      if(u32New_ & AT91C_US_RSTSTA)
+      {
+        psUsart->US_CSR &= ~SIM_USART_ERRORS;
+      }
+      if(u32New_ & AT91C_US_STTTO)
+      {
+        psUsart->US_CSR &= ~AT91C_US_TIMEOUT;
+        Sim_sUsart.bTimeoutWaiting = TRUE;
+        Sim_sUsart.u64Timeout = SIM_NO_EVENT;
+      }
+      if( (u32New_ & AT91C_US_RETTO) && SimUsartTimeoutCycles() )
+      {
+        psUsart->US_CSR &= ~AT91C_US_TIMEOUT;
+        Sim_sUsart.bTimeoutWaiting = FALSE;
+        Sim_sUsart.u64Timeout = SimGetCycles() + SimUsartTimeoutCycles();
+        SimScheduleEvent(Sim_sUsart.u64Timeout);
+      }
+      *pu32Register = 0;
+      break;
+    }
+
+    case offsetof(AT91S_USART, US_IER):  psUsart->US_IMR |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_USART, US_IDR):  psUsart->US_IMR &= ~u32New_; *pu32Register = 0; break;
+
+    case offsetof(AT91S_USART, US_PTCR):
+    {
+      psUsart->US_PTSR |= u32New_ & (AT91C_PDC_RXTEN | AT91C_PDC_TXTEN);
+      if(u32New_ & AT91C_PDC_RXTDIS)
+      {
+        psUsart->US_PTSR &= ~AT91C_PDC_RXTEN;
+      }
+      if(u32New_ & AT91C_PDC_TXTDIS)
+      {
+        psUsart->US_PTSR &= ~AT91C_PDC_TXTEN;
+      }
+      *pu32Register = 0;
+      break;
+    }
+
+    case offsetof(AT91S_USART, US_IMR):
+    case offsetof(AT91S_USART, US_CSR):
+    case offsetof(AT91S_USART, US_RHR):
+    case offsetof(AT91S_USART, US_PTSR):
+    {
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+  SimUsartPdcFlags();
+  SimUsartTxStart(SimGetCycles());
+  SimUsartInterrupt();
+
+} /* end SimUsartWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartUpdate(void)
+
+@brief Finishes the characters sent and received up to the current virtual time and the receiver time-out.
+*/
+static void SimUsartUpdate(void)
+{
+  uint64_t u64Now = SimGetCycles();
+  uint64_t u64Done;
+
+  while(Sim_sUsart.u64TxDone <= u64Now)
+  {
+    u64Done = Sim_sUsart.u64TxDone;
+    SimConsoleOutput(Sim_sUsart.u8TxShift);
+    G_sSimStats.u32UsartTxBytes++;
+
+    Sim_sUsart.u64TxDone = SIM_NO_EVENT;
+    AT91C_BASE_US0->US_CSR |= AT91C_US_TXEMPTY;
+    SimUsartTxStart(u64Done);
+  }
+
+  while(Sim_sUsart.u64RxNext <= u64Now)
+  {
+    SimUsartReceive(Sim_sUsart.u64RxNext);
+  }
+
+  if(Sim_sUsart.u64Timeout <= u64Now)
+  {
+    Sim_sUsart.u64Timeout = SIM_NO_EVENT;
+    AT91C_BASE_US0->US_CSR |= AT91C_US_TIMEOUT;
+  }
+
+  SimUsartPdcFlags();
+  SimUsartInterrupt();
+
+} /* end SimUsartUpdate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartTxStart(uint64_t u64Cycle_)
+
+@brief Has the PDC hand the transmitter its next character if the line is free.
+
+The PDC moves to the next pointer / counter pair as soon as the current count
+runs out, as on target.
+*/
+static void SimUsartTxStart(uint64_t u64Cycle_)
+{
+  AT91PS_USART psUsart = AT91C_BASE_US0;
+
+  if( (Sim_sUsart.u64TxDone != SIM_NO_EVENT) || !Sim_sUsart.bTxEnabled ||
+      !(psUsart->US_PTSR & AT91C_PDC_TXTEN) || (psUsart->US_TCR == 0) || (SimUsartCharacterCycles() == 0) )
+  {
+    return;
+  }
+
+  Sim_sUsart.u8TxShift = *(volatile u8*)(uintptr_t)psUsart->US_TPR;
+  psUsart->US_TPR++;
+  psUsart->US_TCR--;
+  if( (psUsart->US_TCR == 0) && (psUsart->US_TNCR != 0) )
+  {
+    psUsart->US_TPR  = psUsart->US_TNPR;
+    psUsart->US_TCR  = psUsart->US_TNCR;
+    psUsart->US_TNCR = 0;
+  }
+
+  psUsart->US_CSR &= ~AT91C_US_TXEMPTY;
+  Sim_sUsart.u64TxDone = u64Cycle_ + SimUsartCharacterCycles();
+  SimScheduleEvent(Sim_sUsart.u64TxDone);
+
+} /* end SimUsartTxStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartReceive(uint64_t u64Cycle_)
+
+@brief Delivers the next -u character, through the PDC if it has room or to US_RHR.
+
+Characters follow each other at the programmed baud rate.  One that arrives
+while the receiver is off (or before the baud rate is set) is lost.
+*/
+static void SimUsartReceive(uint64_t u64Cycle_)
+{
+  AT91PS_USART psUsart = AT91C_BASE_US0;
+  const SimUsartInputType* psInput = &Sim_asUsartInputs[Sim_sUsart.u32NextInput];
+  uint64_t u64CharacterCycles = SimUsartCharacterCycles();
+  u8 u8Char;
+
+  if(psInput->pcText[Sim_sUsart.u32NextChar] == '\0')
+  {
+    u8Char = '\r';
+    Sim_sUsart.u32NextInput++;
+    Sim_sUsart.u32NextChar = 0;
+  }
+  else
+  {
+    u8Char = (u8)psInput->pcText[Sim_sUsart.u32NextChar++];
+  }
+
+  if( !Sim_sUsart.bRxEnabled || (u64CharacterCycles == 0) )
+  {
+    G_sSimStats.u32UsartRxLost++;
+  }
+  else
+  {
+    G_sSimStats.u32UsartRxBytes++;
+    if( (psUsart->US_PTSR & AT91C_PDC_RXTEN) && (psUsart->US_RCR != 0) )
+    {
+      *(volatile u8*)(uintptr_t)psUsart->US_RPR = u8Char;
+      psUsart->US_RPR++;
+      psUsart->US_RCR--;
+      if( (psUsart->US_RCR == 0) && (psUsart->US_RNCR != 0) )
+      {
+        psUsart->US_RPR  = psUsart->US_RNPR;
+        psUsart->US_RCR  = psUsart->US_RNCR;
+        psUsart->US_RNCR = 0;
+      }
+    }
+    else
+    {
+      if(psUsart->US_CSR & AT91C_US_RXRDY)
+      {
+        psUsart->US_CSR |= AT91C_US_OVRE;
+        G_sSimStats.u32UsartRxLost++;
+      }
+      psUsart->US_RHR = u8Char;
+      psUsart->US_CSR |= AT91C_US_RXRDY;
+    }
+
+    /* Each character restarts a running time-out or starts one STTTO left waiting */
+    if( SimUsartTimeoutCycles() && (Sim_sUsart.bTimeoutWaiting || (Sim_sUsart.u64Timeout != SIM_NO_EVENT)) )
+    {
+      Sim_sUsart.bTimeoutWaiting = FALSE;
+      Sim_sUsart.u64Timeout = u64Cycle_ + SimUsartTimeoutCycles();
+    }
+  }
+
+  Sim_sUsart.u64RxNext = SIM_NO_EVENT;
+  if(Sim_sUsart.u32NextInput < Sim_u32UsartInputs)
+  {
+    Sim_sUsart.u64RxNext = u64Cycle_ + u64CharacterCycles;
+    if(Sim_sUsart.u64RxNext < Sim_asUsartInputs[Sim_sUsart.u32NextInput].u64Cycle)
+    {
+      Sim_sUsart.u64RxNext = Sim_asUsartInputs[Sim_sUsart.u32NextInput].u64Cycle;
+    }
+  }
+
+} /* end SimUsartReceive() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartPdcFlags(void)
+
+@brief Loads ENDTX / TXBUFE / ENDRX / RXBUFF in US_CSR from the PDC counters.
+*/
+static void SimUsartPdcFlags(void)
+{
+  AT91PS_USART psUsart = AT91C_BASE_US0;
+  u32 u32Flags = 0;
+
+  if(psUsart->US_TCR == 0)
+  {
+    u32Flags |= AT91C_US_ENDTX | ((psUsart->US_TNCR == 0) ? AT91C_US_TXBUFE : 0);
+  }
+  if(psUsart->US_RCR == 0)
+  {
+    u32Flags |= AT91C_US_ENDRX | ((psUsart->US_RNCR == 0) ? AT91C_US_RXBUFF : 0);
+  }
+
+  psUsart->US_CSR = (psUsart->US_CSR & ~SIM_USART_PDC_FLAGS) | u32Flags;
+
+} /* end SimUsartPdcFlags() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimUsartInterrupt(void)
+
+@brief Pends IRQn_US0 while an enabled status flag is set (the USART line is level-sensitive).
+*/
+static void SimUsartInterrupt(void)
+{
+  if(AT91C_BASE_US0->US_CSR & AT91C_BASE_US0->US_IMR)
+  {
+    SimPendIrq(IRQn_US0);
+  }
+
+} /* end SimUsartInterrupt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimUsartCharacterCycles(void)
+
+@brief MCK cycles one character takes on the line, 0 while the baud rate generator is off.
+*/
+static uint64_t SimUsartCharacterCycles(void)
+{
+  return( SIM_USART_FRAME_BITS * 16 * (AT91C_BASE_US0->US_BRGR & SIM_USART_CD) );
+
+} /* end SimUsartCharacterCycles() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimUsartTimeoutCycles(void)
+
+@brief MCK cycles of the receiver time-out (US_RTOR bit times), 0 if it is off.
+*/
+static uint64_t SimUsartTimeoutCycles(void)
+{
+  return( (uint64_t)(AT91C_BASE_US0->US_RTOR & SIM_USART_TO) * 16 * (AT91C_BASE_US0->US_BRGR & SIM_USART_CD) );
+
+} /* end SimUsartTimeoutCycles() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+
+@brief TWI0 master and its PDC channel: control, interrupt masks and transfers.
+
+A transfer starts on START, or in write mode when the PDC or TWI_THR has a byte.  The
+bus then moves a byte at a time (SimTwiUpdate()); the PDC end flags follow the
+counters as for USART0.
+*/
+static void SimTwiWrite(u32 u32Offset_, u32 u32Old_, u32 u32New_)
+{
+  AT91PS_TWI psTwi = AT91C_BASE_TWI0;
+  volatile u32* pu32Register = (volatile u32*)((uintptr_t)psTwi + u32Offset_);
+
+  switch(u32Offset_)
+  {
+    case offsetof(AT91S_TWI, TWI_CR):
+    {
+      *pu32Register = 0;
+      if(u32New_ & AT91C_TWI_SWRST)
+      {
+        psTwi->TWI_MMR  = 0;
+        psTwi->TWI_IADR = 0;
+        psTwi->TWI_CWGR = 0;
+        psTwi->TWI_IMR  = 0;
+        psTwi->TWI_SR   = AT91C_TWI_TXCOMP_MASTER | AT91C_TWI_TXRDY_MASTER;
+        memset(&Sim_sTwi, 0, sizeof(Sim_sTwi));
+        Sim_sTwi.u64ByteDone = SIM_NO_EVENT;
+      }
+
+      if(u32New_ & (AT91C_TWI_MSEN | AT91C_TWI_MSDIS))
+      {
+        Sim_sTwi.bMasterEnabled = !(u32New_ & AT91C_TWI_MSDIS);
+      }
+
+      /* START then STOP in one write is a single byte read */
+      if( (u32New_ & AT91C_TWI_START) && (Sim_sTwi.u8Phase == SIM_TWI_IDLE) && Sim_sTwi.bMasterEnabled )
+      {
+        SimTwiBegin(SimGetCycles());
+      }
+      if( (u32New_ & AT91C_TWI_STOP) && (Sim_sTwi.u8Phase != SIM_TWI_IDLE) )
+      {
+        Sim_sTwi.bStop = TRUE;
+      }
+      break;
+    }
+
+    case offsetof(AT91S_TWI, TWI_IER): psTwi->TWI_IMR |=  u32New_; *pu32Register = 0; break;
+    case offsetof(AT91S_TWI, TWI_IDR): psTwi->TWI_IMR &= ~u32New_; *pu32Register = 0; break;
+
+    case offsetof(AT91S_TWI, TWI_THR):
+    {
+      Sim_sTwi.bThrFull = TRUE;
+      psTwi->TWI_SR &= ~AT91C_TWI_TXRDY_MASTER;
+      break;
+    }
+
+    case offsetof(AT91S_TWI, TWI_PTCR):
+    {
+      psTwi->TWI_PTSR |= u32New_ & (AT91C_PDC_RXTEN | AT91C_PDC_TXTEN);
+      if(u32New_ & AT91C_PDC_RXTDIS)
+      {
+        psTwi->TWI_PTSR &= ~AT91C_PDC_RXTEN;
+      }
+      if(u32New_ & AT91C_PDC_TXTDIS)
+      {
+        psTwi->TWI_PTSR &= ~AT91C_PDC_TXTEN;
+      }
+      *pu32Register = 0;
+      break;
+    }
+
+    case offsetof(AT91S_TWI, TWI_SR):
+    case offsetof(AT91S_TWI, TWI_IMR):
+    case offsetof(AT91S_TWI, TWI_RHR):
+    case offsetof(AT91S_TWI, TWI_PTSR):
+    {
+      *pu32Register = u32Old_;
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+  SimTwiKick();
+  SimTwiPdcFlags();
+  SimTwiInterrupt();
+
+} /* end SimTwiWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiUpdate(void)
+
+@brief Finishes the bytes on the bus up to the current virtual time.
+*/
+static void SimTwiUpdate(void)
+{
+  uint64_t u64Now = SimGetCycles();
+  uint64_t u64Done;
+
+  while(Sim_sTwi.u64ByteDone <= u64Now)
+  {
+    u64Done = Sim_sTwi.u64ByteDone;
+    Sim_sTwi.u64ByteDone = SIM_NO_EVENT;
+    SimTwiByteDone(u64Done);
+  }
+
+  SimTwiPdcFlags();
+  SimTwiInterrupt();
+
+} /* end SimTwiUpdate() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiKick(void)
+
+@brief Starts a write transfer that has data, or moves a bus that was waiting for the firmware.
+
+The master holds SCL low while it waits: in a write for the next byte or the STOP, in
+a read for TWI_RHR to be read.
+*/
+static void SimTwiKick(void)
+{
+  AT91PS_TWI psTwi = AT91C_BASE_TWI0;
+  bool bPdcData = (psTwi->TWI_PTSR & AT91C_PDC_TXTEN) && (psTwi->TWI_TCR != 0);
+
+  if(Sim_sTwi.u64ByteDone != SIM_NO_EVENT)
+  {
+    return;
+  }
+
+  if( (Sim_sTwi.u8Phase == SIM_TWI_IDLE) && Sim_sTwi.bMasterEnabled && !(psTwi->TWI_MMR & AT91C_TWI_MREAD) &&
+      (bPdcData || Sim_sTwi.bThrFull) )
+  {
+    SimTwiBegin(SimGetCycles());
+  }
+  else if(Sim_sTwi.u8Phase == SIM_TWI_WRITE)
+  {
+    SimTwiNextWrite(SimGetCycles());
+  }
+  else if( (Sim_sTwi.u8Phase == SIM_TWI_READ) && !(psTwi->TWI_SR & AT91C_TWI_RXRDY) )
+  {
+    SimTwiByteStart(SimGetCycles(), SIM_TWI_BYTE_BITS);
+  }
+
+} /* end SimTwiKick() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiBegin(uint64_t u64Cycle_)
+
+@brief Sends START and the slave address in the direction TWI_MMR sets.
+*/
+static void SimTwiBegin(uint64_t u64Cycle_)
+{
+  Sim_sTwi.u8Phase = SIM_TWI_ADDRESS;
+  Sim_sTwi.bRead = (AT91C_BASE_TWI0->TWI_MMR & AT91C_TWI_MREAD) != 0;
+  Sim_sTwi.bStop = FALSE;
+  Sim_sTwi.u8InternalLeft = (u8)((AT91C_BASE_TWI0->TWI_MMR & AT91C_TWI_IADRSZ) >> 8);
+  AT91C_BASE_TWI0->TWI_SR &= ~AT91C_TWI_TXCOMP_MASTER;
+
+  SimTwiByteStart(u64Cycle_, SIM_TWI_BYTE_BITS + 1);
+
+} /* end SimTwiBegin() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiByteStart(uint64_t u64Cycle_, u8 u8Bits_)
+
+@brief Puts u8Bits_ clocks on the bus from u64Cycle_.
+*/
+static void SimTwiByteStart(uint64_t u64Cycle_, u8 u8Bits_)
+{
+  Sim_sTwi.u64ByteDone = u64Cycle_ + u8Bits_ * SimTwiBitCycles();
+  SimScheduleEvent(Sim_sTwi.u64ByteDone);
+
+} /* end SimTwiByteStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiNextWrite(uint64_t u64Cycle_)
+
+@brief Sends the next byte of a write from the PDC or TWI_THR, the STOP, or waits for either.
+*/
+static void SimTwiNextWrite(uint64_t u64Cycle_)
+{
+  AT91PS_TWI psTwi = AT91C_BASE_TWI0;
+
+  if( (psTwi->TWI_PTSR & AT91C_PDC_TXTEN) && (psTwi->TWI_TCR != 0) )
+  {
+    Sim_sTwi.u8Data = *(volatile u8*)(uintptr_t)psTwi->TWI_TPR;
+    psTwi->TWI_TPR++;
+    psTwi->TWI_TCR--;
+    if( (psTwi->TWI_TCR == 0) && (psTwi->TWI_TNCR != 0) )
+    {
+      psTwi->TWI_TPR  = psTwi->TWI_TNPR;
+      psTwi->TWI_TCR  = psTwi->TWI_TNCR;
+      psTwi->TWI_TNCR = 0;
+    }
+    SimTwiByteStart(u64Cycle_, SIM_TWI_BYTE_BITS);
+  }
+  else if(Sim_sTwi.bThrFull)
+  {
+    Sim_sTwi.u8Data = (u8)psTwi->TWI_THR;
+    Sim_sTwi.bThrFull = FALSE;
+    psTwi->TWI_SR |= AT91C_TWI_TXRDY_MASTER;
+    SimTwiByteStart(u64Cycle_, SIM_TWI_BYTE_BITS);
+  }
+  else if(Sim_sTwi.bStop)
+  {
+    SimTwiEnd();
+  }
+  else
+  {
+    psTwi->TWI_SR |= AT91C_TWI_TXRDY_MASTER;
+  }
+
+} /* end SimTwiNextWrite() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiByteDone(uint64_t u64Cycle_)
+
+@brief Acts on the end of the byte on the bus and starts the next one.
+
+Only SIM_TWI_LCD_ADDRESS acknowledges its address; any other ends the transfer with
+NACK.  The bytes written to it go to the LCD model.  After the internal address bytes of a read comes a repeated START and the
+address again.
+*/
+static void SimTwiByteDone(uint64_t u64Cycle_)
+{
+  switch(Sim_sTwi.u8Phase)
+  {
+    case SIM_TWI_ADDRESS:
+    case SIM_TWI_INTERNAL:
+    {
+      if( (Sim_sTwi.u8Phase == SIM_TWI_ADDRESS) &&
+          (((AT91C_BASE_TWI0->TWI_MMR & AT91C_TWI_DADR) >> 16) != SIM_TWI_LCD_ADDRESS) )
+      {
+        AT91C_BASE_TWI0->TWI_SR |= AT91C_TWI_NACK_MASTER;
+        G_sSimStats.u32TwiNacks++;
+        SimTwiEnd();
+        break;
+      }
+
+      if(Sim_sTwi.u8Phase == SIM_TWI_INTERNAL)
+      {
+        Sim_sTwi.u8InternalLeft--;
+      }
+
+      if(Sim_sTwi.u8InternalLeft != 0)
+      {
+        Sim_sTwi.u8Phase = SIM_TWI_INTERNAL;
+        SimTwiByteStart(u64Cycle_, SIM_TWI_BYTE_BITS);
+      }
+      else if(Sim_sTwi.bRead)
+      {
+        Sim_sTwi.u8Phase = SIM_TWI_READ;
+        SimTwiByteStart(u64Cycle_, (AT91C_BASE_TWI0->TWI_MMR & AT91C_TWI_IADRSZ) ?
+                                   (2 * SIM_TWI_BYTE_BITS + 1) : SIM_TWI_BYTE_BITS);
+      }
+      else
+      {
+        Sim_sTwi.u8Phase = SIM_TWI_WRITE;
+        SimLcdStart();
+        SimTwiNextWrite(u64Cycle_);
+      }
+      break;
+    }
+
+    case SIM_TWI_WRITE:
+    {
+      G_sSimStats.u32TwiBytesWritten++;
+      SimLcdByte(Sim_sTwi.u8Data);
+      SimTwiNextWrite(u64Cycle_);
+      break;
+    }
+
+    case SIM_TWI_READ:
+    {
+      SimTwiReceive(u64Cycle_);
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+} /* end SimTwiByteDone() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiReceive(uint64_t u64Cycle_)
+
+@brief Stores a byte read through the PDC if it has room or in TWI_RHR, then goes on or stops.
+*/
+static void SimTwiReceive(uint64_t u64Cycle_)
+{
+  AT91PS_TWI psTwi = AT91C_BASE_TWI0;
+
+  G_sSimStats.u32TwiBytesRead++;
+  if( (psTwi->TWI_PTSR & AT91C_PDC_RXTEN) && (psTwi->TWI_RCR != 0) )
+  {
+    *(volatile u8*)(uintptr_t)psTwi->TWI_RPR = SIM_TWI_READ_DATA;
+    psTwi->TWI_RPR++;
+    psTwi->TWI_RCR--;
+    if( (psTwi->TWI_RCR == 0) && (psTwi->TWI_RNCR != 0) )
+    {
+      psTwi->TWI_RPR  = psTwi->TWI_RNPR;
+      psTwi->TWI_RCR  = psTwi->TWI_RNCR;
+      psTwi->TWI_RNCR = 0;
+    }
+  }
+  else
+  {
+    psTwi->TWI_RHR = SIM_TWI_READ_DATA;
+    psTwi->TWI_SR |= AT91C_TWI_RXRDY;
+  }
+
+  /* A STOP set during the byte makes it the last (the master does not acknowledge it) */
+  if(Sim_sTwi.bStop)
+  {
+    SimTwiEnd();
+  }
+  else if( !(psTwi->TWI_SR & AT91C_TWI_RXRDY) )
+  {
+    SimTwiByteStart(u64Cycle_, SIM_TWI_BYTE_BITS);
+  }
+
+} /* end SimTwiReceive() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiEnd(void)
+
+@brief Sends the STOP: the transfer is complete and the bus is free.
+*/
+static void SimTwiEnd(void)
+{
+  Sim_sTwi.u8Phase = SIM_TWI_IDLE;
+  Sim_sTwi.bStop = FALSE;
+  Sim_sTwi.u64ByteDone = SIM_NO_EVENT;
+  AT91C_BASE_TWI0->TWI_SR |= AT91C_TWI_TXCOMP_MASTER | AT91C_TWI_TXRDY_MASTER;
+  G_sSimStats.u32TwiTransfers++;
+
+} /* end SimTwiEnd() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiPdcFlags(void)
+
+@brief Loads ENDTX / TXBUFE / ENDRX / RXBUFF in TWI_SR from the PDC counters.
+*/
+static void SimTwiPdcFlags(void)
+{
+  AT91PS_TWI psTwi = AT91C_BASE_TWI0;
+  u32 u32Flags = 0;
+
+  if(psTwi->TWI_TCR == 0)
+  {
+    u32Flags |= AT91C_TWI_ENDTX | ((psTwi->TWI_TNCR == 0) ? AT91C_TWI_TXBUFE : 0);
+  }
+  if(psTwi->TWI_RCR == 0)
+  {
+    u32Flags |= AT91C_TWI_ENDRX | ((psTwi->TWI_RNCR == 0) ? AT91C_TWI_RXBUFF : 0);
+  }
+
+  psTwi->TWI_SR = (psTwi->TWI_SR & ~SIM_TWI_PDC_FLAGS) | u32Flags;
+
+} /* end SimTwiPdcFlags() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimTwiInterrupt(void)
+
+@brief Pends IRQn_TWI0 while an enabled status flag is set (the TWI line is level-sensitive).
+*/
+static void SimTwiInterrupt(void)
+{
+  if(AT91C_BASE_TWI0->TWI_SR & AT91C_BASE_TWI0->TWI_IMR)
+  {
+    SimPendIrq(IRQn_TWI0);
+  }
+
+} /* end SimTwiInterrupt() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static uint64_t SimTwiBitCycles(void)
+
+@brief MCK cycles of one SCL period from TWI_CWGR (low and high parts each take 4 more).
+*/
+static uint64_t SimTwiBitCycles(void)
+{
+  u32 u32Cwgr = AT91C_BASE_TWI0->TWI_CWGR;
+  u32 u32Shift = (u32Cwgr >> SIM_TWI_CKDIV_SHIFT) & 0x7;
+
+  return( (((uint64_t)(u32Cwgr & SIM_TWI_CLDIV) << u32Shift) + 4) +
+          (((uint64_t)((u32Cwgr >> SIM_TWI_CHDIV_SHIFT) & SIM_TWI_CLDIV) << u32Shift) + 4) );
+
+} /* end SimTwiBitCycles() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimLcdStart(void)
+
+@brief A write to the LCD has started: its first byte is a control byte.
+*/
+static void SimLcdStart(void)
+{
+  G_sSimLcd.bControl = TRUE;
+
+} /* end SimLcdStart() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static void SimLcdByte(u8 u8Byte_)
+
+@brief Acts on one byte written to the LCD: a control byte, a command or a character.
+
+Only the commands that move the address or change the text are modelled (clear,
+home and set DDRAM address); the rest are counted and ignored.  The address counts
+up after each character and goes from the end of one line to the start of the other.
+*/
+static void SimLcdByte(u8 u8Byte_)
+{
+  u8 u8Line;
+  u8 u8Column;
+
+  if(G_sSimLcd.bControl)
+  {
+    G_sSimLcd.bCo = (u8Byte_ & SIM_LCD_CONTROL_CO) != 0;
+    G_sSimLcd.bRs = (u8Byte_ & SIM_LCD_CONTROL_RS) != 0;
+    G_sSimLcd.bControl = FALSE;
+    return;
+  }
+
+  /* With Co set, only this byte belongs to the last control byte */
+  G_sSimLcd.bControl = G_sSimLcd.bCo;
+
+  if(!G_sSimLcd.bRs)
+  {
+    G_sSimStats.u32LcdCommands++;
+    if(u8Byte_ & SIM_LCD_SET_ADDRESS)
+    {
+      G_sSimLcd.u8Address = u8Byte_ & (u8)~SIM_LCD_SET_ADDRESS;
+    }
+    else if(u8Byte_ == SIM_LCD_CLEAR)
+    {
+      memset(G_sSimLcd.aacShown, ' ', sizeof(G_sSimLcd.aacShown));
+      G_sSimLcd.u8Address = 0;
+    }
+    else if( (u8Byte_ & (u8)~0x01) == SIM_LCD_HOME )
+    {
+      G_sSimLcd.u8Address = 0;
+    }
+    return;
+  }
+
+  G_sSimStats.u32LcdCharacters++;
+  u8Line = (G_sSimLcd.u8Address & SIM_LCD_LINE_ADDRESS) ? 1 : 0;
+  u8Column = G_sSimLcd.u8Address & (u8)~SIM_LCD_LINE_ADDRESS;
+  if(u8Column < U8_LCD_COLUMNS)
+  {
+    G_sSimLcd.aacShown[u8Line][u8Column] = (char)u8Byte_;
+  }
+
+  if(++u8Column >= SIM_LCD_LINE_BYTES)
+  {
+    u8Column = 0;
+    u8Line ^= 1;
+  }
+  G_sSimLcd.u8Address = (u8)(u8Line * SIM_LCD_LINE_ADDRESS + u8Column);
+
+} /* end SimLcdByte() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static AT91PS_PIO SimPio(u8 u8Port_)
+
+@brief Port index (0 = A) to PIO controller.
+*/
+static AT91PS_PIO SimPio(u8 u8Port_)
+{
+  return( (AT91PS_PIO)((uintptr_t)AT91C_BASE_PIOA + 0x200 * u8Port_) );
+
+} /* end SimPio() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static u8 SimPortIndex(PortOffsetType ePort_)
+
+@brief PortOffsetType (register offset in words) to port index.
+*/
+static u8 SimPortIndex(PortOffsetType ePort_)
+{
+  return( (u8)((u32)ePort_ / PORTB) );
+
+} /* end SimPortIndex() */
+
+
+/*!----------------------------------------------------------------------------------------------------------------------
+@fn static AT91PS_TC SimTc(u8 u8Channel_)
+
+@brief Channel number to TC channel registers.
+*/
+static AT91PS_TC SimTc(u8 u8Channel_)
+{
+  return( (AT91PS_TC)((uintptr_t)AT91C_BASE_TC0 + 0x40 * u8Channel_) );
+
+} /* end SimTc() */
+
+
+/***********************************************************************************************************************
+Access hooks
+
+Entry points emitted by gcc -fsanitize=thread in the firmware objects.
+***********************************************************************************************************************/
+/*! @cond DOXYGEN_EXCLUDE */
+void __tsan_init(void)                                { }
+void __tsan_func_entry(void* pvCaller_)               { (void)pvCaller_; SimBusFlush(); SimAdvance(SIM_CYCLES_PER_CALL); }
+void __tsan_func_exit(void)                           { SimBusFlush(); }
+
+void __tsan_read1(void* pv_)                          { SimBusAccess(pv_, FALSE); }
+void __tsan_read2(void* pv_)                          { SimBusAccess(pv_, FALSE); }
+void __tsan_read4(void* pv_)                          { SimBusAccess(pv_, FALSE); }
+void __tsan_read8(void* pv_)                          { SimBusAccess(pv_, FALSE); }
+void __tsan_read16(void* pv_)                         { SimBusAccess(pv_, FALSE); }
+void __tsan_write1(void* pv_)                         { SimBusAccess(pv_, TRUE); }
+void __tsan_write2(void* pv_)                         { SimBusAccess(pv_, TRUE); }
+void __tsan_write4(void* pv_)                         { SimBusAccess(pv_, TRUE); }
+void __tsan_write8(void* pv_)                         { SimBusAccess(pv_, TRUE); }
+void __tsan_write16(void* pv_)                        { SimBusAccess(pv_, TRUE); }
+void __tsan_unaligned_read2(void* pv_)                { SimBusAccess(pv_, FALSE); }
+void __tsan_unaligned_read4(void* pv_)                { SimBusAccess(pv_, FALSE); }
+void __tsan_unaligned_read8(void* pv_)                { SimBusAccess(pv_, FALSE); }
+void __tsan_unaligned_read16(void* pv_)               { SimBusAccess(pv_, FALSE); }
+void __tsan_unaligned_write2(void* pv_)               { SimBusAccess(pv_, TRUE); }
+void __tsan_unaligned_write4(void* pv_)               { SimBusAccess(pv_, TRUE); }
+void __tsan_unaligned_write8(void* pv_)               { SimBusAccess(pv_, TRUE); }
+void __tsan_unaligned_write16(void* pv_)              { SimBusAccess(pv_, TRUE); }
+void __tsan_read_range(void* pv_, unsigned long u_)   { (void)u_; SimBusAccess(pv_, FALSE); }
+void __tsan_write_range(void* pv_, unsigned long u_)  { (void)u_; SimBusAccess(pv_, TRUE); }
+/*! @endcond */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
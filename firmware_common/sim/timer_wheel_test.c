@@ -0,0 +1,249 @@
+/*!**********************************************************************************************************************
+@file timer_wheel_test.c
+@brief Host test of the software timer wheel in timer.c: every timer expires in the ms it is due.
+
+timer.c is included so the test drives the wheel's own statics; only the software
+timer functions run, so no peripheral register is touched and the simulator is not
+linked.  The task is run the way main.c's scheduler runs it: every ms the task is not
+idle, and again with the loop sleeping until TimerNextDeadline() as tickless idle does.
+
+The timers are one shots that expire on multiples of 32 ms (the boundaries where the
+wheel moves higher level slots down) from level 0 up through the top level and past
+U32_TIMER_WHEEL_SPAN, started from several offsets into a level 0 rotation, plus a
+32 ms periodic timer.  Each run is repeated with the clock just short of its 32 bit
+wrap.
+
+Build and run: make -C firmware_ascii/gcc_sim check
+
+***********************************************************************************************************************/
+
+#include <stdio.h>
+
+#include "configuration.h"
+#include "timer.c"
+
+
+/**********************************************************************************************************************
+Constants / Definitions
+**********************************************************************************************************************/
+#define MAX_TIMERS               512
+#define PERIODIC_CHECKS          64
+
+
+/**********************************************************************************************************************
+Types
+**********************************************************************************************************************/
+typedef struct
+{
+  TimerSoftType sTimer;                   /* The timer under test */
+  u32 u32Start;                           /* G_u32SystemTime1ms it is started at */
+  u32 u32Expected;                        /* G_u32SystemTime1ms it must expire at */
+  u32 u32Fired;                           /* G_u32SystemTime1ms of the last expiry */
+  u32 u32Expiries;                        /* Times its callback ran */
+} TestTimerType;
+
+
+/**********************************************************************************************************************
+Variables
+**********************************************************************************************************************/
+volatile u32 G_u32SystemTime1ms;
+const PinConfigurationType G_asBspTimerTioaPins[U8_TIMER_CHANNELS];
+
+static TestTimerType Test_asTimers[MAX_TIMERS];
+static u32 Test_u32Timers;
+static u32 Test_u32Failures;
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void TestOneShotExpired(void* pvContext_)
+
+@brief Records when a one shot timer expired and checks it was on time.
+*/
+static void TestOneShotExpired(void* pvContext_)
+{
+  TestTimerType* psTest = (TestTimerType*)pvContext_;
+
+  psTest->u32Fired = G_u32SystemTime1ms;
+  psTest->u32Expiries++;
+  if( (psTest->u32Expiries != 1) || (psTest->u32Fired != psTest->u32Expected) )
+  {
+    printf("  %lu ms timer started at %lu: expiry %lu at %lu, due at %lu\n",
+           (unsigned long)psTest->sTimer.u32PeriodMs, (unsigned long)psTest->u32Start,
+           (unsigned long)psTest->u32Expiries, (unsigned long)psTest->u32Fired,
+           (unsigned long)psTest->u32Expected);
+    Test_u32Failures++;
+  }
+
+} /* end TestOneShotExpired() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void TestPeriodicExpired(void* pvContext_)
+
+@brief Checks a periodic timer expires one period after its last expiry.
+*/
+static void TestPeriodicExpired(void* pvContext_)
+{
+  TestTimerType* psTest = (TestTimerType*)pvContext_;
+
+  psTest->u32Fired = G_u32SystemTime1ms;
+  psTest->u32Expiries++;
+  if(psTest->u32Fired != psTest->u32Expected)
+  {
+    printf("  %lu ms periodic timer started at %lu: expiry %lu at %lu, due at %lu\n",
+           (unsigned long)psTest->sTimer.u32PeriodMs, (unsigned long)psTest->u32Start,
+           (unsigned long)psTest->u32Expiries, (unsigned long)psTest->u32Fired,
+           (unsigned long)psTest->u32Expected);
+    Test_u32Failures++;
+  }
+
+  psTest->u32Expected = psTest->u32Fired + psTest->sTimer.u32PeriodMs;
+  if(psTest->u32Expiries == PERIODIC_CHECKS)
+  {
+    TimerSoftStop(&psTest->sTimer);
+  }
+
+} /* end TestPeriodicExpired() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void TestAdd(u32 u32Start_, u32 u32PeriodMs_, TimerModeType eMode_)
+
+@brief Sets up a test timer to start at u32Start_.
+*/
+static void TestAdd(u32 u32Start_, u32 u32PeriodMs_, TimerModeType eMode_)
+{
+  TestTimerType* psTest = &Test_asTimers[Test_u32Timers++];
+
+  psTest->u32Start    = u32Start_;
+  psTest->u32Expected = u32Start_ + u32PeriodMs_;
+  psTest->u32Fired    = 0;
+  psTest->u32Expiries = 0;
+  TimerSoftCreate(&psTest->sTimer, u32PeriodMs_, eMode_,
+                  (eMode_ == TIMER_PERIODIC) ? TestPeriodicExpired : TestOneShotExpired, psTest);
+
+} /* end TestAdd() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void TestRun(u32 u32Base_, bool bTickless_)
+
+@brief Runs every test timer from u32Base_ until the last one is due, then checks none
+was missed.
+*/
+static void TestRun(u32 u32Base_, bool bTickless_)
+{
+  static const u32 au32Offsets[] = {0, 1, 10, 31, 32, 33, 1000, 1023, 1025};
+  static const u32 au32Boundaries[] = {32, 64, 96, 1024, 1056, 2048, 32768, 33792, 65536,
+                                       1048576 - 32, 1048576, 1048576 + 32, 2 * 1048576 + 1024};
+  u32 u32Last = 0;
+  u32 u32Next;
+  u32 u32Sleep;
+
+  Test_u32Timers = 0;
+  for(u32 i = 0; i < sizeof(au32Offsets) / sizeof(au32Offsets[0]); i++)
+  {
+    for(u32 j = 0; j < sizeof(au32Boundaries) / sizeof(au32Boundaries[0]); j++)
+    {
+      /* Expire on a boundary measured from the wheel's time 0, as the slots are */
+      u32Next = ((u32Base_ + au32Offsets[i] + au32Boundaries[j]) & ~(u32)31) - u32Base_ - au32Offsets[i];
+      if(u32Next > 0)
+      {
+        TestAdd(u32Base_ + au32Offsets[i], u32Next, TIMER_ONE_SHOT);
+        u32Last = (u32Next + au32Offsets[i] > u32Last) ? u32Next + au32Offsets[i] : u32Last;
+      }
+    }
+  }
+  TestAdd(u32Base_ + 10, 54, TIMER_ONE_SHOT);
+  TestAdd(u32Base_ + 10, 1014, TIMER_ONE_SHOT);
+  TestAdd(u32Base_, 32, TIMER_PERIODIC);
+
+  /* As TimerInitialize() leaves the wheel */
+  G_u32SystemTime1ms = u32Base_;
+  for(u8 i = 0; i < U8_TIMER_WHEEL_LEVELS; i++)
+  {
+    Timer_au32WheelOccupied[i] = 0;
+  }
+  for(u16 i = 0; i < U8_TIMER_WHEEL_LEVELS * U8_TIMER_WHEEL_SLOTS; i++)
+  {
+    Timer_apsWheel[i] = NULL;
+  }
+  Timer_u32WheelTime = u32Base_;
+  Timer_bWheelBusy = FALSE;
+  Timer_StateMachine = TimerSM_Idle;
+
+  while( (G_u32SystemTime1ms - u32Base_) <= u32Last + 1 )
+  {
+    if( !TimerIsIdle() )
+    {
+      TimerRunActiveState();
+    }
+
+    /* Start the timers due to start now (another task in the same loop) */
+    for(u32 i = 0; i < Test_u32Timers; i++)
+    {
+      if(Test_asTimers[i].u32Start == G_u32SystemTime1ms)
+      {
+        TimerSoftStart(&Test_asTimers[i].sTimer);
+      }
+    }
+
+    /* Tickless idle sleeps to whichever comes first, the wheel's next slot or a start */
+    u32Sleep = TimerNextDeadline();
+    for(u32 i = 0; i < Test_u32Timers; i++)
+    {
+      u32Next = Test_asTimers[i].u32Start - G_u32SystemTime1ms;
+      if( ((s32)u32Next > 0) && (u32Next < u32Sleep) )
+      {
+        u32Sleep = u32Next;
+      }
+    }
+    if( !bTickless_ || (u32Sleep == U32_NO_DEADLINE) )
+    {
+      u32Sleep = 1;
+    }
+    G_u32SystemTime1ms += u32Sleep;
+  }
+
+  for(u32 i = 0; i < Test_u32Timers; i++)
+  {
+    if(Test_asTimers[i].u32Expiries == 0)
+    {
+      printf("  %lu ms timer started at %lu never expired\n",
+             (unsigned long)Test_asTimers[i].sTimer.u32PeriodMs, (unsigned long)Test_asTimers[i].u32Start);
+      Test_u32Failures++;
+    }
+  }
+
+} /* end TestRun() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn int main(void)
+
+@brief Runs the tests; exits with 1 if any timer expired early, late or more than once.
+*/
+int main(void)
+{
+  static const u32 au32Bases[] = {0, 0xFFFFF000};
+
+  for(u32 i = 0; i < sizeof(au32Bases) / sizeof(au32Bases[0]); i++)
+  {
+    TestRun(au32Bases[i], FALSE);
+    TestRun(au32Bases[i], TRUE);
+  }
+
+  printf("timer_wheel_test: %lu timers x 4 runs, %lu failures\n",
+         (unsigned long)Test_u32Timers, (unsigned long)Test_u32Failures);
+  return( (Test_u32Failures == 0) ? 0 : 1 );
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File                                                                                                        */
+/*--------------------------------------------------------------------------------------------------------------------*/
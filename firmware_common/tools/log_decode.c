@@ -0,0 +1,312 @@
+/*!**********************************************************************************************************************
+@file log_decode.c
+@brief Host tool: turns the log records in a debug console capture back into text.
+
+The Log task sends each LOGn() record as one console line: LOG_LINE_START ('!') then
+the record's words in hex, header first.  The header holds the format string's offset
+in the eie_log section (bits 4-31) and the argument count + 1 (bits 0-3); the time
+stamp in ms and the arguments follow.  The format strings themselves never leave the
+target, so the table has to come from the same build as the firmware:
+
+  objcopy -O binary --only-section=eie_log build/eie_sim build/log_formats.bin   (make logformats)
+  log_decode build/log_formats.bin console.txt
+
+For the board, use arm-none-eabi-objcopy with the same options on the IAR .out file.
+With no capture file the console is read from stdin, so a terminal can be piped
+straight through.  Lines that are not records are passed through as they are.
+
+The layout below must match log.h.
+
+Build: make -C firmware_ascii/gcc_sim tools
+
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+
+/**********************************************************************************************************************
+Constants / Definitions (see log.h)
+**********************************************************************************************************************/
+#define LOG_LINE_START           '!'
+#define LOG_ARGS_MASK            0xFu        /* Header bits 0-3: argument count + 1 */
+#define LOG_FORMAT_SHIFT         4u          /* Header bits 4-31: format offset */
+#define LOG_RECORD_HEADER        2u          /* Header and time stamp */
+#define LOG_MAX_ARGS             4u
+
+#define MAX_LINE                 1024
+#define MAX_TEXT                 512
+#define MAX_SPEC                 32
+
+
+/**********************************************************************************************************************
+Variables
+**********************************************************************************************************************/
+static char* Decode_pcFormats;
+static long Decode_lFormatsSize;
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static int ParseRecord(const char* pcText_, uint32_t* pu32Words_)
+
+@brief Reads the hex words of a record line; returns how many (0 if it is not a record).
+*/
+static int ParseRecord(const char* pcText_, uint32_t* pu32Words_)
+{
+  int iWords = 0;
+  int iDigits;
+
+  while(iWords < (int)(LOG_RECORD_HEADER + LOG_MAX_ARGS))
+  {
+    pu32Words_[iWords] = 0;
+    for(iDigits = 0; (iDigits < 8) && isxdigit((unsigned char)pcText_[iDigits]); iDigits++)
+    {
+      pu32Words_[iWords] = (pu32Words_[iWords] << 4) |
+                           (uint32_t)(isdigit((unsigned char)pcText_[iDigits]) ? pcText_[iDigits] - '0' :
+                                      toupper((unsigned char)pcText_[iDigits]) - 'A' + 10);
+    }
+    if(iDigits != 8)
+    {
+      return(0);
+    }
+    iWords++;
+    pcText_ += 8;
+
+    if(*pcText_ != ' ')
+    {
+      break;
+    }
+    pcText_++;
+  }
+
+  /* The header must say exactly what the line holds */
+  if( (iWords < (int)LOG_RECORD_HEADER) || ((pu32Words_[0] & LOG_ARGS_MASK) == 0) ||
+      ((pu32Words_[0] & LOG_ARGS_MASK) - 1 + LOG_RECORD_HEADER != (uint32_t)iWords) )
+  {
+    return(0);
+  }
+
+  return(iWords);
+
+} /* end ParseRecord() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void FormatRecord(const char* pcFormat_, const uint32_t* pu32Args_, int iArgs_, char* pcOut_, size_t szOut_)
+
+@brief printf for the record: each conversion takes the next u32 argument.
+
+The firmware cast every argument to u32, so %d and %i print it as signed and the
+length modifiers are ignored.  Strings cannot be logged (only their address was), so
+%s prints "?".
+*/
+static void FormatRecord(const char* pcFormat_, const uint32_t* pu32Args_, int iArgs_, char* pcOut_, size_t szOut_)
+{
+  char acSpec[MAX_SPEC];
+  size_t szUsed = 0;
+  size_t szSpec;
+  int iArg = 0;
+  uint32_t u32Arg;
+  char cConversion;
+
+  while( (*pcFormat_ != '\0') && (szUsed + 1 < szOut_) )
+  {
+    if(*pcFormat_ != '%')
+    {
+      pcOut_[szUsed++] = *pcFormat_++;
+      continue;
+    }
+
+    /* Copy the flags, width and precision; drop the length modifiers */
+    szSpec = 0;
+    acSpec[szSpec++] = *pcFormat_++;
+    while( (*pcFormat_ != '\0') && strchr("-+ #0123456789.", *pcFormat_) && (szSpec < MAX_SPEC - 3) )
+    {
+      acSpec[szSpec++] = *pcFormat_++;
+    }
+    while( (*pcFormat_ != '\0') && strchr("hlLqjzt", *pcFormat_) )
+    {
+      pcFormat_++;
+    }
+
+    cConversion = *pcFormat_;
+    if(cConversion == '\0')
+    {
+      break;
+    }
+    pcFormat_++;
+
+    if(cConversion == '%')
+    {
+      pcOut_[szUsed++] = '%';
+      continue;
+    }
+
+    u32Arg = (iArg < iArgs_) ? pu32Args_[iArg] : 0;
+    iArg++;
+
+    acSpec[szSpec++] = cConversion;
+    acSpec[szSpec] = '\0';
+    switch(cConversion)
+    {
+      case 'd':
+      case 'i':
+      {
+        snprintf(pcOut_ + szUsed, szOut_ - szUsed, acSpec, (int)(int32_t)u32Arg);
+        break;
+      }
+
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+      {
+        snprintf(pcOut_ + szUsed, szOut_ - szUsed, acSpec, (unsigned)u32Arg);
+        break;
+      }
+
+      case 'c':
+      {
+        snprintf(pcOut_ + szUsed, szOut_ - szUsed, acSpec, (int)(u32Arg & 0xFF));
+        break;
+      }
+
+      case 'p':
+      {
+        snprintf(pcOut_ + szUsed, szOut_ - szUsed, "0x%08X", (unsigned)u32Arg);
+        break;
+      }
+
+      default:
+      {
+        snprintf(pcOut_ + szUsed, szOut_ - szUsed, "?");
+        break;
+      }
+    }
+    szUsed += strlen(pcOut_ + szUsed);
+  }
+
+  pcOut_[szUsed] = '\0';
+
+} /* end FormatRecord() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static int DecodeLine(const char* pcLine_, FILE* pOut_)
+
+@brief Prints the record in pcLine_ as text; returns 0 if the line holds no record.
+
+The record can follow other output on the same line (e.g. the prompt).
+*/
+static int DecodeLine(const char* pcLine_, FILE* pOut_)
+{
+  uint32_t au32Words[LOG_RECORD_HEADER + LOG_MAX_ARGS];
+  char acText[MAX_TEXT];
+  const char* pcStart;
+  uint32_t u32Offset;
+  int iWords;
+
+  for(pcStart = strchr(pcLine_, LOG_LINE_START); pcStart != NULL; pcStart = strchr(pcStart + 1, LOG_LINE_START))
+  {
+    iWords = ParseRecord(pcStart + 1, au32Words);
+    if(iWords == 0)
+    {
+      continue;
+    }
+
+    if(pcStart != pcLine_)
+    {
+      fprintf(pOut_, "%.*s\n", (int)(pcStart - pcLine_), pcLine_);
+    }
+
+    u32Offset = au32Words[0] >> LOG_FORMAT_SHIFT;
+    if(u32Offset >= (uint32_t)Decode_lFormatsSize)
+    {
+      fprintf(pOut_, "%10u ms  <format 0x%X is not in the table: wrong build?>\n",
+              (unsigned)au32Words[1], (unsigned)u32Offset);
+      return(1);
+    }
+
+    FormatRecord(Decode_pcFormats + u32Offset, &au32Words[LOG_RECORD_HEADER], iWords - (int)LOG_RECORD_HEADER,
+                 acText, sizeof(acText));
+    fprintf(pOut_, "%10u ms  %s\n", (unsigned)au32Words[1], acText);
+    return(1);
+  }
+
+  return(0);
+
+} /* end DecodeLine() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn int main(int argc, char** argv)
+
+@brief Loads the format table and decodes the capture line by line.
+*/
+int main(int argc, char** argv)
+{
+  char acLine[MAX_LINE];
+  FILE* pIn;
+  size_t szLength;
+
+  if( (argc < 2) || (argc > 3) )
+  {
+    fprintf(stderr, "usage: %s log_formats.bin [console.txt]\n", argv[0]);
+    return(2);
+  }
+
+  /* Read the whole table; the extra byte terminates a string cut off at the end */
+  pIn = fopen(argv[1], "rb");
+  if(pIn == NULL)
+  {
+    perror(argv[1]);
+    return(1);
+  }
+  fseek(pIn, 0, SEEK_END);
+  Decode_lFormatsSize = ftell(pIn);
+  rewind(pIn);
+  Decode_pcFormats = calloc((size_t)Decode_lFormatsSize + 1, 1);
+  if( (Decode_pcFormats == NULL) ||
+      (fread(Decode_pcFormats, 1, (size_t)Decode_lFormatsSize, pIn) != (size_t)Decode_lFormatsSize) )
+  {
+    fprintf(stderr, "%s: read failed\n", argv[1]);
+    return(1);
+  }
+  fclose(pIn);
+
+  pIn = (argc == 3) ? fopen(argv[2], "r") : stdin;
+  if(pIn == NULL)
+  {
+    perror(argv[2]);
+    return(1);
+  }
+
+  while(fgets(acLine, sizeof(acLine), pIn) != NULL)
+  {
+    szLength = strlen(acLine);
+    while( (szLength > 0) && ((acLine[szLength - 1] == '\n') || (acLine[szLength - 1] == '\r')) )
+    {
+      acLine[--szLength] = '\0';
+    }
+
+    if(!DecodeLine(acLine, stdout))
+    {
+      printf("%s\n", acLine);
+    }
+  }
+
+  if(pIn != stdin)
+  {
+    fclose(pIn);
+  }
+
+  return(0);
+
+} /* end main() */
@@ -0,0 +1,472 @@
+/*!**********************************************************************************************************************
+@file trace_decode.c
+@brief Host tool: turns a raw dump of the firmware trace ring (G_sTrace) into a Chrome trace.
+
+Save G_sTrace from the debugger as raw binary (IAR: Debug > Memory > Save, start at
+&G_sTrace, sizeof(G_sTrace) bytes) or run the simulator with -d file, then:
+
+  trace_decode [-n Debug,Button,Timer,Led,Twi,Lcd,Audio,UserApp1,Log] dump.bin [trace.json]
+
+and open trace.json in chrome://tracing or https://ui.perfetto.dev.  Tasks and sleep
+are drawn on one row, interrupts (nesting by priority) on another; TRACE_USER()
+events are instants.  -n names the tasks in Main_asTasks order (default "task n").
+
+Time comes from the records' DWT cycle counts, put back on the G_u32SystemTime1ms
+timeline at every TRACE_EVENT_TICK: the cycle counter wraps every 89 s at 48 MHz and
+stops in deep sleep, the millisecond count does not.  Gaps between two ticks longer
+than 65 s (16 bits of ms) cannot be seen.  A TRACE_EVENT_RESET record ends every open
+span and the time line carries on after it.
+
+The layout below must match TraceBufferType in trace.h (little endian, as on target).
+
+Build: make -C firmware_ascii/gcc_sim tools
+
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/**********************************************************************************************************************
+Constants / Definitions (see trace.h)
+**********************************************************************************************************************/
+#define TRACE_MAGIC              0x54524345u
+#define TRACE_HEADER_WORDS       5u          /* u32Magic, u32Records, u32CyclesPerUs, u32Enabled, u32Head */
+#define TRACE_MAX_RECORDS        65536u      /* Sanity limit on u32Records */
+
+#define EVENT_ISR_ENTER          1u
+#define EVENT_ISR_EXIT           2u
+#define EVENT_TASK_ENTER         3u
+#define EVENT_TASK_EXIT          4u
+#define EVENT_SLEEP_ENTER        5u
+#define EVENT_SLEEP_EXIT         6u
+#define EVENT_TICK               7u
+#define EVENT_RESET              8u
+#define EVENT_USER               0x100u
+
+#define TID_MAIN                 1           /* Tasks and sleep */
+#define TID_ISR                  2           /* Exception handlers */
+#define MAX_NESTING              32
+#define MAX_TASK_NAMES           32
+
+/* Exception numbers: 0-15 are the Cortex-M3 core's, 16 + n is SAM3U peripheral ID n */
+static const char* const apcExceptionNames[] =
+{
+  "?", "Reset", "NMI", "HardFault", "MemManage", "BusFault", "UsageFault", "?",
+  "?", "?", "?", "SVCall", "DebugMon", "?", "PendSV", "SysTick",
+  "SUPC", "RSTC", "RTC", "RTT", "WDT", "PMC", "EFC0", "EFC1",
+  "DBGU", "HSMC4", "PIOA", "PIOB", "PIOC", "US0", "US1", "US2",
+  "US3", "MCI0", "TWI0", "TWI1", "SPI0", "SSC0", "TC0", "TC1",
+  "TC2", "PWMC", "ADC12B", "ADC", "HDMA", "UDPHS"
+};
+
+static const char* const apcResetTypes[] = {"general", "wake up", "watchdog", "software", "user"};
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+/*! @brief An open B event waiting for its E */
+typedef struct
+{
+  uint32_t u32Event;
+  uint32_t u32Arg;
+} OpenSpanType;
+
+/*! @brief Begin/end spans of one Chrome trace thread */
+typedef struct
+{
+  int iTid;
+  int iDepth;
+  OpenSpanType asOpen[MAX_NESTING];
+} ThreadType;
+
+
+/**********************************************************************************************************************
+Variables
+**********************************************************************************************************************/
+static FILE* Decode_pOut;
+static int Decode_bFirstEvent = 1;
+static char* Decode_apcTaskNames[MAX_TASK_NAMES];
+
+static ThreadType Decode_sMain = {TID_MAIN};
+static ThreadType Decode_sIsr = {TID_ISR};
+
+
+/**********************************************************************************************************************
+Function Definitions
+**********************************************************************************************************************/
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static uint32_t ReadWord(const uint8_t* pu8Data_)
+
+@brief Returns the little endian 32-bit word at pu8Data_.
+*/
+static uint32_t ReadWord(const uint8_t* pu8Data_)
+{
+  return( (uint32_t)pu8Data_[0] | ((uint32_t)pu8Data_[1] << 8) |
+          ((uint32_t)pu8Data_[2] << 16) | ((uint32_t)pu8Data_[3] << 24) );
+
+} /* end ReadWord() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SpanName(uint32_t u32Event_, uint32_t u32Arg_, char* pcName_, size_t szName_)
+
+@brief Writes the display name of a span or instant event.
+*/
+static void SpanName(uint32_t u32Event_, uint32_t u32Arg_, char* pcName_, size_t szName_)
+{
+  switch(u32Event_)
+  {
+    case EVENT_ISR_ENTER:
+    case EVENT_ISR_EXIT:
+    {
+      if(u32Arg_ < sizeof(apcExceptionNames) / sizeof(apcExceptionNames[0]))
+      {
+        snprintf(pcName_, szName_, "%s", apcExceptionNames[u32Arg_]);
+      }
+      else
+      {
+        snprintf(pcName_, szName_, "IRQ%u", (unsigned)(u32Arg_ - 16));
+      }
+      break;
+    }
+
+    case EVENT_TASK_ENTER:
+    case EVENT_TASK_EXIT:
+    {
+      if( (u32Arg_ < MAX_TASK_NAMES) && (Decode_apcTaskNames[u32Arg_] != NULL) )
+      {
+        snprintf(pcName_, szName_, "%s", Decode_apcTaskNames[u32Arg_]);
+      }
+      else
+      {
+        snprintf(pcName_, szName_, "task %u", (unsigned)u32Arg_);
+      }
+      break;
+    }
+
+    case EVENT_SLEEP_ENTER:
+    case EVENT_SLEEP_EXIT:
+    {
+      snprintf(pcName_, szName_, "sleep");
+      break;
+    }
+
+    case EVENT_RESET:
+    {
+      snprintf(pcName_, szName_, "reset (%s)",
+               (u32Arg_ < sizeof(apcResetTypes) / sizeof(apcResetTypes[0])) ? apcResetTypes[u32Arg_] : "?");
+      break;
+    }
+
+    default:
+    {
+      snprintf(pcName_, szName_, "user %u", (unsigned)(u32Event_ - EVENT_USER));
+      break;
+    }
+  }
+
+} /* end SpanName() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void Emit(const char* pcPhase_, int iTid_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+
+@brief Writes one Chrome trace event.
+*/
+static void Emit(const char* pcPhase_, int iTid_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+{
+  char acName[64];
+
+  SpanName(u32Event_, u32Arg_, acName, sizeof(acName));
+  fprintf(Decode_pOut, "%s\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+          Decode_bFirstEvent ? "" : ",", acName, pcPhase_, iTid_, dTimeUs_);
+  if(pcPhase_[0] == 'i')
+  {
+    fprintf(Decode_pOut, ",\"s\":\"%c\",\"args\":{\"arg\":%u}", (u32Event_ == EVENT_RESET) ? 'g' : 't',
+            (unsigned)u32Arg_);
+  }
+  else if( (pcPhase_[0] == 'B') && (u32Event_ == EVENT_SLEEP_ENTER) )
+  {
+    fprintf(Decode_pOut, ",\"args\":{\"ticks\":%u}", (unsigned)u32Arg_);
+  }
+  fprintf(Decode_pOut, "}");
+  Decode_bFirstEvent = 0;
+
+} /* end Emit() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SpanBegin(ThreadType* psThread_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+
+@brief Opens a span on a thread.
+*/
+static void SpanBegin(ThreadType* psThread_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+{
+  if(psThread_->iDepth == MAX_NESTING)
+  {
+    return;
+  }
+
+  psThread_->asOpen[psThread_->iDepth].u32Event = u32Event_;
+  psThread_->asOpen[psThread_->iDepth].u32Arg = u32Arg_;
+  psThread_->iDepth++;
+  Emit("B", psThread_->iTid, dTimeUs_, u32Event_, u32Arg_);
+
+} /* end SpanBegin() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SpanEnd(ThreadType* psThread_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+
+@brief Closes the thread's innermost span if it is the one u32Event_ ends.
+
+An end whose begin was overwritten in the ring (or lost to a reset) is dropped.
+*/
+static void SpanEnd(ThreadType* psThread_, double dTimeUs_, uint32_t u32Event_, uint32_t u32Arg_)
+{
+  OpenSpanType* psOpen;
+
+  if(psThread_->iDepth == 0)
+  {
+    return;
+  }
+
+  psOpen = &psThread_->asOpen[psThread_->iDepth - 1];
+  if( (psOpen->u32Event + 1 == u32Event_) &&
+      ((psOpen->u32Arg == u32Arg_) || (u32Event_ == EVENT_SLEEP_EXIT)) )
+  {
+    psThread_->iDepth--;
+    Emit("E", psThread_->iTid, dTimeUs_, psOpen->u32Event, psOpen->u32Arg);
+  }
+
+} /* end SpanEnd() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void SpanCloseAll(ThreadType* psThread_, double dTimeUs_)
+
+@brief Ends every open span of a thread at dTimeUs_.
+*/
+static void SpanCloseAll(ThreadType* psThread_, double dTimeUs_)
+{
+  while(psThread_->iDepth > 0)
+  {
+    psThread_->iDepth--;
+    Emit("E", psThread_->iTid, dTimeUs_, psThread_->asOpen[psThread_->iDepth].u32Event,
+         psThread_->asOpen[psThread_->iDepth].u32Arg);
+  }
+
+} /* end SpanCloseAll() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn static void ParseTaskNames(char* pcList_)
+
+@brief Splits the -n option into Decode_apcTaskNames.
+*/
+static void ParseTaskNames(char* pcList_)
+{
+  char* pcName = strtok(pcList_, ",");
+
+  for(int i = 0; (i < MAX_TASK_NAMES) && (pcName != NULL); i++)
+  {
+    Decode_apcTaskNames[i] = pcName;
+    pcName = strtok(NULL, ",");
+  }
+
+} /* end ParseTaskNames() */
+
+
+/*!---------------------------------------------------------------------------------------------------------------------
+@fn int main(int argc, char** argv)
+
+@brief Reads the dump, walks the ring oldest first and writes the JSON.
+*/
+int main(int argc, char** argv)
+{
+  const char* pcInput = NULL;
+  const char* pcOutput = NULL;
+  uint8_t* pu8Dump;
+  FILE* pIn;
+  long lSize;
+  uint32_t u32Records, u32CyclesPerUs, u32Head, u32First, u32Count;
+  uint32_t u32Cycles, u32Event, u32Arg;
+  uint32_t u32AnchorCycles = 0;
+  uint32_t u32LastTick = 0;
+  uint64_t u64AnchorMs = 0;
+  double dOffsetUs = 0.0;
+  double dTimeUs, dLastUs = 0.0;
+  int bAnchored = 0;
+  int bTicked = 0;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if( (strcmp(argv[i], "-n") == 0) && (i + 1 < argc) )
+    {
+      ParseTaskNames(argv[++i]);
+    }
+    else if(pcInput == NULL)
+    {
+      pcInput = argv[i];
+    }
+    else
+    {
+      pcOutput = argv[i];
+    }
+  }
+
+  if(pcInput == NULL)
+  {
+    fprintf(stderr, "usage: %s [-n task0,task1,...] dump.bin [trace.json]\n", argv[0]);
+    return(2);
+  }
+
+  /* Read the whole dump */
+  pIn = fopen(pcInput, "rb");
+  if(pIn == NULL)
+  {
+    perror(pcInput);
+    return(1);
+  }
+  fseek(pIn, 0, SEEK_END);
+  lSize = ftell(pIn);
+  rewind(pIn);
+  pu8Dump = malloc((size_t)lSize + 1);
+  if( (pu8Dump == NULL) || (fread(pu8Dump, 1, (size_t)lSize, pIn) != (size_t)lSize) )
+  {
+    fprintf(stderr, "%s: read failed\n", pcInput);
+    return(1);
+  }
+  fclose(pIn);
+
+  if( (lSize < (long)(TRACE_HEADER_WORDS * 4)) || (ReadWord(pu8Dump) != TRACE_MAGIC) )
+  {
+    fprintf(stderr, "%s: not a trace ring (no magic)\n", pcInput);
+    return(1);
+  }
+
+  u32Records = ReadWord(pu8Dump + 4);
+  u32CyclesPerUs = ReadWord(pu8Dump + 8);
+  u32Head = ReadWord(pu8Dump + 16);
+  if( (u32Records == 0) || (u32Records > TRACE_MAX_RECORDS) || (u32CyclesPerUs == 0) ||
+      ((long)(TRACE_HEADER_WORDS * 4 + u32Records * 8) > lSize) )
+  {
+    fprintf(stderr, "%s: bad header (%u records, %u cycles/us, %ld bytes)\n", pcInput, (unsigned)u32Records,
+            (unsigned)u32CyclesPerUs, lSize);
+    return(1);
+  }
+
+  /* Oldest record first: the ring has wrapped once u32Head passes u32Records */
+  u32Count = (u32Head < u32Records) ? u32Head : u32Records;
+  u32First = (u32Head < u32Records) ? 0 : (u32Head % u32Records);
+
+  Decode_pOut = (pcOutput != NULL) ? fopen(pcOutput, "w") : stdout;
+  if(Decode_pOut == NULL)
+  {
+    perror(pcOutput);
+    return(1);
+  }
+
+  fprintf(Decode_pOut, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  fprintf(Decode_pOut, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"tasks\"}}", TID_MAIN);
+  fprintf(Decode_pOut, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"interrupts\"}}", TID_ISR);
+  Decode_bFirstEvent = 0;
+
+  for(uint32_t i = 0; i < u32Count; i++)
+  {
+    const uint8_t* pu8Record = pu8Dump + TRACE_HEADER_WORDS * 4 + ((u32First + i) % u32Records) * 8;
+
+    u32Cycles = ReadWord(pu8Record);
+    u32Event = ReadWord(pu8Record + 4) & 0xFFFF;
+    u32Arg = ReadWord(pu8Record + 4) >> 16;
+
+    if(!bAnchored)
+    {
+      u32AnchorCycles = u32Cycles;
+      bAnchored = 1;
+    }
+
+    /* Ticks set the time base; the first one after the start or a reset only sets the ms count */
+    if(u32Event == EVENT_TICK)
+    {
+      if(bTicked)
+      {
+        u64AnchorMs += (uint16_t)(u32Arg - u32LastTick);
+      }
+      else
+      {
+        dOffsetUs = dLastUs - (double)u32Arg * 1000.0;
+        u64AnchorMs = u32Arg;
+        bTicked = 1;
+      }
+      u32LastTick = u32Arg;
+      u32AnchorCycles = u32Cycles;
+    }
+
+    /* Cycles since the anchor; a counter restarted by code after the tick reads as slightly negative */
+    dTimeUs = dOffsetUs + (double)u64AnchorMs * 1000.0 +
+              (double)(int32_t)(u32Cycles - u32AnchorCycles) / (double)u32CyclesPerUs;
+    if(dTimeUs < dLastUs)
+    {
+      dTimeUs = dLastUs;
+    }
+    dLastUs = dTimeUs;
+
+    switch(u32Event)
+    {
+      case EVENT_ISR_ENTER:   SpanBegin(&Decode_sIsr, dTimeUs, u32Event, u32Arg); break;
+      case EVENT_ISR_EXIT:    SpanEnd(&Decode_sIsr, dTimeUs, u32Event, u32Arg); break;
+      case EVENT_TASK_ENTER:
+      case EVENT_SLEEP_ENTER: SpanBegin(&Decode_sMain, dTimeUs, u32Event, u32Arg); break;
+      case EVENT_TASK_EXIT:
+      case EVENT_SLEEP_EXIT:  SpanEnd(&Decode_sMain, dTimeUs, u32Event, u32Arg); break;
+      case EVENT_TICK:        break;
+
+      case EVENT_RESET:
+      {
+        /* Nothing open before the reset ever ends; the new boot's time starts again at 0 ms */
+        SpanCloseAll(&Decode_sIsr, dTimeUs);
+        SpanCloseAll(&Decode_sMain, dTimeUs);
+        Emit("i", TID_MAIN, dTimeUs, u32Event, u32Arg);
+        bAnchored = 0;
+        bTicked = 0;
+        dOffsetUs = dTimeUs;
+        u64AnchorMs = 0;
+        break;
+      }
+
+      default:
+      {
+        if(u32Event >= EVENT_USER)
+        {
+          Emit("i", TID_MAIN, dTimeUs, u32Event, u32Arg);
+        }
+        break;
+      }
+    }
+  }
+
+  SpanCloseAll(&Decode_sIsr, dLastUs);
+  SpanCloseAll(&Decode_sMain, dLastUs);
+  fprintf(Decode_pOut, "\n]}\n");
+
+  if(Decode_pOut != stdout)
+  {
+    fclose(Decode_pOut);
+  }
+  fprintf(stderr, "%u records, %.3f ms\n", (unsigned)u32Count, dLastUs / 1000.0);
+  free(pu8Dump);
+
+  return(0);
+
+} /* end main() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/